@@ -0,0 +1,388 @@
+// bsp_trace.cpp
+// Line traces against the world of a .bsp file, so the navigation code can run without the engine
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "extdll.h"
+#include "util.h"
+
+#include "bsp_trace.h"
+
+
+//--------------------------------------------------------------------------------------------------------------
+//
+// The parts of the version 30 .bsp format used here
+//
+enum
+{
+	BSP_VERSION = 30,
+
+	LUMP_PLANES = 1,
+	LUMP_NODES = 5,
+	LUMP_LEAFS = 10,
+	LUMP_MODELS = 14,
+	NUM_LUMPS = 15,
+};
+
+struct BspLump
+{
+	int offset;
+	int length;
+};
+
+struct BspHeader
+{
+	int version;
+	BspLump lump[ NUM_LUMPS ];
+};
+
+struct BspPlane
+{
+	float normal[3];
+	float dist;
+	int type;
+};
+
+struct BspNode
+{
+	int plane;
+	short children[2];										///< negative numbers are -(leaf + 1)
+	short mins[3];
+	short maxs[3];
+	unsigned short firstFace;
+	unsigned short faceCount;
+};
+
+struct BspLeaf
+{
+	int contents;
+	int visOffset;
+	short mins[3];
+	short maxs[3];
+	unsigned short firstMarkSurface;
+	unsigned short markSurfaceCount;
+	unsigned char ambientLevel[4];
+};
+
+struct BspModel
+{
+	float mins[3];
+	float maxs[3];
+	float origin[3];
+	int headNode[4];
+	int visLeafs;
+	int firstFace;
+	int faceCount;
+};
+
+/// distance the impact point is pulled back from a plane, as the engine does
+static const float DIST_EPSILON = 0.03125f;
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Copy the lump's records out of the file data.
+ * Return false if the lump does not lie within the file.
+ */
+template < typename T >
+static bool ReadBspLump( const std::vector< unsigned char > &data, const BspHeader &header, int which, std::vector< T > *records )
+{
+	const BspLump &lump = header.lump[ which ];
+
+	if (lump.offset < 0 || lump.length < 0 || (unsigned int)lump.offset + lump.length > data.size() || lump.length % sizeof(T))
+		return false;
+
+	records->resize( lump.length / sizeof(T) );
+	if (!records->empty())
+		memcpy( records->data(), &data[ lump.offset ], lump.length );
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load the world hull from the given .bsp file
+ */
+bool CBspTracer::Load( const char *filename )
+{
+	m_plane.clear();
+	m_node.clear();
+
+	FILE *fp = fopen( filename, "rb" );
+	if (fp == nullptr)
+		return false;
+
+	std::vector< unsigned char > data;
+
+	fseek( fp, 0, SEEK_END );
+	long length = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+
+	if (length > 0)
+	{
+		data.resize( length );
+		if (fread( data.data(), length, 1, fp ) != 1)
+			data.clear();
+	}
+
+	fclose( fp );
+
+	if (data.size() < sizeof(BspHeader))
+		return false;
+
+	BspHeader header;
+	memcpy( &header, data.data(), sizeof(BspHeader) );
+
+	if (header.version != BSP_VERSION)
+		return false;
+
+	std::vector< BspPlane > planes;
+	std::vector< BspNode > nodes;
+	std::vector< BspLeaf > leafs;
+	std::vector< BspModel > models;
+
+	if (!ReadBspLump( data, header, LUMP_PLANES, &planes ) ||
+		!ReadBspLump( data, header, LUMP_NODES, &nodes ) ||
+		!ReadBspLump( data, header, LUMP_LEAFS, &leafs ) ||
+		!ReadBspLump( data, header, LUMP_MODELS, &models ))
+		return false;
+
+	if (models.empty() || nodes.empty())
+		return false;
+
+	m_plane.resize( planes.size() );
+	for( unsigned int i=0; i<planes.size(); ++i )
+	{
+		m_plane[i].normal = Vector( planes[i].normal[0], planes[i].normal[1], planes[i].normal[2] );
+		m_plane[i].dist = planes[i].dist;
+		m_plane[i].type = planes[i].type;
+	}
+
+	// resolve leaf children to their contents, so a trace never has to look at the leafs
+	m_node.resize( nodes.size() );
+	for( unsigned int i=0; i<nodes.size(); ++i )
+	{
+		if (nodes[i].plane < 0 || nodes[i].plane >= (int)m_plane.size())
+		{
+			m_node.clear();
+			return false;
+		}
+
+		m_node[i].plane = nodes[i].plane;
+
+		for( int c=0; c<2; ++c )
+		{
+			int child = nodes[i].children[c];
+
+			if (child >= 0)
+			{
+				if (child >= (int)nodes.size())
+				{
+					m_node.clear();
+					return false;
+				}
+
+				m_node[i].children[c] = child;
+			}
+			else
+			{
+				int leaf = -1 - child;
+				m_node[i].children[c] = (leaf < (int)leafs.size()) ? leafs[ leaf ].contents : CONTENTS_SOLID;
+			}
+		}
+	}
+
+	m_headNode = models[0].headNode[0];
+	if (m_headNode < 0 || m_headNode >= (int)m_node.size())
+	{
+		m_node.clear();
+		return false;
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the contents at the given point, starting from the given node
+ */
+int CBspTracer::GetContents( int num, const Vector &pos ) const
+{
+	while( num >= 0 )
+	{
+		const Node &node = m_node[ num ];
+		const Plane &plane = m_plane[ node.plane ];
+
+		float d;
+		if (plane.type < 3)
+			d = pos[ plane.type ] - plane.dist;
+		else
+			d = DotProduct( plane.normal, pos ) - plane.dist;
+
+		num = (d < 0.0f) ? node.children[1] : node.children[0];
+	}
+
+	return num;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+int CBspTracer::GetPointContents( const Vector &pos ) const
+{
+	if (!IsLoaded())
+		return CONTENTS_EMPTY;
+
+	return GetContents( m_headNode, pos );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Trace the segment p1-p2 (the fractions p1f-p2f of the whole trace) thru the subtree at 'num'.
+ * Return false once the trace has hit something and no further checking is needed.
+ */
+bool CBspTracer::RecursiveTrace( int num, float p1f, float p2f, const Vector &p1, const Vector &p2, Trace *trace ) const
+{
+	// reached a leaf
+	if (num < 0)
+	{
+		if (num != CONTENTS_SOLID)
+		{
+			trace->isAllSolid = false;
+
+			if (num == CONTENTS_EMPTY)
+				trace->isInOpen = true;
+			else
+				trace->isInWater = true;
+		}
+		else
+		{
+			trace->isStartSolid = true;
+		}
+
+		return true;
+	}
+
+	const Node &node = m_node[ num ];
+	const Plane &plane = m_plane[ node.plane ];
+
+	// find the distances of the endpoints from the node's plane
+	float t1, t2;
+	if (plane.type < 3)
+	{
+		t1 = p1[ plane.type ] - plane.dist;
+		t2 = p2[ plane.type ] - plane.dist;
+	}
+	else
+	{
+		t1 = DotProduct( plane.normal, p1 ) - plane.dist;
+		t2 = DotProduct( plane.normal, p2 ) - plane.dist;
+	}
+
+	// the segment is entirely on one side
+	if (t1 >= 0.0f && t2 >= 0.0f)
+		return RecursiveTrace( node.children[0], p1f, p2f, p1, p2, trace );
+
+	if (t1 < 0.0f && t2 < 0.0f)
+		return RecursiveTrace( node.children[1], p1f, p2f, p1, p2, trace );
+
+	// put the crosspoint DIST_EPSILON units on the near side
+	float frac;
+	if (t1 < 0.0f)
+		frac = (t1 + DIST_EPSILON) / (t1 - t2);
+	else
+		frac = (t1 - DIST_EPSILON) / (t1 - t2);
+
+	if (frac < 0.0f)
+		frac = 0.0f;
+	else if (frac > 1.0f)
+		frac = 1.0f;
+
+	float midf = p1f + (p2f - p1f) * frac;
+	Vector mid = p1 + frac * (p2 - p1);
+
+	int side = (t1 < 0.0f) ? 1 : 0;
+
+	// move up to the node
+	if (!RecursiveTrace( node.children[ side ], p1f, midf, p1, mid, trace ))
+		return false;
+
+	// go past the node, if the far side is open
+	if (GetContents( node.children[ side ^ 1 ], mid ) != CONTENTS_SOLID)
+		return RecursiveTrace( node.children[ side ^ 1 ], midf, p2f, mid, p2, trace );
+
+	// never got out of the solid area
+	if (trace->isAllSolid)
+		return false;
+
+	// the other side of the node is solid - this is the impact point
+	if (side == 0)
+	{
+		trace->planeNormal = plane.normal;
+		trace->planeDist = plane.dist;
+	}
+	else
+	{
+		trace->planeNormal = -plane.normal;
+		trace->planeDist = -plane.dist;
+	}
+
+	// back up until the impact point is out of the solid, as the engine does
+	while( GetContents( m_headNode, mid ) == CONTENTS_SOLID )
+	{
+		frac -= 0.1f;
+		if (frac < 0.0f)
+		{
+			trace->fraction = midf;
+			trace->endPos = mid;
+			return false;
+		}
+
+		midf = p1f + (p2f - p1f) * frac;
+		mid = p1 + frac * (p2 - p1);
+	}
+
+	trace->fraction = midf;
+	trace->endPos = mid;
+
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Trace a point from 'start' to 'end' thru the world, filling in 'result' as the engine's TraceLine() does.
+ * Anything hit is the world, which is reported as a null 'pHit'.
+ */
+void CBspTracer::TraceLine( const Vector &start, const Vector &end, TraceResult *result ) const
+{
+	Trace trace;
+	trace.isAllSolid = true;
+	trace.isStartSolid = false;
+	trace.isInOpen = false;
+	trace.isInWater = false;
+	trace.fraction = 1.0f;
+	trace.endPos = end;
+	trace.planeNormal = Vector( 0, 0, 0 );
+	trace.planeDist = 0.0f;
+
+	if (IsLoaded())
+		RecursiveTrace( m_headNode, 0.0f, 1.0f, start, end, &trace );
+	else
+		trace.isAllSolid = false;
+
+	if (trace.isAllSolid)
+		trace.isStartSolid = true;
+
+	memset( result, 0, sizeof(TraceResult) );
+
+	result->fAllSolid = trace.isAllSolid;
+	result->fStartSolid = trace.isStartSolid;
+	result->fInOpen = trace.isInOpen;
+	result->fInWater = trace.isInWater;
+	result->flFraction = trace.fraction;
+	result->vecEndPos = (trace.fraction == 1.0f) ? end : trace.endPos;
+	result->flPlaneDist = trace.planeDist;
+	result->vecPlaneNormal = trace.planeNormal;
+	result->pHit = nullptr;
+	result->iHitgroup = 0;
+}
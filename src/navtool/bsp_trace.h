@@ -0,0 +1,63 @@
+// bsp_trace.h
+// Line traces against the world of a .bsp file, so the navigation code can run without the engine
+
+#ifndef _BSP_TRACE_H_
+#define _BSP_TRACE_H_
+
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Reads the point hull (hull 0) of a map's world model and answers TraceLine() queries against it,
+ * the same way the engine does for a point-sized trace.
+ * Only the world is loaded - brush entities such as doors, walls and breakables are not traced against.
+ * Once loaded, the tracer is read-only, so traces may be issued from any number of threads at once.
+ */
+class CBspTracer
+{
+public:
+	bool Load( const char *filename );							///< load the world hull from the given .bsp file
+	bool IsLoaded( void ) const						{ return !m_node.empty(); }
+
+	int GetPointContents( const Vector &pos ) const;			///< return the CONTENTS_* value at the given point
+	void TraceLine( const Vector &start, const Vector &end, TraceResult *result ) const;
+
+private:
+	struct Plane
+	{
+		Vector normal;
+		float dist;
+		int type;											///< 0-2 if the plane is axial in X, Y, or Z
+	};
+
+	/**
+	 * A node of the world hull. A child index that is negative is a leaf, and holds
+	 * the leaf's CONTENTS_* value directly.
+	 */
+	struct Node
+	{
+		int plane;
+		int children[2];
+	};
+
+	struct Trace
+	{
+		bool isAllSolid;
+		bool isStartSolid;
+		bool isInOpen;
+		bool isInWater;
+		float fraction;
+		Vector endPos;
+		Vector planeNormal;
+		float planeDist;
+	};
+
+	int GetContents( int num, const Vector &pos ) const;
+	bool RecursiveTrace( int num, float p1f, float p2f, const Vector &p1, const Vector &p2, Trace *trace ) const;
+
+	std::vector< Plane > m_plane;
+	std::vector< Node > m_node;
+	int m_headNode;
+};
+
+#endif // _BSP_TRACE_H_
@@ -0,0 +1,106 @@
+// navtool.cpp
+// Offline navigation mesh analysis tool.
+// Loads a map's .nav file, traces against the map's .bsp instead of a running server, recomputes the
+// hiding spots, sniper spots, spot encounters and approach areas on all cores, and writes the .nav file back.
+//
+// Usage: navtool [-vis] <gamedir> <map> [<map> ...]
+//
+// -vis also computes the potentially visible areas of each area, which are saved with the mesh.
+//
+// NOTE: Only the world is traced against, and func_ladder entities are not loaded, so approach areas
+// are computed without ladders.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "perf_counter.h"
+
+#include "bot_util.h"
+#include "nav.h"
+#include "nav_area.h"
+
+#include "navtool.h"
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Analyze one map and save the results. Return false if the map could not be processed.
+ */
+static bool AnalyzeMap( const char *gameDir, const char *mapName )
+{
+	char filename[ 512 ];
+
+	SetNavToolMap( mapName );
+
+	snprintf( filename, sizeof(filename), "%s/maps/%s.bsp", gameDir, mapName );
+	if (!TheBspTracer.Load( filename ))
+	{
+		printf( "ERROR: Unable to load '%s'.\n", filename );
+		return false;
+	}
+
+	DestroyNavigationMap();
+
+	NavErrorType error = LoadNavigationMap();
+	if (error != NAV_OK)
+	{
+		printf( "ERROR: Unable to load the navigation mesh for '%s' (error %d).\n", mapName, error );
+		return false;
+	}
+
+	printf( "%s: %d areas\n", mapName, (int)TheNavAreaList.size() );
+
+	// our traces never touch the engine, so they can run on all threads
+	AnalyzeNavigationMap( true );
+
+	snprintf( filename, sizeof(filename), "%s/maps/%s.nav", gameDir, mapName );
+	if (!SaveNavigationMap( filename ))
+	{
+		printf( "ERROR: Unable to save '%s'.\n", filename );
+		return false;
+	}
+
+	printf( "%s: %d hiding spots, %s area visibility, saved '%s'\n", mapName, (int)TheHidingSpotList.size(),
+			(TheNavAreaVisibility.IsComputed()) ? "with" : "without", filename );
+
+	DestroyNavigationMap();
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+int main( int argc, char *argv[] )
+{
+	int first = 1;
+
+	if (argc > 1 && !strcmp( argv[1], "-vis" ))
+	{
+		cv_bot_nav_visibility.value = 1.0f;
+		++first;
+	}
+
+	if (argc < first + 2)
+	{
+		printf( "Usage: %s [-vis] <gamedir> <map> [<map> ...]\n", argv[0] );
+		printf( "Recomputes hiding spots, encounters and approach areas for each map's .nav file.\n" );
+		printf( "  -vis  also compute the potentially visible areas of each area\n" );
+		return 1;
+	}
+
+	const char *gameDir = argv[ first ];
+
+	InstallNavToolEngine( gameDir );
+
+	int failCount = 0;
+
+	for( int i=first+1; i<argc; ++i )
+	{
+		if (!AnalyzeMap( gameDir, argv[i] ))
+			++failCount;
+	}
+
+	return (failCount) ? 1 : 0;
+}
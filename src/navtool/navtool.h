@@ -0,0 +1,14 @@
+// navtool.h
+// Offline navigation mesh analysis tool
+
+#ifndef _NAVTOOL_H_
+#define _NAVTOOL_H_
+
+#include "bsp_trace.h"
+
+extern CBspTracer TheBspTracer;								///< the world all traces are made against
+
+extern void InstallNavToolEngine( const char *gameDir );		///< point the engine callbacks used by the nav code at the tool's versions
+extern void SetNavToolMap( const char *mapName );				///< set the map name the nav code sees in gpGlobals->mapname
+
+#endif // _NAVTOOL_H_
@@ -0,0 +1,236 @@
+// navtool_engine.cpp
+// Stand-ins for the engine and game functions used by the navigation code, so it can run without a server.
+// Traces go to the map's .bsp, files are read from the game directory, and everything
+// to do with players, entities, or drawing does nothing.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+
+#include "bot_util.h"
+#include "navtool.h"
+
+
+CBspTracer TheBspTracer;
+
+static globalvars_t navToolGlobals;
+static char navToolGameDir[ 256 ];
+static char navToolMapName[ 256 ];
+
+//
+// The bot cvars the navigation code reads, at their server defaults
+//
+cvar_t cv_bot_traceview		= { "cv_bot_traceview",		"0",	FCVAR_SERVER, 0.0f };
+cvar_t cv_bot_nav_zdraw		= { "cv_bot_nav_zdraw",		"0",	FCVAR_SERVER, 0.0f };
+cvar_t cv_bot_debug			= { "cv_bot_debug",			"0",	FCVAR_SERVER, 0.0f };
+cvar_t cv_bot_quicksave		= { "cv_bot_quicksave",		"0",	FCVAR_SERVER, 0.0f };
+cvar_t cv_bot_prefix		= { "cv_bot_prefix",		"",		FCVAR_SERVER, 0.0f };
+cvar_t cv_bot_nav_budget_us	= { "bot_nav_budget_us",	"500",	FCVAR_SERVER, 500.0f };
+cvar_t cv_bot_nav_threads	= { "bot_nav_threads",		"0",	FCVAR_SERVER, 0.0f };
+cvar_t cv_bot_nav_visibility	= { "bot_nav_visibility",	"0",	FCVAR_SERVER, 0.0f };
+cvar_t cv_bot_nav_smooth_paths	= { "bot_nav_smooth_paths",	"1",	FCVAR_SERVER, 1.0f };
+cvar_t cv_bot_perf_enable		= { "bot_perf_enable",		"0",	FCVAR_SERVER, 0.0f };
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Convert a path relative to the game directory, as the engine accepts them, into one we can open
+ */
+static void GetNavToolPath( const char *filename, char *path, int pathLength )
+{
+	snprintf( path, pathLength, "%s/%s", navToolGameDir, filename );
+
+	for( char *c = path; *c; ++c )
+		if (*c == '\\')
+			*c = '/';
+}
+
+//--------------------------------------------------------------------------------------------------------------
+static byte *NavToolLoadFileForMe( const char *filename, int *length )
+{
+	char path[ 512 ];
+	GetNavToolPath( filename, path, sizeof(path) );
+
+	if (length)
+		*length = 0;
+
+	FILE *fp = fopen( path, "rb" );
+	if (fp == nullptr)
+		return nullptr;
+
+	fseek( fp, 0, SEEK_END );
+	long size = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+
+	// the engine terminates loaded files, so text files can be parsed in place
+	byte *data = (byte *)malloc( size + 1 );
+	if (data == nullptr || fread( data, 1, size, fp ) != (size_t)size)
+	{
+		free( data );
+		fclose( fp );
+		return nullptr;
+	}
+
+	data[ size ] = '\000';
+	fclose( fp );
+
+	if (length)
+		*length = size;
+
+	return data;
+}
+
+static void NavToolFreeFile( void *buffer )
+{
+	free( buffer );
+}
+
+static int NavToolGetFileSize( const char *filename )
+{
+	char path[ 512 ];
+	GetNavToolPath( filename, path, sizeof(path) );
+
+	FILE *fp = fopen( path, "rb" );
+	if (fp == nullptr)
+		return -1;
+
+	fseek( fp, 0, SEEK_END );
+	int size = ftell( fp );
+	fclose( fp );
+
+	return size;
+}
+
+static void NavToolGetGameDir( char *gameDir )
+{
+	strcpy( gameDir, navToolGameDir );
+}
+
+static void NavToolServerPrint( const char *msg )
+{
+	fputs( msg, stdout );
+}
+
+static void NavToolAlertMessage( ALERT_TYPE type, const char *format, ... )
+{
+	va_list args;
+	va_start( args, format );
+	vprintf( format, args );
+	va_end( args );
+}
+
+static int32 NavToolRandomLong( int32 low, int32 high )
+{
+	if (high <= low)
+		return low;
+
+	return low + rand() % (high - low + 1);
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void InstallNavToolEngine( const char *gameDir )
+{
+	strncpy( navToolGameDir, gameDir, sizeof(navToolGameDir) - 1 );
+
+	memset( &navToolGlobals, 0, sizeof(navToolGlobals) );
+	gpGlobals = &navToolGlobals;
+
+	engine::LoadFileForMe = NavToolLoadFileForMe;
+	engine::FreeFile = NavToolFreeFile;
+	engine::GetFileSize = NavToolGetFileSize;
+	engine::GetGameDir = NavToolGetGameDir;
+	engine::ServerPrint = NavToolServerPrint;
+	engine::AlertMessage = NavToolAlertMessage;
+	engine::RandomLong = NavToolRandomLong;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void SetNavToolMap( const char *mapName )
+{
+	strncpy( navToolMapName, mapName, sizeof(navToolMapName) - 1 );
+
+	// the string table holds nothing but the map name
+	navToolGlobals.pStringBase = navToolMapName;
+	navToolGlobals.mapname = 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+//
+// util functions - traces hit the world only, and there are no players or entities
+//
+void util::TraceLine( const Vector &vecStart, const Vector &vecEnd, IGNORE_MONSTERS igmon, CBaseEntity *ignore, TraceResult *ptr )
+{
+	TheBspTracer.TraceLine( vecStart, vecEnd, ptr );
+}
+
+void util::TraceLine( const Vector &vecStart, const Vector &vecEnd, IGNORE_MONSTERS igmon, IGNORE_GLASS ignoreGlass, CBaseEntity *ignore, TraceResult *ptr )
+{
+	TheBspTracer.TraceLine( vecStart, vecEnd, ptr );
+}
+
+CBaseEntity *util::GetLocalPlayer( void )
+{
+	return nullptr;
+}
+
+CBaseEntity *util::PlayerByIndex( int playerIndex )
+{
+	return nullptr;
+}
+
+CBaseEntity *util::FindEntityByClassname( CBaseEntity *pStartEntity, const char *szName )
+{
+	return nullptr;
+}
+
+void util::MakeVectors( const Vector &vecAngles )
+{
+	AngleVectors( vecAngles, &gpGlobals->v_forward, &gpGlobals->v_right, &gpGlobals->v_up );
+}
+
+void util::ClientPrintAll( int msg_dest, const char *msg_name, const char *param1, const char *param2, const char *param3, const char *param4 )
+{
+}
+
+void util::HudMessageAll( const hudtextparms_t &textparms, const char *pMessage )
+{
+}
+
+char *util::VarArgs( const char *format, ... )
+{
+	static char string[1024];
+
+	va_list args;
+	va_start( args, format );
+	vsnprintf( string, sizeof(string), format, args );
+	va_end( args );
+
+	return string;
+}
+
+void util::LogPrintf( const char *fmt, ... )
+{
+	va_list args;
+	va_start( args, fmt );
+	vprintf( fmt, args );
+	va_end( args );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+//
+// Entity functions referenced by the nav editing code, which the tool never runs
+//
+void CBaseEntity::SetOrigin( const Vector &org )
+{
+	v.origin = org;
+}
+
+void CBaseEntity::EmitSound( const char *sample, int channel, float volume, float attenuation, int pitch, int flags )
+{
+}
@@ -18,6 +18,9 @@
 
 #include "bot.h"
 #include "bot_util.h"
+#include "bot_profiler.h"
+#include "nav.h"
+#include "nav_area.h"
 
 float g_flBotCommandInterval		= 1.0 / 30.0;	// 30 times per second, just like human clients
 float g_flBotFullThinkInterval	= 1.0 / 10.0;	// full AI only 10 times per second
@@ -40,6 +43,13 @@ CBot::CBot( Entity* containingEntity ) : CBasePlayer(containingEntity)
 	++nextID;
 
 	m_postureStackIndex = 0;
+
+	// think as soon as the bot manager gets to us
+	m_flNextBotThink = 0.0f;
+	m_flNextFullBotThink = 0.0f;
+
+	m_lastKnownArea = nullptr;
+	m_lastKnownAreaGeneration = 0;
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -68,8 +78,9 @@ bool CBot::Spawn( void )
 	ClearThink();
 	v.nextthink = -1;
 
+	// stagger the full thinks of bots that spawn together, so they don't all come due in the same frame
 	m_flNextBotThink		= gpGlobals->time + g_flBotCommandInterval;
-	m_flNextFullBotThink	= gpGlobals->time + g_flBotFullThinkInterval;
+	m_flNextFullBotThink	= gpGlobals->time + g_flBotFullThinkInterval * (1 + GetID() % 8) / 8.0f;
 	m_flPreviousCommandTime	= gpGlobals->time;
 
 	m_isRunning = true;
@@ -78,6 +89,8 @@ bool CBot::Spawn( void )
 
 	m_jumpTimestamp = 0.0f;
 
+	m_lastKnownArea = nullptr;
+
 	// Command interface variable initialization
 	ResetCommand();
 
@@ -98,19 +111,28 @@ Vector CBot::GetAimVector( void )
 
 
 //--------------------------------------------------------------------------------------------------------------
-void CBot::BotThink( void )
+/**
+ * Invoked each frame by the bot manager, which decides when we run our full think
+ * and sets the time of the next one
+ */
+void CBot::BotThink( bool isFullThink )
 {
-	if ( gpGlobals->time >= m_flNextBotThink )
+	if ( isFullThink || gpGlobals->time >= m_flNextBotThink )
 	{
 		m_flNextBotThink = gpGlobals->time + g_flBotCommandInterval;
 
-		Upkeep();
+		UpdateLastKnownArea();
 
-		if ( gpGlobals->time >= m_flNextFullBotThink )
 		{
-			m_flNextFullBotThink = gpGlobals->time + g_flBotFullThinkInterval;
+			CBotProfileScope profileScope( BOT_PROFILE_UPKEEP, v.GetIndex() );
+			Upkeep();
+		}
 
+		if ( isFullThink )
+		{
 			ResetCommand();
+
+			CBotProfileScope profileScope( BOT_PROFILE_UPDATE, v.GetIndex() );
 			Update();
 		}
 
@@ -119,6 +141,28 @@ void CBot::BotThink( void )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Track the nav area we are standing on.
+ * We rarely move more than one area between thinks, so the area we were on last time is checked first.
+ */
+void CBot::UpdateLastKnownArea( void )
+{
+	// our area may have been destroyed since we last looked
+	if (m_lastKnownAreaGeneration != TheNavAreaGrid.GetGeneration())
+	{
+		m_lastKnownArea = nullptr;
+		m_lastKnownAreaGeneration = TheNavAreaGrid.GetGeneration();
+	}
+
+	CNavArea *area = TheNavAreaGrid.GetNavArea( &v.origin, 120.0f, m_lastKnownArea );
+
+	// keep the last area we were on while we are off of the mesh (jumping, falling, etc)
+	if (area)
+		m_lastKnownArea = area;
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 void CBot::MoveForward( void )
 {
@@ -184,6 +184,8 @@ public:
 
 	bool IsLocalPlayerWatchingMe( void ) const;				///< return true if local player is observing this bot
 
+	CNavArea *GetLastKnownArea( void ) const	{ return m_lastKnownArea; }	///< return the last nav area we were standing on, or nullptr
+
 	void Print( char *format, ... ) const;					///< output message to console
 	void PrintIfWatched( char *format, ... ) const;			///< output message to console if we are being watched by the local player
 
@@ -192,7 +194,9 @@ public:
 	virtual Vector GetAimVector( void );
 
 	bool Spawn( void ) override;
-	void BotThink( void );
+	void BotThink( bool isFullThink );						///< run Upkeep() when due, and Update() if the bot manager scheduled a full think this frame
+	float GetNextFullThinkTime( void ) const		{ return m_flNextFullBotThink; }
+	void SetNextFullThinkTime( float time )			{ m_flNextFullBotThink = time; }
 	bool IsNetClient( void ) override			{ return false; }
 #ifdef HALFLIFE_SAVERESTORE
 	int Save( CSave &save )	override			{ return 0; }
@@ -229,6 +233,10 @@ private:
 
 	float m_jumpTimestamp;									///< time when we last began a jump
 
+	CNavArea *m_lastKnownArea;								///< the last nav area we were standing on
+	unsigned int m_lastKnownAreaGeneration;					///< the nav grid generation m_lastKnownArea is valid for
+	void UpdateLastKnownArea( void );
+
 	/// the PostureContext represents the current settings of walking and crouching
 	struct PostureContext
 	{
@@ -11,6 +11,8 @@
 
 #define DEFINE_EVENT_NAMES
 
+#include <algorithm>
+
 #include "extdll.h"
 #include "util.h"
 #include "cbase.h"
@@ -19,10 +21,14 @@
 #include "player.h"
 #include "client.h"
 #include "perf_counter.h"
+#include "player_snapshot.h"
 
 #include "bot.h"
 #include "bot_manager.h"
+#include "bot_profiler.h"
 #include "nav_area.h"
+#include "nav_path.h"
+#include "nav_influence.h"
 #include "bot_util.h"
 #ifdef CSTRIKE
 #include "hostage.h"
@@ -32,25 +38,6 @@
 const float smokeRadius = 115.0f;		///< for smoke grenades
 
 
-//#define CHECK_PERFORMANCE
-#ifdef CHECK_PERFORMANCE
-	// crude performance timing
-	static CPerformanceCounter perfCounter;
-
-	struct PerfInfo
-	{
-		float frameTime;
-		float botThinkTime;
-	};
-
-	#define MAX_PERF_DATA 50000
-	static PerfInfo perfData[ MAX_PERF_DATA ];
-	static int perfDataCount = 0;
-	static int perfFileIndex = 0;
-#endif
-
-
-
 /**
  * Convert name to GameEventType
  * @todo Find more appropriate place for this function
@@ -69,6 +56,11 @@ GameEventType NameToGameEvent( const char *name )
 CBotManager::CBotManager()
 {
 	InitBotTrig();
+
+	memset( &m_thinkStats, 0, sizeof(m_thinkStats) );
+	memset( &m_eventStats, 0, sizeof(m_eventStats) );
+
+	m_eventFrameTime = -1.0f;
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -77,23 +69,6 @@ CBotManager::CBotManager()
  */
 void CBotManager::RestartRound( void )
 {
-#ifdef CHECK_PERFORMANCE
-	// dump previous round's performance
-	char filename[80];
-	sprintf( filename, "perfdata%02X.txt", perfFileIndex++ );
-	FILE *fp = fopen( filename, "w" );
-
-	if (fp)
-	{
-		for( int p=0; p<perfDataCount; ++p )
-			fprintf( fp, "%f\t%f\n", perfData[p].frameTime, perfData[p].botThinkTime );
-
-		fclose( fp );
-	}
-		
-	perfDataCount = 0;
-#endif
-
 	DestroyAllGrenades();
 }
 
@@ -103,6 +78,9 @@ void CBotManager::RestartRound( void )
  */
 void CBotManager::StartFrame( void )
 {
+	// follow bot_perf_enable
+	TheBotProfiler.Update();
+
 	// debug smoke grenade visualization
 	if (cv_bot_debug.value == 5)
 	{
@@ -157,45 +135,194 @@ void CBotManager::StartFrame( void )
 	}
 
 
+	// hand back path searches that finished on worker threads last frame
+	TheNavSearchPool.DeliverResults();
+
+	TheNavInfluenceMap.Update();
+
+	if (cv_bot_show_danger.value)
+		TheNavInfluenceMap.Draw();
+
 	//
 	// Process each active bot
 	//
+	{
+		CBotProfileScope profileScope( BOT_PROFILE_THINK );
+		ThinkBots();
+	}
 
-#ifdef CHECK_PERFORMANCE
-	static double lastTime = 0.0f;
-	double startTime = perfCounter.GetCurTime();
-#endif
+	// advance pending path searches requested by the bots, within this frame's time budget,
+	// or hand them to worker threads if bot_nav_threads is set
+	TheNavPathQueue.Update( cv_bot_nav_budget_us.value );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return how often the given bot should run its full think.
+ * Bots that no human is near enough to notice think less often, and dead or spectating bots least of all.
+ */
+CBotManager::ThinkLOD CBotManager::GetThinkLOD( CBot *bot ) const
+{
+	if (cv_bot_think_lod.value <= 0.0f)
+		return THINK_LOD_NORMAL;
+
+	if (!bot->IsAlive() || bot->IsObserver() || bot->IsSpectator())
+		return THINK_LOD_IDLE;
+
+	const float rangeSq = cv_bot_think_lod_range.value * cv_bot_think_lod_range.value;
+
+	for( unsigned int h=0; h<m_humanPos.size(); ++h )
+	{
+		if ((m_humanPos[h] - bot->v.origin).LengthSquared() < rangeSq)
+			return THINK_LOD_NORMAL;
+	}
+
+	return THINK_LOD_DISTANT;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Order bots by when their full think came due, earliest first
+ */
+static bool IsFullThinkEarlier( const CBot *a, const CBot *b )
+{
+	return a->GetNextFullThinkTime() < b->GetNextFullThinkTime();
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Run each bot's think. Every bot runs its Upkeep() at the command rate, but full thinks are
+ * handed out by this scheduler - at most bot_think_max_per_frame each frame, longest overdue first -
+ * so that bots that came due together (after a round restart, say) are spread over the next few frames.
+ */
+void CBotManager::ThinkBots( void )
+{
+	static const float lodIntervalScale[ NUM_THINK_LODS ] = { 1.0f, 2.0f, 4.0f };
+
+	static CPerformanceCounter thinkCounter;
+	double startTime = thinkCounter.GetCurTime();
+
+	// find the bots and the humans
+	m_thinkBot.clear();
+	m_thinkDue.clear();
+	m_humanPos.clear();
 
 	for( int i = 1; i <= gpGlobals->maxClients; ++i )
 	{
 		CBasePlayer *pPlayer = (CBasePlayer *)util::PlayerByIndex( i );
 
-		if (!pPlayer)
+		if (!pPlayer || !IsEntityValid( pPlayer ))
 			continue;
 
-		if (pPlayer->IsBot() && IsEntityValid( pPlayer ))
-		{
-			CBot *pBot = static_cast<CBot *>( pPlayer );
+		if (pPlayer->IsBot())
+			m_thinkBot.push_back( static_cast<CBot *>( pPlayer ) );
+		else
+			m_humanPos.push_back( pPlayer->v.origin );
+	}
 
-			pBot->BotThink();
-		}
+	// find whose full think is due, and how many full thinks per frame keeps every bot on schedule
+	float expectedThinks = 0.0f;
+	m_thinkLOD.resize( m_thinkBot.size() );
+
+	for( unsigned int b=0; b<m_thinkBot.size(); ++b )
+	{
+		CBot *bot = m_thinkBot[b];
+
+		m_thinkLOD[b] = GetThinkLOD( bot );
+		++m_thinkStats.botFrameCount[ m_thinkLOD[b] ];
+
+		expectedThinks += gpGlobals->frametime / (g_flBotFullThinkInterval * lodIntervalScale[ m_thinkLOD[b] ]);
+
+		if (gpGlobals->time >= bot->GetNextFullThinkTime())
+			m_thinkDue.push_back( bot );
 	}
 
-#ifdef CHECK_PERFORMANCE
-	if (perfDataCount < MAX_PERF_DATA)
+	int maxThinks = (int)cv_bot_think_max_per_frame.value;
+	if (maxThinks <= 0)
+		maxThinks = std::max( 1, (int)ceil( expectedThinks ) );
+
+	// the longest overdue go first, the rest wait for a later frame
+	if ((int)m_thinkDue.size() > maxThinks)
 	{
-		if (lastTime > 0.0f)
-		{
-			double endTime = perfCounter.GetCurTime();
+		std::sort( m_thinkDue.begin(), m_thinkDue.end(), IsFullThinkEarlier );
 
-			perfData[ perfDataCount ].frameTime = (float)(startTime - lastTime);
-			perfData[ perfDataCount ].botThinkTime = (float)(endTime - startTime);
-			++perfDataCount;
-		}
+		m_thinkStats.deferredCount += m_thinkDue.size() - maxThinks;
+		m_thinkDue.resize( maxThinks );
+	}
 
-		lastTime = startTime;
+	for( unsigned int d=0; d<m_thinkDue.size(); ++d )
+	{
+		float lateness = gpGlobals->time - m_thinkDue[d]->GetNextFullThinkTime();
+
+		m_thinkStats.totalLateness += lateness;
+		if (lateness > m_thinkStats.maxLateness)
+			m_thinkStats.maxLateness = lateness;
 	}
-#endif
+
+	// think
+	for( unsigned int b=0; b<m_thinkBot.size(); ++b )
+	{
+		CBot *bot = m_thinkBot[b];
+
+		bool isFullThink = (std::find( m_thinkDue.begin(), m_thinkDue.end(), bot ) != m_thinkDue.end());
+
+		if (isFullThink)
+			bot->SetNextFullThinkTime( gpGlobals->time + g_flBotFullThinkInterval * lodIntervalScale[ m_thinkLOD[b] ] );
+
+		bot->BotThink( isFullThink );
+	}
+
+	double thinkTime = thinkCounter.GetCurTime() - startTime;
+
+	++m_thinkStats.frameCount;
+	m_thinkStats.fullThinkCount += m_thinkDue.size();
+	m_thinkStats.maxFullThinksPerFrame = std::max( m_thinkStats.maxFullThinksPerFrame, (int)m_thinkDue.size() );
+	m_thinkStats.totalThinkTime += thinkTime;
+	m_thinkStats.maxThinkTime = std::max( m_thinkStats.maxThinkTime, thinkTime );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Print the bot think scheduling statistics gathered since they were last printed, and reset them
+ */
+void CBotManager::PrintThinkStats( void )
+{
+	const ThinkStats &stats = m_thinkStats;
+
+	if (stats.frameCount == 0)
+	{
+		CONSOLE_ECHO( "bot_think_stats: no frames since the last report\n" );
+		return;
+	}
+
+	CONSOLE_ECHO( "bot_think_stats: %d frames, %d full thinks (%.2f per frame, most in one frame %d), %d deferred to a later frame\n",
+					stats.frameCount, stats.fullThinkCount, (float)stats.fullThinkCount / stats.frameCount,
+					stats.maxFullThinksPerFrame, stats.deferredCount );
+
+	if (stats.fullThinkCount)
+		CONSOLE_ECHO( "bot_think_stats: full thinks ran %.2f ms late on average, %.2f ms at worst\n",
+						1000.0 * stats.totalLateness / stats.fullThinkCount, 1000.0f * stats.maxLateness );
+
+	CONSOLE_ECHO( "bot_think_stats: think time %.3f ms per frame on average, %.3f ms at worst\n",
+					1000.0 * stats.totalThinkTime / stats.frameCount, 1000.0 * stats.maxThinkTime );
+
+	CONSOLE_ECHO( "bot_think_stats: average bots per frame - %.1f near a human, %.1f distant, %.1f dead or spectating\n",
+					(float)stats.botFrameCount[ THINK_LOD_NORMAL ] / stats.frameCount,
+					(float)stats.botFrameCount[ THINK_LOD_DISTANT ] / stats.frameCount,
+					(float)stats.botFrameCount[ THINK_LOD_IDLE ] / stats.frameCount );
+
+	memset( &m_thinkStats, 0, sizeof(m_thinkStats) );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * bot_think_stats
+ * Print how bot thinks have been scheduled since the last time this command was used
+ */
+void BotPrintThinkStats( void )
+{
+	if (g_pBotMan)
+		g_pBotMan->PrintThinkStats();
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -209,15 +336,91 @@ const char *CBotManager::GetNavMapFilename( void ) const
 	return filename;
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return how far away bots can hear the given event, or zero if every bot is told about it
+ */
+static float GetEventRange( GameEventType event )
+{
+	const float quietRange = 500.0f;
+	const float shortRange = 1000.0f;
+	const float normalRange = 2000.0f;
+
+	switch( event )
+	{
+		case EVENT_WEAPON_FIRED:
+		case EVENT_HE_GRENADE_EXPLODED:
+		case EVENT_FLASHBANG_GRENADE_EXPLODED:
+		case EVENT_SMOKE_GRENADE_EXPLODED:
+			return normalRange;
+
+		case EVENT_PLAYER_FOOTSTEP:
+		case EVENT_PLAYER_LANDED_FROM_HEIGHT:
+		case EVENT_PLAYER_TOOK_DAMAGE:
+		case EVENT_DOOR:
+		case EVENT_BREAK_GLASS:
+		case EVENT_BREAK_WOOD:
+		case EVENT_BREAK_METAL:
+		case EVENT_BREAK_FLESH:
+		case EVENT_BREAK_CONCRETE:
+		case EVENT_BULLET_IMPACT:
+			return shortRange;
+
+		case EVENT_WEAPON_FIRED_ON_EMPTY:
+		case EVENT_WEAPON_RELOADED:
+		case EVENT_WEAPON_ZOOMED:
+		case EVENT_GRENADE_BOUNCED:
+		case EVENT_PLAYER_JUMPED:
+			return quietRange;
+
+		default:
+			break;
+	}
+
+	return 0.0f;
+}
+
+/// size of the grid cells bots are sorted into for noise delivery - a noise's range covers only a few cells
+static const float eventCellSize = 1024.0f;
+static const int eventGridSize = 256;						///< cells on a side, centered on the world origin
+
+//--------------------------------------------------------------------------------------------------------------
+inline int GetEventGridCoord( float v )
+{
+	int c = (int)floor( v / eventCellSize ) + eventGridSize/2;
+
+	if (c < 0)
+		return 0;
+
+	if (c >= eventGridSize)
+		return eventGridSize-1;
+
+	return c;
+}
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Invoked when given player does given event (some events have nullptr player).
- * Events are propogated to all bots.
+ * Events are propogated to all bots, except noises, which only go to the bots close enough to hear them.
  *
  * @todo This has become the game-wide event dispatcher. We should restructure this.
  */
 void CBotManager::OnEvent( GameEventType event, CBaseEntity *entity, CBaseEntity *other )
 {
+	CBotProfileScope profileScope( BOT_PROFILE_EVENT );
+
+	// record where things happen, for everyone's use
+	TheNavInfluenceMap.OnEvent( event, entity, other );
+
+	++m_eventStats.eventCount;
+
+	float range = GetEventRange( event );
+	if (range > 0.0f && entity && cv_bot_event_cull.value > 0.0f)
+	{
+		OnRangedEvent( event, entity, other, range );
+		return;
+	}
+
 	// propogate event to all bots
 	for ( int i=1; i <= gpGlobals->maxClients; ++i )
 	{
@@ -238,6 +441,8 @@ void CBotManager::OnEvent( GameEventType event, CBaseEntity *entity, CBaseEntity
 
 		CBot *bot = static_cast<CBot *>( player );
 		bot->OnEvent( event, entity, other );
+
+		++m_eventStats.deliveryCount;
 	}
 
 #ifdef CSTRIKE
@@ -249,6 +454,168 @@ void CBotManager::OnEvent( GameEventType event, CBaseEntity *entity, CBaseEntity
 #endif
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Sort the bots into grid cells by where they were at the start of the frame
+ */
+void CBotManager::BucketEventListeners( void )
+{
+	m_eventListener.clear();
+
+	for( int i=0; i<g_PlayerSnapshot.GetCount(); ++i )
+	{
+		if (!g_PlayerSnapshot.IsBot( i ))
+			continue;
+
+		const Vector &pos = g_PlayerSnapshot.GetOrigin( i );
+
+		EventListener listener;
+		listener.cell = GetEventGridCoord( pos.y ) * eventGridSize + GetEventGridCoord( pos.x );
+		listener.playerIndex = g_PlayerSnapshot.GetPlayer( i )->v.GetIndex();
+		listener.pos = pos;
+
+		m_eventListener.push_back( listener );
+	}
+
+	std::sort( m_eventListener.begin(), m_eventListener.end() );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Deliver a noise made by 'entity' to the bots within 'range' of it.
+ * Only the grid cells the range overlaps are looked at, and a source making the same noise
+ * about the same 'other' more than once in a frame (a minigun, say) is only heard once.
+ */
+void CBotManager::OnRangedEvent( GameEventType event, CBaseEntity *entity, CBaseEntity *other, float range )
+{
+	// the listeners and recent noises are gathered once per frame
+	if (gpGlobals->time != m_eventFrameTime)
+	{
+		m_eventFrameTime = gpGlobals->time;
+		m_recentEvent.clear();
+
+		BucketEventListeners();
+	}
+
+	RecentEvent recent;
+	recent.event = event;
+	recent.entity = &entity->v;
+	recent.entitySerialNumber = entity->v.GetSerialNumber();
+	recent.other = (other) ? &other->v : nullptr;
+	recent.otherSerialNumber = (other) ? other->v.GetSerialNumber() : 0;
+
+	for( unsigned int r=0; r<m_recentEvent.size(); ++r )
+	{
+		const RecentEvent &previous = m_recentEvent[r];
+
+		if (previous.event == event &&
+			previous.entity == recent.entity && previous.entitySerialNumber == recent.entitySerialNumber &&
+			previous.other == recent.other && previous.otherSerialNumber == recent.otherSerialNumber)
+		{
+			++m_eventStats.coalescedCount;
+			return;
+		}
+	}
+
+	m_recentEvent.push_back( recent );
+
+	const Vector &pos = entity->v.origin;
+	const float rangeSq = range * range;
+
+	int loX = GetEventGridCoord( pos.x - range );
+	int hiX = GetEventGridCoord( pos.x + range );
+	int loY = GetEventGridCoord( pos.y - range );
+	int hiY = GetEventGridCoord( pos.y + range );
+
+	int heardCount = 0;
+
+	// the cells of each row are contiguous in the sorted list
+	for( int y=loY; y<=hiY; ++y )
+	{
+		EventListener first, last;
+		first.cell = y * eventGridSize + loX;
+		last.cell = y * eventGridSize + hiX;
+
+		std::vector< EventListener >::const_iterator iter = std::lower_bound( m_eventListener.cbegin(), m_eventListener.cend(), first );
+		std::vector< EventListener >::const_iterator end = std::upper_bound( iter, m_eventListener.cend(), last );
+
+		for( ; iter != end; ++iter )
+		{
+			if ((iter->pos - pos).LengthSquared() > rangeSq)
+				continue;
+
+			CBasePlayer *player = static_cast<CBasePlayer *>( util::PlayerByIndex( iter->playerIndex ) );
+
+			if (player == nullptr)
+				continue;
+
+			if (STRING(player->v.netname)[0] == '\0')
+				continue;
+
+			if (!player->IsBot())
+				continue;
+
+			// do not send self-generated event
+			if (entity == player)
+				continue;
+
+			CBot *bot = static_cast<CBot *>( player );
+			bot->OnEvent( event, entity, other );
+
+			++heardCount;
+		}
+	}
+
+	m_eventStats.deliveryCount += heardCount;
+
+	// every other bot would have been told, before noises were culled
+	int botCount = m_eventListener.size();
+	if (entity->IsBot())
+		--botCount;
+
+	if (botCount > heardCount)
+		m_eventStats.culledCount += botCount - heardCount;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Print the event delivery statistics gathered since they were last printed, and reset them
+ */
+void CBotManager::PrintEventStats( void )
+{
+	const EventStats &stats = m_eventStats;
+
+	float elapsed = gpGlobals->time - stats.startTime;
+
+	if (stats.eventCount == 0 || elapsed <= 0.0f)
+	{
+		CONSOLE_ECHO( "bot_event_stats: no events since the last report\n" );
+	}
+	else
+	{
+		CONSOLE_ECHO( "bot_event_stats: %d events in %.1f seconds (%.1f per second)\n",
+						stats.eventCount, elapsed, stats.eventCount / elapsed );
+
+		CONSOLE_ECHO( "bot_event_stats: %.1f deliveries per second, %.1f suppressed per second (%d out of range, %d repeats coalesced)\n",
+						stats.deliveryCount / elapsed, (stats.culledCount + stats.coalescedCount) / elapsed,
+						stats.culledCount, stats.coalescedCount );
+	}
+
+	memset( &m_eventStats, 0, sizeof(m_eventStats) );
+	m_eventStats.startTime = gpGlobals->time;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * bot_event_stats
+ * Print how many game events were delivered to bots, and how many were not, since the last time this command was used
+ */
+void BotPrintEventStats( void )
+{
+	if (g_pBotMan)
+		g_pBotMan->PrintEventStats();
+}
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Add an active grenade to the bot's awareness
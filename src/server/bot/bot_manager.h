@@ -15,10 +15,12 @@
 #include "extdll.h"
 #include "util.h"
 #include <list>
+#include <vector>
 #include "GameEvent.h" // Game event enum used by career mode, tutor system, and bots
 
 
 class CNavArea;
+class CBot;
 
 
 //--------------------------------------------------------------------------------------------------------------
@@ -76,7 +78,7 @@ public:
 
 	/**
 	 * Invoked when event occurs in the game (some events have nullptr entity).
-	 * Events are propogated to all bots.
+	 * Events are propogated to all bots, except noises, which only go to bots that can hear them.
 	 */
 	virtual void OnEvent( GameEventType event, CBaseEntity *entity = nullptr, CBaseEntity *other = nullptr );
 
@@ -90,8 +92,84 @@ public:
 	bool IsLineBlockedBySmoke( const Vector *from, const Vector *to );	///< return true if line intersects smoke volume
 	bool IsInsideSmokeCloud( const Vector *pos );				///< return true if position is inside a smoke cloud
 
+	void PrintThinkStats( void );								///< print and reset the bot think scheduling statistics
+	void PrintEventStats( void );								///< print and reset the event delivery statistics
+
 private:
 	ActiveGrenadeList m_activeGrenadeList;///< the list of active grenades the bots are aware of
+
+	/// how often a bot runs its full think, from most to least often
+	enum ThinkLOD
+	{
+		THINK_LOD_NORMAL,										///< a human is nearby
+		THINK_LOD_DISTANT,										///< no human is within bot_think_lod_range
+		THINK_LOD_IDLE,											///< dead or spectating
+
+		NUM_THINK_LODS
+	};
+
+	ThinkLOD GetThinkLOD( CBot *bot ) const;					///< return how often the given bot should run its full think
+	void ThinkBots( void );										///< run each bot's think, spreading full thinks evenly across frames
+
+	std::vector< CBot * > m_thinkBot;							///< the bots being thought about this frame
+	std::vector< ThinkLOD > m_thinkLOD;							///< the think LOD of each of m_thinkBot
+	std::vector< CBot * > m_thinkDue;							///< the bots whose full think is due this frame
+	std::vector< Vector > m_humanPos;							///< where the humans are this frame, for think LOD
+
+	/// accumulated by ThinkBots() until printed with "bot_think_stats"
+	struct ThinkStats
+	{
+		int frameCount;
+		int botFrameCount[ NUM_THINK_LODS ];					///< number of frames each bot spent at each LOD
+		int fullThinkCount;
+		int deferredCount;										///< number of times a due full think was pushed to a later frame
+		int maxFullThinksPerFrame;
+		double totalLateness;									///< total time full thinks ran after they were due
+		float maxLateness;
+		double totalThinkTime;									///< time spent thinking, in seconds
+		double maxThinkTime;									///< longest single frame of thinking
+	};
+	ThinkStats m_thinkStats;
+
+	void OnRangedEvent( GameEventType event, CBaseEntity *entity, CBaseEntity *other, float range );	///< deliver a noise to the bots that can hear it
+	void BucketEventListeners( void );							///< sort this frame's bots by grid cell, for OnRangedEvent()
+
+	/// a bot that may hear noises this frame, and the grid cell it was in at the start of the frame
+	struct EventListener
+	{
+		unsigned int cell;
+		int playerIndex;										///< looked up again on delivery, in case the bot has left
+		Vector pos;
+
+		bool operator<( const EventListener &other ) const		{ return cell < other.cell; }
+	};
+	std::vector< EventListener > m_eventListener;				///< sorted by cell
+	float m_eventFrameTime;										///< the frame m_eventListener and m_recentEvent were gathered in
+
+	/// a noise already delivered this frame - repeats from the same source are dropped
+	struct RecentEvent
+	{
+		GameEventType event;
+		Entity *entity;											///< entities are told apart by serial number, in case one is freed and reused
+		int entitySerialNumber;
+		Entity *other;
+		int otherSerialNumber;
+	};
+	std::vector< RecentEvent > m_recentEvent;
+
+	/// accumulated by OnEvent() until printed with "bot_event_stats"
+	struct EventStats
+	{
+		float startTime;
+		int eventCount;
+		int coalescedCount;										///< noises dropped as repeats from the same source in the same frame
+		int deliveryCount;										///< calls made to bots' OnEvent()
+		int culledCount;										///< bots skipped because they were too far away to hear the noise
+	};
+	EventStats m_eventStats;
 };
 
+extern void BotPrintThinkStats( void );							///< "bot_think_stats" console command
+extern void BotPrintEventStats( void );							///< "bot_event_stats" console command
+
 #endif
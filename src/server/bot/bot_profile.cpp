@@ -42,6 +42,7 @@ BotProfileManager *TheBotProfiles = nullptr;
 	#include "pm_shared.h"
 	#include "bot.h"
 	#include "bot_util.h"
+	#include "steam_util.h"
 #endif
 
 //--------------------------------------------------------------------------------------------------------
@@ -133,15 +134,14 @@ BotProfileManager::BotProfileManager( void )
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Load the bot profile database
+ * Load the bot profile database, from its compiled cache if the cache is up to date
  */
 void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 {
 	int dataLength;
 	char *dataPointer = (char *)engine::LoadFileForMe( const_cast<char *>( filename ), &dataLength );
-	const char *dataFile = dataPointer;
 
-	if (dataFile == nullptr)
+	if (dataPointer == nullptr)
 	{
 #ifdef CSTRIKE
 		if ( UTIL_IsGame( "czero" ) )
@@ -152,12 +152,32 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 		return;
 	}
 
-	// compute simple checksum
+	// compute simple checksum - this also tells us if the cache was compiled from this file
+	unsigned int sourceChecksum = ComputeSimpleChecksum( (const unsigned char *)dataPointer, dataLength );
+
 	if (checksum)
 	{
-		*checksum = ComputeSimpleChecksum( (const unsigned char *)dataPointer, dataLength );
+		*checksum = sourceChecksum;
+	}
+
+	if (!LoadCache( filename, dataLength, sourceChecksum ))
+	{
+		if (Parse( filename, dataPointer ))
+			SaveCache( filename, dataLength, sourceChecksum );
 	}
 
+	engine::FreeFile( dataPointer );
+
+	BuildProfileIndex();
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Parse the text of the bot profile database into BotProfile instances.
+ * Return false if the database has errors.
+ */
+bool BotProfileManager::Parse( const char *filename, const char *dataFile )
+{
 	// keep list of templates used for inheritance
 	BotProfileList templateList;
 
@@ -188,8 +208,7 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			if (!dataFile)
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected skin name\n", filename );
-				engine::FreeFile( dataPointer );
-				return;
+				return false;
 			}
 			token = SharedGetToken();
 			snprintf( skinName, BufLen, "%s", token );
@@ -199,15 +218,13 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			if (!dataFile)
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected 'Model'\n", filename );
-				engine::FreeFile( dataPointer );
-				return;
+				return false;
 			}
 			token = SharedGetToken();
 			if (stricmp( "Model", token ))
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected 'Model'\n", filename );
-				engine::FreeFile( dataPointer );
-				return;
+				return false;
 			}
 
 			// eat '='
@@ -215,15 +232,13 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			if (!dataFile)
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected '='\n", filename );
-				engine::FreeFile( dataPointer );
-				return;
+				return false;
 			}
 			token = SharedGetToken();
 			if (strcmp( "=", token ))
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected '='\n", filename );
-				engine::FreeFile( dataPointer );
-				return;
+				return false;
 			}
 
 			// get attribute value
@@ -231,39 +246,24 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			if (!dataFile)
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected attribute value\n", filename );
-				engine::FreeFile( dataPointer );
-				return;
+				return false;
 			}
 			token = SharedGetToken();
 
-			const char *decoratedName = GetDecoratedSkinName( skinName, filename );
-			bool skinExists = GetCustomSkinIndex( decoratedName ) > 0;
-			if ( m_nextSkin < NumCustomSkins && !skinExists )
-			{
-				// decorate the name
-				m_skins[ m_nextSkin ] = CloneString( decoratedName );
-
-				// construct the model filename
-				m_skinModelnames[ m_nextSkin ] = CloneString( token );
-				m_skinFilenames[ m_nextSkin ] = new char[ strlen(token)*2 + strlen("models/player//.mdl") + 1 ];
-				sprintf( m_skinFilenames[ m_nextSkin ], "models/player/%s/%s.mdl", token, token );
-				++m_nextSkin;
-			}
+			AddCustomSkin( GetDecoratedSkinName( skinName, filename ), token );
 
 			// eat 'End'
 			dataFile = SharedParse( dataFile );
 			if (!dataFile)
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected 'End'\n", filename );
-				engine::FreeFile( dataPointer );
-				return;
+				return false;
 			}
 			token = SharedGetToken();
 			if (strcmp( "End", token ))
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected 'End'\n", filename );
-				engine::FreeFile( dataPointer );
-				return;
+				return false;
 			}
 
 			continue; // it's just a custom skin - no need to do inheritance on a bot profile, etc.
@@ -309,8 +309,7 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 				if (inherit == nullptr)
 				{
 					CONSOLE_ECHO( "Error parsing '%s' - invalid template reference '%s'\n", filename, token );
-					engine::FreeFile( dataPointer );
-					return;
+					return false;
 				}
 
 				// inherit the data
@@ -331,8 +330,7 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			if (!dataFile)
 			{
 				CONSOLE_ECHO( "Error parsing '%s' - expected name\n", filename );
-				engine::FreeFile( dataPointer );
-				return;
+				return false;
 			}
 			profile->m_name = CloneString( SharedGetToken() );
 
@@ -356,8 +354,7 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			if (!dataFile)
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected 'End'\n", filename );
-				engine::FreeFile( dataPointer );
-				return;
+				return false;
 			}
 			token = SharedGetToken();
 
@@ -374,16 +371,14 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			if (!dataFile)
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected '='\n", filename );
-				engine::FreeFile( dataPointer );
-				return;
+				return false;
 			}
 
 			token = SharedGetToken();
 			if (strcmp( "=", token ))
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected '='\n", filename );
-				engine::FreeFile( dataPointer );
-				return;
+				return false;
 			}
 
 			// get attribute value
@@ -391,8 +386,7 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			if (!dataFile)
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected attribute value\n", filename );
-				engine::FreeFile( dataPointer );
-				return;
+				return false;
 			}
 			token = SharedGetToken();
 
@@ -526,11 +520,269 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 		}
 	}
 
-	engine::FreeFile( dataPointer );
-
 	// free the templates
 	for( BotProfileList::iterator iter = templateList.begin(); iter != templateList.end(); ++iter )
 		delete *iter;
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+//
+// The compiled bot profile database.
+// The file is a BotProfileCacheHeader, followed by its skins, voice banks, profiles, and finally the
+// strings they refer to, as offsets into the string block. Only the finished profiles are stored -
+// templates and inheritance are resolved before it is written.
+//
+#define BOT_PROFILE_CACHE_MAGIC 0xFEEDB0DB
+#define BOT_PROFILE_CACHE_VERSION 1
+
+struct BotProfileCacheHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int sourceLength;									///< length and checksum of the database this was compiled from
+	unsigned int sourceChecksum;
+	float thinkInterval;										///< already subtracted from reaction times
+	unsigned int skinCount;
+	unsigned int voiceBankCount;
+	unsigned int profileCount;
+	unsigned int stringSize;									///< in bytes
+};
+
+struct BotProfileCacheSkin
+{
+	unsigned int name;											///< filename-decorated skin name
+	unsigned int modelname;
+};
+
+struct BotProfileCacheRecord
+{
+	unsigned int name;
+	float aggression;
+	float skill;
+	float teamwork;
+	int weaponPreference[ 16 ];
+	int weaponPreferenceCount;
+	int cost;
+	int skin;													///< custom skins are indices into the cache's skins
+	unsigned int difficultyFlags;
+	int voicePitch;
+	float reactionTime;
+	float attackDelay;
+	int teams;
+	int voiceBank;												///< index into the cache's voice banks
+	unsigned int prefersSilencer;
+};
+
+/**
+ * The cache lives next to the database, in the game directory
+ */
+static void GetBotProfileCacheFilename( const char *filename, char *cacheFilename, int length )
+{
+	snprintf( cacheFilename, length, "%s.cache", filename );
+}
+
+/**
+ * Append a string to the string block, returning its offset
+ */
+static unsigned int AddBotProfileCacheString( std::vector<char> *strings, const char *str )
+{
+	unsigned int offset = strings->size();
+	strings->insert( strings->end(), str, str + strlen( str ) + 1 );
+	return offset;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load the compiled database, which is read in a single piece.
+ * Return false, having loaded nothing, if there is no cache or it was compiled from a different database.
+ */
+bool BotProfileManager::LoadCache( const char *filename, unsigned int sourceLength, unsigned int sourceChecksum )
+{
+	char cacheFilename[ 256 ];
+	GetBotProfileCacheFilename( filename, cacheFilename, sizeof(cacheFilename) );
+
+	SteamFile file( cacheFilename );
+	if (!file.IsValid())
+		return false;
+
+	const BotProfileCacheHeader *header = file.View<BotProfileCacheHeader>();
+	if (header == nullptr ||
+		header->magic != BOT_PROFILE_CACHE_MAGIC ||
+		header->version != BOT_PROFILE_CACHE_VERSION ||
+		header->sourceLength != sourceLength ||
+		header->sourceChecksum != sourceChecksum ||
+		header->thinkInterval != g_flBotFullThinkInterval)
+		return false;
+
+	if (header->skinCount > NumCustomSkins || header->voiceBankCount > 1024 || header->profileCount > 65536)
+		return false;
+
+	const BotProfileCacheSkin *skin = file.View<BotProfileCacheSkin>( header->skinCount );
+	const unsigned int *voiceBank = file.View<unsigned int>( header->voiceBankCount );
+	const BotProfileCacheRecord *record = file.View<BotProfileCacheRecord>( header->profileCount );
+	const char *strings = file.View<char>( header->stringSize );
+
+	if (skin == nullptr || voiceBank == nullptr || record == nullptr || strings == nullptr)
+		return false;
+
+	// every string must be terminated within the string block
+	if (header->stringSize > 0 && strings[ header->stringSize-1 ] != '\000')
+		return false;
+
+	unsigned int i;
+	for( i=0; i<header->skinCount; ++i )
+		if (skin[i].name >= header->stringSize || skin[i].modelname >= header->stringSize)
+			return false;
+
+	for( i=0; i<header->voiceBankCount; ++i )
+		if (voiceBank[i] >= header->stringSize)
+			return false;
+
+	for( i=0; i<header->profileCount; ++i )
+		if (record[i].name >= header->stringSize ||
+			record[i].weaponPreferenceCount < 0 || record[i].weaponPreferenceCount > BotProfile::MAX_WEAPON_PREFS ||
+			record[i].teams < BOT_TEAM_T || record[i].teams > BOT_TEAM_ANY)
+			return false;
+
+	//
+	// The cache is good - skins and voice banks may already be known to us under other indices
+	//
+	int skinIndex[ NumCustomSkins ];
+	for( i=0; i<header->skinCount; ++i )
+		skinIndex[i] = AddCustomSkin( &strings[ skin[i].name ], &strings[ skin[i].modelname ] );
+
+	std::vector<int> voiceBankIndex( header->voiceBankCount );
+	for( i=0; i<header->voiceBankCount; ++i )
+		voiceBankIndex[i] = FindVoiceBankIndex( &strings[ voiceBank[i] ] );
+
+	for( i=0; i<header->profileCount; ++i )
+	{
+		const BotProfileCacheRecord *data = &record[i];
+		BotProfile *profile = new BotProfile;
+
+		profile->m_name = CloneString( &strings[ data->name ] );
+		profile->m_aggression = data->aggression;
+		profile->m_skill = data->skill;
+		profile->m_teamwork = data->teamwork;
+
+		profile->m_weaponPreferenceCount = data->weaponPreferenceCount;
+		for( int w=0; w<data->weaponPreferenceCount; ++w )
+			profile->m_weaponPreference[w] = data->weaponPreference[w];
+
+		profile->m_cost = data->cost;
+
+		if (data->skin >= FirstCustomSkin && data->skin < FirstCustomSkin + (int)header->skinCount)
+			profile->m_skin = skinIndex[ data->skin - FirstCustomSkin ];
+		else
+			profile->m_skin = data->skin;
+
+		profile->m_difficultyFlags = (unsigned char)data->difficultyFlags;
+		profile->m_voicePitch = data->voicePitch;
+		profile->m_reactionTime = data->reactionTime;
+		profile->m_attackDelay = data->attackDelay;
+		profile->m_teams = (BotProfileTeamType)data->teams;
+
+		if (data->voiceBank >= 0 && data->voiceBank < (int)header->voiceBankCount)
+			profile->m_voiceBank = voiceBankIndex[ data->voiceBank ];
+		else
+			profile->m_voiceBank = data->voiceBank;
+
+		profile->m_prefersSilencer = (data->prefersSilencer) ? true : false;
+
+		m_profileList.push_back( profile );
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Write the profiles just parsed from the given database as its compiled cache
+ */
+void BotProfileManager::SaveCache( const char *filename, unsigned int sourceLength, unsigned int sourceChecksum ) const
+{
+	static_assert( BotProfile::MAX_WEAPON_PREFS == sizeof(BotProfileCacheRecord::weaponPreference) / sizeof(int), "cache record must hold every weapon preference" );
+
+	std::vector<char> strings;
+
+	std::vector<BotProfileCacheSkin> skins( m_nextSkin );
+	for( int i=0; i<m_nextSkin; ++i )
+	{
+		skins[i].name = AddBotProfileCacheString( &strings, m_skins[i] );
+		skins[i].modelname = AddBotProfileCacheString( &strings, m_skinModelnames[i] );
+	}
+
+	std::vector<unsigned int> voiceBanks;
+	for( VoiceBankList::const_iterator it = m_voiceBanks.begin(); it != m_voiceBanks.end(); ++it )
+		voiceBanks.push_back( AddBotProfileCacheString( &strings, *it ) );
+
+	std::vector<BotProfileCacheRecord> records;
+	for( BotProfileList::const_iterator iter = m_profileList.begin(); iter != m_profileList.end(); ++iter )
+	{
+		const BotProfile *profile = *iter;
+
+		BotProfileCacheRecord data;
+		memset( &data, 0, sizeof(data) );
+
+		data.name = AddBotProfileCacheString( &strings, profile->m_name );
+		data.aggression = profile->m_aggression;
+		data.skill = profile->m_skill;
+		data.teamwork = profile->m_teamwork;
+
+		data.weaponPreferenceCount = profile->m_weaponPreferenceCount;
+		for( int w=0; w<profile->m_weaponPreferenceCount; ++w )
+			data.weaponPreference[w] = profile->m_weaponPreference[w];
+
+		data.cost = profile->m_cost;
+		data.skin = profile->m_skin;
+		data.difficultyFlags = profile->m_difficultyFlags;
+		data.voicePitch = profile->m_voicePitch;
+		data.reactionTime = profile->m_reactionTime;
+		data.attackDelay = profile->m_attackDelay;
+		data.teams = profile->m_teams;
+		data.voiceBank = profile->m_voiceBank;
+		data.prefersSilencer = profile->m_prefersSilencer;
+
+		records.push_back( data );
+	}
+
+	// keep whatever follows the string block aligned
+	while( strings.size() % 4 )
+		strings.push_back( '\000' );
+
+	BotProfileCacheHeader header;
+	header.magic = BOT_PROFILE_CACHE_MAGIC;
+	header.version = BOT_PROFILE_CACHE_VERSION;
+	header.sourceLength = sourceLength;
+	header.sourceChecksum = sourceChecksum;
+	header.thinkInterval = g_flBotFullThinkInterval;
+	header.skinCount = skins.size();
+	header.voiceBankCount = voiceBanks.size();
+	header.profileCount = records.size();
+	header.stringSize = strings.size();
+
+	BufferedFileWriter file;
+	file.Write( header );
+	file.Write( skins.data(), skins.size() * sizeof(BotProfileCacheSkin) );
+	file.Write( voiceBanks.data(), voiceBanks.size() * sizeof(unsigned int) );
+	file.Write( records.data(), records.size() * sizeof(BotProfileCacheRecord) );
+	file.Write( strings.data(), strings.size() );
+
+	char gameDir[256];
+	engine::GetGameDir( gameDir );
+
+	char cacheFilename[256];
+	GetBotProfileCacheFilename( filename, cacheFilename, sizeof(cacheFilename) );
+
+	char path[512];
+	snprintf( path, sizeof(path), "%s/%s", gameDir, cacheFilename );
+
+	// a read-only game directory just means we parse the text every time
+	if (!file.Save( path ))
+		CONSOLE_ECHO( "WARNING: Unable to write bot profile cache '%s'\n", path );
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -556,6 +808,11 @@ void BotProfileManager::Reset( void )
 		delete *iter;
 
 	m_profileList.clear();
+	m_profileByName.clear();
+
+	for( int d=0; d<NUM_DIFFICULTY_LEVELS; ++d )
+		for( int t=0; t<=BOT_TEAM_ANY; ++t )
+			m_profileByDifficulty[d][t].clear();
 
 	for (int i=0; i<NumCustomSkins; ++i)
 	{
@@ -577,6 +834,77 @@ void BotProfileManager::Reset( void )
 	}
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Index the profiles by name, and by the difficulty levels and teams they may be used for
+ */
+void BotProfileManager::BuildProfileIndex( void )
+{
+	m_profileByName.clear();
+
+	for( int d=0; d<NUM_DIFFICULTY_LEVELS; ++d )
+		for( int t=0; t<=BOT_TEAM_ANY; ++t )
+			m_profileByDifficulty[d][t].clear();
+
+	for( BotProfileList::const_iterator iter = m_profileList.begin(); iter != m_profileList.end(); ++iter )
+	{
+		const BotProfile *profile = *iter;
+
+		m_profileByName[ profile->GetName() ].push_back( profile );
+
+		for( int d=0; d<NUM_DIFFICULTY_LEVELS; ++d )
+		{
+			if (!profile->IsDifficulty( (BotDifficultyType)d ))
+				continue;
+
+			for( int t=0; t<=BOT_TEAM_ANY; ++t )
+				if (profile->IsValidForTeam( (BotProfileTeamType)t ))
+					m_profileByDifficulty[d][t].push_back( profile );
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Given a name, return a profile
+ */
+const BotProfile *BotProfileManager::GetProfile( const char *name, BotProfileTeamType team ) const
+{
+	BotProfileNameIndex::const_iterator found = m_profileByName.find( name );
+	if (found == m_profileByName.end())
+		return nullptr;
+
+	for( BotProfileVector::const_iterator iter = found->second.begin(); iter != found->second.end(); ++iter )
+		if ((*iter)->IsValidForTeam( team ))
+			return *iter;
+
+	return nullptr;
+}
+
+//--------------------------------------------------------------------------------------------------------
+/**
+ * Return the index of the given filename-decorated skin, adding it if needed.
+ * Returns 0 if there is no room for another skin.
+ */
+int BotProfileManager::AddCustomSkin( const char *decoratedName, const char *modelname )
+{
+	int index = GetCustomSkinIndex( decoratedName );
+	if (index > 0)
+		return index;
+
+	if (m_nextSkin >= NumCustomSkins)
+		return 0;
+
+	m_skins[ m_nextSkin ] = CloneString( decoratedName );
+
+	// construct the model filename
+	m_skinModelnames[ m_nextSkin ] = CloneString( modelname );
+	m_skinFilenames[ m_nextSkin ] = new char[ strlen(modelname)*2 + strlen("models/player//.mdl") + 1 ];
+	sprintf( m_skinFilenames[ m_nextSkin ], "models/player/%s/%s.mdl", modelname, modelname );
+
+	return FirstCustomSkin + m_nextSkin++;
+}
+
 //--------------------------------------------------------------------------------------------------------
 /**
  * Returns custom skin name at a particular index
@@ -673,15 +1001,18 @@ int BotProfileManager::FindVoiceBankIndex( const char *filename )
  */
 const BotProfile *BotProfileManager::GetRandomProfile( BotDifficultyType difficulty, BotProfileTeamType team ) const
 {
-	BotProfileList::const_iterator iter;
+	if (difficulty < 0 || difficulty >= NUM_DIFFICULTY_LEVELS || team < BOT_TEAM_T || team > BOT_TEAM_ANY)
+		return nullptr;
+
+	// only the profiles for this difficulty and team are considered
+	const BotProfileVector &candidates = m_profileByDifficulty[ difficulty ][ team ];
+	BotProfileVector::const_iterator iter;
 
 	// count up valid profiles
 	int validCount = 0;
-	for( iter = m_profileList.begin(); iter != m_profileList.end(); ++iter )
+	for( iter = candidates.begin(); iter != candidates.end(); ++iter )
 	{
-		const BotProfile *profile = *iter;
-
-		if (profile->IsDifficulty( difficulty ) && !UTIL_IsNameTaken( profile->GetName() ) && profile->IsValidForTeam( team ))
+		if (!UTIL_IsNameTaken( (*iter)->GetName() ))
 			++validCount;
 	}
 
@@ -690,13 +1021,11 @@ const BotProfile *BotProfileManager::GetRandomProfile( BotDifficultyType difficu
 
 	// select one at random
 	int which = engine::RandomLong( 0, validCount-1 );
-	for( iter = m_profileList.begin(); iter != m_profileList.end(); ++iter )
+	for( iter = candidates.begin(); iter != candidates.end(); ++iter )
 	{
-		const BotProfile *profile = *iter;
-
-		if (profile->IsDifficulty( difficulty ) && !UTIL_IsNameTaken( profile->GetName() ) && profile->IsValidForTeam( team ))
+		if (!UTIL_IsNameTaken( (*iter)->GetName() ))
 			if (which-- == 0)
-				return profile;
+				return *iter;
 	}
 
 	return nullptr;
@@ -17,8 +17,10 @@
 #endif
 
 #include <Platform.h>
+#include <ctype.h>
 #include <list>
 #include <vector>
+#include <unordered_map>
 #include "bot_constants.h"
 
 enum
@@ -109,6 +111,7 @@ private:
 	int m_voiceBank;										///< Index of the BotChatter.db voice bank this profile uses (0 is the default)
 };
 typedef std::list<BotProfile *> BotProfileList;
+typedef std::vector<const BotProfile *> BotProfileVector;
 
 
 inline bool BotProfile::IsDifficulty( BotDifficultyType diff ) const
@@ -167,7 +170,32 @@ inline void BotProfile::Inherit( const BotProfile *parent, const BotProfile *bas
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * The BotProfileManager defines the interface to accessing BotProfiles
+ * Profile names are compared without regard to case, so they are hashed the same way
+ */
+struct BotProfileNameHash
+{
+	size_t operator()( const char *name ) const
+	{
+		// FNV-1a
+		size_t hash = 2166136261u;
+		for( const char *c = name; *c; ++c )
+			hash = (hash ^ (unsigned char)tolower( *c )) * 16777619u;
+
+		return hash;
+	}
+};
+
+struct BotProfileNameEqual
+{
+	bool operator()( const char *a, const char *b ) const		{ return !stricmp( a, b ); }
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The BotProfileManager defines the interface to accessing BotProfiles.
+ * The text database is compiled into a binary cache next to it the first time it is parsed, and
+ * the cache is used instead for as long as the text file's length and checksum match.
  */
 class BotProfileManager
 {
@@ -178,15 +206,7 @@ public:
 	void Init( const char *filename, unsigned int *checksum = nullptr );
 	void Reset( void );
 
-	/// given a name, return a profile
-	const BotProfile *GetProfile( const char *name, BotProfileTeamType team ) const
-	{
-		for( BotProfileList::const_iterator iter = m_profileList.begin(); iter != m_profileList.end(); ++iter )
-			if ( !stricmp( name, (*iter)->GetName() ) && (*iter)->IsValidForTeam( team ) )
-				return *iter;
-
-		return nullptr;
-	}
+	const BotProfile *GetProfile( const char *name, BotProfileTeamType team ) const;		///< given a name, return a profile
 
 	const BotProfileList *GetProfileList( void ) const		{ return &m_profileList; }		///< return list of all profiles
 
@@ -202,8 +222,18 @@ public:
 	int FindVoiceBankIndex( const char *filename );		///< return index of the (custom) bot phrase db, inserting it if needed
 
 protected:
+	bool Parse( const char *filename, const char *dataFile );	///< parse the text database, return false on error
+	bool LoadCache( const char *filename, unsigned int sourceLength, unsigned int sourceChecksum );	///< load the compiled database, if it is up to date
+	void SaveCache( const char *filename, unsigned int sourceLength, unsigned int sourceChecksum ) const;
+	int AddCustomSkin( const char *decoratedName, const char *modelname );	///< return the skin's index, adding it if needed, or 0 if there is no room
+	void BuildProfileIndex( void );
+
 	BotProfileList m_profileList;							///< the list of all bot profiles
 
+	typedef std::unordered_map< const char *, BotProfileVector, BotProfileNameHash, BotProfileNameEqual > BotProfileNameIndex;
+	BotProfileNameIndex m_profileByName;					///< profiles sharing each name, in database order
+	BotProfileVector m_profileByDifficulty[ NUM_DIFFICULTY_LEVELS ][ BOT_TEAM_ANY+1 ];	///< profiles usable at each difficulty, for each team that may ask
+
 	VoiceBankList m_voiceBanks;
 
 	char *m_skins[ NumCustomSkins ];						///< Custom skin names
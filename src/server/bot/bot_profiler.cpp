@@ -0,0 +1,275 @@
+// bot_profiler.cpp
+// Scoped timers and latency histograms for the bot systems
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+
+#include "bot_util.h"
+#include "bot_profiler.h"
+
+
+CBotProfiler TheBotProfiler;
+
+/// the smallest time the histograms tell apart, as a power of two nanoseconds
+static const int minBucketExponent = 7;
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Add a sample, in nanoseconds
+ */
+void BotProfileHistogram::Add( double ns )
+{
+	// each octave is split into four buckets, by the top bits of the mantissa
+	int exponent;
+	double mantissa = frexp( ns, &exponent );
+
+	int which = (exponent - minBucketExponent - 1) * 4 + (int)((mantissa - 0.5) * 8.0);
+
+	if (which < 0)
+		which = 0;
+	else if (which >= NUM_BUCKETS)
+		which = NUM_BUCKETS-1;
+
+	++bucket[ which ];
+	++count;
+	total += ns;
+
+	if (ns > max)
+		max = ns;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+double BotProfileHistogram::GetBucketLimit( int which )
+{
+	return ldexp( 0.5 + 0.125 * (which % 4 + 1), which / 4 + minBucketExponent + 1 );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the time the given fraction of the samples took no longer than, to the nearest bucket
+ */
+double BotProfileHistogram::GetPercentile( float fraction ) const
+{
+	if (count == 0)
+		return 0.0;
+
+	unsigned int wanted = (unsigned int)ceil( fraction * count );
+	unsigned int sum = 0;
+
+	for( int i=0; i<NUM_BUCKETS; ++i )
+	{
+		sum += bucket[i];
+
+		// the last bucket holds everything too long for the others
+		if (sum >= wanted)
+			return (i < NUM_BUCKETS-1 && GetBucketLimit( i ) < max) ? GetBucketLimit( i ) : max;
+	}
+
+	return max;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CBotProfiler::CBotProfiler( void )
+{
+	m_isEnabled = false;
+	Reset();
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CBotProfiler::Reset( void )
+{
+	memset( m_phase, 0, sizeof(m_phase) );
+	memset( m_botPhase, 0, sizeof(m_botPhase) );
+
+	m_startTime = (gpGlobals) ? gpGlobals->time : 0.0f;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Invoked at the start of each frame. Scopes only check a flag, so the cvar is looked at here.
+ */
+void CBotProfiler::Update( void )
+{
+	bool isEnabled = (cv_bot_perf_enable.value > 0.0f);
+
+	// start over each time the profiler is turned on
+	if (isEnabled && !m_isEnabled)
+		Reset();
+
+	m_isEnabled = isEnabled;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CBotProfiler::Record( BotProfilePhase phase, int botIndex, double ns )
+{
+	m_phase[ phase ].Add( ns );
+
+	if (botIndex > 0 && botIndex <= MAX_PLAYERS)
+		m_botPhase[ botIndex ][ phase ].Add( ns );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+const char *CBotProfiler::GetPhaseName( BotProfilePhase phase )
+{
+	static const char *name[ NUM_BOT_PROFILE_PHASES ] =
+	{
+		"think",
+		"upkeep",
+		"update",
+		"path_build",
+		"path_follow",
+		"visibility",
+		"event",
+	};
+
+	return name[ phase ];
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the name of the player at the given index, or nullptr if there is none
+ */
+static const char *GetProfiledBotName( int botIndex )
+{
+	CBaseEntity *player = util::PlayerByIndex( botIndex );
+	if (player == nullptr)
+		return nullptr;
+
+	return STRING( player->v.netname );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+static void PrintHistogram( const char *label, const char *phaseName, const BotProfileHistogram &histogram )
+{
+	CONSOLE_ECHO( "%-16s %-12s %9u %9.2f %9.2f %9.2f %9.2f\n", label, phaseName, histogram.count,
+					0.001 * histogram.total / histogram.count,
+					0.001 * histogram.GetPercentile( 0.5f ),
+					0.001 * histogram.GetPercentile( 0.99f ),
+					0.001 * histogram.max );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Print the percentiles of each phase, and of each bot's phases if 'isPerBot'. Times are in microseconds.
+ */
+void CBotProfiler::Print( bool isPerBot ) const
+{
+	CONSOLE_ECHO( "bot_perf: %s, collecting for %.1f seconds\n", (m_isEnabled) ? "enabled" : "disabled", gpGlobals->time - m_startTime );
+	CONSOLE_ECHO( "%-16s %-12s %9s %9s %9s %9s %9s\n", "", "phase", "count", "mean us", "p50 us", "p99 us", "max us" );
+
+	for( int p=0; p<NUM_BOT_PROFILE_PHASES; ++p )
+	{
+		if (m_phase[p].count)
+			PrintHistogram( "all", GetPhaseName( (BotProfilePhase)p ), m_phase[p] );
+	}
+
+	if (!isPerBot)
+		return;
+
+	for( int b=1; b<=MAX_PLAYERS; ++b )
+	{
+		const char *name = GetProfiledBotName( b );
+
+		for( int p=0; p<NUM_BOT_PROFILE_PHASES; ++p )
+		{
+			if (m_botPhase[b][p].count)
+				PrintHistogram( (name) ? name : "(gone)", GetPhaseName( (BotProfilePhase)p ), m_botPhase[b][p] );
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+static void WriteHistogramCSV( FILE *fp, int botIndex, const char *name, const char *phaseName, const BotProfileHistogram &histogram )
+{
+	fprintf( fp, "%d,\"%s\",%s,%u,%.3f,%.3f,%.3f,%.3f", botIndex, name, phaseName, histogram.count,
+				0.001 * histogram.total / histogram.count,
+				0.001 * histogram.GetPercentile( 0.5f ),
+				0.001 * histogram.GetPercentile( 0.99f ),
+				0.001 * histogram.max );
+
+	for( int i=0; i<BotProfileHistogram::NUM_BUCKETS; ++i )
+		fprintf( fp, ",%u", histogram.bucket[i] );
+
+	fprintf( fp, "\n" );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Write one row for each phase, and for each phase of each bot, with the percentiles and the histogram buckets.
+ * Bot index zero is all bots together. The header of each bucket's column is the upper end of it, in microseconds.
+ */
+bool CBotProfiler::WriteCSV( const char *filename ) const
+{
+	FILE *fp = fopen( filename, "w" );
+	if (fp == nullptr)
+		return false;
+
+	fprintf( fp, "bot,name,phase,count,mean_us,p50_us,p99_us,max_us" );
+	for( int i=0; i<BotProfileHistogram::NUM_BUCKETS; ++i )
+		fprintf( fp, ",%.3f", 0.001 * BotProfileHistogram::GetBucketLimit( i ) );
+	fprintf( fp, "\n" );
+
+	for( int p=0; p<NUM_BOT_PROFILE_PHASES; ++p )
+	{
+		if (m_phase[p].count)
+			WriteHistogramCSV( fp, 0, "all", GetPhaseName( (BotProfilePhase)p ), m_phase[p] );
+	}
+
+	for( int b=1; b<=MAX_PLAYERS; ++b )
+	{
+		const char *name = GetProfiledBotName( b );
+
+		for( int p=0; p<NUM_BOT_PROFILE_PHASES; ++p )
+		{
+			if (m_botPhase[b][p].count)
+				WriteHistogramCSV( fp, b, (name) ? name : "", GetPhaseName( (BotProfilePhase)p ), m_botPhase[b][p] );
+		}
+	}
+
+	fclose( fp );
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * bot_perf [bots | csv [filename] | reset]
+ * Print the bot profiler's percentiles, for all bots or each bot, write them to a .csv file in the game directory,
+ * or start collecting over. Collection is turned on and off with bot_perf_enable.
+ */
+void BotPerf( void )
+{
+	const char *arg = (engine::Cmd_Argc() > 1) ? engine::Cmd_Argv( 1 ) : "";
+
+	if (!stricmp( arg, "reset" ))
+	{
+		TheBotProfiler.Reset();
+		CONSOLE_ECHO( "bot_perf: reset\n" );
+	}
+	else if (!stricmp( arg, "csv" ))
+	{
+		char gameDir[256];
+		engine::GetGameDir( gameDir );
+
+		char filename[512];
+		snprintf( filename, sizeof(filename), "%s/%s", gameDir, (engine::Cmd_Argc() > 2) ? engine::Cmd_Argv( 2 ) : "bot_perf.csv" );
+
+		if (TheBotProfiler.WriteCSV( filename ))
+			CONSOLE_ECHO( "bot_perf: wrote '%s'\n", filename );
+		else
+			CONSOLE_ECHO( "ERROR: Unable to write '%s'.\n", filename );
+	}
+	else
+	{
+		TheBotProfiler.Print( !stricmp( arg, "bots" ) );
+
+		if (!TheBotProfiler.IsEnabled())
+			CONSOLE_ECHO( "bot_perf: set bot_perf_enable to 1 to collect times\n" );
+	}
+}
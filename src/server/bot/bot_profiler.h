@@ -0,0 +1,116 @@
+// bot_profiler.h
+// Scoped timers and latency histograms for the bot systems
+
+#ifndef _BOT_PROFILER_H_
+#define _BOT_PROFILER_H_
+
+#include <chrono>
+
+#include "cdll_dll.h"
+
+class CBaseEntity;
+
+/**
+ * The parts of the bot systems that are timed
+ */
+enum BotProfilePhase
+{
+	BOT_PROFILE_THINK,										///< all bots' thinking for one frame
+	BOT_PROFILE_UPKEEP,										///< a bot's Upkeep(), run every command interval
+	BOT_PROFILE_UPDATE,										///< a bot's Update(), run on its full thinks
+	BOT_PROFILE_PATH_BUILD,									///< the path searches run on the main thread each frame
+	BOT_PROFILE_PATH_FOLLOW,								///< one step of CNavPathFollower
+	BOT_PROFILE_VISIBILITY,									///< a bot checking whether it can see a player
+	BOT_PROFILE_EVENT,										///< delivering one game event
+
+	NUM_BOT_PROFILE_PHASES
+};
+
+/**
+ * A histogram of how long something took, in quarter-octave buckets from 128 ns up to about 130 ms
+ */
+struct BotProfileHistogram
+{
+	enum { NUM_BUCKETS = 80 };
+
+	void Add( double ns );
+	double GetPercentile( float fraction ) const;			///< return an upper bound on the given fraction of the samples, in ns
+	static double GetBucketLimit( int bucket );				///< return the upper end of the given bucket, in ns
+
+	unsigned int bucket[ NUM_BUCKETS ];
+	unsigned int count;
+	double total;											///< in ns
+	double max;												///< in ns
+};
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The CBotProfiler collects the times recorded by CBotProfileScopes into a histogram for each phase,
+ * and another for each phase of each bot.
+ * It is always compiled in, and does nothing but test a flag while bot_perf_enable is off.
+ * Times may only be recorded on the main thread.
+ */
+class CBotProfiler
+{
+public:
+	CBotProfiler( void );
+
+	bool IsEnabled( void ) const					{ return m_isEnabled; }
+	void Update( void );									///< invoked at the start of each frame to follow bot_perf_enable
+
+	void Record( BotProfilePhase phase, int botIndex, double ns );	///< add a time for the given phase, and bot if 'botIndex' is nonzero
+	void Reset( void );
+
+	void Print( bool isPerBot ) const;						///< print percentiles for each phase, and each bot if 'isPerBot'
+	bool WriteCSV( const char *filename ) const;			///< write the histograms to a spreadsheet
+
+	static const char *GetPhaseName( BotProfilePhase phase );
+
+private:
+	bool m_isEnabled;
+	float m_startTime;										///< when collection started
+
+	BotProfileHistogram m_phase[ NUM_BOT_PROFILE_PHASES ];
+	BotProfileHistogram m_botPhase[ MAX_PLAYERS+1 ][ NUM_BOT_PROFILE_PHASES ];	///< indexed by player index
+};
+
+extern CBotProfiler TheBotProfiler;
+
+extern void BotPerf( void );								///< "bot_perf" console command
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Time the scope it is declared in, if the profiler is enabled
+ */
+class CBotProfileScope
+{
+public:
+	CBotProfileScope( BotProfilePhase phase, int botIndex = 0 )
+	{
+		m_isTiming = TheBotProfiler.IsEnabled();
+
+		if (m_isTiming)
+		{
+			m_phase = phase;
+			m_botIndex = botIndex;
+			m_start = std::chrono::steady_clock::now();
+		}
+	}
+
+	~CBotProfileScope()
+	{
+		if (m_isTiming)
+		{
+			std::chrono::duration< double, std::nano > elapsed = std::chrono::steady_clock::now() - m_start;
+			TheBotProfiler.Record( m_phase, m_botIndex, elapsed.count() );
+		}
+	}
+
+private:
+	bool m_isTiming;
+	BotProfilePhase m_phase;
+	int m_botIndex;
+	std::chrono::steady_clock::time_point m_start;
+};
+
+#endif // _BOT_PROFILER_H_
@@ -12,6 +12,7 @@
 #include "cbase.h"
 #include "player.h"
 #include "gamerules.h"
+#include "player_snapshot.h"
 
 #include "bot.h"
 #include "bot_util.h"
@@ -313,24 +314,19 @@ CBasePlayer *UTIL_GetClosestPlayer( const Vector *pos, float *distance, CBasePla
 	CBasePlayer *closePlayer = nullptr;
 	float closeDistSq = 999999999999.9f;
 
-	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
+	for( int i=0; i<g_PlayerSnapshot.GetCount(); ++i )
 	{
-		CBasePlayer *player = static_cast<CBasePlayer *>( util::PlayerByIndex( i ) );
-
-		if (!IsEntityValid( player ))
+		if (!g_PlayerSnapshot.IsAlive( i ))
 			continue;
 
-		if (player == ignore)
-			continue;
-
-		if (!player->IsAlive())
+		if (g_PlayerSnapshot.GetPlayer( i ) == ignore)
 			continue;
 
-		float distSq = (player->v.origin - *pos).LengthSquared();
+		float distSq = (g_PlayerSnapshot.GetOrigin( i ) - *pos).LengthSquared();
 		if (distSq < closeDistSq)
 		{
 			closeDistSq = distSq;
-			closePlayer = static_cast<CBasePlayer *>( player );
+			closePlayer = g_PlayerSnapshot.GetPlayer( i );
 		}
 	}
 	
@@ -350,27 +346,22 @@ CBasePlayer *UTIL_GetClosestPlayer( const Vector *pos, int team, float *distance
 	CBasePlayer *closePlayer = nullptr;
 	float closeDistSq = 999999999999.9f;
 
-	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
+	for( int i=0; i<g_PlayerSnapshot.GetCount(); ++i )
 	{
-		CBasePlayer *player = static_cast<CBasePlayer *>( util::PlayerByIndex( i ) );
-
-		if (!IsEntityValid( player ))
+		if (!g_PlayerSnapshot.IsAlive( i ))
 			continue;
 
-		if (player == ignore)
+		if (g_PlayerSnapshot.GetTeam( i ) != team)
 			continue;
 
-		if (!player->IsAlive())
+		if (g_PlayerSnapshot.GetPlayer( i ) == ignore)
 			continue;
 
-		if (player->TeamNumber() != team)
-			continue;
-
-		float distSq = (player->v.origin - *pos).LengthSquared();
+		float distSq = (g_PlayerSnapshot.GetOrigin( i ) - *pos).LengthSquared();
 		if (distSq < closeDistSq)
 		{
 			closeDistSq = distSq;
-			closePlayer = static_cast<CBasePlayer *>( player );
+			closePlayer = g_PlayerSnapshot.GetPlayer( i );
 		}
 	}
 	
@@ -385,28 +376,26 @@ CBasePlayer *UTIL_GetClosestEnemyPlayer( CBasePlayer *self, float *distance )
 	CBasePlayer *closePlayer = nullptr;
 	float closeDistSq = 999999999999.9f;
 
-	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
+	for( int i=0; i<g_PlayerSnapshot.GetCount(); ++i )
 	{
-		CBasePlayer *player = static_cast<CBasePlayer *>( util::PlayerByIndex( i ) );
-
-		if (!IsEntityValid( player ))
+		if (!g_PlayerSnapshot.IsAlive( i ))
 			continue;
 
+		CBasePlayer *player = g_PlayerSnapshot.GetPlayer( i );
+
 		if (player == self)
 			continue;
 
-		if (!player->IsAlive())
+		// only ask the game rules about players that would be closer
+		float distSq = (g_PlayerSnapshot.GetOrigin( i ) - self->v.origin).LengthSquared();
+		if (distSq >= closeDistSq)
 			continue;
 
 		if (g_pGameRules->PlayerRelationship(self, player) > GR_NOTTEAMMATE)
 			continue;
 
-		float distSq = (player->v.origin - self->v.origin).LengthSquared();
-		if (distSq < closeDistSq)
-		{
-			closeDistSq = distSq;
-			closePlayer = static_cast<CBasePlayer *>( player );
-		}
+		closeDistSq = distSq;
+		closePlayer = player;
 	}
 	
 	if (distance)
@@ -52,6 +52,15 @@ extern cvar_t cv_bot_zombie;
 extern cvar_t cv_bot_defer_to_human;
 extern cvar_t cv_bot_chatter;
 extern cvar_t cv_bot_profile_db;
+extern cvar_t cv_bot_nav_budget_us;
+extern cvar_t cv_bot_nav_threads;
+extern cvar_t cv_bot_nav_visibility;
+extern cvar_t cv_bot_nav_smooth_paths;
+extern cvar_t cv_bot_think_max_per_frame;
+extern cvar_t cv_bot_think_lod;
+extern cvar_t cv_bot_think_lod_range;
+extern cvar_t cv_bot_event_cull;
+extern cvar_t cv_bot_perf_enable;
 
 #ifdef TERRORSTRIKE
 extern cvar_t cv_zombie_near_spawn;
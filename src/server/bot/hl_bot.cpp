@@ -18,8 +18,12 @@
 #include "bot.h"
 #include "bot_util.h"
 #include "bot_profile.h"
+#include "bot_profiler.h"
+#include "nav_area.h"
 
 #include "hl_bot.h"
+#include "visibility_cache.h"
+#include "player_snapshot.h"
 
 
 CHLBot::CHLBot(Entity* containingEntity) : CBot(containingEntity)
@@ -110,8 +114,47 @@ bool CHLBot::IsVisible(const Vector* pos, bool testFOV = false)
 }
 
 
+/*
+The nav area the player is standing in, or null if we can't be sure of it.
+The area visibility table only holds for eyes at standing or crouching height over the area.
+*/
+static CNavArea* GetStandingArea(CBasePlayer* player)
+{
+    if ((player->v.flags & FL_ONGROUND) == 0)
+    {
+        return nullptr;
+    }
+
+    CNavArea* area = nullptr;
+
+    for (int i = 0; i < g_PlayerSnapshot.GetCount(); i++)
+    {
+        if (g_PlayerSnapshot.GetPlayer(i) == player)
+        {
+            area = g_PlayerSnapshot.GetNavArea(i);
+            break;
+        }
+    }
+
+    if (area == nullptr || !area->IsOverlapping(&player->v.origin))
+    {
+        return nullptr;
+    }
+
+    /* Standing on something above the mesh, like a crate. */
+    if (fabsf(player->v.absmin.z - area->GetZ(&player->v.origin)) > StepHeight)
+    {
+        return nullptr;
+    }
+
+    return area;
+}
+
+
 bool CHLBot::IsVisible(CBasePlayer* player, bool testFOV = false, unsigned char* visParts = nullptr)
 {
+    CBotProfileScope profileScope(BOT_PROFILE_VISIBILITY, v.GetIndex());
+
     if (!player->IsPlayer() || !player->IsAlive())
     {
         return false;
@@ -146,18 +189,19 @@ bool CHLBot::IsVisible(CBasePlayer* player, bool testFOV = false, unsigned char*
 		return false;
 	}
 
-    TraceResult tr;
-    auto start = GetGunPosition();
-    auto end = player->BodyTarget();
-
-    util::TraceLine(start, end, util::ignore_monsters, this, &tr);
+    /* Bots react slowly enough that a line of sight a few frames old will do. */
+    auto maxAge = kVisibilityMaxAge;
 
-    if (tr.flFraction != 1.0f && tr.pHit != &player->v)
+    /*
+    The areas' visibility can miss a sightline, so it only lets a line of sight that is almost
+    certainly blocked go staler. The player stepping into an area we can see makes it fresh again.
+    */
+    if (!TheNavAreaVisibility.IsPotentiallyVisible(GetStandingArea(this), GetStandingArea(player)))
     {
-        return false;
+        maxAge = kHiddenVisibilityMaxAge;
     }
 
-    return true;
+    return g_VisibilityCache.IsVisible(this, player, maxAge);
 }
 
 
@@ -13,6 +13,9 @@
 class CHLBot : public CBot
 {
 public:
+	static constexpr float kVisibilityMaxAge = 0.1F;
+	static constexpr float kHiddenVisibilityMaxAge = 0.5F;	// for players in areas that can't be seen from ours
+
 	CHLBot(Entity* containingEntity);
 
 	bool Initialize(const BotProfile* profile) override;
@@ -17,8 +17,11 @@
 #include "bot.h"
 #include "bot_manager.h"
 #include "nav_area.h"
+#include "nav_path.h"
+#include "nav_influence.h"
 #include "bot_util.h"
 #include "bot_profile.h"
+#include "bot_profiler.h"
 
 #include "hl_bot.h"
 #include "hl_bot_manager.h"
@@ -46,6 +49,15 @@ cvar_t cv_bot_zombie					= {"cv_bot_zombie",					"0",			FCVAR_SERVER};
 cvar_t cv_bot_defer_to_human			= {"cv_bot_defer_to_human",			"0",			FCVAR_SERVER};
 cvar_t cv_bot_chatter					= {"cv_bot_chatter",				"0",			FCVAR_SERVER};
 cvar_t cv_bot_profile_db				= {"cv_bot_profile_db",				"BotProfile.db",FCVAR_SERVER};
+cvar_t cv_bot_nav_budget_us				= {"bot_nav_budget_us",				"500",			FCVAR_SERVER};
+cvar_t cv_bot_nav_threads				= {"bot_nav_threads",				"0",			FCVAR_SERVER};
+cvar_t cv_bot_nav_visibility			= {"bot_nav_visibility",			"0",			FCVAR_SERVER};
+cvar_t cv_bot_nav_smooth_paths			= {"bot_nav_smooth_paths",			"1",			FCVAR_SERVER};
+cvar_t cv_bot_think_max_per_frame		= {"bot_think_max_per_frame",		"0",			FCVAR_SERVER};
+cvar_t cv_bot_think_lod					= {"bot_think_lod",					"1",			FCVAR_SERVER};
+cvar_t cv_bot_think_lod_range			= {"bot_think_lod_range",			"1500",			FCVAR_SERVER};
+cvar_t cv_bot_event_cull				= {"bot_event_cull",				"1",			FCVAR_SERVER};
+cvar_t cv_bot_perf_enable				= {"bot_perf_enable",				"0",			FCVAR_SERVER};
 
 
 CHLBotManager::CHLBotManager()
@@ -131,6 +143,8 @@ void CHLBotManager::ServerActivate()
 	TheBotProfiles->Init(cv_bot_profile_db.string);
 
 	m_NextQuotaCheckTime = gpGlobals->time + 3.0f;
+
+	TheNavInfluenceMap.Reset();
 }
 
 
@@ -212,4 +226,25 @@ void Bot_RegisterCvars()
 	engine::CVarRegister(&cv_bot_defer_to_human);
 	engine::CVarRegister(&cv_bot_chatter);
 	engine::CVarRegister(&cv_bot_profile_db);
+	engine::CVarRegister(&cv_bot_nav_budget_us);
+	engine::CVarRegister(&cv_bot_nav_threads);
+	engine::CVarRegister(&cv_bot_nav_visibility);
+	engine::CVarRegister(&cv_bot_nav_smooth_paths);
+	engine::CVarRegister(&cv_bot_think_max_per_frame);
+	engine::CVarRegister(&cv_bot_think_lod);
+	engine::CVarRegister(&cv_bot_think_lod_range);
+	engine::CVarRegister(&cv_bot_event_cull);
+	engine::CVarRegister(&cv_bot_perf_enable);
+
+	engine::AddServerCommand("bot_nav_bench", NavBenchmarkPathfind);
+	engine::AddServerCommand("bot_nav_stats", NavPrintPathQueueStats);
+	engine::AddServerCommand("bot_nav_build_routes", NavBuildRouteTable);
+	engine::AddServerCommand("bot_nav_convert", ConvertNavigationMap);
+	engine::AddServerCommand("bot_nav_bench_load", NavBenchmarkLoad);
+	engine::AddServerCommand("bot_nav_bench_grid", NavBenchmarkGrid);
+	engine::AddServerCommand("bot_nav_bench_spots", NavBenchmarkSpots);
+	engine::AddServerCommand("bot_nav_analyze", NavAnalyze);
+	engine::AddServerCommand("bot_think_stats", BotPrintThinkStats);
+	engine::AddServerCommand("bot_event_stats", BotPrintEventStats);
+	engine::AddServerCommand("bot_perf", BotPerf);
 }
@@ -8,6 +8,8 @@
 #include <list>
 #include <vector>
 #include <algorithm>
+#include <set>
+#include <map>
 
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -28,6 +30,8 @@
 #include "player.h"
 #include "gamerules.h"
 #include "bot_util.h"
+#include "perf_counter.h"
+#include "player_snapshot.h"
 
 #ifdef CSTRIKE
 #include "cs_bot.h"
@@ -41,6 +45,8 @@
 #include "nav.h"
 #include "nav_node.h"
 #include "nav_area.h"
+#include "nav_influence.h"
+#include "nav_spot_index.h"
 
 #include "pm_shared.h" // for OBS_ROAMING
 
@@ -51,9 +57,6 @@ NavAreaList TheNavAreaList;
 
 NavLadderList TheNavLadderList;
 
-unsigned int CNavArea::m_masterMarker = 1;
-CNavArea *CNavArea::m_openList = nullptr;
-
 bool CNavArea::m_isReset = false;
 static float lastDrawTimestamp = 0.0f;
 
@@ -86,6 +89,7 @@ static void buildGoodSizedList( void )
 HidingSpotList TheHidingSpotList;
 unsigned int HidingSpot::m_nextID = 1;
 unsigned int HidingSpot::m_masterMarker = 0;
+unsigned int HidingSpot::m_changeCount = 0;
 
 void DestroyHidingSpots( void )
 {
@@ -98,6 +102,7 @@ void DestroyHidingSpots( void )
 	}
 
 	HidingSpot::m_nextID = 0;
+	++HidingSpot::m_changeCount;
 
 	// free all the HidingSpots
 	for( HidingSpotList::iterator iter = TheHidingSpotList.begin(); iter != TheHidingSpotList.end(); ++iter )
@@ -114,6 +119,7 @@ HidingSpot::HidingSpot( void )
 	m_pos = Vector( 0, 0, 0 );
 	m_id = 0;
 	m_flags = 0;
+	++m_changeCount;
 
 	TheHidingSpotList.push_back( this );
 }
@@ -126,22 +132,24 @@ HidingSpot::HidingSpot( const Vector *pos, unsigned char flags )
 	m_pos = *pos;
 	m_id = m_nextID++;
 	m_flags = flags;
+	++m_changeCount;
 
 	TheHidingSpotList.push_back( this );
 }
 
-void HidingSpot::Save( int fd, unsigned int version ) const
+void HidingSpot::Save( BufferedFileWriter *file, unsigned int version ) const
 {
-	_write( fd, &m_id, sizeof(unsigned int) );
-	_write( fd, &m_pos, 3 * sizeof(float) );
-	_write( fd, &m_flags, sizeof(unsigned char) );
+	file->Write( &m_id, sizeof(unsigned int) );
+	file->Write( &m_pos, 3 * sizeof(float) );
+	file->Write( &m_flags, sizeof(unsigned char) );
 }
 
 void HidingSpot::Load( SteamFile *file, unsigned int version )
 {
-	file->Read( &m_id, sizeof(unsigned int) );
+	file->Read( &m_id );
 	file->Read( &m_pos, 3 * sizeof(float) );
-	file->Read( &m_flags, sizeof(unsigned char) );
+	file->Read( &m_flags );
+	++m_changeCount;
 
 	// update next ID to avoid ID collisions by later spots
 	if (m_id >= m_nextID)
@@ -171,17 +179,11 @@ HidingSpot *GetHidingSpotByID( unsigned int id )
  */
 void CNavArea::Initialize( void )
 {
-	m_marker = 0;
-	m_parent = nullptr;
-	m_parentHow = GO_NORTH;
 	m_attributeFlags = 0;
 	m_place = 0;
 
 	for ( int i=0; i<MAX_AREA_TEAMS; ++i )
 	{
-		m_danger[i] = 0.0f;
-		m_dangerTimestamp[i] = 0.0f;
-
 		m_clearedTimestamp[i] = 0.0f;
 	}
 
@@ -192,6 +194,13 @@ void CNavArea::Initialize( void )
 
 	m_prevHash = nullptr;
 	m_nextHash = nullptr;
+
+	TheNavAreaGraph.Invalidate();
+	m_graphIndex = 0;
+
+	// the visibility table doesn't know about us
+	TheNavAreaVisibility.Reset();
+	m_visIndex = 0;
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -297,6 +306,10 @@ CNavArea::CNavArea( CNavNode *nwNode, CNavNode *neNode, CNavNode *seNode, CNavNo
  */
 CNavArea::~CNavArea()
 {
+	// the search graph may still refer to us
+	TheNavAreaGraph.Invalidate();
+	TheNavAreaVisibility.Reset();
+
 	// if we are resetting the system, don't bother cleaning up - all areas are being destroyed
 	if (m_isReset)
 		return;
@@ -335,6 +348,8 @@ CNavArea::~CNavArea()
  */
 void CNavArea::OnDestroyNotify( CNavArea *dead )
 {
+	TheNavAreaGraph.Invalidate();
+
 	NavConnect con;
 	con.area = dead;
 	for( int d=0; d<NUM_DIRECTIONS; ++d )
@@ -349,6 +364,8 @@ void CNavArea::OnDestroyNotify( CNavArea *dead )
  */
 void CNavArea::ConnectTo( CNavArea *area, NavDirType dir )
 {
+	TheNavAreaGraph.Invalidate();
+
 	// check if already connected
 	for( NavConnectList::iterator iter = m_connect[ dir ].begin(); iter != m_connect[ dir ].end(); ++iter )
 		if ((*iter).area == area)
@@ -368,6 +385,8 @@ void CNavArea::ConnectTo( CNavArea *area, NavDirType dir )
  */
 void CNavArea::Disconnect( CNavArea *area )
 {
+	TheNavAreaGraph.Invalidate();
+
 	NavConnect connect;
 	connect.area = area;
 
@@ -382,6 +401,9 @@ void CNavArea::Disconnect( CNavArea *area )
  */
 void CNavArea::FinishMerge( CNavArea *adjArea )
 {
+	// the grid holds a copy of our extent
+	TheNavAreaGrid.RemoveNavArea( this );
+
 	// update extent
 	m_extent.lo = *m_node[ NORTH_WEST ]->GetPosition();
 	m_extent.hi = *m_node[ SOUTH_EAST ]->GetPosition();
@@ -393,6 +415,8 @@ void CNavArea::FinishMerge( CNavArea *adjArea )
 	m_neZ = m_node[ NORTH_EAST ]->GetPosition()->z;
 	m_swZ = m_node[ SOUTH_WEST ]->GetPosition()->z;
 
+	TheNavAreaGrid.AddNavArea( this );
+
 	// reassign the adjacent area's internal nodes to the final area
 	adjArea->AssignNodes( this );
 
@@ -410,6 +434,8 @@ void CNavArea::FinishMerge( CNavArea *adjArea )
  */
 void CNavArea::MergeAdjacentConnections( CNavArea *adjArea )
 {
+	TheNavAreaGraph.Invalidate();
+
 	// merge adjacency links - we gain all the connections that adjArea had
 	NavConnectList::iterator iter;
 	int dir;
@@ -478,7 +504,6 @@ void CNavArea::MergeAdjacentConnections( CNavArea *adjArea )
 			}
 		}
 	}
-
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -931,6 +956,9 @@ bool CNavArea::MergeEdit( CNavArea *adj )
 		return false;
 
 	Extent origExtent = m_extent;
+
+	// the grid holds a copy of our extent
+	TheNavAreaGrid.RemoveNavArea( this );
 	
 	// update extent
 	if (m_extent.lo.x > adj->m_extent.lo.x || m_extent.lo.y > adj->m_extent.lo.y)
@@ -953,6 +981,8 @@ bool CNavArea::MergeEdit( CNavArea *adj )
 	else
 		m_swZ = GetZ( m_extent.lo.x, m_extent.hi.y );
 
+	TheNavAreaGrid.AddNavArea( this );
+
 	// merge adjacency links - we gain all the connections that adjArea had
 	MergeAdjacentConnections( adj );
 
@@ -982,6 +1012,8 @@ void CleanupApproachAreaAnalysisPrep( void )
  */
 void DestroyLadders( void )
 {
+	TheNavAreaGraph.Invalidate();
+
 	while( !TheNavLadderList.empty() )
 	{
 		CNavLadder *ladder = TheNavLadderList.front();
@@ -1013,6 +1045,7 @@ void DestroyNavigationMap( void )
 
 	// destroy all hiding spots
 	DestroyHidingSpots();
+	TheHidingSpotIndex.Reset();
 
 	// destroy navigation nodes created during map learning
 	CNavNode *node, *next;
@@ -1025,6 +1058,11 @@ void DestroyNavigationMap( void )
 
 	// reset the grid
 	TheNavAreaGrid.Reset();
+
+	// discard the search graph
+	TheNavAreaGraph.Reset();
+	TheNavRouteTable.Reset();
+	TheNavAreaVisibility.Reset();
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -1155,113 +1193,343 @@ inline CNavArea *findJumpDownArea( const Vector *fromPos, NavDirType dir )
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Define connections between adjacent generated areas
+ * Records how long each phase of navigation mesh generation and analysis takes
  */
-void ConnectGeneratedAreas( void )
+class NavGenerationReport
 {
-	CONSOLE_ECHO( "  Connecting navigation areas...\n" );
+public:
+	NavGenerationReport( void )		{ m_phaseCount = 0; m_startTime = 0.0; }
 
-	for( NavAreaList::iterator iter = TheNavAreaList.begin(); iter != TheNavAreaList.end(); ++iter )
+	void StartPhase( const char *name );		///< begin timing the named phase
+	void FinishPhase( void );					///< stop timing the current phase
+	void Print( const char *title ) const;		///< print the time taken by each phase
+
+private:
+	enum { MAX_PHASES = 16 };
+
+	struct Phase
 	{
-		CNavArea *area = *iter;
+		const char *name;
+		double elapsed;
+		int areaCount;								///< number of areas when the phase finished
+	};
 
-		// scan along edge nodes, stepping one node over into the next area
-		// for now, only use bi-directional connections
+	Phase m_phase[ MAX_PHASES ];
+	int m_phaseCount;
 
-		// north edge
-		CNavNode *node;
-		for( node = area->m_node[ NORTH_WEST ]; node != area->m_node[ NORTH_EAST ]; node = node->GetConnectedNode( EAST ) )
-		{
-			CNavNode *adj = node->GetConnectedNode( NORTH );
+	CPerformanceCounter m_counter;
+	double m_startTime;
+};
 
-			if (adj && adj->GetArea() && adj->GetConnectedNode( SOUTH ) == node)
-			{
-				area->ConnectTo( adj->GetArea(), NORTH );
-			}
-			else
-			{
-				CNavArea *downArea = findJumpDownArea( node->GetPosition(), NORTH );
-				if (downArea && downArea != area)
-					area->ConnectTo( downArea, NORTH );
-			}
-		}
+void NavGenerationReport::StartPhase( const char *name )
+{
+	CONSOLE_ECHO( "  %s...\n", name );
+
+	if (m_phaseCount < MAX_PHASES)
+		m_phase[ m_phaseCount ].name = name;
+
+	m_startTime = m_counter.GetCurTime();
+}
+
+void NavGenerationReport::FinishPhase( void )
+{
+	if (m_phaseCount >= MAX_PHASES)
+		return;
+
+	m_phase[ m_phaseCount ].elapsed = m_counter.GetCurTime() - m_startTime;
+	m_phase[ m_phaseCount ].areaCount = TheNavAreaList.size();
+	++m_phaseCount;
+}
+
+void NavGenerationReport::Print( const char *title ) const
+{
+	double total = 0.0;
+
+	CONSOLE_ECHO( "%s:\n", title );
+
+	for( int i=0; i<m_phaseCount; ++i )
+	{
+		CONSOLE_ECHO( "  %-24s %10.2f ms  %6d areas\n", m_phase[i].name, 1000.0 * m_phase[i].elapsed, m_phase[i].areaCount );
+		total += m_phase[i].elapsed;
+	}
+
+	CONSOLE_ECHO( "  %-24s %10.2f ms\n", "total", 1000.0 * total );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Copy the area list into an array, so it can be split into partitions
+ */
+static void GetNavAreaArray( std::vector< CNavArea * > *areas )
+{
+	areas->assign( TheNavAreaList.begin(), TheNavAreaList.end() );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Invoke 'func( area, index )' for every area in the given array, splitting the array into one contiguous
+ * partition per worker thread. These phases run while nothing else touches the mesh, and 'func' may only
+ * write to data belonging to its own area (or its own slot in an output array indexed by 'index').
+ * Engine functions (traces, entity lookups) are not thread-safe and must not be called from 'func'.
+ */
+template < typename Functor >
+void ForEachAreaInPartition( const std::vector< CNavArea * > *areas, Functor *func, int first, int last )
+{
+	for( int i=first; i<last; ++i )
+		(*func)( (*areas)[i], i );
+}
 
-		// west edge
-		for( node = area->m_node[ NORTH_WEST ]; node != area->m_node[ SOUTH_WEST ]; node = node->GetConnectedNode( SOUTH ) )
+template < typename Functor >
+void ForEachAreaInParallel( const std::vector< CNavArea * > &areas, Functor &func )
+{
+	enum { MAX_GENERATION_THREADS = 8, MIN_AREAS_PER_THREAD = 64 };
+
+	int threadCount = std::thread::hardware_concurrency();
+	if (threadCount > MAX_GENERATION_THREADS)
+		threadCount = MAX_GENERATION_THREADS;
+
+	int maxThreadCount = areas.size() / MIN_AREAS_PER_THREAD;
+	if (threadCount > maxThreadCount)
+		threadCount = maxThreadCount;
+
+	if (threadCount <= 1)
+	{
+		ForEachAreaInPartition( &areas, &func, 0, areas.size() );
+		return;
+	}
+
+	// the calling thread processes the last partition itself
+	std::vector< std::thread > workers;
+	workers.reserve( threadCount - 1 );
+
+	const int partitionSize = (areas.size() + threadCount - 1) / threadCount;
+
+	for( int t=0; t<threadCount; ++t )
+	{
+		int first = t * partitionSize;
+		int last = first + partitionSize;
+		if (last > (int)areas.size())
+			last = areas.size();
+
+		if (t < threadCount - 1)
+			workers.push_back( std::thread( &ForEachAreaInPartition< Functor >, &areas, &func, first, last ) );
+		else
+			ForEachAreaInPartition( &areas, &func, first, last );
+	}
+
+	for( unsigned int t=0; t<workers.size(); ++t )
+		workers[t].join();
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A connection found while scanning the edges of a generated area.
+ * If 'adjArea' is nullptr, the node had no neighbor across the edge and a "jump down" trace is needed.
+ */
+struct NavConnectRequest
+{
+	const CNavNode *node;
+	CNavArea *adjArea;
+	NavDirType dir;
+};
+
+static inline void AddConnectRequest( std::vector< NavConnectRequest > *requests, const CNavNode *node, CNavNode *adj, NavDirType dir )
+{
+	NavConnectRequest request;
+
+	request.node = node;
+	request.adjArea = (adj && adj->GetArea() && adj->GetConnectedNode( OppositeDirection( dir ) ) == node) ? adj->GetArea() : nullptr;
+	request.dir = dir;
+
+	requests->push_back( request );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Walk the edge nodes of a generated area, stepping one node over into the next area.
+ * This only reads the node grid, so it is safe to run in parallel.
+ */
+void ScanGeneratedAreaEdges( const CNavArea *area, std::vector< NavConnectRequest > *requests )
+{
+	// for now, only use bi-directional connections
+
+	// north edge
+	CNavNode *node;
+	for( node = area->m_node[ NORTH_WEST ]; node != area->m_node[ NORTH_EAST ]; node = node->GetConnectedNode( EAST ) )
+		AddConnectRequest( requests, node, node->GetConnectedNode( NORTH ), NORTH );
+
+	// west edge
+	for( node = area->m_node[ NORTH_WEST ]; node != area->m_node[ SOUTH_WEST ]; node = node->GetConnectedNode( SOUTH ) )
+		AddConnectRequest( requests, node, node->GetConnectedNode( WEST ), WEST );
+
+	// south edge - this edge's nodes are actually part of adjacent areas
+	// move one node north, and scan west to east
+	/// @todo This allows one-node-wide areas - do we want this?
+	node = area->m_node[ SOUTH_WEST ];
+	node = node->GetConnectedNode( NORTH );
+	if (node)
+	{
+		CNavNode *end = area->m_node[ SOUTH_EAST ]->GetConnectedNode( NORTH );
+		/// @todo Figure out why cs_backalley gets a nullptr node in here...
+		for( ; node && node != end; node = node->GetConnectedNode( EAST ) )
+			AddConnectRequest( requests, node, node->GetConnectedNode( SOUTH ), SOUTH );
+	}
+
+	// east edge - this edge's nodes are actually part of adjacent areas
+	node = area->m_node[ NORTH_EAST ];
+	node = node->GetConnectedNode( WEST );
+	if (node)
+	{
+		CNavNode *end = area->m_node[ SOUTH_EAST ]->GetConnectedNode( WEST );
+		for( ; node && node != end; node = node->GetConnectedNode( SOUTH ) )
+			AddConnectRequest( requests, node, node->GetConnectedNode( EAST ), EAST );
+	}
+}
+
+class ScanGeneratedAreaEdgesFunctor
+{
+public:
+	ScanGeneratedAreaEdgesFunctor( std::vector< std::vector< NavConnectRequest > > *requests ) : m_requests( requests ) { }
+
+	void operator() ( CNavArea *area, int index )
+	{
+		ScanGeneratedAreaEdges( area, &(*m_requests)[ index ] );
+	}
+
+private:
+	std::vector< std::vector< NavConnectRequest > > *m_requests;
+};
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Define connections between adjacent generated areas.
+ * The node grid is scanned in parallel, then all of the "jump down" traces are issued together on this thread.
+ */
+void ConnectGeneratedAreas( void )
+{
+	std::vector< CNavArea * > areas;
+	GetNavAreaArray( &areas );
+
+	std::vector< std::vector< NavConnectRequest > > requests( areas.size() );
+	ScanGeneratedAreaEdgesFunctor scan( &requests );
+	ForEachAreaInParallel( areas, scan );
+
+	// connect in the same order as the edges were scanned, tracing only where there was no adjacent node
+	for( unsigned int i=0; i<areas.size(); ++i )
+	{
+		CNavArea *area = areas[i];
+
+		for( unsigned int r=0; r<requests[i].size(); ++r )
 		{
-			CNavNode *adj = node->GetConnectedNode( WEST );
-			
-			if (adj && adj->GetArea() && adj->GetConnectedNode( EAST ) == node)
+			const NavConnectRequest &request = requests[i][r];
+
+			if (request.adjArea)
 			{
-				area->ConnectTo( adj->GetArea(), WEST );
+				area->ConnectTo( request.adjArea, request.dir );
 			}
 			else
 			{
-				CNavArea *downArea = findJumpDownArea( node->GetPosition(), WEST );
+				CNavArea *downArea = findJumpDownArea( request.node->GetPosition(), request.dir );
 				if (downArea && downArea != area)
-					area->ConnectTo( downArea, WEST );
+					area->ConnectTo( downArea, request.dir );
 			}
 		}
+	}
+}
 
-		// south edge - this edge's nodes are actually part of adjacent areas
-		// move one node north, and scan west to east
-		/// @todo This allows one-node-wide areas - do we want this?
-		node = area->m_node[ SOUTH_WEST ];
-		node = node->GetConnectedNode( NORTH );
-		if (node)
-		{
-			CNavNode *end = area->m_node[ SOUTH_EAST ]->GetConnectedNode( NORTH );
-			/// @todo Figure out why cs_backalley gets a nullptr node in here...
-			for( ; node && node != end; node = node->GetConnectedNode( EAST ) )
-			{
-				CNavNode *adj = node->GetConnectedNode( SOUTH );
-				
-				if (adj && adj->GetArea() && adj->GetConnectedNode( NORTH ) == node)
-				{
-					area->ConnectTo( adj->GetArea(), SOUTH );
-				}
-				else
-				{
-					CNavArea *downArea = findJumpDownArea( node->GetPosition(), SOUTH );
-					if (downArea && downArea != area)
-						area->ConnectTo( downArea, SOUTH );
-				}
-			}
-		}
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true if the given adjacent area can be merged into this area across the given edge.
+ * Areas can only be merged if their attributes match, and the result remains rectangular.
+ */
+bool CNavArea::IsMergeable( const CNavArea *adjArea, NavDirType dir ) const
+{
+	switch( dir )
+	{
+		case NORTH:
+			if (m_node[ NORTH_WEST ] != adjArea->m_node[ SOUTH_WEST ] || m_node[ NORTH_EAST ] != adjArea->m_node[ SOUTH_EAST ])
+				return false;
+			break;
+
+		case SOUTH:
+			if (adjArea->m_node[ NORTH_WEST ] != m_node[ SOUTH_WEST ] || adjArea->m_node[ NORTH_EAST ] != m_node[ SOUTH_EAST ])
+				return false;
+			break;
+
+		case WEST:
+			if (m_node[ NORTH_WEST ] != adjArea->m_node[ NORTH_EAST ] || m_node[ SOUTH_WEST ] != adjArea->m_node[ SOUTH_EAST ])
+				return false;
+			break;
+
+		case EAST:
+			if (adjArea->m_node[ NORTH_WEST ] != m_node[ NORTH_EAST ] || adjArea->m_node[ SOUTH_WEST ] != m_node[ SOUTH_EAST ])
+				return false;
+			break;
+
+		default:
+			return false;
+	}
+
+	return (GetAttributes() == adjArea->GetAttributes() && IsCoplanar( adjArea ));
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A pair of areas found to be mergeable during a merge pass
+ */
+struct NavMergeCandidate
+{
+	CNavArea *adjArea;										///< nullptr if the area has nothing to merge with
+	NavDirType dir;
+};
+
+class FindMergeCandidateFunctor
+{
+public:
+	FindMergeCandidateFunctor( std::vector< NavMergeCandidate > *candidates ) : m_candidates( candidates ) { }
 
-		// east edge - this edge's nodes are actually part of adjacent areas
-		node = area->m_node[ NORTH_EAST ];
-		node = node->GetConnectedNode( WEST );
-		if (node)
+	void operator() ( CNavArea *area, int index )
+	{
+		static const NavDirType order[ NUM_DIRECTIONS ] = { NORTH, SOUTH, WEST, EAST };
+
+		NavMergeCandidate *candidate = &(*m_candidates)[ index ];
+		candidate->adjArea = nullptr;
+
+		for( int d=0; d<NUM_DIRECTIONS; ++d )
 		{
-			CNavNode *end = area->m_node[ SOUTH_EAST ]->GetConnectedNode( WEST );
-			for( ; node && node != end; node = node->GetConnectedNode( SOUTH ) )
+			int count = area->GetAdjacentCount( order[d] );
+			for( int i=0; i<count; ++i )
 			{
-				CNavNode *adj = node->GetConnectedNode( EAST );
-				
-				if (adj && adj->GetArea() && adj->GetConnectedNode( WEST ) == node)
-				{
-					area->ConnectTo( adj->GetArea(), EAST );
-				}
-				else
+				CNavArea *adjArea = area->GetAdjacentArea( order[d], i );
+
+				if (area->IsMergeable( adjArea, order[d] ))
 				{
-					CNavArea *downArea = findJumpDownArea( node->GetPosition(), EAST );
-					if (downArea && downArea != area)
-						area->ConnectTo( downArea, EAST );
+					candidate->adjArea = adjArea;
+					candidate->dir = order[d];
+					return;
 				}
 			}
 		}
 	}
-}
+
+private:
+	std::vector< NavMergeCandidate > *m_candidates;
+};
 
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Merge areas together to make larger ones (must remain rectangular - convex).
  * Areas can only be merged if their attributes match.
+ *
+ * Each pass searches every area for a merge partner in parallel, then performs the merges on this thread.
+ * An area takes part in at most one merge per pass, since the merge changes its shape and its neighbors.
+ * Passes repeat until nothing more can be merged.
  */
 void MergeGeneratedAreas( void )
 {
-	CONSOLE_ECHO( "  Merging navigation areas...\n" );
+	std::vector< CNavArea * > areas;
+	std::vector< NavMergeCandidate > candidates;
+	std::set< CNavArea * > touched;
 
 	bool merged;
 
@@ -1269,121 +1537,61 @@ void MergeGeneratedAreas( void )
 	{
 		merged = false;
 
-		for( NavAreaList::iterator iter = TheNavAreaList.begin(); iter != TheNavAreaList.end(); ++iter )
-		{
-			CNavArea *area = *iter;
-
-			// north edge
-			NavConnectList::iterator citer;
-			for( citer = area->m_connect[ NORTH ].begin(); citer != area->m_connect[ NORTH ].end(); ++citer )
-			{
-				CNavArea *adjArea = (*citer).area;
+		GetNavAreaArray( &areas );
+		candidates.resize( areas.size() );
 
-				if (area->m_node[ NORTH_WEST ] == adjArea->m_node[ SOUTH_WEST ] &&
-						area->m_node[ NORTH_EAST ] == adjArea->m_node[ SOUTH_EAST ] &&
-						area->GetAttributes() == adjArea->GetAttributes() &&
-						area->IsCoplanar( adjArea ))
-				{
-					// merge vertical
-					area->m_node[ NORTH_WEST ] = adjArea->m_node[ NORTH_WEST ];
-					area->m_node[ NORTH_EAST ] = adjArea->m_node[ NORTH_EAST ];
+		FindMergeCandidateFunctor find( &candidates );
+		ForEachAreaInParallel( areas, find );
 
-					merged = true;
-					//CONSOLE_ECHO( "  Merged (north) areas #%d and #%d\n", area->m_id, adjArea->m_id );
+		touched.clear();
 
-					area->FinishMerge( adjArea );
+		for( unsigned int i=0; i<areas.size(); ++i )
+		{
+			CNavArea *area = areas[i];
+			CNavArea *adjArea = candidates[i].adjArea;
 
-					// restart scan - iterator is invalidated
-					break;
-				}
-			}
+			if (adjArea == nullptr)
+				continue;
 
-			if (merged)
-				break;
+			// an earlier merge this pass may have changed or destroyed either area
+			if (touched.count( area ) || touched.count( adjArea ))
+				continue;
 
-			// south edge
-			for( citer = area->m_connect[ SOUTH ].begin(); citer != area->m_connect[ SOUTH ].end(); ++citer )
+			switch( candidates[i].dir )
 			{
-				CNavArea *adjArea = (*citer).area;
+				case NORTH:
+					// merge vertical
+					area->m_node[ NORTH_WEST ] = adjArea->m_node[ NORTH_WEST ];
+					area->m_node[ NORTH_EAST ] = adjArea->m_node[ NORTH_EAST ];
+					break;
 
-				if (adjArea->m_node[ NORTH_WEST ] == area->m_node[ SOUTH_WEST ] &&
-						adjArea->m_node[ NORTH_EAST ] == area->m_node[ SOUTH_EAST ] &&
-						area->GetAttributes() == adjArea->GetAttributes() &&
-						area->IsCoplanar( adjArea ))
-				{
+				case SOUTH:
 					// merge vertical
 					area->m_node[ SOUTH_WEST ] = adjArea->m_node[ SOUTH_WEST ];
 					area->m_node[ SOUTH_EAST ] = adjArea->m_node[ SOUTH_EAST ];
-
-					merged = true;
-					//CONSOLE_ECHO( "  Merged (south) areas #%d and #%d\n", area->m_id, adjArea->m_id );
-
-					area->FinishMerge( adjArea );
-
-					// restart scan - iterator is invalidated
 					break;
-				}
-
-			}
-
-			if (merged)
-				break;
-
-
-			// west edge
-			for( citer = area->m_connect[ WEST ].begin(); citer != area->m_connect[ WEST ].end(); ++citer )
-			{
-				CNavArea *adjArea = (*citer).area;
 
-				if (area->m_node[ NORTH_WEST ] == adjArea->m_node[ NORTH_EAST ] &&
-						area->m_node[ SOUTH_WEST ] == adjArea->m_node[ SOUTH_EAST ] &&
-						area->GetAttributes() == adjArea->GetAttributes() &&
-						area->IsCoplanar( adjArea ))
-				{
+				case WEST:
 					// merge horizontal
 					area->m_node[ NORTH_WEST ] = adjArea->m_node[ NORTH_WEST ];
 					area->m_node[ SOUTH_WEST ] = adjArea->m_node[ SOUTH_WEST ];
-
-					merged = true;
-					//CONSOLE_ECHO( "  Merged (west) areas #%d and #%d\n", area->m_id, adjArea->m_id );
-
-					area->FinishMerge( adjArea );
-
-					// restart scan - iterator is invalidated
 					break;
-				}
-
-			}
 
-			if (merged)
-				break;
-
-			// east edge
-			for( citer = area->m_connect[ EAST ].begin(); citer != area->m_connect[ EAST ].end(); ++citer )
-			{
-				CNavArea *adjArea = (*citer).area;
-				
-				if (adjArea->m_node[ NORTH_WEST ] == area->m_node[ NORTH_EAST ] &&
-						adjArea->m_node[ SOUTH_WEST ] == area->m_node[ SOUTH_EAST ] &&
-						area->GetAttributes() == adjArea->GetAttributes() &&
-						area->IsCoplanar( adjArea ))
-				{
+				case EAST:
 					// merge horizontal
 					area->m_node[ NORTH_EAST ] = adjArea->m_node[ NORTH_EAST ];
 					area->m_node[ SOUTH_EAST ] = adjArea->m_node[ SOUTH_EAST ];
-
-					merged = true;
-					//CONSOLE_ECHO( "  Merged (east) areas #%d and #%d\n", area->m_id, adjArea->m_id );
-
-					area->FinishMerge( adjArea );
-
-					// restart scan - iterator is invalidated
 					break;
-				}
+
+				default:
+					continue;
 			}
 
-			if (merged)
-				break;
+			touched.insert( area );
+			touched.insert( adjArea );
+
+			area->FinishMerge( adjArea );
+			merged = true;
 		}
 	}
 	while( merged );
@@ -1901,6 +2109,10 @@ void MarkJumpAreas( void )
  */
 void GenerateNavigationAreaMesh( void )
 {
+	NavGenerationReport report;
+
+	report.StartPhase( "Building navigation areas" );
+
 	// haven't yet seen a map use larger than 30...
 	int tryWidth = 50;
 	int tryHeight = 50;
@@ -1935,6 +2147,10 @@ void GenerateNavigationAreaMesh( void )
 			break;
 	}
 
+	report.FinishPhase();
+
+	report.StartPhase( "Building area grid" );
+
 	Extent extent;
 	extent.lo.x = 9999999999.9f;
 	extent.lo.y = 9999999999.9f;
@@ -1964,11 +2180,25 @@ void GenerateNavigationAreaMesh( void )
 	for( iter = TheNavAreaList.begin(); iter != TheNavAreaList.end(); ++iter )
 		TheNavAreaGrid.AddNavArea( *iter );
 
+	report.FinishPhase();
 
+	report.StartPhase( "Connecting navigation areas" );
 	ConnectGeneratedAreas();
+	report.FinishPhase();
+
+	report.StartPhase( "Merging navigation areas" );
 	MergeGeneratedAreas();
+	report.FinishPhase();
+
+	report.StartPhase( "Squaring up navigation areas" );
 	SquareUpAreas();
+	report.FinishPhase();
+
+	report.StartPhase( "Marking jump areas" );
 	MarkJumpAreas();
+	report.FinishPhase();
+
+	report.Print( "Navigation mesh generation" );
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -2632,126 +2862,17 @@ void CNavArea::DrawMarkedCorner( NavCornerType corner, byte red, byte green, byt
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Add to open list in decreasing value order
+ * Return the coordinates of the area's corner.
+ * NOTE: Do not retain the returned pointer - it is temporary.
  */
-void CNavArea::AddToOpenList( void )
+const Vector *CNavArea::GetCorner( NavCornerType corner ) const
 {
-	// mark as being on open list for quick check
-	m_openMarker = m_masterMarker;
+	static Vector pos;
 
-	// if list is empty, add and return
-	if (m_openList == nullptr)
+	switch( corner )
 	{
-		m_openList = this;
-		this->m_prevOpen = nullptr;
-		this->m_nextOpen = nullptr;
-		return;
-	}
-
-	// insert self in ascending cost order
-	CNavArea *area, *last = nullptr;
-	for( area = m_openList; area; area = area->m_nextOpen )
-	{
-		if (this->GetTotalCost() < area->GetTotalCost())
-			break;
-
-		last = area;
-	}
-
-	if (area)
-	{
-		// insert before this area
-		this->m_prevOpen = area->m_prevOpen;
-		if (this->m_prevOpen)
-			this->m_prevOpen->m_nextOpen = this;
-		else
-			m_openList = this;
-
-		this->m_nextOpen = area;
-		area->m_prevOpen = this;
-	}
-	else
-	{
-		// append to end of list
-		last->m_nextOpen = this;
-
-		this->m_prevOpen = last;
-		this->m_nextOpen = nullptr;
-	}
-}
-
-//--------------------------------------------------------------------------------------------------------------
-/**
- * A smaller value has been found, update this area on the open list
- * @todo "bubbling" does unnecessary work, since the order of all other nodes will be unchanged - only this node is altered
- */
-void CNavArea::UpdateOnOpenList( void )
-{
-	// since value can only decrease, bubble this area up from current spot
-	while( m_prevOpen && 
-				 this->GetTotalCost() < m_prevOpen->GetTotalCost() )
-	{
-		// swap position with predecessor
-		CNavArea *other = m_prevOpen;
-		CNavArea *before = other->m_prevOpen;
-		CNavArea *after  = this->m_nextOpen;
-
-		this->m_nextOpen = other;
-		this->m_prevOpen = before;
-
-		other->m_prevOpen = this;
-		other->m_nextOpen = after;
-
-		if (before)
-			before->m_nextOpen = this;
-		else
-			m_openList = this;
-
-		if (after)
-			after->m_prevOpen = other;
-	}
-}
-
-//--------------------------------------------------------------------------------------------------------------
-void CNavArea::RemoveFromOpenList( void )
-{
-	if (m_prevOpen)
-		m_prevOpen->m_nextOpen = m_nextOpen;
-	else
-		m_openList = m_nextOpen;
-
-	if (m_nextOpen)
-		m_nextOpen->m_prevOpen = m_prevOpen;
-
-	// zero is an invalid marker
-	m_openMarker = 0;
-}
-
-//--------------------------------------------------------------------------------------------------------------
-/**
- * Clears the open and closed lists for a new search
- */
-void CNavArea::ClearSearchLists( void )
-{
-	// effectively clears all open list pointers and closed flags
-	CNavArea::MakeNewMarker();
-
-	m_openList = nullptr;
-}
-
-//--------------------------------------------------------------------------------------------------------------
-/**
- * Return the coordinates of the area's corner.
- * NOTE: Do not retain the returned pointer - it is temporary.
- */
-const Vector *CNavArea::GetCorner( NavCornerType corner ) const
-{
-	static Vector pos;
-
-	switch( corner )
-	{
-		case NORTH_WEST:
-			return &m_extent.lo;
+		case NORTH_WEST:
+			return &m_extent.lo;
 
 		case NORTH_EAST:
 			pos.x = m_extent.hi.x;
@@ -2963,7 +3084,7 @@ void CNavArea::ComputeHidingSpots( void )
 /**
  * Determine how much walkable area we can see from the spot, and how far away we can see.
  */
-void ClassifySniperSpot( HidingSpot *spot )
+void ClassifySniperSpot( HidingSpot *spot, const CNavArea *spotArea )
 {
 	Vector eye = *spot->GetPosition() + Vector( 0, 0, HalfHumanHeight );		// assume we are crouching
 	Vector walkable;
@@ -2978,6 +3099,10 @@ void ClassifySniperSpot( HidingSpot *spot )
 	{
 		CNavArea *area = *iter;
 
+		// don't bother tracing to areas that can't be seen from here
+		if (!TheNavAreaVisibility.IsPotentiallyVisible( spotArea, area ))
+			continue;
+
 		const Extent *extent = area->GetExtent();
 
 		// scan this area
@@ -3058,7 +3183,33 @@ void CNavArea::ComputeSniperSpots( void )
 	{
 		HidingSpot *spot = *iter;
 
-		ClassifySniperSpot( spot );
+		ClassifySniperSpot( spot, this );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The area each spot in TheHidingSpotList belongs to, by position in the list, while the map is being analyzed
+ */
+static std::vector< const CNavArea * > hidingSpotAreas;
+
+static void BuildHidingSpotAreas( const std::vector< CNavArea * > &areas )
+{
+	std::map< const HidingSpot *, const CNavArea * > spotArea;
+	for( unsigned int i=0; i<areas.size(); ++i )
+	{
+		const HidingSpotList *list = areas[i]->GetHidingSpotList();
+		for( HidingSpotList::const_iterator iter = list->begin(); iter != list->end(); ++iter )
+			spotArea[ *iter ] = areas[i];
+	}
+
+	hidingSpotAreas.clear();
+	hidingSpotAreas.reserve( TheHidingSpotList.size() );
+
+	for( HidingSpotList::const_iterator iter = TheHidingSpotList.begin(); iter != TheHidingSpotList.end(); ++iter )
+	{
+		std::map< const HidingSpot *, const CNavArea * >::const_iterator found = spotArea.find( *iter );
+		hidingSpotAreas.push_back( (found != spotArea.end()) ? found->second : nullptr );
 	}
 }
 
@@ -3110,8 +3261,9 @@ void CNavArea::AddSpotEncounters( const CNavArea *from, NavDirType fromDir, cons
 	Vector dir = e.path.to - e.path.from;
 	float length = dir.NormalizeInPlace();
 
-	// create unique marker to flag used spots
-	HidingSpot::ChangeMasterMarker();
+	// flag used spots by their position in TheHidingSpotList, rather than with the spots' shared marker,
+	// so that encounters for different areas can be gathered at the same time
+	std::vector< unsigned char > isSpotSeen( TheHidingSpotList.size(), false );
 
 	const float stepSize = 25.0f;		// 50
 	const float seeSpotRange = 2000.0f;	// 3000
@@ -3136,15 +3288,17 @@ void CNavArea::AddSpotEncounters( const CNavArea *from, NavDirType fromDir, cons
 		eye = e.path.from + along * dir;
 
 		// check each hiding spot for visibility
+		int spotIndex = -1;
 		for( HidingSpotList::iterator iter = TheHidingSpotList.begin(); iter != TheHidingSpotList.end(); ++iter )
 		{
 			spot = *iter;
+			++spotIndex;
 
 			// only look at spots with cover (others are out in the open and easily seen)
 			if (!spot->HasGoodCover())
 				continue;
 
-			if (spot->IsMarked())
+			if (isSpotSeen[ spotIndex ])
 				continue;
 
 			const Vector *spotPos = spot->GetPosition();
@@ -3157,29 +3311,28 @@ void CNavArea::AddSpotEncounters( const CNavArea *from, NavDirType fromDir, cons
 			if (delta > seeSpotRange)
 				continue;
 
+			// the eye never leaves this area, so skip spots in areas that can't be seen from it
+			if (spotIndex < (int)hidingSpotAreas.size() && !TheNavAreaVisibility.IsPotentiallyVisible( this, hidingSpotAreas[ spotIndex ] ))
+				continue;
+
 			// check if we have LOS
 			util::TraceLine( eye, Vector( spotPos->x, spotPos->y, spotPos->z + HalfHumanHeight ), util::ignore_monsters, util::ignore_glass, nullptr, &result );
 			if (result.flFraction != 1.0f)
 				continue;
 
-			// if spot is in front of us along our path, ignore it
-			delta.NormalizeInPlace();
-			float dot = DotProduct( dir, delta );
-			if (dot < 0.7071f && dot > -0.7071f)
+			// we only want to keep spots that BECOME visible as we walk past them
+			// therefore, skip ALL visible spots at the start of the path segment
+			// spots in front of us along our path are removed later by OrderSpotEncounters()
+			if (along > 0.0f)
 			{
-				// we only want to keep spots that BECOME visible as we walk past them
-				// therefore, skip ALL visible spots at the start of the path segment
-				if (along > 0.0f)
-				{
-					// add spot to encounter
-					spotOrder.spot = spot;
-					spotOrder.t = along/length;
-					e.spotList.push_back( spotOrder );
-				}
+				// add spot to encounter
+				spotOrder.spot = spot;
+				spotOrder.t = along/length;
+				e.spotList.push_back( spotOrder );
 			}
 
 			// mark spot as encountered
-			spot->Mark();
+			isSpotSeen[ spotIndex ] = true;
 		}
 	}
 
@@ -3189,169 +3342,93 @@ void CNavArea::AddSpotEncounters( const CNavArea *from, NavDirType fromDir, cons
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Compute "spot encounter" data. This is an ordered list of spots to look at 
- * for each possible path thru a nav area.
+ * Remove the spots that were visible ahead of us along each encounter path, leaving only those that
+ * appear off to the side as we walk past them.
+ * This does no traces and only touches this area's encounter data, so it can run in parallel.
  */
-void CNavArea::ComputeSpotEncounters( void )
+void CNavArea::OrderSpotEncounters( void )
 {
-	m_spotEncounterList.clear();
-
-	if (cv_bot_quicksave.value > 0.0f)
-		return;
+	const float eyeHeight = HalfHumanHeight;
 
-	// for each adjacent area
-	for( int fromDir=0; fromDir<NUM_DIRECTIONS; ++fromDir )
+	for( SpotEncounterList::iterator iter = m_spotEncounterList.begin(); iter != m_spotEncounterList.end(); ++iter )
 	{
-		for( NavConnectList::iterator fromIter = m_connect[ fromDir ].begin(); fromIter != m_connect[ fromDir ].end(); ++fromIter )
-		{
-			NavConnect *fromCon = &(*fromIter);
-
-			// compute encounter data for path to each adjacent area
-			for( int toDir=0; toDir<NUM_DIRECTIONS; ++toDir )
-			{
-				for( NavConnectList::iterator toIter = m_connect[ toDir ].begin(); toIter != m_connect[ toDir ].end(); ++toIter )
-				{
-					NavConnect *toCon = &(*toIter);
-
-					if (toCon == fromCon)
-						continue;
+		SpotEncounter *e = &(*iter);
 
-					// just do our direction, as we'll loop around for other direction
-					AddSpotEncounters( fromCon->area, (NavDirType)fromDir, toCon->area, (NavDirType)toDir );
-				}
-			}
-		}
-	}
-}
+		Vector dir = e->path.to - e->path.from;
+		float length = dir.NormalizeInPlace();
 
-//--------------------------------------------------------------------------------------------------------------
-/**
- * Decay the danger values
- */
-void CNavArea::DecayDanger( void )
-{
-	// one kill == 1.0, which we will forget about in two minutes
-	const float decayRate = 1.0f / 120.0f;
+		SpotOrderList::iterator spotIter = e->spotList.begin();
+		while( spotIter != e->spotList.end() )
+		{
+			// recover the eyepoint this spot was first seen from
+			Vector eye = e->path.from + (spotIter->t * length) * dir;
 
-	for( int i=0; i<MAX_AREA_TEAMS; ++i )
-	{
-		float deltaT = gpGlobals->time - m_dangerTimestamp[i];
-		float decayAmount = decayRate * deltaT;
+			const Vector *spotPos = spotIter->spot->GetPosition();
 
-		m_danger[i] -= decayAmount;
-		if (m_danger[i] < 0.0f)
-			m_danger[i] = 0.0f;
+			Vector delta;
+			delta.x = spotPos->x - eye.x;
+			delta.y = spotPos->y - eye.y;
+			delta.z = (spotPos->z + eyeHeight) - eye.z;
 
-		// update timestamp
-		m_dangerTimestamp[i] = gpGlobals->time;
+			// if spot is in front of us along our path, ignore it
+			delta.NormalizeInPlace();
+			float dot = DotProduct( dir, delta );
+			if (dot < 0.7071f && dot > -0.7071f)
+				++spotIter;
+			else
+				spotIter = e->spotList.erase( spotIter );
+		}
 	}
 }
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Increase the danger of this area for the given team
+ * Compute "spot encounter" data. This is an ordered list of spots to look at 
+ * for each possible path thru a nav area.
  */
-void CNavArea::IncreaseDanger( int teamID, float amount )
+void CNavArea::ComputeSpotEncounters( void )
 {
-	// before we add the new value, decay what's there
-	DecayDanger();
-
-	m_danger[ teamID ] += amount;
-	m_dangerTimestamp[ teamID ] = gpGlobals->time;
+	GatherSpotEncounters();
+	OrderSpotEncounters();
 }
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Return the danger of this area (decays over time)
+ * Trace from each possible path thru this nav area to find the spots that become visible along it.
+ * OrderSpotEncounters() must be called afterwards to finish the encounter data.
  */
-float CNavArea::GetDanger( int teamID )
+void CNavArea::GatherSpotEncounters( void )
 {
-	DecayDanger();
-	return m_danger[ teamID ];
-}
+	m_spotEncounterList.clear();
 
-//--------------------------------------------------------------------------------------------------------------
-/**
- * Increase the danger of nav areas containing and near the given position
- */
-void IncreaseDangerNearby( int teamID, float amount, CNavArea *startArea, const Vector *pos, float maxRadius )
-{
-	if (startArea == nullptr)
+	if (cv_bot_quicksave.value > 0.0f)
 		return;
 
-	CNavArea::MakeNewMarker();
-	CNavArea::ClearSearchLists();
-
-	startArea->AddToOpenList();
-	startArea->SetTotalCost( 0.0f );
-	startArea->Mark();
-	startArea->IncreaseDanger( teamID, amount );
-
-	while( !CNavArea::IsOpenListEmpty() )
+	// for each adjacent area
+	for( int fromDir=0; fromDir<NUM_DIRECTIONS; ++fromDir )
 	{
-		// get next area to check
-		CNavArea *area = CNavArea::PopOpenList();
-		
-		// area has no hiding spots, explore adjacent areas
-		for( int dir=0; dir<NUM_DIRECTIONS; ++dir )
+		for( NavConnectList::iterator fromIter = m_connect[ fromDir ].begin(); fromIter != m_connect[ fromDir ].end(); ++fromIter )
 		{
-			int count = area->GetAdjacentCount( (NavDirType)dir );
-			for( int i=0; i<count; ++i )
-			{
-				CNavArea *adjArea = area->GetAdjacentArea( (NavDirType)dir, i );
+			NavConnect *fromCon = &(*fromIter);
 
-				if (!adjArea->IsMarked())
+			// compute encounter data for path to each adjacent area
+			for( int toDir=0; toDir<NUM_DIRECTIONS; ++toDir )
+			{
+				for( NavConnectList::iterator toIter = m_connect[ toDir ].begin(); toIter != m_connect[ toDir ].end(); ++toIter )
 				{
-					// compute distance from danger source
-					float cost = (*adjArea->GetCenter() - *pos).Length();
-					if (cost <= maxRadius)
-					{
-						adjArea->AddToOpenList();
-						adjArea->SetTotalCost( cost );
-						adjArea->Mark();
-						adjArea->IncreaseDanger( teamID, amount * cost/maxRadius );
-					}
-				}
-			}
-		}
-	}
-}
-
-//--------------------------------------------------------------------------------------------------------------
-/**
- * Show danger levels for debugging
- */
-void DrawDanger( void )
-{
-	for( NavAreaList::iterator iter = TheNavAreaList.begin(); iter != TheNavAreaList.end(); ++iter )
-	{
-		CNavArea *area = *iter;
-
-		Vector center = *area->GetCenter();
-		Vector top;
-		center.z = area->GetZ( &center );
+					NavConnect *toCon = &(*toIter);
 
-		float danger = area->GetDanger( 0 );
-		if (danger > 0.1f)
-		{
-			top.x = center.x;
-			top.y = center.y;
-			top.z = center.z + 10.0f * danger;
-			UTIL_DrawBeamPoints( center, top, 3.0f, 255, 0, 0 );
-		}
+					if (toCon == fromCon)
+						continue;
 
-		danger = area->GetDanger( 1 );
-		if (danger > 0.1f)
-		{
-			top.x = center.x;
-			top.y = center.y;
-			top.z = center.z + 10.0f * danger;
-			UTIL_DrawBeamPoints( center, top, 3.0f, 0, 0, 255 );
+					// just do our direction, as we'll loop around for other direction
+					AddSpotEncounters( fromCon->area, (NavDirType)fromDir, toCon->area, (NavDirType)toDir );
+				}
+			}
 		}
 	}
 }
 
-
 //--------------------------------------------------------------------------------------------------------------
 /**
  * If a player is at the given spot, return true
@@ -3389,6 +3466,8 @@ class CollectHidingSpotsFunctor
 public:
 	CollectHidingSpotsFunctor( CBaseEntity *me, const Vector *origin, float range, unsigned char flags, Place place = UNDEFINED_PLACE, bool useCrouchAreas = true )
 	{
+		TheHidingSpotIndex.Update();
+
 		m_me = me;
 		m_count = 0;
 		m_origin = origin;
@@ -3406,38 +3485,36 @@ public:
 		if (m_place != UNDEFINED_PLACE && area->GetPlace() != m_place)
 			return true;
 
-		// collect all the hiding spots in this area
-		const HidingSpotList *list = area->GetHidingSpotList();
-		
-		for( HidingSpotList::const_iterator iter = list->begin(); iter != list->end() && m_count < MAX_SPOTS; ++iter )
+		// collect all the hiding spots in this area, which are a run in the spot index
+		const unsigned int areaIndex = area->GetGraphIndex();
+		const unsigned int end = TheHidingSpotIndex.GetAreaSpotsEnd( areaIndex );
+
+		for( unsigned int i = TheHidingSpotIndex.GetAreaSpotsBegin( areaIndex ); i < end && m_count < MAX_SPOTS; ++i )
 		{
-			const HidingSpot *spot = *iter;
+			const unsigned char flags = TheHidingSpotIndex.GetFlags( i );
 
-			if (m_useCrouchAreas == false)
-			{
-				CNavArea *area = TheNavAreaGrid.GetNavArea( spot->GetPosition() );
-				if (area && (area->GetAttributes() & NAV_CROUCH))
-					continue;
-			}
+			// only collect hiding spots with matching flags
+			if (!(m_flags & flags))
+				continue;
+
+			if (m_useCrouchAreas == false && (flags & CHidingSpotIndex::IN_CROUCH_AREA))
+				continue;
 
 			// make sure hiding spot is in range
 			if (m_range > 0.0f)
-				if ((*spot->GetPosition() - *m_origin) > m_range)
+				if ((TheHidingSpotIndex.GetPosition( i ) - *m_origin).LengthSquared() > m_range * m_range)
 					continue;
 
 			// if a Player is using this hiding spot, don't consider it
-			if (IsSpotOccupied( m_me, spot->GetPosition() ))
+			if (TheHidingSpotIndex.IsOccupied( i, m_me ))
 			{
 				// player is in hiding spot
 				/// @todo Check if player is moving or sitting still
 				continue;
 			}
 
-			// only collect hiding spots with matching flags
-			if (m_flags & spot->GetFlags())
-			{
-				m_hidingSpot[ m_count++ ] = spot->GetPosition();
-			}
+			m_hidingSpotArea[ m_count ] = area;
+			m_hidingSpot[ m_count++ ] = TheHidingSpotIndex.GetSpot( i )->GetPosition();
 		}
 
 		// if we've filled up, stop searching
@@ -3456,7 +3533,10 @@ public:
 			return;
 
 		for( int j=i+1; j<m_count; ++j )
+		{
 			m_hidingSpot[j-1] = m_hidingSpot[j];
+			m_hidingSpotArea[j-1] = m_hidingSpotArea[j];
+		}
 
 		--m_count;
 	}
@@ -3467,6 +3547,7 @@ public:
 	float m_range;
 
 	const Vector *m_hidingSpot[ MAX_SPOTS ];
+	CNavArea *m_hidingSpotArea[ MAX_SPOTS ];				///< the area each hiding spot belongs to
 	int m_count;
 
 	unsigned char m_flags;
@@ -3587,6 +3668,84 @@ const Vector *FindRandomHidingSpot( CBaseEntity *me, Place place, bool isSniper
 	return collector.m_hidingSpot[ which ];
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Keeps the nearest unoccupied spot with any of the given flags among the areas the search reaches within travel range
+ */
+class NearestReachableSpotFunctor
+{
+public:
+	NearestReachableSpotFunctor( CBaseEntity *me, const Vector *pos, unsigned char flags, float range, float travelRange )
+	{
+		m_me = me;
+		m_pos = pos;
+		m_flags = flags;
+		m_rangeSq = (range > 0.0f) ? range * range : 9999999999.9f;
+		m_travelRange = travelRange;
+		m_nearest = -1;
+	}
+
+	bool operator() ( CNavArea *area )
+	{
+		const unsigned int areaIndex = area->GetGraphIndex();
+
+		if (CNavSearchContext::GetCurrent()->GetCostSoFar( areaIndex ) > m_travelRange)
+			return false;
+
+		const unsigned int end = TheHidingSpotIndex.GetAreaSpotsEnd( areaIndex );
+
+		for( unsigned int i = TheHidingSpotIndex.GetAreaSpotsBegin( areaIndex ); i < end; ++i )
+		{
+			if (!(TheHidingSpotIndex.GetFlags( i ) & m_flags))
+				continue;
+
+			float rangeSq = (TheHidingSpotIndex.GetPosition( i ) - *m_pos).LengthSquared();
+			if (rangeSq > m_rangeSq || TheHidingSpotIndex.IsOccupied( i, m_me ))
+				continue;
+
+			// spots nearer than this are all that matter from now on
+			m_nearest = i;
+			m_rangeSq = rangeSq;
+		}
+
+		return true;
+	}
+
+	CBaseEntity *m_me;
+	const Vector *m_pos;
+	unsigned char m_flags;
+	float m_rangeSq;
+	float m_travelRange;
+	int m_nearest;
+};
+
+/**
+ * Return the nearest unoccupied hiding spot with any of the given flags within 'range' of 'pos'.
+ * If 'travelRange' is positive, the spot must also be reachable from 'startArea' within that travel distance.
+ * For example, FindNearestHidingSpot( me, &pos, area, HidingSpot::IDEAL_SNIPER_SPOT, 2000.0f, 3000.0f ).
+ */
+const HidingSpot *FindNearestHidingSpot( CBaseEntity *me, const Vector *pos, CNavArea *startArea, unsigned char flags, float range, float travelRange )
+{
+	TheHidingSpotIndex.Update();
+
+	int nearest;
+
+	if (travelRange > 0.0f)
+	{
+		// one bounded search, looking at the spots of each area it reaches
+		NearestReachableSpotFunctor reachable( me, pos, flags, range, travelRange );
+		SearchSurroundingAreas( startArea, pos, reachable, travelRange );
+
+		nearest = reachable.m_nearest;
+	}
+	else
+	{
+		nearest = TheHidingSpotIndex.FindNearestSpot( *pos, range, flags, me );
+	}
+
+	return (nearest >= 0) ? TheHidingSpotIndex.GetSpot( nearest ) : nullptr;
+}
+
 //--------------------------------------------------------------------------------------------------------------------
 /**
  * Return true if moving from "start" to "finish" will cross a player's line of fire.
@@ -3595,30 +3754,25 @@ const Vector *FindRandomHidingSpot( CBaseEntity *me, Place place, bool isSniper
  */
 bool IsCrossingLineOfFire( const Vector &start, const Vector &finish, CBaseEntity *ignore, int ignoreTeam  )
 {
-	for ( int p=1; p <= gpGlobals->maxClients; ++p )
+	for( int p=0; p<g_PlayerSnapshot.GetCount(); ++p )
 	{
-		CBasePlayer *player = static_cast<CBasePlayer *>( util::PlayerByIndex( p ) );
-
-		if (!IsEntityValid( player ))
-			continue;
-
-		if (player == ignore)
+		if (!g_PlayerSnapshot.IsAlive( p ))
 			continue;
 
-		if (!player->IsAlive())
+		if (g_PlayerSnapshot.GetPlayer( p ) == ignore)
 			continue;
 
-		if (ignoreTeam && player->TeamNumber() == ignoreTeam)
+		if (ignoreTeam && g_PlayerSnapshot.GetTeam( p ) == ignoreTeam)
 			continue;
 
-		// compute player's unit aiming vector 
-		util::MakeVectors( player->v.v_angle + player->v.punchangle );
+		// the player's unit aiming vector was computed once for the frame
+		const Vector &playerOrigin = g_PlayerSnapshot.GetOrigin( p );
 
 		const float longRange = 5000.0f;
-		Vector playerTarget = player->v.origin + longRange * gpGlobals->v_forward;
+		Vector playerTarget = playerOrigin + longRange * g_PlayerSnapshot.GetForward( p );
 
 		Vector result;
-		if (IsIntersecting2D( start, finish, player->v.origin, playerTarget, &result ))
+		if (IsIntersecting2D( start, finish, playerOrigin, playerTarget, &result ))
 		{
 			// simple check to see if intersection lies in the Z range of the path
 			float loZ, hiZ;
@@ -3647,6 +3801,7 @@ bool IsCrossingLineOfFire( const Vector &start, const Vector &finish, CBaseEntit
  * Select a nearby retreat spot.
  * Don't pick a hiding spot that a Player is currently occupying.
  * If "avoidTeam" is nonzero, avoid getting close to members of that team.
+ * Spots in areas our team's influence map marks as threatening are skipped.
  */
 const Vector *FindNearbyRetreatSpot( CBaseEntity *me, const Vector *start, CNavArea *startArea, float maxRange, int avoidTeam, bool useCrouchAreas )
 {
@@ -3660,9 +3815,22 @@ const Vector *FindNearbyRetreatSpot( CBaseEntity *me, const Vector *start, CNavA
 	if (collector.m_count == 0)
 		return nullptr;
 
+	// spots where our team has recently been under threat are no place to retreat to
+	const float maxRetreatThreat = 1.0f;
+
 	// find the closest unoccupied hiding spot that crosses the least lines of fire and has the best cover
 	for( int i=0; i<collector.m_count; ++i )
 	{
+		if (TheNavInfluenceMap.GetThreat( me->TeamNumber(), collector.m_hidingSpotArea[i] ) > maxRetreatThreat)
+		{
+			collector.RemoveSpot( i );
+
+			// back up a step, so iteration won't skip a spot
+			--i;
+
+			continue;
+		}
+
 		// check if we would have to cross a line of fire to reach this hiding spot
 		if (IsCrossingLineOfFire( *start, *collector.m_hidingSpot[i], me ))
 		{
@@ -3707,31 +3875,25 @@ const Vector *FindNearbyRetreatSpot( CBaseEntity *me, const Vector *start, CNavA
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Return number of players with given teamID in this area (teamID == 0 means any/all)
- * @todo Keep pointers to contained Players to make this a zero-time query
+ * Uses the area each player was standing on at the start of the frame.
  */
 int CNavArea::GetPlayerCount( int teamID, CBasePlayer *ignore ) const
 {
 	int count = 0;
 
-	for( int i=1; i<=gpGlobals->maxClients; ++i )
+	for( int i=0; i<g_PlayerSnapshot.GetCount(); ++i )
 	{
-		CBasePlayer *player = static_cast<CBasePlayer *>( util::PlayerByIndex( i ) );
-
-		if (player == ignore)
-			continue;
-
-		if (!IsEntityValid( player ))
+		if (g_PlayerSnapshot.GetNavArea( i ) != this)
 			continue;
 
-		if (!player->IsPlayer())
+		if (!g_PlayerSnapshot.IsActive( i ) || !g_PlayerSnapshot.IsAlive( i ))
 			continue;
 
-		if (!player->IsAlive())
+		if (g_PlayerSnapshot.GetPlayer( i ) == ignore)
 			continue;
 
-		if (teamID == 0 || player->TeamNumber() == teamID)
-			if (Contains( &player->v.origin ))
-				++count;
+		if (teamID == 0 || g_PlayerSnapshot.GetTeam( i ) == teamID)
+			++count;
 	}
 	
 	return count;
@@ -3941,6 +4103,11 @@ void CNavArea::DrawConnectedAreas( void )
  */
 void CNavArea::RaiseCorner( NavCornerType corner, int amount )
 {
+	TheNavAreaGraph.Invalidate();
+
+	// the grid holds a copy of our heights
+	TheNavAreaGrid.RemoveNavArea( this );
+
 	if ( corner == NUM_CORNERS )
 	{
 		m_extent.lo.z += amount;
@@ -3970,6 +4137,8 @@ void CNavArea::RaiseCorner( NavCornerType corner, int amount )
 	m_center.x = (m_extent.lo.x + m_extent.hi.x)/2.0f;
 	m_center.y = (m_extent.lo.y + m_extent.hi.y)/2.0f;
 	m_center.z = (m_extent.lo.z + m_extent.hi.z)/2.0f;
+
+	TheNavAreaGrid.AddNavArea( this );
 }
 
 /**
@@ -4668,7 +4837,7 @@ bool GetGroundHeight( const Vector *pos, float *height, Vector *normal )
 	{
 		from = *pos + Vector( 0, 0, offset );
 
-		util::TraceLine( from, to, util::ignore_monsters, util::dont_ignore_glass, ignore->Get<CBaseEntity>(), &result );
+		util::TraceLine( from, to, util::ignore_monsters, util::dont_ignore_glass, (ignore) ? ignore->Get<CBaseEntity>() : nullptr, &result );
 
 		// if the trace came down thru a door, ignore the door and try again
 		// also ignore breakable floors
@@ -4752,8 +4921,8 @@ bool GetSimpleGroundHeight( const Vector *pos, float *height, Vector *normal )
 
 //--------------------------------------------------------------------------------------------------------------
 enum { MAX_BLOCKED_AREAS = 256 };
-static unsigned int BlockedID[ MAX_BLOCKED_AREAS ];
-static int BlockedIDCount = 0;
+static thread_local unsigned int BlockedID[ MAX_BLOCKED_AREAS ];
+static thread_local int BlockedIDCount = 0;
 
 /**
  * Shortest path cost, paying attention to "blocked" areas
@@ -4816,6 +4985,34 @@ inline bool IsAreaVisible( const Vector *pos, const CNavArea *area )
 	return false;
 }
 
+/**
+ * Remembers which areas can be seen from one eye position, since the approach area search asks about
+ * the same areas along many different paths
+ */
+class AreaVisibilityCache
+{
+public:
+	AreaVisibilityCache( const Vector *eye ) : m_eye( *eye ) { }
+
+	bool IsAreaVisible( const CNavArea *area )
+	{
+		unsigned int id = area->GetID();
+		if (id >= m_visibility.size())
+			m_visibility.resize( id + 1, UNKNOWN );
+
+		if (m_visibility[ id ] == UNKNOWN)
+			m_visibility[ id ] = (::IsAreaVisible( &m_eye, area )) ? VISIBLE : NOT_VISIBLE;
+
+		return (m_visibility[ id ] == VISIBLE);
+	}
+
+private:
+	enum { UNKNOWN, VISIBLE, NOT_VISIBLE };
+
+	Vector m_eye;
+	std::vector< unsigned char > m_visibility;
+};
+
 /**
  * Determine the set of "approach areas".
  * An approach area is an area representing a place where players 
@@ -4842,6 +5039,8 @@ void CNavArea::ComputeApproachAreas( void )
 	enum { MAX_PATH_LENGTH = 256 };
 	CNavArea *path[ MAX_PATH_LENGTH ];
 
+	AreaVisibilityCache visibility( &eye );
+
 	//
 	// In order to enumerate all of the approach areas, we need to
 	// run the algorithm many times, once for each "far away" area
@@ -4855,7 +5054,7 @@ void CNavArea::ComputeApproachAreas( void )
 		BlockedIDCount = 0;
 
 		// if we can see 'farArea', try again - the whole point is to go "around the bend", so to speak
-		if (IsAreaVisible( &eye, farArea ))
+		if (visibility.IsAreaVisible( farArea ))
 			continue;
 	
 		// make first path to far away area
@@ -4888,7 +5087,7 @@ void CNavArea::ComputeApproachAreas( void )
 			for( i=1; i<count; ++i )
 			{
 				// if we see this area, continue on
-				if (IsAreaVisible( &eye, path[i] ))
+				if (visibility.IsAreaVisible( path[i] ))
 					continue;
 
 				// we can't see this area.
@@ -4943,6 +5142,413 @@ void CNavArea::ComputeApproachAreas( void )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+class ComputeSniperSpotsFunctor
+{
+public:
+	void operator() ( CNavArea *area, int )		{ area->ComputeSniperSpots(); }
+};
+
+class GatherSpotEncountersFunctor
+{
+public:
+	void operator() ( CNavArea *area, int )		{ area->GatherSpotEncounters(); }
+};
+
+class OrderSpotEncountersFunctor
+{
+public:
+	void operator() ( CNavArea *area, int )		{ area->OrderSpotEncounters(); }
+};
+
+class ComputeApproachAreasFunctor
+{
+public:
+	void operator() ( CNavArea *area, int )		{ area->ComputeApproachAreas(); }
+};
+
+/**
+ * Run the functor over all areas, in parallel only if allowed
+ */
+template < typename Functor >
+void ForEachArea( const std::vector< CNavArea * > &areas, Functor &func, bool isParallel )
+{
+	if (isParallel)
+	{
+		ForEachAreaInParallel( areas, func );
+	}
+	else
+	{
+		for( unsigned int i=0; i<areas.size(); ++i )
+			func( areas[i], i );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The singleton for the potentially visible areas
+ */
+CNavAreaVisibility TheNavAreaVisibility;
+
+
+CNavAreaVisibility::CNavAreaVisibility( void )
+{
+	m_areaCount = 0;
+	m_rowWords = 0;
+}
+
+void CNavAreaVisibility::Reset( void )
+{
+	m_areaCount = 0;
+	m_rowWords = 0;
+	m_bits.clear();
+}
+
+/**
+ * Clear the table, and index the given areas
+ */
+void CNavAreaVisibility::Resize( const std::vector< CNavArea * > &areas )
+{
+	m_areaCount = areas.size();
+	m_rowWords = (m_areaCount + 31) / 32;
+	m_bits.assign( m_areaCount * m_rowWords, 0 );
+
+	for( unsigned int i=0; i<areas.size(); ++i )
+		areas[i]->m_visIndex = i;
+}
+
+bool CNavAreaVisibility::IsInOrder( const std::vector< CNavArea * > &areas ) const
+{
+	if (areas.size() != m_areaCount)
+		return false;
+
+	for( unsigned int i=0; i<areas.size(); ++i )
+		if (areas[i]->m_visIndex != i)
+			return false;
+
+	return true;
+}
+
+unsigned int CNavAreaVisibility::GetVisiblePairCount( void ) const
+{
+	unsigned int count = 0;
+
+	for( unsigned int i=0; i<m_bits.size(); ++i )
+		for( unsigned int bits = m_bits[i]; bits; bits &= bits - 1 )
+			++count;
+
+	return count;
+}
+
+/**
+ * The points each area is sampled at - its center and its corners, pulled in as far as a hiding spot
+ * would be - at crouching and standing eye height
+ */
+struct NavVisibilitySamples
+{
+	enum { NUM_POINTS = 5 };
+
+	Vector crouch[ NUM_POINTS ];
+	Vector stand[ NUM_POINTS ];
+};
+
+static void ComputeVisibilitySamples( const CNavArea *area, NavVisibilitySamples *samples )
+{
+	const float standEyeHeight = HumanHeight - 8.0f;
+	const float cornerInset = 12.5f;
+
+	const Extent *extent = area->GetExtent();
+
+	float insetX = (extent->hi.x - extent->lo.x) / 2.0f;
+	if (insetX > cornerInset)
+		insetX = cornerInset;
+
+	float insetY = (extent->hi.y - extent->lo.y) / 2.0f;
+	if (insetY > cornerInset)
+		insetY = cornerInset;
+
+	Vector point[ NavVisibilitySamples::NUM_POINTS ];
+	point[0] = *area->GetCenter();
+	point[1] = Vector( extent->lo.x + insetX, extent->lo.y + insetY, 0.0f );
+	point[2] = Vector( extent->hi.x - insetX, extent->lo.y + insetY, 0.0f );
+	point[3] = Vector( extent->hi.x - insetX, extent->hi.y - insetY, 0.0f );
+	point[4] = Vector( extent->lo.x + insetX, extent->hi.y - insetY, 0.0f );
+
+	for( int p=0; p<NavVisibilitySamples::NUM_POINTS; ++p )
+	{
+		float z = area->GetZ( &point[p] );
+
+		samples->crouch[p] = Vector( point[p].x, point[p].y, z + HalfHumanHeight );
+		samples->stand[p] = Vector( point[p].x, point[p].y, z + standEyeHeight );
+	}
+}
+
+/**
+ * Return true if any pair of samples at the same height can see each other
+ */
+static bool IsAnySampleVisible( const NavVisibilitySamples *from, const NavVisibilitySamples *to )
+{
+	TraceResult result;
+
+	for( int i=0; i<NavVisibilitySamples::NUM_POINTS; ++i )
+	{
+		for( int j=0; j<NavVisibilitySamples::NUM_POINTS; ++j )
+		{
+			util::TraceLine( from->stand[i], to->stand[j], util::ignore_monsters, util::ignore_glass, nullptr, &result );
+			if (result.flFraction == 1.0f)
+				return true;
+
+			util::TraceLine( from->crouch[i], to->crouch[j], util::ignore_monsters, util::ignore_glass, nullptr, &result );
+			if (result.flFraction == 1.0f)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Fill in one area's row of the table.
+ * Each pair of areas is traced once, by the row chosen by the parity of the pair, so every row does about
+ * the same amount of work and the partitions stay balanced. The table is made symmetric afterwards.
+ */
+class ComputeAreaVisibilityFunctor
+{
+public:
+	ComputeAreaVisibilityFunctor( CNavAreaVisibility *table, const std::vector< CNavArea * > *areas, const std::vector< NavVisibilitySamples > *samples )
+	{
+		m_table = table;
+		m_areas = areas;
+		m_samples = samples;
+	}
+
+	void operator() ( CNavArea *area, int index )
+	{
+		const unsigned int from = index;
+
+		m_table->SetVisible( from, from );
+
+		for( unsigned int to=0; to<m_areas->size(); ++to )
+		{
+			if (to == from || (from < to) != (((from + to) & 1) != 0))
+				continue;
+
+			const CNavArea *other = (*m_areas)[ to ];
+
+			if (area->IsConnected( other, NUM_DIRECTIONS ) || other->IsConnected( area, NUM_DIRECTIONS ) ||
+				IsAnySampleVisible( &(*m_samples)[ from ], &(*m_samples)[ to ] ))
+			{
+				m_table->SetVisible( from, to );
+			}
+		}
+	}
+
+private:
+	CNavAreaVisibility *m_table;
+	const std::vector< CNavArea * > *m_areas;
+	const std::vector< NavVisibilitySamples > *m_samples;
+};
+
+/**
+ * Compute the potentially visible areas of each of the given areas.
+ * The areas are indexed by their position in the array.
+ */
+void CNavAreaVisibility::Compute( const std::vector< CNavArea * > &areas, bool isTraceThreadSafe )
+{
+	Resize( areas );
+
+	std::vector< NavVisibilitySamples > samples( areas.size() );
+	for( unsigned int i=0; i<areas.size(); ++i )
+		ComputeVisibilitySamples( areas[i], &samples[i] );
+
+	ComputeAreaVisibilityFunctor func( this, &areas, &samples );
+	ForEachArea( areas, func, isTraceThreadSafe );
+
+	// each pair was traced from one side only
+	for( unsigned int from=0; from<m_areaCount; ++from )
+		for( unsigned int to=0; to<m_areaCount; ++to )
+			if (IsVisible( from, to ))
+				SetVisible( to, from );
+}
+
+/**
+ * Append each area's row, in index order. A zero byte is followed by the number of zero bytes in the run,
+ * as in the bsp's visdata, and runs never cross from one row into the next.
+ */
+void CNavAreaVisibility::Compress( std::vector< unsigned char > *data ) const
+{
+	const unsigned int rowBytes = (m_areaCount + 7) / 8;
+
+	for( unsigned int from=0; from<m_areaCount; ++from )
+	{
+		const unsigned int *row = &m_bits[ from * m_rowWords ];
+
+		for( unsigned int b=0; b<rowBytes; ++b )
+		{
+			unsigned char value = (unsigned char)(row[ b / 4 ] >> (8 * (b & 3)));
+
+			if (value)
+			{
+				data->push_back( value );
+				continue;
+			}
+
+			unsigned int run = 1;
+			while( b + 1 < rowBytes && run < 255 && !(unsigned char)(row[ (b + 1) / 4 ] >> (8 * ((b + 1) & 3))) )
+			{
+				++b;
+				++run;
+			}
+
+			data->push_back( 0 );
+			data->push_back( (unsigned char)run );
+		}
+	}
+}
+
+/**
+ * Load the rows written by Compress() for the given areas, indexed by their position in the array.
+ * Return false and leave the table empty if the data does not hold exactly one row per area.
+ */
+bool CNavAreaVisibility::Decompress( const unsigned char *data, unsigned int size, const std::vector< CNavArea * > &areas )
+{
+	Resize( areas );
+
+	const unsigned int rowBytes = (m_areaCount + 7) / 8;
+	const unsigned char *end = data + size;
+
+	for( unsigned int from=0; from<m_areaCount; ++from )
+	{
+		unsigned int *row = &m_bits[ from * m_rowWords ];
+
+		for( unsigned int b=0; b<rowBytes; )
+		{
+			if (data >= end)
+			{
+				Reset();
+				return false;
+			}
+
+			unsigned char value = *data++;
+
+			if (value)
+			{
+				row[ b / 4 ] |= (unsigned int)value << (8 * (b & 3));
+				++b;
+				continue;
+			}
+
+			if (data >= end || *data == 0 || b + *data > rowBytes)
+			{
+				Reset();
+				return false;
+			}
+
+			b += *data++;
+		}
+	}
+
+	if (data != end)
+	{
+		Reset();
+		return false;
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Compute the "map learning" data for every nav area - hiding spots, sniper spots, spot encounters
+ * and approach areas - replacing whatever the areas had before. If bot_nav_visibility is set, the
+ * potentially visible areas are computed first, and the sniper spot and encounter traces skip areas
+ * that can't be seen.
+ * The encounter ordering always runs in parallel. The phases that trace only do so if 'isTraceThreadSafe' is
+ * true, which is the case for the offline nav tool but never for the engine's traces.
+ */
+void AnalyzeNavigationMap( bool isTraceThreadSafe )
+{
+	NavGenerationReport report;
+
+	std::vector< CNavArea * > areas;
+	GetNavAreaArray( &areas );
+
+	// spot encounters refer to hiding spots, so they must be rebuilt too
+	for( unsigned int i=0; i<areas.size(); ++i )
+		areas[i]->m_spotEncounterList.clear();
+
+	DestroyHidingSpots();
+
+	// the areas themselves don't change, so a table loaded with the mesh is still good
+	if (cv_bot_nav_visibility.value > 0.0f)
+	{
+		report.StartPhase( "Computing area visibility" );
+		TheNavAreaVisibility.Compute( areas, isTraceThreadSafe );
+		report.FinishPhase();
+
+		CONSOLE_ECHO( "%u of %u area pairs are potentially visible\n", TheNavAreaVisibility.GetVisiblePairCount(), (unsigned int)(areas.size() * areas.size()) );
+	}
+
+	report.StartPhase( "Finding hiding spots" );
+	for( unsigned int i=0; i<areas.size(); ++i )
+		areas[i]->ComputeHidingSpots();
+	report.FinishPhase();
+
+	BuildHidingSpotAreas( areas );
+
+	report.StartPhase( "Finding sniper spots" );
+	ComputeSniperSpotsFunctor sniper;
+	ForEachArea( areas, sniper, isTraceThreadSafe );
+	report.FinishPhase();
+
+	report.StartPhase( "Tracing spot encounters" );
+	GatherSpotEncountersFunctor gather;
+	ForEachArea( areas, gather, isTraceThreadSafe );
+	report.FinishPhase();
+
+	report.StartPhase( "Ordering spot encounters" );
+	OrderSpotEncountersFunctor order;
+	ForEachAreaInParallel( areas, order );
+	report.FinishPhase();
+
+	report.StartPhase( "Finding approach areas" );
+	ApproachAreaAnalysisPrep();
+
+	// workers must not rebuild the search graph
+	TheNavAreaGraph.Update();
+
+	ComputeApproachAreasFunctor approach;
+	ForEachArea( areas, approach, isTraceThreadSafe );
+
+	CleanupApproachAreaAnalysisPrep();
+	report.FinishPhase();
+
+	hidingSpotAreas.clear();
+
+	report.Print( "Navigation mesh analysis" );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * bot_nav_analyze
+ * Recompute hiding spots, encounters and approach areas for the current map's nav mesh, and report how long
+ * each phase took. Use "bot_nav_convert" to save the results.
+ */
+void NavAnalyze( void )
+{
+	if (TheNavAreaList.empty())
+	{
+		NavErrorType error = LoadNavigationMap();
+		if (error != NAV_OK)
+		{
+			CONSOLE_ECHO( "Unable to load navigation mesh for this map (error %d).\n", error );
+			return;
+		}
+	}
+
+	AnalyzeNavigationMap();
+}
+
 //--------------------------------------------------------------------------------------------------------------
 
 /**
@@ -4953,14 +5559,12 @@ CNavAreaGrid TheNavAreaGrid;
 
 CNavAreaGrid::CNavAreaGrid( void ) : m_cellSize( 300.0f )
 {
-	m_grid = nullptr;
+	m_generation = 0;
 	Reset();
 }
 
 CNavAreaGrid::~CNavAreaGrid()
 {
-	delete [] m_grid;
-	m_grid = nullptr;
 }
 
 /**
@@ -4968,10 +5572,7 @@ CNavAreaGrid::~CNavAreaGrid()
  */
 void CNavAreaGrid::Reset( void )
 {
-	if (m_grid)
-		delete [] m_grid;
-
-	m_grid = nullptr;
+	m_grid.clear();
 	m_gridSizeX = 0;
 	m_gridSizeY = 0;
 
@@ -4980,6 +5581,7 @@ void CNavAreaGrid::Reset( void )
 		m_hashTable[i] = nullptr;
 
 	m_areaCount = 0;
+	++m_generation;
 
 	EditNavAreasReset(); // reset static vars
 }
@@ -4989,7 +5591,7 @@ void CNavAreaGrid::Reset( void )
  */
 void CNavAreaGrid::Initialize( float minX, float maxX, float minY, float maxY )
 {
-	if (m_grid)
+	if (!m_grid.empty())
 		Reset();
 
 	m_minX = minX;
@@ -4998,7 +5600,7 @@ void CNavAreaGrid::Initialize( float minX, float maxX, float minY, float maxY )
 	m_gridSizeX = ((maxX - minX) / m_cellSize) + 1;
 	m_gridSizeY = ((maxY - minY) / m_cellSize) + 1;
 
-	m_grid = new NavAreaList[ m_gridSizeX * m_gridSizeY ];
+	m_grid.resize( m_gridSizeX * m_gridSizeY );
 }
 
 /**
@@ -5009,14 +5611,29 @@ void CNavAreaGrid::AddNavArea( CNavArea *area )
 	// add to grid
 	const Extent *extent = area->GetExtent();
 
+	Entry entry;
+	entry.loX = extent->lo.x;
+	entry.loY = extent->lo.y;
+	entry.hiX = extent->hi.x;
+	entry.hiY = extent->hi.y;
+	entry.loZ = std::min( std::min( extent->lo.z, extent->hi.z ), std::min( area->m_neZ, area->m_swZ ) );
+	entry.hiZ = std::max( std::max( extent->lo.z, extent->hi.z ), std::max( area->m_neZ, area->m_swZ ) );
+	entry.area = area;
+
 	int loX = WorldToGridX( extent->lo.x );
 	int loY = WorldToGridY( extent->lo.y );
 	int hiX = WorldToGridX( extent->hi.x );
 	int hiY = WorldToGridY( extent->hi.y );
 
 	for( int y = loY; y <= hiY; ++y )
+	{
 		for( int x = loX; x <= hiX; ++x )
-			m_grid[ x + y*m_gridSizeX ].push_back( const_cast<CNavArea *>( area ) );
+		{
+			// keep the cell sorted from highest to lowest
+			Cell &cell = m_grid[ x + y*m_gridSizeX ];
+			cell.insert( std::upper_bound( cell.begin(), cell.end(), entry, IsHigherEntry ), entry );
+		}
+	}
 
 	// add to hash table
 	int key = ComputeHashKey( area->GetID() );
@@ -5041,11 +5658,12 @@ void CNavAreaGrid::AddNavArea( CNavArea *area )
 }
 
 /**
- * Remove an area from the grid
+ * Remove an area from the grid.
+ * The area's extent must not have changed since it was added.
  */
 void CNavAreaGrid::RemoveNavArea( CNavArea *area )
 {
-	// add to grid
+	// remove from grid
 	const Extent *extent = area->GetExtent();
 
 	int loX = WorldToGridX( extent->lo.x );
@@ -5054,8 +5672,21 @@ void CNavAreaGrid::RemoveNavArea( CNavArea *area )
 	int hiY = WorldToGridY( extent->hi.y );
 
 	for( int y = loY; y <= hiY; ++y )
+	{
 		for( int x = loX; x <= hiX; ++x )
-			m_grid[ x + y*m_gridSizeX ].remove( area );
+		{
+			Cell &cell = m_grid[ x + y*m_gridSizeX ];
+
+			for( Cell::iterator iter = cell.begin(); iter != cell.end(); ++iter )
+			{
+				if (iter->area == area)
+				{
+					cell.erase( iter );
+					break;
+				}
+			}
+		}
+	}
 
 	// remove from hash table
 	int key = ComputeHashKey( area->GetID() );
@@ -5079,6 +5710,7 @@ void CNavAreaGrid::RemoveNavArea( CNavArea *area )
 	}
 
 	--m_areaCount;
+	++m_generation;
 }
 
 /**
@@ -5086,60 +5718,119 @@ void CNavAreaGrid::RemoveNavArea( CNavArea *area )
  */
 CNavArea *CNavAreaGrid::GetNavArea( const Vector *pos, float beneathLimit ) const
 {
-	if (m_grid == nullptr)
+	if (m_grid.empty())
 		return nullptr;
 
 	// get list in cell that contains position
 	int x = WorldToGridX( pos->x );
 	int y = WorldToGridY( pos->y );
-	NavAreaList *list = &m_grid[ x + y*m_gridSizeX ];
+	const Cell &cell = m_grid[ x + y*m_gridSizeX ];
 
 
 	// search cell list to find correct area
 	CNavArea *use = nullptr;
 	float useZ = -99999999.9f;
 	Vector testPos = *pos + Vector( 0, 0, 5 );
+	float lowestZ = pos->z - beneathLimit;
 
-	for( NavAreaList::iterator iter = list->begin(); iter != list->end(); ++iter )
+	for( Cell::const_iterator iter = cell.begin(); iter != cell.end(); ++iter )
 	{
-		CNavArea *area = *iter;
+		const Entry &entry = *iter;
+
+		// the remaining areas are all lower than this one - if it can't be used, none of them can
+		if (entry.hiZ <= useZ || entry.hiZ < lowestZ)
+			break;
+
+		// if area is entirely above us, skip it
+		if (entry.loZ > testPos.z)
+			continue;
 
 		// check if position is within 2D boundaries of this area
-		if (area->IsOverlapping( &testPos ))
-		{
-			// project position onto area to get Z
-			float z = area->GetZ( &testPos );
+		if (testPos.x < entry.loX || testPos.x > entry.hiX || testPos.y < entry.loY || testPos.y > entry.hiY)
+			continue;
 
-			// if area is above us, skip it
-			if (z > testPos.z)
-				continue;
+		// project position onto area to get Z
+		float z = entry.area->GetZ( &testPos );
 
-			// if area is too far below us, skip it
-			if (z < pos->z - beneathLimit)
-				continue;
+		// if area is above us, skip it
+		if (z > testPos.z)
+			continue;
 
-			// if area is higher than the one we have, use this instead
-			if (z > useZ)
-			{
-				use = area;
-				useZ = z;
-			}
+		// if area is too far below us, skip it
+		if (z < lowestZ)
+			continue;
+
+		// if area is higher than the one we have, use this instead
+		if (z > useZ)
+		{
+			use = entry.area;
+			useZ = z;
 		}
 	}
 
 	return use;
 }
 
+/**
+ * Return true if 'area' is under 'pos', no more than 'beneathLimit' below it, and return the area's height there in 'z'
+ */
+bool CNavAreaGrid::IsBeneath( const CNavArea *area, const Vector *pos, float beneathLimit, float *z ) const
+{
+	Vector testPos = *pos + Vector( 0, 0, 5 );
+
+	if (!area->IsOverlapping( &testPos ))
+		return false;
+
+	*z = area->GetZ( &testPos );
+
+	return (*z <= testPos.z && *z >= pos->z - beneathLimit);
+}
+
+/**
+ * Given a position, return the nav area that IsOverlapping and is *immediately* beneath it.
+ * Callers that move a short distance between lookups, such as bots tracking their current area,
+ * pass the area they found last time as 'hint'. If the position is still over the hint or one of its
+ * neighbors, and no other area could fit between it and the position, the grid is not searched.
+ */
+CNavArea *CNavAreaGrid::GetNavArea( const Vector *pos, float beneathLimit, CNavArea *hint ) const
+{
+	if (hint)
+	{
+		// areas are never stacked closer than a player's height, so nothing can lie between
+		const float headroom = HumanHeight + 5.0f;
+		float z;
+
+		if (IsBeneath( hint, pos, beneathLimit, &z ) && pos->z - z < headroom)
+			return hint;
+
+		for( int d=0; d<NUM_DIRECTIONS; ++d )
+		{
+			int count = hint->GetAdjacentCount( (NavDirType)d );
+			for( int i=0; i<count; ++i )
+			{
+				CNavArea *adj = hint->GetAdjacentArea( (NavDirType)d, i );
+
+				if (IsBeneath( adj, pos, beneathLimit, &z ) && pos->z - z < headroom)
+					return adj;
+			}
+		}
+	}
+
+	return GetNavArea( pos, beneathLimit );
+}
+
 
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Given a position in the world, return the nav area that is closest
  * and at the same height, or beneath it.
  * Used to find initial area if we start off of the mesh.
+ * The grid is searched in rings of cells moving outward from the position, stopping once
+ * every unsearched cell is farther away than the closest area found so far.
  */
 CNavArea *CNavAreaGrid::GetNearestNavArea( const Vector *pos, bool anyZ ) const
 {
-	if (m_grid == nullptr)
+	if (m_grid.empty())
 		return nullptr;
 
 	CNavArea *close = nullptr;
@@ -5159,32 +5850,95 @@ CNavArea *CNavAreaGrid::GetNearestNavArea( const Vector *pos, bool anyZ ) const
 
 	source.z += HalfHumanHeight;
 
-	/// @todo Step incrementally using grid for speed
+	const int centerX = WorldToGridX( source.x );
+	const int centerY = WorldToGridY( source.y );
+	const int maxRing = std::max( std::max( centerX, m_gridSizeX-1 - centerX ), std::max( centerY, m_gridSizeY-1 - centerY ) );
 
-	// find closest nav area
-	for( NavAreaList::iterator iter = TheNavAreaList.begin(); iter != TheNavAreaList.end(); ++iter )
+	for( int ring=0; ring<=maxRing; ++ring )
 	{
-		CNavArea *area = *iter;
-
-		Vector areaPos;
-		area->GetClosestPointOnArea( &source, &areaPos );
+		if (ring > 0)
+		{
+			// find how far the nearest unsearched cell is - sides at the edge of the grid have nothing beyond them
+			float edgeDist = 99999999.9f;
+
+			if (centerX - ring >= 0)
+				edgeDist = std::min( edgeDist, source.x - (m_minX + (centerX - ring + 1) * m_cellSize) );
+			if (centerX + ring < m_gridSizeX)
+				edgeDist = std::min( edgeDist, (m_minX + (centerX + ring) * m_cellSize) - source.x );
+			if (centerY - ring >= 0)
+				edgeDist = std::min( edgeDist, source.y - (m_minY + (centerY - ring + 1) * m_cellSize) );
+			if (centerY + ring < m_gridSizeY)
+				edgeDist = std::min( edgeDist, (m_minY + (centerY + ring) * m_cellSize) - source.y );
+
+			if (edgeDist > 0.0f && edgeDist * edgeDist >= closeDistSq)
+				break;
+		}
 
-		float distSq = (areaPos - source).LengthSquared();
+		const int ringLoX = centerX - ring;
+		const int ringHiX = centerX + ring;
+		const int ringLoY = centerY - ring;
+		const int ringHiY = centerY + ring;
 
-		// keep the closest area
-		if (distSq < closeDistSq)
+		for( int y = std::max( ringLoY, 0 ); y <= std::min( ringHiY, m_gridSizeY-1 ); ++y )
 		{
-			// check LOS to area
-			if (!anyZ)
+			// the inside of the ring was searched already
+			bool isEdgeRow = (y == ringLoY || y == ringHiY);
+			int step = (isEdgeRow) ? 1 : 2 * ring;
+
+			for( int x = ringLoX; x <= ringHiX; x += step )
 			{
-				TraceResult result;
-				util::TraceLine( source, areaPos + Vector( 0, 0, HalfHumanHeight ), util::ignore_monsters, util::ignore_glass, nullptr, &result );
-				if (result.flFraction != 1.0f)
+				if (x < 0 || x >= m_gridSizeX)
 					continue;
+
+				const Cell &cell = m_grid[ x + y*m_gridSizeX ];
+
+				for( Cell::const_iterator iter = cell.begin(); iter != cell.end(); ++iter )
+				{
+					const Entry &entry = *iter;
+
+					// if even the area's 2D extent is farther than the closest area, skip it
+					float dx = std::max( 0.0f, std::max( entry.loX - source.x, source.x - entry.hiX ) );
+					float dy = std::max( 0.0f, std::max( entry.loY - source.y, source.y - entry.hiY ) );
+					if (dx*dx + dy*dy >= closeDistSq)
+						continue;
+
+					// an area overlapping several cells is checked only once - in the cell nearest its
+					// low corner, on the first ring that reaches it
+					int areaLoX = WorldToGridX( entry.loX );
+					int areaLoY = WorldToGridY( entry.loY );
+					int areaHiX = WorldToGridX( entry.hiX );
+					int areaHiY = WorldToGridY( entry.hiY );
+
+					int areaRing = std::max( std::max( 0, std::max( areaLoX - centerX, centerX - areaHiX ) ),
+										std::max( 0, std::max( areaLoY - centerY, centerY - areaHiY ) ) );
+
+					if (areaRing != ring || std::max( areaLoX, ringLoX ) != x || std::max( areaLoY, ringLoY ) != y)
+						continue;
+
+					CNavArea *area = entry.area;
+
+					Vector areaPos;
+					area->GetClosestPointOnArea( &source, &areaPos );
+
+					float distSq = (areaPos - source).LengthSquared();
+
+					// keep the closest area
+					if (distSq < closeDistSq)
+					{
+						// check LOS to area
+						if (!anyZ)
+						{
+							TraceResult result;
+							util::TraceLine( source, areaPos + Vector( 0, 0, HalfHumanHeight ), util::ignore_monsters, util::ignore_glass, nullptr, &result );
+							if (result.flFraction != 1.0f)
+								continue;
+						}
+
+						closeDistSq = distSq;
+						close = area;
+					}
+				}
 			}
-					
-			closeDistSq = distSq;
-			close = area;
 		}
 	}
 
@@ -5224,3 +5978,451 @@ unsigned int CNavAreaGrid::GetPlace( const Vector *pos ) const
 }
 
 
+
+//--------------------------------------------------------------------------------------------------------------
+
+/**
+ * The singletons for searching the mesh
+ * NOTE: The pool is defined first so it is constructed before, and destroyed after, the graph
+ */
+CNavSearchPool TheNavSearchPool;
+CNavAreaGraph TheNavAreaGraph;
+
+
+CNavAreaGraph::CNavAreaGraph( void )
+{
+	// a single sentinel so an empty graph still has valid edge ranges
+	m_offset.assign( 1, 0 );
+
+	m_isDirty = true;
+	m_buildCount = 0;
+}
+
+/**
+ * The mesh is about to change. Wait for any searches running on worker threads, since they read
+ * the graph and the areas, then flag the graph to be rebuilt before the next search.
+ */
+void CNavAreaGraph::Invalidate( void )
+{
+	TheNavSearchPool.Wait();
+
+	m_isDirty = true;
+}
+
+/**
+ * Discard the graph
+ */
+void CNavAreaGraph::Reset( void )
+{
+	TheNavSearchPool.Wait();
+
+	m_area.clear();
+	m_center.clear();
+	m_extent.clear();
+	m_edge.clear();
+
+	// a single sentinel so an empty graph still has valid edge ranges
+	m_offset.assign( 1, 0 );
+
+	m_isDirty = true;
+	++m_buildCount;
+}
+
+/**
+ * Append an edge to the area currently being built, if its destination is part of the graph
+ */
+inline void CNavAreaGraph::AddEdge( const CNavArea *to, NavTraverseType how, const CNavLadder *ladder )
+{
+	if (to == nullptr || !Contains( to ))
+		return;
+
+	NavAreaEdge edge;
+	edge.to = to->m_graphIndex;
+	edge.how = how;
+	edge.ladder = ladder;
+
+	m_edge.push_back( edge );
+}
+
+/**
+ * Freeze the current contents of TheNavAreaList into flat arrays
+ */
+void CNavAreaGraph::Build( void )
+{
+	m_area.clear();
+	m_center.clear();
+	m_extent.clear();
+	m_offset.clear();
+	m_edge.clear();
+
+	m_area.reserve( TheNavAreaList.size() );
+	m_center.reserve( TheNavAreaList.size() );
+	m_extent.reserve( TheNavAreaList.size() );
+	m_offset.reserve( TheNavAreaList.size() * NUM_EDGE_GROUPS + 1 );
+
+	// assign indices first, so edges can refer to areas later in the list
+	NavAreaList::iterator iter;
+	for( iter = TheNavAreaList.begin(); iter != TheNavAreaList.end(); ++iter )
+	{
+		CNavArea *area = *iter;
+
+		area->m_graphIndex = m_area.size();
+
+		m_area.push_back( area );
+		m_center.push_back( area->m_center );
+		m_extent.push_back( area->m_extent );
+	}
+
+	for( unsigned int i=0; i<m_area.size(); ++i )
+	{
+		const CNavArea *area = m_area[i];
+
+		// floor connections
+		for( int dir=0; dir<NUM_DIRECTIONS; ++dir )
+		{
+			m_offset.push_back( m_edge.size() );
+
+			for( NavConnectList::const_iterator citer = area->m_connect[ dir ].begin(); citer != area->m_connect[ dir ].end(); ++citer )
+				AddEdge( (*citer).area, (NavTraverseType)dir, nullptr );
+		}
+
+		// up ladders - do not use BEHIND connection, as its very hard to get to when going up a ladder
+		m_offset.push_back( m_edge.size() );
+
+		NavLadderList::const_iterator liter;
+		for( liter = area->m_ladder[ LADDER_UP ].begin(); liter != area->m_ladder[ LADDER_UP ].end(); ++liter )
+		{
+			const CNavLadder *ladder = *liter;
+
+			// cannot use this ladder if the ladder bottom is hanging above our head
+			if (ladder->m_isDangling)
+				continue;
+
+			AddEdge( ladder->m_topForwardArea, GO_LADDER_UP, ladder );
+			AddEdge( ladder->m_topLeftArea, GO_LADDER_UP, ladder );
+			AddEdge( ladder->m_topRightArea, GO_LADDER_UP, ladder );
+		}
+
+		// down ladders
+		m_offset.push_back( m_edge.size() );
+
+		for( liter = area->m_ladder[ LADDER_DOWN ].begin(); liter != area->m_ladder[ LADDER_DOWN ].end(); ++liter )
+		{
+			const CNavLadder *ladder = *liter;
+
+			AddEdge( ladder->m_bottomArea, GO_LADDER_DOWN, ladder );
+		}
+	}
+
+	// sentinel marking the end of the last area's edges
+	m_offset.push_back( m_edge.size() );
+
+	m_isDirty = false;
+	++m_buildCount;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+
+thread_local CNavSearchContext *CNavSearchContext::m_active = nullptr;
+
+/**
+ * Each thread gets its own scratch context for synchronous searches
+ */
+CNavSearchContext *CNavSearchContext::GetScratch( void )
+{
+	static thread_local CNavSearchContext scratch;
+	return &scratch;
+}
+
+
+CNavSearchContext::CNavSearchContext( void )
+{
+	m_marker = 0;
+	m_sequence = 0;
+	m_expansionCount = 0;
+	m_buildCount = 0;
+}
+
+/**
+ * Start a new search over the current graph
+ */
+void CNavSearchContext::Begin( void )
+{
+	unsigned int count = TheNavAreaGraph.GetAreaCount();
+
+	++m_marker;
+
+	// if the marker wrapped, or the graph changed size, stale markers could look current
+	if (m_marker == 0 || m_node.size() != count)
+	{
+		Node empty;
+		empty.marker = 0;
+		empty.heapIndex = CLOSED;
+		empty.order = 0;
+		empty.parent = NO_PARENT;
+		empty.costSoFar = 0.0f;
+		empty.totalCost = 0.0f;
+		empty.how = NUM_TRAVERSE_TYPES;
+
+		m_node.assign( count, empty );
+		m_marker = 1;
+	}
+
+	m_heap.clear();
+	m_sequence = 0;
+	m_expansionCount = 0;
+	m_buildCount = TheNavAreaGraph.GetBuildCount();
+}
+
+void CNavSearchContext::SiftUp( unsigned int slot )
+{
+	unsigned int i = m_heap[ slot ];
+
+	while( slot > 0 )
+	{
+		unsigned int parentSlot = (slot - 1) / 2;
+		unsigned int parent = m_heap[ parentSlot ];
+
+		if (!IsLess( i, parent ))
+			break;
+
+		m_heap[ slot ] = parent;
+		m_node[ parent ].heapIndex = slot;
+		slot = parentSlot;
+	}
+
+	m_heap[ slot ] = i;
+	m_node[ i ].heapIndex = slot;
+}
+
+void CNavSearchContext::SiftDown( unsigned int slot )
+{
+	unsigned int i = m_heap[ slot ];
+	unsigned int count = m_heap.size();
+
+	while( true )
+	{
+		unsigned int child = 2 * slot + 1;
+		if (child >= count)
+			break;
+
+		// pick the cheaper child
+		if (child + 1 < count && IsLess( m_heap[ child + 1 ], m_heap[ child ] ))
+			++child;
+
+		if (!IsLess( m_heap[ child ], i ))
+			break;
+
+		m_heap[ slot ] = m_heap[ child ];
+		m_node[ m_heap[ slot ] ].heapIndex = slot;
+		slot = child;
+	}
+
+	m_heap[ slot ] = i;
+	m_node[ i ].heapIndex = slot;
+}
+
+/**
+ * Mark the area as visited and add it to the open list
+ */
+void CNavSearchContext::AddToOpenList( unsigned int i )
+{
+	m_node[i].marker = m_marker;
+	m_node[i].order = m_sequence++;
+
+	m_heap.push_back( i );
+	SiftUp( m_heap.size() - 1 );
+}
+
+/**
+ * A smaller cost has been found for an area already on the open list
+ */
+void CNavSearchContext::UpdateOnOpenList( unsigned int i )
+{
+	// costs only decrease, so the area can only move towards the root
+	m_node[i].order = m_sequence++;
+	SiftUp( m_node[i].heapIndex );
+}
+
+/**
+ * Remove and return the cheapest area on the open list. It is now closed.
+ */
+unsigned int CNavSearchContext::PopOpenList( void )
+{
+	unsigned int i = m_heap.front();
+
+	unsigned int last = m_heap.back();
+	m_heap.pop_back();
+
+	if (!m_heap.empty())
+	{
+		m_heap.front() = last;
+		m_node[ last ].heapIndex = 0;
+		SiftDown( 0 );
+	}
+
+	m_node[i].heapIndex = CLOSED;
+	++m_expansionCount;
+
+	return i;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+
+CNavSearchPool::CNavSearchPool( void )
+{
+	m_isQuitting = false;
+}
+
+CNavSearchPool::~CNavSearchPool()
+{
+	SetThreadCount( 0 );
+}
+
+/**
+ * Start or stop worker threads. With no worker threads, jobs run synchronously when submitted.
+ */
+void CNavSearchPool::SetThreadCount( int count )
+{
+	if (count < 0)
+		count = 0;
+
+	if (count == (int)m_thread.size())
+		return;
+
+	// stop the current workers - any waiting jobs are run first
+	if (!m_thread.empty())
+	{
+		Wait();
+
+		{
+			std::lock_guard<std::mutex> lock( m_mutex );
+			m_isQuitting = true;
+		}
+		m_wake.notify_all();
+
+		for( unsigned int i=0; i<m_thread.size(); ++i )
+			m_thread[i].join();
+
+		m_thread.clear();
+		m_isQuitting = false;
+	}
+
+	for( int i=0; i<count; ++i )
+		m_thread.push_back( std::thread( &CNavSearchPool::WorkerMain, this ) );
+}
+
+/**
+ * Queue a job to run on a worker thread. Its results are delivered by the next DeliverResults().
+ */
+void CNavSearchPool::Submit( CNavSearchJob *job )
+{
+	if (job->m_isBusy)
+		return;
+
+	job->m_isBusy = true;
+
+	// workers must never see the graph rebuilt underneath them
+	TheNavAreaGraph.Update();
+
+	if (m_thread.empty())
+	{
+		// no workers - run it now, but still deliver it with the others
+		job->Run();
+
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_finished.push_back( job );
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_waiting.push_back( job );
+	}
+	m_wake.notify_one();
+}
+
+/**
+ * Withdraw the job. If it is running, wait for it to finish. Its results are discarded.
+ */
+void CNavSearchPool::Cancel( CNavSearchJob *job )
+{
+	if (!job->m_isBusy)
+		return;
+
+	std::unique_lock<std::mutex> lock( m_mutex );
+
+	m_waiting.erase( std::remove( m_waiting.begin(), m_waiting.end(), job ), m_waiting.end() );
+
+	while( std::find( m_running.begin(), m_running.end(), job ) != m_running.end() )
+		m_idle.wait( lock );
+
+	m_finished.erase( std::remove( m_finished.begin(), m_finished.end(), job ), m_finished.end() );
+
+	job->m_isBusy = false;
+}
+
+/**
+ * Block until no jobs are waiting or running
+ */
+void CNavSearchPool::Wait( void )
+{
+	if (m_thread.empty())
+		return;
+
+	std::unique_lock<std::mutex> lock( m_mutex );
+
+	while( !m_waiting.empty() || !m_running.empty() )
+		m_idle.wait( lock );
+}
+
+/**
+ * Invoke OnComplete() for all finished jobs. Call from the main thread at the start of a frame.
+ */
+void CNavSearchPool::DeliverResults( void )
+{
+	std::vector<CNavSearchJob *> finished;
+
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		finished.swap( m_finished );
+	}
+
+	for( unsigned int i=0; i<finished.size(); ++i )
+	{
+		CNavSearchJob *job = finished[i];
+
+		job->m_isBusy = false;
+		job->OnComplete();
+	}
+}
+
+/**
+ * Worker thread loop
+ */
+void CNavSearchPool::WorkerMain( void )
+{
+	std::unique_lock<std::mutex> lock( m_mutex );
+
+	while( true )
+	{
+		while( m_waiting.empty() && !m_isQuitting )
+			m_wake.wait( lock );
+
+		if (m_isQuitting)
+			break;
+
+		CNavSearchJob *job = m_waiting.front();
+		m_waiting.pop_front();
+		m_running.push_back( job );
+
+		lock.unlock();
+		job->Run();
+		lock.lock();
+
+		m_running.erase( std::find( m_running.begin(), m_running.end(), job ) );
+		m_finished.push_back( job );
+
+		m_idle.notify_all();
+	}
+}
@@ -6,14 +6,22 @@
 #define _NAV_AREA_H_
 
 #include <list>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "nav.h"
 #include "steam_util.h"
 
 class CNavArea;
+struct NavFileMesh;
+struct NavFileHidingSpot;
+struct NavConnectRequest;
 
 void DestroyHidingSpots( void );
 void StripNavigationAreas( void );
-bool SaveNavigationMap( const char *filename );
+bool SaveNavigationMap( const char *filename, unsigned int version = NAV_CURRENT_VERSION );
 NavErrorType LoadNavigationMap( void );
 void DestroyNavigationMap( void );
 
@@ -127,11 +135,12 @@ public:
 	bool IsGoodSniperSpot( void ) const			{ return (m_flags & GOOD_SNIPER_SPOT) ? true : false; }
 	bool IsIdealSniperSpot( void ) const		{ return (m_flags & IDEAL_SNIPER_SPOT) ? true : false; }
 
-	void SetFlags( unsigned char flags )		{ m_flags |= flags; }		///< FOR INTERNAL USE ONLY
+	void SetFlags( unsigned char flags )		{ m_flags |= flags; ++m_changeCount; }		///< FOR INTERNAL USE ONLY
 	unsigned char GetFlags( void ) const		{ return m_flags; }
 
-	void Save( int fd, unsigned int version ) const;
+	void Save( BufferedFileWriter *file, unsigned int version ) const;
 	void Load( SteamFile *file, unsigned int version );
+	void Load( const NavFileHidingSpot *data );				///< load from a version 6 nav file
 
 	const Vector *GetPosition( void ) const		{ return &m_pos; }	///< get the position of the hiding spot
 	unsigned int GetID( void ) const			{ return m_id; }
@@ -140,6 +149,8 @@ public:
 	bool IsMarked( void ) const					{ return (m_marker == m_masterMarker) ? true : false; }
 	static void ChangeMasterMarker( void )		{ ++m_masterMarker; }
 
+	static unsigned int GetChangeCount( void )	{ return m_changeCount; }	///< changes whenever any spot is created, destroyed, moved, or flagged
+
 private:
 	friend void DestroyHidingSpots( void );
 
@@ -151,6 +162,7 @@ private:
 
 	static unsigned int m_nextID;							///< used when allocating spot ID's
 	static unsigned int m_masterMarker;						///< used to mark spots
+	static unsigned int m_changeCount;
 };
 typedef std::list<HidingSpot *> HidingSpotList;
 extern HidingSpotList TheHidingSpotList;
@@ -206,9 +218,10 @@ public:
 	void Disconnect( CNavArea *area );							///< disconnect this area from given area
 
 	void Save( FILE *fp ) const;
-	void Save( int fd, unsigned int version );
+	void Save( BufferedFileWriter *file, unsigned int version );
 	void Load( SteamFile *file, unsigned int version );
 	NavErrorType PostLoad( void );
+	void Load( const NavFileMesh *mesh, unsigned int index, CNavArea **areas, HidingSpot **spots );	///< load from a version 6 nav file - IDs are already resolved
 
 	unsigned int GetID( void ) const						{ return m_id; }
 
@@ -258,10 +271,8 @@ public:
 
 	SpotEncounter *GetSpotEncounter( const CNavArea *from, const CNavArea *to );	///< given the areas we are moving between, return the spots we will encounter
 	void ComputeSpotEncounters( void );							///< compute spot encounter data - for map learning
-
-	//- "danger" ----------------------------------------------------------------------------------------
-	void IncreaseDanger( int teamID, float amount );			///< increase the danger of this area for the given team
-	float GetDanger( int teamID );								///< return the danger of this area (decays over time)
+	void GatherSpotEncounters( void );							///< trace the spots visible along each path thru this area - first half of ComputeSpotEncounters()
+	void OrderSpotEncounters( void );							///< drop spots seen ahead of each path - second half of ComputeSpotEncounters(), does no traces
 
 	float GetSizeX( void ) const					{ return m_extent.hi.x - m_extent.lo.x; }
 	float GetSizeY( void ) const					{ return m_extent.hi.y - m_extent.lo.y; }
@@ -283,18 +294,18 @@ public:
 	void ComputeApproachAreas( void );							///< determine the set of "approach areas" - for map learning
 
 	//- A* pathfinding algorithm ------------------------------------------------------------------------
-	static void MakeNewMarker( void )					{ ++m_masterMarker; if (m_masterMarker == 0) m_masterMarker = 1; }
-	void Mark( void )													{ m_marker = m_masterMarker; }
-	bool IsMarked( void ) const								{ return (m_marker == m_masterMarker) ? true : false; }
+	// NOTE: Search state is kept in the calling thread's current CNavSearchContext, not in the area itself
+	static void MakeNewMarker( void );
+	void Mark( void );
+	bool IsMarked( void ) const;
 	
-	void SetParent( CNavArea *parent, NavTraverseType how = NUM_TRAVERSE_TYPES )	{ m_parent = parent; m_parentHow = how; }
-	CNavArea *GetParent( void ) const						{ return m_parent; }
-	NavTraverseType GetParentHow( void ) const	{ return m_parentHow; }
+	void SetParent( CNavArea *parent, NavTraverseType how = NUM_TRAVERSE_TYPES );
+	CNavArea *GetParent( void ) const;
+	NavTraverseType GetParentHow( void ) const;
 
 	bool IsOpen( void ) const;								///< true if on "open list"
 	void AddToOpenList( void );								///< add to open list in decreasing value order
 	void UpdateOnOpenList( void );							///< a smaller value has been found, update this area on the open list
-	void RemoveFromOpenList( void );
 	static bool IsOpenListEmpty( void );
 	static CNavArea *PopOpenList( void );					///< remove and return the first element of the open list													
 
@@ -304,11 +315,13 @@ public:
 
 	static void ClearSearchLists( void );					///< clears the open and closed lists for a new search
 
-	void SetTotalCost( float value )							{ m_totalCost = value; }
-	float GetTotalCost( void ) const							{ return m_totalCost; }
+	void SetTotalCost( float value );
+	float GetTotalCost( void ) const;
+
+	void SetCostSoFar( float value );
+	float GetCostSoFar( void ) const;
 
-	void SetCostSoFar( float value )							{ m_costSoFar = value; }
-	float GetCostSoFar( void ) const							{ return m_costSoFar; }
+	unsigned int GetGraphIndex( void ) const					{ return m_graphIndex; }	///< our slot in TheNavAreaGraph (see CNavAreaGraph::Contains)
 
 	//- editing -----------------------------------------------------------------------------------------
 	void Draw( byte red, byte green, byte blue, int duration = 50 );	///< draw area for debugging & editing
@@ -316,23 +329,29 @@ public:
 	void DrawMarkedCorner( NavCornerType corner, byte red, byte green, byte blue, int duration = 50 );
 	bool SplitEdit( bool splitAlongX, float splitEdge, CNavArea **outAlpha = nullptr, CNavArea **outBeta = nullptr );	///< split this area into two areas at the given edge
 	bool MergeEdit( CNavArea *adj );						///< merge this area and given adjacent area 
+	bool IsMergeable( const CNavArea *adj, NavDirType dir ) const;	///< return true if given adjacent area can be merged with this one across the given edge
 	bool SpliceEdit( CNavArea *other );						///< create a new area between this area and given area 
 	void RaiseCorner( NavCornerType corner, int amount );	///< raise/lower a corner (or all corners if corner == NUM_CORNERS)
 
 	//- ladders -----------------------------------------------------------------------------------------
-	void AddLadderUp( CNavLadder *ladder )				{ m_ladder[ LADDER_UP ].push_back( ladder ); }
-	void AddLadderDown( CNavLadder *ladder )			{ m_ladder[ LADDER_DOWN ].push_back( ladder ); }
+	void AddLadderUp( CNavLadder *ladder );
+	void AddLadderDown( CNavLadder *ladder );
 
 private:
 	friend void ConnectGeneratedAreas( void );
+	friend void ScanGeneratedAreaEdges( const CNavArea *area, std::vector< NavConnectRequest > *requests );
 	friend void MergeGeneratedAreas( void );
 	friend void MarkJumpAreas( void );
-	friend bool SaveNavigationMap( const char *filename );
+	friend bool SaveNavigationMap( const char *filename, unsigned int version );
+	friend void SaveFlatNavigationMap( BufferedFileWriter *file );
 	friend NavErrorType LoadNavigationMap( void );
 	friend void DestroyNavigationMap( void );
 	friend void DestroyHidingSpots( void );
+	friend void AnalyzeNavigationMap( bool isTraceThreadSafe );
 	friend void StripNavigationAreas( void );
 	friend class CNavAreaGrid;
+	friend class CNavAreaGraph;
+	friend class CNavAreaVisibility;
 	friend class CBotManager;
 
 	void Initialize( void );								///< to keep constructors consistent
@@ -354,11 +373,6 @@ private:
 	//- for hunting -------------------------------------------------------------------------------------
 	float m_clearedTimestamp[ MAX_AREA_TEAMS ];				///< time this area was last "cleared" of enemies
 
-	//- "danger" ----------------------------------------------------------------------------------------
-	float m_danger[ MAX_AREA_TEAMS ];						///< danger of this area, allowing bots to avoid areas where they died in the past - zero is no danger
-	float m_dangerTimestamp[ MAX_AREA_TEAMS ];				///< time when danger value was set - used for decaying
-	void DecayDanger( void );
-
 	//- hiding spots ------------------------------------------------------------------------------------
 	HidingSpotList m_hidingSpotList;
 	bool IsHidingSpotCollision( const Vector *pos ) const;	///< returns true if an existing hiding spot is too close to given position
@@ -375,16 +389,10 @@ private:
 	void Strip( void );										///< remove "analyzed" data from nav area
 
 	//- A* pathfinding algorithm ------------------------------------------------------------------------
-	static unsigned int m_masterMarker;
-	unsigned int m_marker;									///< used to flag the area as visited
-	CNavArea *m_parent;										///< the area just prior to this on in the search path
-	NavTraverseType m_parentHow;							///< how we get from parent to us
-	float m_totalCost;										///< the distance so far plus an estimate of the distance left
-	float m_costSoFar;										///< distance travelled so far
+	unsigned int m_graphIndex;								///< index of this area in TheNavAreaGraph, assigned when the graph is built
 
-	static CNavArea *m_openList;
-	CNavArea *m_nextOpen, *m_prevOpen;						///< only valid if m_openMarker == m_masterMarker
-	unsigned int m_openMarker;								///< if this equals the current marker value, we are on the open list
+	//- potentially visible areas -----------------------------------------------------------------------
+	unsigned int m_visIndex;								///< index of this area in TheNavAreaVisibility, assigned when it is computed or loaded
 
 	//- connections to adjacent areas -------------------------------------------------------------------
 	NavConnectList m_connect[ NUM_DIRECTIONS ];				///< a list of adjacent areas for each direction
@@ -432,54 +440,14 @@ inline CNavArea *CNavArea::GetAdjacentArea( NavDirType dir, int i ) const
 	return nullptr;
 }
 
-inline bool CNavArea::IsOpen( void ) const
-{
-	return (m_openMarker == m_masterMarker) ? true : false;
-}
-
-inline bool CNavArea::IsOpenListEmpty( void )
-{
-	return (m_openList) ? false : true;
-}
-
-inline CNavArea *CNavArea::PopOpenList( void )
-{
-	if (m_openList)
-	{
-		CNavArea *area = m_openList;
-	
-		// disconnect from list
-		area->RemoveFromOpenList();
-
-		return area;
-	}
-
-	return nullptr;
-}
-
-inline bool CNavArea::IsClosed( void ) const
-{
-	if (IsMarked() && !IsOpen())
-		return true;
-
-	return false;
-}
-
-inline void CNavArea::AddToClosedList( void )
-{
-	Mark();
-}
-
-inline void CNavArea::RemoveFromClosedList( void )
-{
-	// since "closed" is defined as visited (marked) and not on open list, do nothing
-}
-
 //--------------------------------------------------------------------------------------------------------------
 
 /**
  * The CNavAreaGrid is used to efficiently access navigation areas by world position.
- * Each cell of the grid contains a list of areas that overlap it.
+ * Each cell of the grid contains an array of the areas that overlap it, along with each area's 2D extent
+ * and height range, so most areas can be rejected without touching the areas themselves.
+ * The areas in a cell are kept sorted from highest to lowest, so a lookup can stop as soon as
+ * the remaining areas are too low to be the one beneath the position.
  * Given a world position, the corresponding grid cell is ( x/cellsize, y/cellsize ).
  */
 class CNavAreaGrid
@@ -493,21 +461,37 @@ public:
 	void AddNavArea( CNavArea *area );						///< add an area to the grid
 	void RemoveNavArea( CNavArea *area );					///< remove an area from the grid
 	unsigned int GetNavAreaCount( void ) const	{ return m_areaCount; }	///< return total number of nav areas
+	unsigned int GetGeneration( void ) const	{ return m_generation; }	///< changes whenever an area leaves the grid, so saved area pointers can be checked
 
 	CNavArea *GetNavArea( const Vector *pos, float beneathLimt = 120.0f ) const;	///< given a position, return the nav area that IsOverlapping and is *immediately* beneath it
+	CNavArea *GetNavArea( const Vector *pos, float beneathLimit, CNavArea *hint ) const;	///< as above, but try 'hint' and its neighbors first
 	CNavArea *GetNavAreaByID( unsigned int id ) const;
 	CNavArea *GetNearestNavArea( const Vector *pos, bool anyZ = false ) const;
 
 	Place GetPlace( const Vector *pos ) const;				///< return radio chatter place for given coordinate
 
 private:
+	/// an area overlapping a cell, with the bounds needed to reject it cheaply
+	struct Entry
+	{
+		float loX, loY;										///< 2D extent of the area
+		float hiX, hiY;
+		float loZ, hiZ;										///< height of the area's lowest and highest corners
+		CNavArea *area;
+	};
+	typedef std::vector< Entry > Cell;
+
+	static bool IsHigherEntry( const Entry &a, const Entry &b )	{ return a.hiZ > b.hiZ; }
+	bool IsBeneath( const CNavArea *area, const Vector *pos, float beneathLimit, float *z ) const;	///< return true if 'area' is under 'pos', within 'beneathLimit'
+
 	const float m_cellSize;
-	NavAreaList *m_grid;
+	std::vector< Cell > m_grid;
 	int m_gridSizeX;
 	int m_gridSizeY;
 	float m_minX;
 	float m_minY;
 	unsigned int m_areaCount;								///< total number of nav areas
+	unsigned int m_generation;
 
 	enum { HASH_TABLE_SIZE = 256 };
 	CNavArea *m_hashTable[ HASH_TABLE_SIZE ];				///< hash table to optimize lookup by ID
@@ -542,14 +526,478 @@ private:
 
 extern CNavAreaGrid TheNavAreaGrid;
 
+//--------------------------------------------------------------------------------------------------------------
+
+/**
+ * A single traversable link from one area to another, as stored in CNavAreaGraph
+ */
+struct NavAreaEdge
+{
+	unsigned int to;										///< graph index of the adjacent area
+	NavTraverseType how;									///< how we get from the source area to the adjacent area
+	const CNavLadder *ladder;								///< the ladder used, or nullptr for floor connections
+};
+
+/**
+ * The CNavAreaGraph is a "frozen" copy of the nav mesh connectivity, laid out for fast searching.
+ * The per-area connection and ladder lists are std::lists, so walking them during A* costs a cache
+ * miss per neighbor. Here every area gets a small integer index, all outgoing edges live in one
+ * contiguous array (compressed sparse rows), and the geometry the searches touch most is kept in
+ * arrays parallel to the index.
+ * Edges for an area are grouped by direction: NORTH, EAST, SOUTH, WEST, then ladders up and down,
+ * in the same order the lists are walked, so searches visit neighbors exactly as before.
+ * Anything that changes areas or their connections must call Invalidate(); the graph is rebuilt
+ * the next time a search calls Update().
+ */
+class CNavAreaGraph
+{
+public:
+	CNavAreaGraph( void );
+
+	enum { EDGE_LADDER_UP = NUM_DIRECTIONS, EDGE_LADDER_DOWN, NUM_EDGE_GROUPS };
+
+	void Reset( void );										///< discard the graph
+	void Build( void );										///< rebuild the graph from TheNavAreaList
+	void Invalidate( void );								///< the mesh is about to change - rebuild before the next search
+	void Update( void )										{ if (m_isDirty) Build(); }	///< rebuild only if something changed
+	bool IsDirty( void ) const								{ return m_isDirty; }
+	unsigned int GetBuildCount( void ) const				{ return m_buildCount; }	///< changes every time the indices may have changed
+
+	unsigned int GetAreaCount( void ) const					{ return m_area.size(); }
+	unsigned int GetEdgeCount( void ) const					{ return m_edge.size(); }
+
+	bool Contains( const CNavArea *area ) const;			///< return true if the area has a valid index in the current graph
+
+	CNavArea *GetArea( unsigned int index ) const			{ return m_area[ index ]; }
+	const Vector &GetCenter( unsigned int index ) const		{ return m_center[ index ]; }
+	const Extent &GetExtent( unsigned int index ) const		{ return m_extent[ index ]; }
+
+	/// all edges leaving the given area
+	const NavAreaEdge *GetEdgesBegin( unsigned int index ) const	{ return m_edge.data() + m_offset[ index * NUM_EDGE_GROUPS ]; }
+	const NavAreaEdge *GetEdgesEnd( unsigned int index ) const		{ return m_edge.data() + m_offset[ (index+1) * NUM_EDGE_GROUPS ]; }
+
+	/// edges leaving the given area in one group (a NavDirType, EDGE_LADDER_UP, or EDGE_LADDER_DOWN)
+	const NavAreaEdge *GetEdgesBegin( unsigned int index, int group ) const	{ return m_edge.data() + m_offset[ index * NUM_EDGE_GROUPS + group ]; }
+	const NavAreaEdge *GetEdgesEnd( unsigned int index, int group ) const	{ return m_edge.data() + m_offset[ index * NUM_EDGE_GROUPS + group + 1 ]; }
+
+private:
+	void AddEdge( const CNavArea *to, NavTraverseType how, const CNavLadder *ladder );
+
+	bool m_isDirty;
+	unsigned int m_buildCount;
+
+	std::vector<CNavArea *> m_area;							///< index -> area
+	std::vector<Vector> m_center;							///< index -> area centroid
+	std::vector<Extent> m_extent;							///< index -> area extents
+	std::vector<unsigned int> m_offset;						///< (index * NUM_EDGE_GROUPS + group) -> first edge, with a final sentinel
+	std::vector<NavAreaEdge> m_edge;						///< all edges, grouped by source area
+};
+
+extern CNavAreaGraph TheNavAreaGraph;
+
+inline bool CNavAreaGraph::Contains( const CNavArea *area ) const
+{
+	return (area->m_graphIndex < m_area.size() && m_area[ area->m_graphIndex ] == area) ? true : false;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+
+/**
+ * A CNavSearchContext holds the state of one A* search over TheNavAreaGraph - the open and closed
+ * sets, parents and costs - in arrays indexed by graph index, rather than in the areas themselves.
+ * This allows a search to be suspended and resumed later while other searches run in between,
+ * and allows several threads to search the (read-only) graph at once.
+ * Each thread has a current context: its own scratch context, unless another has been made active.
+ * The CNavArea search accessors (Mark(), GetParent(), GetCostSoFar(), etc) operate on it, so
+ * existing searches and cost functors work unchanged.
+ */
+class CNavSearchContext
+{
+public:
+	CNavSearchContext( void );
+
+	void Begin( void );										///< start a new search over the current graph
+	bool IsCurrent( void ) const;							///< return false if the graph has been rebuilt since Begin()
+
+	void Mark( unsigned int i );							///< mark as visited, without adding to the open list
+	bool IsVisited( unsigned int i ) const					{ return (m_node[i].marker == m_marker) ? true : false; }
+	bool IsOpen( unsigned int i ) const						{ return (IsVisited( i ) && m_node[i].heapIndex != CLOSED) ? true : false; }
+	bool IsClosed( unsigned int i ) const					{ return (IsVisited( i ) && m_node[i].heapIndex == CLOSED) ? true : false; }
+
+	void SetParent( unsigned int i, unsigned int parent, NavTraverseType how )	{ m_node[i].parent = parent; m_node[i].how = how; }
+	CNavArea *GetParent( unsigned int i ) const				{ return (m_node[i].parent == NO_PARENT) ? nullptr : TheNavAreaGraph.GetArea( m_node[i].parent ); }
+	NavTraverseType GetParentHow( unsigned int i ) const	{ return m_node[i].how; }
+
+	void SetCostSoFar( unsigned int i, float value )		{ m_node[i].costSoFar = value; }
+	float GetCostSoFar( unsigned int i ) const				{ return m_node[i].costSoFar; }
+	void SetTotalCost( unsigned int i, float value )		{ m_node[i].totalCost = value; }
+	float GetTotalCost( unsigned int i ) const				{ return m_node[i].totalCost; }
+
+	void AddToOpenList( unsigned int i );					///< mark visited and add to the open list
+	void UpdateOnOpenList( unsigned int i );				///< a smaller cost has been found, reorder the open list
+	bool IsOpenListEmpty( void ) const						{ return m_heap.empty(); }
+	unsigned int PopOpenList( void );						///< remove the cheapest area from the open list and close it
+
+	unsigned int GetExpansionCount( void ) const			{ return m_expansionCount; }
+
+	static CNavSearchContext *GetCurrent( void );			///< return this thread's current context
+	static CNavSearchContext *GetActive( void )				{ return m_active; }	///< return the context made active on this thread, if any
+	static void SetActive( CNavSearchContext *context )		{ m_active = context; }	///< make the given context current on this thread (nullptr to use the scratch context)
+
+	enum { NO_PARENT = 0xFFFFFFFF };
+
+private:
+	enum { CLOSED = 0xFFFFFFFF };
+
+	struct Node
+	{
+		unsigned int marker;								///< equals m_marker if visited during this search
+		unsigned int heapIndex;								///< slot in m_heap, or CLOSED
+		unsigned int order;									///< insertion sequence, to break cost ties in FIFO order
+		unsigned int parent;								///< graph index of the area prior to this one, or NO_PARENT
+		float costSoFar;
+		float totalCost;
+		NavTraverseType how;
+	};
+
+	bool IsLess( unsigned int a, unsigned int b ) const;
+	void SiftUp( unsigned int slot );
+	void SiftDown( unsigned int slot );
+
+	std::vector<Node> m_node;
+	std::vector<unsigned int> m_heap;						///< binary min-heap of graph indices
+	unsigned int m_marker;
+	unsigned int m_sequence;
+	unsigned int m_expansionCount;
+	unsigned int m_buildCount;								///< TheNavAreaGraph build this search was started on
+
+	static thread_local CNavSearchContext *m_active;
+	static CNavSearchContext *GetScratch( void );			///< this thread's scratch context
+};
+
+//--------------------------------------------------------------------------------------------------------------
+
+/**
+ * A CNavSearchJob is a search that runs on one of TheNavSearchPool's worker threads.
+ * Run() may use NavAreaBuildPath(), NavAreaTravelDistance(), SearchSurroundingAreas() and
+ * CNavSearchContext freely, since each thread searches with its own context. It must not call
+ * into the engine (traces, messages, cvars), change the mesh, or use functors that do.
+ */
+class CNavSearchJob
+{
+public:
+	CNavSearchJob( void )							{ m_isBusy = false; }
+	virtual ~CNavSearchJob() { }
+
+	virtual void Run( void ) = 0;					///< perform the search - invoked on a worker thread
+	virtual void OnComplete( void ) = 0;			///< deliver the results - invoked on the main thread, at the start of the frame after Run() finishes
+
+	bool IsBusy( void ) const						{ return m_isBusy; }	///< true from submission until OnComplete() or cancellation
+
+private:
+	friend class CNavSearchPool;
+	bool m_isBusy;
+};
+
+/**
+ * A small pool of worker threads for nav mesh searches.
+ * Anything that changes the mesh calls TheNavAreaGraph.Invalidate(), which waits for running jobs
+ * to finish first, so workers never see the mesh change underneath them.
+ */
+class CNavSearchPool
+{
+public:
+	CNavSearchPool( void );
+	~CNavSearchPool();
+
+	void SetThreadCount( int count );				///< start or stop worker threads - with none, jobs run as they are submitted
+	int GetThreadCount( void ) const				{ return m_thread.size(); }
+
+	void Submit( CNavSearchJob *job );				///< queue a job for a worker thread
+	void Cancel( CNavSearchJob *job );				///< withdraw a job, waiting for it if it is running - OnComplete() is not invoked
+	void Wait( void );								///< block until no jobs are waiting or running
+	void DeliverResults( void );					///< invoke OnComplete() for every finished job - main thread only
+
+private:
+	void WorkerMain( void );
+
+	std::vector<std::thread> m_thread;
+	std::mutex m_mutex;								///< guards everything below
+	std::condition_variable m_wake;					///< signalled when jobs are added or workers should quit
+	std::condition_variable m_idle;					///< signalled when a job finishes
+	std::deque<CNavSearchJob *> m_waiting;
+	std::vector<CNavSearchJob *> m_running;
+	std::vector<CNavSearchJob *> m_finished;
+	bool m_isQuitting;
+};
+
+extern CNavSearchPool TheNavSearchPool;
+
+//--------------------------------------------------------------------------------------------------------------
+
+/**
+ * The CNavRouteTable is an optional, precomputed routing table for the nav mesh, in the spirit of the
+ * node graph's static routing tables (CGraph::ComputeStaticRoutingTables).
+ * Connected areas are grouped into small clusters, and for every pair of clusters the table stores the
+ * travel distance along the shortest path between them and the first cluster to move to along the way.
+ * It is built by "bot_nav_build_routes" and saved next to the .nav file. It is only used while it matches
+ * the loaded mesh - if the bsp or the mesh changes, queries fall back to A*.
+ * Distances between areas in different clusters are approximate, by up to about two cluster radii.
+ */
+class CNavRouteTable
+{
+public:
+	CNavRouteTable( void );
+
+	enum
+	{
+		AREAS_PER_CLUSTER = 8,
+		MAX_CLUSTERS = 1024,
+		NO_CLUSTER = 0xFFFF,
+		UNREACHABLE = 0xFFFF,
+		DISTANCE_UNITS = 4									///< world units per stored distance step
+	};
+
+	void Reset( void );
+	bool Build( void );										///< compute the table for the current mesh - return false if the mesh is too large
+	bool Save( const char *filename ) const;
+	bool Load( const char *filename );						///< load the table, if it matches the current mesh
+
+	bool IsCurrent( void ) const;							///< true if the table matches the mesh being searched
+
+	bool GetTravelDistance( CNavArea *startArea, CNavArea *endArea, float *distance ) const;	///< return false if the table can't answer - 'distance' is -1 if unreachable
+	bool IsUnreachable( CNavArea *startArea, CNavArea *endArea ) const;	///< return true only if the table knows there is no path
+	CNavArea *GetNextHop( CNavArea *startArea, CNavArea *endArea ) const;	///< center area of the next cluster on the way, or nullptr if unknown
+
+	unsigned int GetClusterCount( void ) const				{ return m_clusterArea.size(); }
+
+private:
+	unsigned int GetCluster( const CNavArea *area ) const;	///< return NO_CLUSTER if the table can't be used for this area
+	unsigned int ComputeChecksum( void ) const;				///< summarize the mesh connectivity, to detect stale tables
+
+	unsigned int m_buildCount;								///< TheNavAreaGraph build the table is valid for
+	std::vector<unsigned short> m_areaCluster;				///< graph index -> cluster
+	std::vector<unsigned int> m_clusterArea;				///< cluster -> graph index of its center area
+	std::vector<unsigned short> m_distance;					///< (from * clusters + to) -> travel distance in DISTANCE_UNITS, or UNREACHABLE
+	std::vector<unsigned short> m_nextHop;					///< (from * clusters + to) -> next cluster along the route, or NO_CLUSTER
+};
+
+extern CNavRouteTable TheNavRouteTable;
+
+extern void NavBuildRouteTable( void );						///< "bot_nav_build_routes" console command
+
+//--------------------------------------------------------------------------------------------------------------
+
+/**
+ * The CNavAreaVisibility is an optional, precomputed "potentially visible set" for each area - the areas
+ * that might be seen from somewhere in it - in the spirit of the bsp's leaf visibility.
+ * It is computed by AnalyzeNavigationMap() when bot_nav_visibility is set, and stored in the .nav file
+ * run-length compressed, as the bsp compresses its visdata.
+ * Visibility is sampled by tracing between the centers and inset corners of the two areas at crouching
+ * and standing eye height, and connected areas can always see each other. A sightline thru a narrow
+ * gap may be missed, so it is only used to trace less often where a trace is almost certain to fail,
+ * never to answer a visibility question on its own.
+ * Until it is computed, and as soon as an area is created or destroyed, every area is potentially visible.
+ */
+class CNavAreaVisibility
+{
+public:
+	CNavAreaVisibility( void );
+
+	void Reset( void );										///< discard the table
+	void Compute( const std::vector< CNavArea * > &areas, bool isTraceThreadSafe );	///< compute the table for the given areas
+	bool IsComputed( void ) const							{ return (m_areaCount > 0); }
+
+	bool IsPotentiallyVisible( const CNavArea *from, const CNavArea *to ) const;	///< return false only if 'to' can't be seen from 'from'
+	bool IsInOrder( const std::vector< CNavArea * > &areas ) const;	///< return true if the table's indices are the positions of the given areas
+
+	void Compress( std::vector< unsigned char > *data ) const;	///< append each area's row, in index order, run-length compressed
+	bool Decompress( const unsigned char *data, unsigned int size, const std::vector< CNavArea * > &areas );	///< load rows written by Compress() for the given areas
+
+	unsigned int GetVisiblePairCount( void ) const;			///< number of (from, to) pairs that are potentially visible
+
+private:
+	friend class ComputeAreaVisibilityFunctor;
+
+	void Resize( const std::vector< CNavArea * > &areas );	///< clear the table, and index the given areas
+	void SetVisible( unsigned int from, unsigned int to )	{ m_bits[ from * m_rowWords + to / 32 ] |= 1u << (to & 31); }
+	bool IsVisible( unsigned int from, unsigned int to ) const	{ return (m_bits[ from * m_rowWords + to / 32 ] & (1u << (to & 31))) ? true : false; }
+
+	unsigned int m_areaCount;
+	unsigned int m_rowWords;								///< words in each area's row
+	std::vector< unsigned int > m_bits;						///< (from * m_rowWords + to / 32) -> bit (to % 32) set if 'to' may be visible from 'from'
+};
+
+extern CNavAreaVisibility TheNavAreaVisibility;
+
+inline bool CNavAreaVisibility::IsPotentiallyVisible( const CNavArea *from, const CNavArea *to ) const
+{
+	if (from == nullptr || to == nullptr || !IsComputed())
+		return true;
+
+	if (from->m_visIndex >= m_areaCount || to->m_visIndex >= m_areaCount)
+		return true;
+
+	return IsVisible( from->m_visIndex, to->m_visIndex );
+}
+
+inline bool CNavSearchContext::IsCurrent( void ) const
+{
+	return (!TheNavAreaGraph.IsDirty() && m_buildCount == TheNavAreaGraph.GetBuildCount()) ? true : false;
+}
+
+inline bool CNavSearchContext::IsLess( unsigned int a, unsigned int b ) const
+{
+	if (m_node[a].totalCost != m_node[b].totalCost)
+		return (m_node[a].totalCost < m_node[b].totalCost);
+
+	return (m_node[a].order < m_node[b].order);
+}
+
+inline CNavSearchContext *CNavSearchContext::GetCurrent( void )
+{
+	return (m_active) ? m_active : GetScratch();
+}
+
+inline void CNavSearchContext::Mark( unsigned int i )
+{
+	if (m_node[i].marker != m_marker)
+	{
+		m_node[i].marker = m_marker;
+		m_node[i].heapIndex = CLOSED;
+	}
+}
+
+inline void CNavArea::MakeNewMarker( void )
+{
+	TheNavAreaGraph.Update();
+	CNavSearchContext::GetCurrent()->Begin();
+}
+
+inline void CNavArea::ClearSearchLists( void )
+{
+	TheNavAreaGraph.Update();
+	CNavSearchContext::GetCurrent()->Begin();
+}
+
+inline void CNavArea::Mark( void )
+{
+	CNavSearchContext::GetCurrent()->Mark( m_graphIndex );
+}
+
+inline bool CNavArea::IsMarked( void ) const
+{
+	return CNavSearchContext::GetCurrent()->IsVisited( m_graphIndex );
+}
+
+inline void CNavArea::SetParent( CNavArea *parent, NavTraverseType how )
+{
+	CNavSearchContext::GetCurrent()->SetParent( m_graphIndex, (parent) ? parent->m_graphIndex : (unsigned int)CNavSearchContext::NO_PARENT, how );
+}
+
+inline CNavArea *CNavArea::GetParent( void ) const
+{
+	return CNavSearchContext::GetCurrent()->GetParent( m_graphIndex );
+}
+
+inline NavTraverseType CNavArea::GetParentHow( void ) const
+{
+	return CNavSearchContext::GetCurrent()->GetParentHow( m_graphIndex );
+}
+
+inline bool CNavArea::IsOpen( void ) const
+{
+	return CNavSearchContext::GetCurrent()->IsOpen( m_graphIndex );
+}
+
+inline void CNavArea::AddToOpenList( void )
+{
+	CNavSearchContext::GetCurrent()->AddToOpenList( m_graphIndex );
+}
+
+inline void CNavArea::UpdateOnOpenList( void )
+{
+	CNavSearchContext::GetCurrent()->UpdateOnOpenList( m_graphIndex );
+}
+
+inline bool CNavArea::IsOpenListEmpty( void )
+{
+	return CNavSearchContext::GetCurrent()->IsOpenListEmpty();
+}
+
+inline CNavArea *CNavArea::PopOpenList( void )
+{
+	CNavSearchContext *context = CNavSearchContext::GetCurrent();
+
+	if (context->IsOpenListEmpty())
+		return nullptr;
+
+	return TheNavAreaGraph.GetArea( context->PopOpenList() );
+}
+
+inline bool CNavArea::IsClosed( void ) const
+{
+	return CNavSearchContext::GetCurrent()->IsClosed( m_graphIndex );
+}
+
+inline void CNavArea::AddToClosedList( void )
+{
+	Mark();
+}
+
+inline void CNavArea::RemoveFromClosedList( void )
+{
+	// since "closed" is defined as visited (marked) and not on open list, do nothing
+}
+
+inline void CNavArea::SetTotalCost( float value )
+{
+	CNavSearchContext::GetCurrent()->SetTotalCost( m_graphIndex, value );
+}
+
+inline float CNavArea::GetTotalCost( void ) const
+{
+	return CNavSearchContext::GetCurrent()->GetTotalCost( m_graphIndex );
+}
+
+inline void CNavArea::SetCostSoFar( float value )
+{
+	CNavSearchContext::GetCurrent()->SetCostSoFar( m_graphIndex, value );
+}
+
+inline float CNavArea::GetCostSoFar( void ) const
+{
+	return CNavSearchContext::GetCurrent()->GetCostSoFar( m_graphIndex );
+}
+
+inline void CNavArea::AddLadderUp( CNavLadder *ladder )
+{
+	TheNavAreaGraph.Invalidate();
+	m_ladder[ LADDER_UP ].push_back( ladder );
+}
+
+inline void CNavArea::AddLadderDown( CNavLadder *ladder )
+{
+	TheNavAreaGraph.Invalidate();
+	m_ladder[ LADDER_DOWN ].push_back( ladder );
+}
+
 //--------------------------------------------------------------------------------------------------------------
 //
 // Function prototypes
 //
 extern NavErrorType LoadNavigationMap( void );
 extern void GenerateNavigationAreaMesh( void );
+extern void AnalyzeNavigationMap( bool isTraceThreadSafe = false );	///< compute hiding spots, encounters, and approach areas for all areas
+extern void NavAnalyze( void );									///< "bot_nav_analyze" console command - analyze the current map's nav mesh and report phase timing
 
 extern void SanityCheckNavigationMap( const char *mapName );	///< Performs a lightweight sanity-check of the specified map's nav mesh
+extern void ConvertNavigationMap( void );					///< "bot_nav_convert" console command - rewrite the current map's nav file in another version
+
+extern void NavBenchmarkPathfind( void );						///< "bot_nav_bench" console command - time random A* queries over the nav mesh
+extern void NavBenchmarkLoad( void );							///< "bot_nav_bench_load" console command - time loading the nav file
+extern void NavBenchmarkGrid( void );							///< "bot_nav_bench_grid" console command - time position lookups in the nav grid
+extern void NavBenchmarkSpots( void );							///< "bot_nav_bench_spots" console command - time hiding spot queries
 
 extern void ApproachAreaAnalysisPrep( void );
 extern void CleanupApproachAreaAnalysisPrep( void );
@@ -569,6 +1017,7 @@ extern bool IsSpotOccupied( CBaseEntity *me, const Vector *pos );	// if a player
 
 extern const Vector *FindNearbyHidingSpot( CBaseEntity *me, const Vector *pos, CNavArea *currentArea, float maxRange = 1000.0f, bool isSniper = false, bool useNearest = false );
 extern const Vector *FindRandomHidingSpot( CBaseEntity *me, Place place, bool isSniper = false );
+extern const HidingSpot *FindNearestHidingSpot( CBaseEntity *me, const Vector *pos, CNavArea *startArea, unsigned char flags, float range, float travelRange = -1.0f );	///< nearest unoccupied spot with any of 'flags', optionally within a travel distance
 
 #define NO_CROUCH_SPOTS false
 extern const Vector *FindNearbyRetreatSpot( CBaseEntity *me, const Vector *start, CNavArea *startArea, float maxRange = 1000.0f, int avoidTeam = 0, bool useCrouchAreas = true );
@@ -576,9 +1025,6 @@ extern const Vector *FindNearbyRetreatSpot( CBaseEntity *me, const Vector *start
 /// return true if moving from "start" to "finish" will cross a player's line of fire.
 extern bool IsCrossingLineOfFire( const Vector &start, const Vector &finish, CBaseEntity *ignore = nullptr, int ignoreTeam = 0 );
 
-extern void IncreaseDangerNearby( int teamID, float amount, CNavArea *area, const Vector *pos, float maxRadius );
-extern void DrawDanger( void );
-
 enum NavEditCmdType
 {
 	EDIT_NONE,
@@ -693,13 +1139,26 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 		return false;
 	}
 
-	startArea->SetParent( nullptr );
+	// pick up any edits made since the search graph was last built
+	TheNavAreaGraph.Update();
+
+	if (!TheNavAreaGraph.Contains( startArea ))
+		return false;
+
+	// no need to search if the route table knows the goal can't be reached
+	if (closestArea == nullptr && goalArea && TheNavRouteTable.IsUnreachable( startArea, goalArea ))
+		return false;
+
+	// start search - all search state lives in this thread's current context
+	CNavSearchContext *context = CNavSearchContext::GetCurrent();
+	context->Begin();
+
+	const unsigned int startIndex = startArea->GetGraphIndex();
+	context->SetParent( startIndex, CNavSearchContext::NO_PARENT, NUM_TRAVERSE_TYPES );
 
 	// if we are already in the goal area, build trivial path
 	if (startArea == goalArea)
 	{
-		goalArea->SetParent( nullptr );
-
 		if (closestArea)
 			*closestArea = goalArea;
 
@@ -709,30 +1168,28 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 	// determine actual goal position
 	Vector actualGoalPos = (goalPos) ? *goalPos : *goalArea->GetCenter();
 
-	// start search
-	CNavArea::ClearSearchLists();
-
 	// compute estimate of path length
 	/// @todo Cost might work as "manhattan distance"
-	startArea->SetTotalCost( (*startArea->GetCenter() - actualGoalPos).Length() );
+	context->SetTotalCost( startIndex, (*startArea->GetCenter() - actualGoalPos).Length() );
 
 	float initCost = costFunc( startArea, nullptr, nullptr );	
 	if (initCost < 0.0f)
 		return false;
-	startArea->SetCostSoFar( initCost );
+	context->SetCostSoFar( startIndex, initCost );
 
-	startArea->AddToOpenList();
+	context->AddToOpenList( startIndex );
 
 	// keep track of the area we visit that is closest to the goal
 	if (closestArea)
 		*closestArea = startArea;
-	float closestAreaDist = startArea->GetTotalCost();
+	float closestAreaDist = context->GetTotalCost( startIndex );
 
 	// do A* search
-	while( !CNavArea::IsOpenListEmpty() )
+	while( !context->IsOpenListEmpty() )
 	{
 		// get next area to check
-		CNavArea *area = CNavArea::PopOpenList();
+		const unsigned int index = context->PopOpenList();
+		CNavArea *area = TheNavAreaGraph.GetArea( index );
 
 		// check if we have found the goal area
 		if (area == goalArea)
@@ -743,126 +1200,25 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 			return true;
 		}
 
-		// search adjacent areas
-		bool searchFloor = true;
-		int dir = NORTH;
-		const NavConnectList *floorList = area->GetAdjacentList( NORTH );
-		NavConnectList::const_iterator floorIter = floorList->begin();
-
-		bool ladderUp = true;
-		const NavLadderList *ladderList = nullptr;
-		NavLadderList::const_iterator ladderIter;
-		enum { AHEAD = 0, LEFT, RIGHT, BEHIND, NUM_TOP_DIRECTIONS };
-		int ladderTopDir;
+		// search adjacent areas - floor connections in each direction, then up and down ladders
+		const NavAreaEdge *edge = TheNavAreaGraph.GetEdgesBegin( index );
+		const NavAreaEdge *edgeEnd = TheNavAreaGraph.GetEdgesEnd( index );
 
-		while(true)
+		for( ; edge != edgeEnd; ++edge )
 		{
-			CNavArea *newArea;
-			NavTraverseType how;
-			const CNavLadder *ladder = nullptr;
-
-			//
-			// Get next adjacent area - either on floor or via ladder
-			//
-			if (searchFloor)
-			{
-				// if exhausted adjacent connections in current direction, begin checking next direction
-				if (floorIter == floorList->end())
-				{
-					++dir;
-
-					if (dir == NUM_DIRECTIONS)
-					{
-						// checked all directions on floor - check ladders next
-						searchFloor = false;
-
-						ladderList = area->GetLadderList( LADDER_UP );
-						ladderIter = ladderList->begin();
-						ladderTopDir = AHEAD;
-					}
-					else
-					{
-						// start next direction
-						floorList = area->GetAdjacentList( (NavDirType)dir );
-						floorIter = floorList->begin();
-					}
-
-					continue;
-				}
-
-				newArea = (*floorIter).area;
-				how = (NavTraverseType)dir;
-				++floorIter;
-			}
-			else	// search ladders
-			{
-				if (ladderIter == ladderList->end())
-				{
-					if (!ladderUp)
-					{
-						// checked both ladder directions - done
-						break;
-					}
-					else
-					{
-						// check down ladders
-						ladderUp = false;
-						ladderList = area->GetLadderList( LADDER_DOWN );
-						ladderIter = ladderList->begin();
-					}
-					continue;
-				}
-
-				if (ladderUp)
-				{
-					ladder = *ladderIter;
-
-					// cannot use this ladder if the ladder bottom is hanging above our head
-					if (ladder->m_isDangling)
-					{
-						++ladderIter;
-						continue;
-					}
-
-					// do not use BEHIND connection, as its very hard to get to when going up a ladder
-					if (ladderTopDir == AHEAD)
-						newArea = ladder->m_topForwardArea;
-					else if (ladderTopDir == LEFT)
-						newArea = ladder->m_topLeftArea;
-					else if (ladderTopDir == RIGHT)
-						newArea = ladder->m_topRightArea;
-					else
-					{
-						++ladderIter;
-						continue;
-					}
-
-					how = GO_LADDER_UP;
-					++ladderTopDir;
-				}
-				else
-				{
-					newArea = (*ladderIter)->m_bottomArea;
-					how = GO_LADDER_DOWN;
-					ladder = (*ladderIter);
-					++ladderIter;
-				}
-
-				if (newArea == nullptr)
-					continue;
-			}
-
 			// don't backtrack
-			if (newArea == area)
+			if (edge->to == index)
 				continue;
 
-			float newCostSoFar = costFunc( newArea, area, ladder );
+			CNavArea *newArea = TheNavAreaGraph.GetArea( edge->to );
+
+			float newCostSoFar = costFunc( newArea, area, edge->ladder );
 
 			// check if cost functor says this area is a dead-end
 			if (newCostSoFar < 0.0f)
 				continue;
 
-			if ((newArea->IsOpen() || newArea->IsClosed()) && newArea->GetCostSoFar() <= newCostSoFar)
+			if (context->IsVisited( edge->to ) && context->GetCostSoFar( edge->to ) <= newCostSoFar)
 			{
 				// this is a worse path - skip it
 				continue;
@@ -870,7 +1226,7 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 			else
 			{
 				// compute estimate of distance left to go
-				float newCostRemaining = (*newArea->GetCenter() - actualGoalPos).Length();
+				float newCostRemaining = (TheNavAreaGraph.GetCenter( edge->to ) - actualGoalPos).Length();
 
 				// track closest area to goal in case path fails
 				if (closestArea && newCostRemaining < closestAreaDist)
@@ -879,27 +1235,22 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 					closestAreaDist = newCostRemaining;
 				}
 				
-				newArea->SetParent( area, how );
-				newArea->SetCostSoFar( newCostSoFar );
-				newArea->SetTotalCost( newCostSoFar + newCostRemaining );
-
-				if (newArea->IsClosed())
-					newArea->RemoveFromClosedList();
+				context->SetParent( edge->to, index, edge->how );
+				context->SetCostSoFar( edge->to, newCostSoFar );
+				context->SetTotalCost( edge->to, newCostSoFar + newCostRemaining );
 
-				if (newArea->IsOpen())
+				if (context->IsOpen( edge->to ))
 				{
 					// area already on open list, update the list order to keep costs sorted
-					newArea->UpdateOnOpenList();
+					context->UpdateOnOpenList( edge->to );
 				}
 				else
 				{
-					newArea->AddToOpenList();
+					// new or previously closed area
+					context->AddToOpenList( edge->to );
 				}
 			}
 		}
-
-		// we have searched this area
-		area->AddToClosedList();
 	}
 
 	return false;
@@ -936,6 +1287,20 @@ float NavAreaTravelDistance( CNavArea *startArea, CNavArea *endArea, CostFunctor
 	return distance;
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Compute shortest path distance between two areas, using the route table if it is current.
+ * Return -1 if can't reach 'endArea' from 'startArea'.
+ */
+inline float NavAreaTravelDistance( CNavArea *startArea, CNavArea *endArea, ShortestPathCost &costFunc )
+{
+	float distance;
+	if (TheNavRouteTable.GetTravelDistance( startArea, endArea, &distance ))
+		return distance;
+
+	return NavAreaTravelDistance< ShortestPathCost >( startArea, endArea, costFunc );
+}
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Compute distance from area to position. Return -1 if can't reach position.
@@ -987,40 +1352,39 @@ float NavAreaTravelDistance( const Vector *startPos, CNavArea *startArea, const
  */
 
 // helper function
-inline void AddAreaToOpenList( CNavArea *area, CNavArea *parent, const Vector *startPos, float maxRange )
+inline void AddAreaToOpenList( CNavSearchContext *context, unsigned int index, unsigned int parent, const Vector *startPos, float maxRange )
 {
-	if (area == nullptr)
+	if (context->IsVisited( index ))
 		return;
 
-	if (!area->IsMarked())
+	context->Mark( index );
+	context->SetTotalCost( index, 0.0f );
+	context->SetParent( index, parent, NUM_TRAVERSE_TYPES );
+
+	if (maxRange > 0.0f)
 	{
-		area->Mark();
-		area->SetTotalCost( 0.0f );
-		area->SetParent( parent );
+		// make sure this area overlaps range
+		CNavArea *area = TheNavAreaGraph.GetArea( index );
 
-		if (maxRange > 0.0f)
-		{
-			// make sure this area overlaps range
-			Vector closePos;
-			area->GetClosestPointOnArea( startPos, &closePos );
-			if ((closePos - *startPos).Make2D() < maxRange)
-			{
-				// compute approximate distance along path to limit travel range, too
-				float distAlong = parent->GetCostSoFar();
-				distAlong += (*area->GetCenter() - *parent->GetCenter()).Length();
-				area->SetCostSoFar( distAlong );
-
-				// allow for some fudge due to large size areas
-				if (distAlong <= 1.5f * maxRange)
-					area->AddToOpenList();
-			}
-		}
-		else
+		Vector closePos;
+		area->GetClosestPointOnArea( startPos, &closePos );
+		if ((closePos - *startPos).Make2D() < maxRange)
 		{
-			// infinite range
-			area->AddToOpenList();
+			// compute approximate distance along path to limit travel range, too
+			float distAlong = context->GetCostSoFar( parent );
+			distAlong += (TheNavAreaGraph.GetCenter( index ) - TheNavAreaGraph.GetCenter( parent )).Length();
+			context->SetCostSoFar( index, distAlong );
+
+			// allow for some fudge due to large size areas
+			if (distAlong <= 1.5f * maxRange)
+				context->AddToOpenList( index );
 		}
 	}
+	else
+	{
+		// infinite range
+		context->AddToOpenList( index );
+	}
 }
 
 
@@ -1030,71 +1394,36 @@ void SearchSurroundingAreas( CNavArea *startArea, const Vector *startPos, Functo
 	if (startArea == nullptr || startPos == nullptr)
 		return;
 
-	CNavArea::MakeNewMarker();
-	CNavArea::ClearSearchLists();
+	// pick up any edits made since the search graph was last built
+	TheNavAreaGraph.Update();
 
-	startArea->AddToOpenList();
-	startArea->SetTotalCost( 0.0f );
-	startArea->SetCostSoFar( 0.0f );
-	startArea->SetParent( nullptr );
-	startArea->Mark();
+	if (!TheNavAreaGraph.Contains( startArea ))
+		return;
+
+	// all search state lives in this thread's current context
+	CNavSearchContext *context = CNavSearchContext::GetCurrent();
+	context->Begin();
+
+	const unsigned int startIndex = startArea->GetGraphIndex();
+	context->SetTotalCost( startIndex, 0.0f );
+	context->SetCostSoFar( startIndex, 0.0f );
+	context->AddToOpenList( startIndex );
+	context->SetParent( startIndex, CNavSearchContext::NO_PARENT, NUM_TRAVERSE_TYPES );
 
-	while( !CNavArea::IsOpenListEmpty() )
+	while( !context->IsOpenListEmpty() )
 	{
 		// get next area to check
-		CNavArea *area = CNavArea::PopOpenList();
+		const unsigned int index = context->PopOpenList();
 
 		// invoke functor on area
-		if (func( area ))
+		if (func( TheNavAreaGraph.GetArea( index ) ))
 		{
-			// explore adjacent floor areas
-			for( int dir=0; dir<NUM_DIRECTIONS; ++dir )
-			{
-				int count = area->GetAdjacentCount( (NavDirType)dir );
-				for( int i=0; i<count; ++i )
-				{
-					CNavArea *adjArea = area->GetAdjacentArea( (NavDirType)dir, i );
-					
-					AddAreaToOpenList( adjArea, area, startPos, maxRange );
-				}
-			}
-
+			// explore adjacent floor areas, then areas connected by ladders
+			const NavAreaEdge *edge = TheNavAreaGraph.GetEdgesBegin( index );
+			const NavAreaEdge *edgeEnd = TheNavAreaGraph.GetEdgesEnd( index );
 
-			// explore adjacent areas connected by ladders
-			NavLadderList::const_iterator ladderIt;
-
-			// check up ladders
-			const NavLadderList *ladderList = area->GetLadderList( LADDER_UP );
-			if (ladderList)
-			{
-				for( ladderIt = ladderList->begin(); ladderIt != ladderList->end(); ++ladderIt )
-				{
-					const CNavLadder *ladder = *ladderIt;
-
-					// cannot use this ladder if the ladder bottom is hanging above our head
-					if (ladder->m_isDangling)
-					{
-						continue;
-					}
-
-					// do not use BEHIND connection, as its very hard to get to when going up a ladder
-					AddAreaToOpenList( ladder->m_topForwardArea, area, startPos, maxRange );
-					AddAreaToOpenList( ladder->m_topLeftArea, area, startPos, maxRange );
-					AddAreaToOpenList( ladder->m_topRightArea, area, startPos, maxRange );
-				}
-			}
-
-			// check down ladders
-			ladderList = area->GetLadderList( LADDER_DOWN );
-			if (ladderList)
-			{
-				for( ladderIt = ladderList->begin(); ladderIt != ladderList->end(); ++ladderIt )
-				{
-					const CNavLadder *ladder = *ladderIt;
-
-					AddAreaToOpenList( ladder->m_bottomArea, area, startPos, maxRange );
-				}
-			}
+			for( ; edge != edgeEnd; ++edge )
+				AddAreaToOpenList( context, edge->to, index, startPos, maxRange );
 		}
 	}
 }
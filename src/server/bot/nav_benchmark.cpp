@@ -0,0 +1,487 @@
+// nav_benchmark.cpp
+// Console commands for timing the navigation system against a real .nav file
+
+#pragma warning( disable : 4530 )					// STL uses exceptions, but we are not compiling with them - ignore warning
+
+#include <vector>
+#include <algorithm>
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "player.h"
+#include "perf_counter.h"
+
+#include "bot_util.h"
+#include "nav.h"
+#include "nav_area.h"
+#include "nav_path.h"
+#include "nav_spot_index.h"
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Tiny deterministic random number generator, so that repeated benchmark runs
+ * (and runs on different builds) issue exactly the same queries.
+ */
+class NavBenchmarkRandom
+{
+public:
+	NavBenchmarkRandom( unsigned int seed )	{ m_state = seed; }
+
+	unsigned int Next( void )
+	{
+		m_state = m_state * 1664525u + 1013904223u;
+		return m_state >> 8;
+	}
+
+	unsigned int Next( unsigned int count )	{ return Next() % count; }
+
+private:
+	unsigned int m_state;
+};
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Make sure the navigation mesh for the current map is in memory.
+ * Return false if there is nothing to benchmark.
+ */
+static bool NavBenchmarkPrepare( std::vector<CNavArea *> *areas )
+{
+	if (TheNavAreaList.empty())
+	{
+		NavErrorType error = LoadNavigationMap();
+		if (error != NAV_OK)
+		{
+			CONSOLE_ECHO( "Unable to load navigation mesh for this map (error %d).\n", error );
+			return false;
+		}
+	}
+
+	areas->clear();
+	areas->reserve( TheNavAreaList.size() );
+
+	for( NavAreaList::iterator iter = TheNavAreaList.begin(); iter != TheNavAreaList.end(); ++iter )
+		areas->push_back( *iter );
+
+	if (areas->size() < 2)
+	{
+		CONSOLE_ECHO( "Navigation mesh is too small to benchmark.\n" );
+		return false;
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Read an optional positive integer argument, using 'defaultValue' if it is missing
+ */
+static int NavBenchmarkArg( int which, int defaultValue )
+{
+	if (engine::Cmd_Argc() > which)
+	{
+		int value = atoi( engine::Cmd_Argv( which ) );
+		if (value > 0)
+			return value;
+	}
+
+	return defaultValue;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * bot_nav_bench [queries] [seed]
+ * Run random start/goal A* queries over the loaded nav mesh and report throughput.
+ */
+void NavBenchmarkPathfind( void )
+{
+	std::vector<CNavArea *> areas;
+	if (!NavBenchmarkPrepare( &areas ))
+		return;
+
+	const int queryCount = NavBenchmarkArg( 1, 1000 );
+	NavBenchmarkRandom random( NavBenchmarkArg( 2, 1 ) );
+
+	// pick all query endpoints up front so only the searches are timed
+	std::vector<CNavArea *> endpoints;
+	endpoints.reserve( 2 * queryCount );
+	for( int i=0; i<2*queryCount; ++i )
+		endpoints.push_back( areas[ random.Next( areas.size() ) ] );
+
+	// build the search graph outside the timed loop
+	TheNavAreaGraph.Update();
+
+	ShortestPathCost cost;
+	int foundCount = 0;
+
+	CPerformanceCounter counter;
+	double startTime = counter.GetCurTime();
+
+	for( int i=0; i<queryCount; ++i )
+	{
+		if (NavAreaBuildPath( endpoints[ 2*i ], endpoints[ 2*i+1 ], nullptr, cost ))
+			++foundCount;
+	}
+
+	double elapsed = counter.GetCurTime() - startTime;
+
+	CONSOLE_ECHO( "bot_nav_bench: %d areas, %d edges, %d queries (%d found a path) in %.3f ms\n",
+					(int)areas.size(), TheNavAreaGraph.GetEdgeCount(), queryCount, foundCount, 1000.0 * elapsed );
+
+	if (elapsed > 0.0)
+		CONSOLE_ECHO( "bot_nav_bench: %.1f queries/sec, %.2f us/query\n", queryCount / elapsed, 1000000.0 * elapsed / queryCount );
+
+	// travel distances, answered by the route table where possible
+	if (TheNavRouteTable.IsCurrent())
+	{
+		int reachableCount = 0;
+
+		startTime = counter.GetCurTime();
+
+		for( int i=0; i<queryCount; ++i )
+		{
+			if (NavAreaTravelDistance( endpoints[ 2*i ], endpoints[ 2*i+1 ], cost ) >= 0.0f)
+				++reachableCount;
+		}
+
+		elapsed = counter.GetCurTime() - startTime;
+
+		CONSOLE_ECHO( "bot_nav_bench: route table travel distance %d queries (%d reachable) in %.3f ms, %d clusters\n",
+						queryCount, reachableCount, 1000.0 * elapsed, TheNavRouteTable.GetClusterCount() );
+	}
+
+	//
+	// Run the same queries again as resumable path queries, in the step sizes used by TheNavPathQueue,
+	// to measure the worst single step and to check both searches agree on which goals are reachable
+	//
+	NavPathQuery< ShortestPathCost > query;
+	int queryFoundCount = 0;
+	int stepCount = 0;
+	double maxStepTime = 0.0;
+
+	startTime = counter.GetCurTime();
+
+	for( int i=0; i<queryCount; ++i )
+	{
+		if (!query.Request( endpoints[ 2*i ]->GetCenter(), endpoints[ 2*i+1 ]->GetCenter() ))
+			continue;
+
+		// drive the query ourselves instead of waiting for the frame update
+		TheNavPathQueue.Remove( &query );
+
+		while( true )
+		{
+			double stepStart = counter.GetCurTime();
+			bool isDone = query.Step( CNavPathQueue::EXPANSIONS_PER_STEP );
+			double stepTime = counter.GetCurTime() - stepStart;
+
+			++stepCount;
+			if (stepTime > maxStepTime)
+				maxStepTime = stepTime;
+
+			if (isDone)
+				break;
+		}
+
+		if (query.IsPathToGoal())
+			++queryFoundCount;
+	}
+
+	elapsed = counter.GetCurTime() - startTime;
+
+	CONSOLE_ECHO( "bot_nav_bench: incremental %d queries (%d reached the goal) in %.3f ms, %d steps, worst step %.2f us\n",
+					queryCount, queryFoundCount, 1000.0 * elapsed, stepCount, 1000000.0 * maxStepTime );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * bot_nav_bench_load [iterations]
+ * Repeatedly destroy and reload the current map's nav mesh, and report how long loading takes.
+ * Use "bot_nav_convert" to compare nav file versions.
+ */
+void NavBenchmarkLoad( void )
+{
+	const int iterationCount = NavBenchmarkArg( 1, 10 );
+
+	CPerformanceCounter counter;
+	double totalTime = 0.0;
+	double minTime = 0.0;
+
+	for( int i=0; i<iterationCount; ++i )
+	{
+		DestroyNavigationMap();
+
+		double startTime = counter.GetCurTime();
+		NavErrorType error = LoadNavigationMap();
+		double elapsed = counter.GetCurTime() - startTime;
+
+		if (error != NAV_OK)
+		{
+			CONSOLE_ECHO( "Unable to load navigation mesh for this map (error %d).\n", error );
+			return;
+		}
+
+		totalTime += elapsed;
+		if (i == 0 || elapsed < minTime)
+			minTime = elapsed;
+	}
+
+	CONSOLE_ECHO( "bot_nav_bench_load: %d areas, %d hiding spots, %d loads - %.2f ms average, %.2f ms best\n",
+					(int)TheNavAreaList.size(), (int)TheHidingSpotList.size(), iterationCount,
+					1000.0 * totalTime / iterationCount, 1000.0 * minTime );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return a random position standing on the given area
+ */
+static Vector NavBenchmarkPositionOnArea( const CNavArea *area, NavBenchmarkRandom &random )
+{
+	const Extent *extent = area->GetExtent();
+
+	Vector pos;
+	pos.x = extent->lo.x + (extent->hi.x - extent->lo.x) * random.Next( 1001 ) / 1000.0f;
+	pos.y = extent->lo.y + (extent->hi.y - extent->lo.y) * random.Next( 1001 ) / 1000.0f;
+	pos.z = area->GetZ( &pos ) + HalfHumanHeight;
+
+	return pos;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * bot_nav_bench_grid [lookups] [seed]
+ * Time position lookups in TheNavAreaGrid: random positions on the mesh, positions along a walk
+ * from area to adjacent area using the previous area as a hint, and nearest area searches
+ * from random positions anywhere within the mesh's extents.
+ */
+void NavBenchmarkGrid( void )
+{
+	std::vector<CNavArea *> areas;
+	if (!NavBenchmarkPrepare( &areas ))
+		return;
+
+	const int lookupCount = NavBenchmarkArg( 1, 100000 );
+	NavBenchmarkRandom random( NavBenchmarkArg( 2, 1 ) );
+
+	// find the extents of the mesh
+	Extent meshExtent = *areas[0]->GetExtent();
+	for( unsigned int i=1; i<areas.size(); ++i )
+	{
+		const Extent *extent = areas[i]->GetExtent();
+
+		meshExtent.lo.x = std::min( meshExtent.lo.x, extent->lo.x );
+		meshExtent.lo.y = std::min( meshExtent.lo.y, extent->lo.y );
+		meshExtent.lo.z = std::min( meshExtent.lo.z, extent->lo.z );
+		meshExtent.hi.x = std::max( meshExtent.hi.x, extent->hi.x );
+		meshExtent.hi.y = std::max( meshExtent.hi.y, extent->hi.y );
+		meshExtent.hi.z = std::max( meshExtent.hi.z, extent->hi.z );
+	}
+
+	// pick all positions up front so only the lookups are timed
+	std::vector<Vector> onMesh;
+	std::vector<Vector> walk;
+	std::vector<Vector> anywhere;
+	onMesh.reserve( lookupCount );
+	walk.reserve( lookupCount );
+	anywhere.reserve( lookupCount );
+
+	CNavArea *walkArea = areas[ random.Next( areas.size() ) ];
+
+	for( int i=0; i<lookupCount; ++i )
+	{
+		onMesh.push_back( NavBenchmarkPositionOnArea( areas[ random.Next( areas.size() ) ], random ) );
+
+		// wander to a random neighbor now and then, as a bot moving thru the mesh would
+		if (random.Next( 4 ) == 0)
+		{
+			NavDirType dir = (NavDirType)random.Next( NUM_DIRECTIONS );
+			int count = walkArea->GetAdjacentCount( dir );
+			if (count)
+				walkArea = walkArea->GetAdjacentArea( dir, random.Next( count ) );
+		}
+		walk.push_back( NavBenchmarkPositionOnArea( walkArea, random ) );
+
+		Vector pos;
+		pos.x = meshExtent.lo.x + (meshExtent.hi.x - meshExtent.lo.x) * random.Next( 1001 ) / 1000.0f;
+		pos.y = meshExtent.lo.y + (meshExtent.hi.y - meshExtent.lo.y) * random.Next( 1001 ) / 1000.0f;
+		pos.z = meshExtent.lo.z + (meshExtent.hi.z - meshExtent.lo.z) * random.Next( 1001 ) / 1000.0f + HalfHumanHeight;
+		anywhere.push_back( pos );
+	}
+
+	CPerformanceCounter counter;
+	int foundCount = 0;
+
+	// random lookups
+	double startTime = counter.GetCurTime();
+
+	for( int i=0; i<lookupCount; ++i )
+	{
+		if (TheNavAreaGrid.GetNavArea( &onMesh[i] ))
+			++foundCount;
+	}
+
+	double elapsed = counter.GetCurTime() - startTime;
+
+	CONSOLE_ECHO( "bot_nav_bench_grid: %d areas, %d random lookups (%d found an area) in %.3f ms, %.3f us/lookup\n",
+					(int)areas.size(), lookupCount, foundCount, 1000.0 * elapsed, 1000000.0 * elapsed / lookupCount );
+
+	// walking, with and without the previous area as a hint
+	foundCount = 0;
+	startTime = counter.GetCurTime();
+
+	for( int i=0; i<lookupCount; ++i )
+	{
+		if (TheNavAreaGrid.GetNavArea( &walk[i] ))
+			++foundCount;
+	}
+
+	elapsed = counter.GetCurTime() - startTime;
+
+	int hintFoundCount = 0;
+	CNavArea *hint = nullptr;
+	startTime = counter.GetCurTime();
+
+	for( int i=0; i<lookupCount; ++i )
+	{
+		CNavArea *area = TheNavAreaGrid.GetNavArea( &walk[i], 120.0f, hint );
+		if (area)
+		{
+			hint = area;
+			++hintFoundCount;
+		}
+	}
+
+	double hintElapsed = counter.GetCurTime() - startTime;
+
+	CONSOLE_ECHO( "bot_nav_bench_grid: walk %d lookups (%d found) %.3f us/lookup, with hint (%d found) %.3f us/lookup\n",
+					lookupCount, foundCount, 1000000.0 * elapsed / lookupCount, hintFoundCount, 1000000.0 * hintElapsed / lookupCount );
+
+	// nearest area searches, skipping the line of sight checks so only the grid is measured
+	const int nearestCount = std::max( 1, lookupCount / 100 );
+	foundCount = 0;
+	startTime = counter.GetCurTime();
+
+	for( int i=0; i<nearestCount; ++i )
+	{
+		if (TheNavAreaGrid.GetNearestNavArea( &anywhere[i], true ))
+			++foundCount;
+	}
+
+	elapsed = counter.GetCurTime() - startTime;
+
+	CONSOLE_ECHO( "bot_nav_bench_grid: %d nearest area searches (%d found) in %.3f ms, %.2f us/search\n",
+					nearestCount, foundCount, 1000.0 * elapsed, 1000000.0 * elapsed / nearestCount );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * bot_nav_bench_spots [queries] [seed]
+ * Time hiding spot queries from random positions on the mesh: nearby hiding and sniper spots found by searching
+ * the surrounding areas, and the nearest sniper spot within range, by a scan of every spot checking occupancy
+ * against every player as before, and by the spot index, with and without a travel distance limit.
+ */
+void NavBenchmarkSpots( void )
+{
+	std::vector<CNavArea *> areas;
+	if (!NavBenchmarkPrepare( &areas ))
+		return;
+
+	const int queryCount = NavBenchmarkArg( 1, 1000 );
+	NavBenchmarkRandom random( NavBenchmarkArg( 2, 1 ) );
+
+	const float range = 1500.0f;
+	const unsigned char sniperFlags = HidingSpot::GOOD_SNIPER_SPOT | HidingSpot::IDEAL_SNIPER_SPOT;
+
+	// pick all query positions up front so only the queries are timed
+	std::vector<CNavArea *> startArea;
+	std::vector<Vector> startPos;
+	startArea.reserve( queryCount );
+	startPos.reserve( queryCount );
+
+	for( int i=0; i<queryCount; ++i )
+	{
+		CNavArea *area = areas[ random.Next( areas.size() ) ];
+		startArea.push_back( area );
+		startPos.push_back( NavBenchmarkPositionOnArea( area, random ) );
+	}
+
+	// build the search graph and the spot index outside the timed loops
+	TheHidingSpotIndex.Update();
+
+	CPerformanceCounter counter;
+	int foundCount = 0;
+
+	double startTime = counter.GetCurTime();
+
+	for( int i=0; i<queryCount; ++i )
+	{
+		if (FindNearbyHidingSpot( nullptr, &startPos[i], startArea[i], range, (i & 1) ? true : false ))
+			++foundCount;
+	}
+
+	double elapsed = counter.GetCurTime() - startTime;
+
+	CONSOLE_ECHO( "bot_nav_bench_spots: %d hiding spots, %d nearby hiding/sniper spot searches (%d found) in %.3f ms, %.2f us/search\n",
+					TheHidingSpotIndex.GetSpotCount(), queryCount, foundCount, 1000.0 * elapsed, 1000000.0 * elapsed / queryCount );
+
+	// the nearest sniper spot in range, checking every spot and every player
+	int scanFoundCount = 0;
+	startTime = counter.GetCurTime();
+
+	for( int i=0; i<queryCount; ++i )
+	{
+		const HidingSpot *closest = nullptr;
+		float closeRangeSq = range * range;
+
+		for( HidingSpotList::const_iterator iter = TheHidingSpotList.begin(); iter != TheHidingSpotList.end(); ++iter )
+		{
+			const HidingSpot *spot = *iter;
+
+			if (!(spot->GetFlags() & sniperFlags))
+				continue;
+
+			float rangeSq = (*spot->GetPosition() - startPos[i]).LengthSquared();
+			if (rangeSq > closeRangeSq || IsSpotOccupied( nullptr, spot->GetPosition() ))
+				continue;
+
+			closest = spot;
+			closeRangeSq = rangeSq;
+		}
+
+		if (closest)
+			++scanFoundCount;
+	}
+
+	double scanElapsed = counter.GetCurTime() - startTime;
+
+	// the same, using the spot index
+	foundCount = 0;
+	startTime = counter.GetCurTime();
+
+	for( int i=0; i<queryCount; ++i )
+	{
+		if (FindNearestHidingSpot( nullptr, &startPos[i], startArea[i], sniperFlags, range ))
+			++foundCount;
+	}
+
+	elapsed = counter.GetCurTime() - startTime;
+
+	CONSOLE_ECHO( "bot_nav_bench_spots: nearest sniper spot - scan (%d found) %.2f us/query, index (%d found) %.2f us/query\n",
+					scanFoundCount, 1000000.0 * scanElapsed / queryCount, foundCount, 1000000.0 * elapsed / queryCount );
+
+	// and also requiring the spot be reachable within twice the range
+	foundCount = 0;
+	startTime = counter.GetCurTime();
+
+	for( int i=0; i<queryCount; ++i )
+	{
+		if (FindNearestHidingSpot( nullptr, &startPos[i], startArea[i], sniperFlags, range, 2.0f * range ))
+			++foundCount;
+	}
+
+	elapsed = counter.GetCurTime() - startTime;
+
+	CONSOLE_ECHO( "bot_nav_bench_spots: nearest reachable sniper spot (%d found) %.2f us/query\n",
+					foundCount, 1000000.0 * elapsed / queryCount );
+}
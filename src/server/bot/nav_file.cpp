@@ -7,21 +7,11 @@
 
 #include <list>
 #include <vector>
+#include <map>
 #include <algorithm>
 
-#include <fcntl.h>
-#include <sys/stat.h>
 #include <assert.h>
 
-#ifdef _WIN32
-#include <io.h>
-
-#else
-#include <unistd.h>
-#define _write write
-#define _close close
-#endif
-
 #include "extdll.h"
 #include "util.h"
 #include "cbase.h"
@@ -122,12 +112,12 @@ public:
 	}
 
 	/// store the directory
-	void Save( int fd )
+	void Save( BufferedFileWriter *file )
 	{
 #ifdef CSTRIKE
 		// store number of entries in directory
 		EntryType count = m_directory.size();
-		_write( fd, &count, sizeof(EntryType) );
+		file->Write( &count, sizeof(EntryType) );
 
 		// store entries		
 		std::vector<Place>::iterator it;
@@ -137,12 +127,12 @@ public:
 
 			// store string length followed by string itself
 			unsigned short len = strlen(placeName)+1;
-			_write( fd, &len, sizeof(unsigned short) );
-			_write( fd, placeName, len );
+			file->Write( &len, sizeof(unsigned short) );
+			file->Write( placeName, len );
 		}
 #else
 		EntryType count = 0;
-		_write( fd, &count, sizeof(EntryType) );
+		file->Write( &count, sizeof(EntryType) );
 #endif
 	}
 
@@ -151,7 +141,7 @@ public:
 	{
 		// read number of entries
 		EntryType count;
-		file->Read( &count, sizeof(EntryType) );
+		file->Read( &count );
 
 		m_directory.reserve( count );
 
@@ -160,7 +150,7 @@ public:
 		unsigned short len;
 		for( int i=0; i<count; ++i )
 		{
-			file->Read( &len, sizeof(unsigned short) );
+			file->Read( &len );
 			file->Read( placeName, len );
 #ifdef CSTRIKE
 			AddPlace( TheBotPhrases->NameToID( placeName ) );
@@ -216,22 +206,22 @@ void CNavArea::Save( FILE *fp ) const
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Save a navigation area to the opened binary stream
+ * Save a navigation area to the file being written
  */
-void CNavArea::Save( int fd, unsigned int version )
+void CNavArea::Save( BufferedFileWriter *file, unsigned int version )
 {
 	// save ID
-	_write( fd, &m_id, sizeof(unsigned int) );
+	file->Write( &m_id, sizeof(unsigned int) );
 
 	// save attribute flags
-	_write( fd, &m_attributeFlags, sizeof(unsigned char) );
+	file->Write( &m_attributeFlags, sizeof(unsigned char) );
 
 	// save extent of area
-	_write( fd, &m_extent, 6*sizeof(float) );
+	file->Write( &m_extent, 6*sizeof(float) );
 
 	// save heights of implicit corners
-	_write( fd, &m_neZ, sizeof(float) );
-	_write( fd, &m_swZ, sizeof(float) );
+	file->Write( &m_neZ, sizeof(float) );
+	file->Write( &m_swZ, sizeof(float) );
 
 	// save connections to adjacent areas
 	// in the enum order NORTH, EAST, SOUTH, WEST
@@ -239,13 +229,13 @@ void CNavArea::Save( int fd, unsigned int version )
 	{
 		// save number of connections for this direction
 		unsigned int count = m_connect[d].size();
-		_write( fd, &count, sizeof(unsigned int) );
+		file->Write( &count, sizeof(unsigned int) );
 
 		NavConnectList::const_iterator iter;
 		for( iter = m_connect[d].begin(); iter != m_connect[d].end(); ++iter )
 		{
 			NavConnect connect = *iter;
-			_write( fd, &connect.area->m_id, sizeof(unsigned int) );
+			file->Write( &connect.area->m_id, sizeof(unsigned int) );
 		}
 	}
 
@@ -262,7 +252,7 @@ void CNavArea::Save( int fd, unsigned int version )
 	{
 		count = m_hidingSpotList.size();
 	}
-	_write( fd, &count, sizeof(unsigned char) );
+	file->Write( &count, sizeof(unsigned char) );
 
 	// store HidingSpot objects
 	unsigned int saveCount = 0;
@@ -270,7 +260,7 @@ void CNavArea::Save( int fd, unsigned int version )
 	{
 		HidingSpot *spot = *iter;
 		
-		spot->Save( fd, version );
+		spot->Save( file, version );
 
 		// overflow check
 		if (++saveCount == count)
@@ -282,7 +272,7 @@ void CNavArea::Save( int fd, unsigned int version )
 	//
 
 	// save number of approach areas
-	_write( fd, &m_approachCount, sizeof(unsigned char) );
+	file->Write( &m_approachCount, sizeof(unsigned char) );
 	if (cv_bot_debug.value > 0.0f)
 		CONSOLE_ECHO( "  m_approachCount = %d\n", m_approachCount );
 
@@ -292,23 +282,23 @@ void CNavArea::Save( int fd, unsigned int version )
 	for( int a=0; a<m_approachCount; ++a )
 	{
 		if (m_approach[a].here.area)
-			_write( fd, &m_approach[a].here.area->m_id, sizeof(unsigned int) );
+			file->Write( &m_approach[a].here.area->m_id, sizeof(unsigned int) );
 		else
-			_write( fd, &zero, sizeof(unsigned int) );
+			file->Write( &zero, sizeof(unsigned int) );
 
 		if (m_approach[a].prev.area)
-			_write( fd, &m_approach[a].prev.area->m_id, sizeof(unsigned int) );
+			file->Write( &m_approach[a].prev.area->m_id, sizeof(unsigned int) );
 		else
-			_write( fd, &zero, sizeof(unsigned int) );
+			file->Write( &zero, sizeof(unsigned int) );
 		type = (unsigned char)m_approach[a].prevToHereHow;
-		_write( fd, &type, sizeof(unsigned char) );
+		file->Write( &type, sizeof(unsigned char) );
 
 		if (m_approach[a].next.area)
-			_write( fd, &m_approach[a].next.area->m_id, sizeof(unsigned int) );
+			file->Write( &m_approach[a].next.area->m_id, sizeof(unsigned int) );
 		else
-			_write( fd, &zero, sizeof(unsigned int) );
+			file->Write( &zero, sizeof(unsigned int) );
 		type = (unsigned char)m_approach[a].hereToNextHow;
-		_write( fd, &type, sizeof(unsigned char) );
+		file->Write( &type, sizeof(unsigned char) );
 	}
 
 	//
@@ -317,7 +307,7 @@ void CNavArea::Save( int fd, unsigned int version )
 	{
 		// save number of encounter paths for this area
 		unsigned int count = m_spotEncounterList.size();
-		_write( fd, &count, sizeof(unsigned int) );
+		file->Write( &count, sizeof(unsigned int) );
 
 		if (cv_bot_debug.value > 0.0f)
 			CONSOLE_ECHO( "  m_spotEncounterList.size() = %d\n", count );
@@ -328,20 +318,20 @@ void CNavArea::Save( int fd, unsigned int version )
 			e = &(*iter);
 
 			if (e->from.area)
-				_write( fd, &e->from.area->m_id, sizeof(unsigned int) );
+				file->Write( &e->from.area->m_id, sizeof(unsigned int) );
 			else
-				_write( fd, &zero, sizeof(unsigned int) );
+				file->Write( &zero, sizeof(unsigned int) );
 
 			unsigned char dir = e->fromDir;
-			_write( fd, &dir, sizeof(unsigned char) );
+			file->Write( &dir, sizeof(unsigned char) );
 
 			if (e->to.area)
-				_write( fd, &e->to.area->m_id, sizeof(unsigned int) );
+				file->Write( &e->to.area->m_id, sizeof(unsigned int) );
 			else
-				_write( fd, &zero, sizeof(unsigned int) );
+				file->Write( &zero, sizeof(unsigned int) );
 
 			dir = e->toDir;
-			_write( fd, &dir, sizeof(unsigned char) );
+			file->Write( &dir, sizeof(unsigned char) );
 
 			// write list of spots along this path
 			unsigned char spotCount;
@@ -354,7 +344,7 @@ void CNavArea::Save( int fd, unsigned int version )
 			{
 				spotCount = e->spotList.size();
 			}
-			_write( fd, &spotCount, sizeof(unsigned char) );
+			file->Write( &spotCount, sizeof(unsigned char) );
 		
 			saveCount = 0;
 			for( SpotOrderList::iterator oiter = e->spotList.begin(); oiter != e->spotList.end(); ++oiter )
@@ -363,10 +353,10 @@ void CNavArea::Save( int fd, unsigned int version )
 
 				// order->spot may be nullptr if we've loaded a nav mesh that has been edited but not re-analyzed
 				unsigned int id = (order->spot) ? order->spot->GetID() : 0;
-				_write( fd, &id, sizeof(unsigned int) );
+				file->Write( &id, sizeof(unsigned int) );
 
 				unsigned char t = 255 * order->t;
-				_write( fd, &t, sizeof(unsigned char) );
+				file->Write( &t, sizeof(unsigned char) );
 
 				// overflow check
 				if (++saveCount == spotCount)
@@ -377,7 +367,7 @@ void CNavArea::Save( int fd, unsigned int version )
 
 	// store place dictionary entry
 	PlaceDirectory::EntryType entry = placeDirectory.GetEntry( GetPlace() );
-	_write( fd, &entry, sizeof(entry) );
+	file->Write( &entry, sizeof(entry) );
 
 }
 
@@ -388,14 +378,14 @@ void CNavArea::Save( int fd, unsigned int version )
 void CNavArea::Load( SteamFile *file, unsigned int version )
 {
 	// load ID
-	file->Read( &m_id, sizeof(unsigned int) );
+	file->Read( &m_id );
 
 	// update nextID to avoid collisions
 	if (m_id >= m_nextID)
 		m_nextID = m_id+1;
 
 	// load attribute flags
-	file->Read( &m_attributeFlags, sizeof(unsigned char) );
+	file->Read( &m_attributeFlags );
 
 	// load extent of area
 	file->Read( &m_extent, 6*sizeof(float) );
@@ -405,21 +395,26 @@ void CNavArea::Load( SteamFile *file, unsigned int version )
 	m_center.z = (m_extent.lo.z + m_extent.hi.z)/2.0f;
 
 	// load heights of implicit corners
-	file->Read( &m_neZ, sizeof(float) );
-	file->Read( &m_swZ, sizeof(float) );
+	file->Read( &m_neZ );
+	file->Read( &m_swZ );
 
 	// load connections (IDs) to adjacent areas
 	// in the enum order NORTH, EAST, SOUTH, WEST
 	for( int d=0; d<NUM_DIRECTIONS; d++ )
 	{
 		// load number of connections for this direction
-		unsigned int count;
-		file->Read( &count, sizeof(unsigned int) );
+		unsigned int count = 0;
+		file->Read( &count );
+
+		// the IDs are used in place
+		const unsigned int *id = file->View<unsigned int>( count );
+		if (id == nullptr)
+			break;
 
 		for( unsigned int i=0; i<count; ++i )
 		{
 			NavConnect connect;
-			file->Read( &connect.id, sizeof(unsigned int) );
+			memcpy( &connect.id, &id[i], sizeof(unsigned int) );
 
 			m_connect[d].push_back( connect );
 		}
@@ -431,7 +426,7 @@ void CNavArea::Load( SteamFile *file, unsigned int version )
 
 	// load number of hiding spots
 	unsigned char hidingSpotCount;
-	file->Read( &hidingSpotCount, sizeof(unsigned char) );
+	file->Read( &hidingSpotCount );
 
 	if (version == 1)
 	{
@@ -464,20 +459,20 @@ void CNavArea::Load( SteamFile *file, unsigned int version )
 	//
 	// Load number of approach areas
 	//
-	file->Read( &m_approachCount, sizeof(unsigned char) );
+	file->Read( &m_approachCount );
 
 	// load approach area info (IDs)
 	unsigned char type;
 	for( int a=0; a<m_approachCount; ++a )
 	{
-		file->Read( &m_approach[a].here.id, sizeof(unsigned int) );
+		file->Read( &m_approach[a].here.id );
 
-		file->Read( &m_approach[a].prev.id, sizeof(unsigned int) );
-		file->Read( &type, sizeof(unsigned char) );
+		file->Read( &m_approach[a].prev.id );
+		file->Read( &type );
 		m_approach[a].prevToHereHow = (NavTraverseType)type;
 
-		file->Read( &m_approach[a].next.id, sizeof(unsigned int) );
-		file->Read( &type, sizeof(unsigned char) );
+		file->Read( &m_approach[a].next.id );
+		file->Read( &type );
 		m_approach[a].hereToNextHow = (NavTraverseType)type;
 	}
 
@@ -486,7 +481,7 @@ void CNavArea::Load( SteamFile *file, unsigned int version )
 	// Load encounter paths for this area
 	//
 	unsigned int count;
-	file->Read( &count, sizeof(unsigned int) );
+	file->Read( &count );
 
 	if (version < 3)
 	{
@@ -495,22 +490,18 @@ void CNavArea::Load( SteamFile *file, unsigned int version )
 		{
 			SpotEncounter encounter;
 
-			file->Read( &encounter.from.id, sizeof(unsigned int) );
-			file->Read( &encounter.to.id, sizeof(unsigned int) );
+			file->Read( &encounter.from.id );
+			file->Read( &encounter.to.id );
 
 			file->Read( &encounter.path.from.x, 3 * sizeof(float) );
 			file->Read( &encounter.path.to.x, 3 * sizeof(float) );
 
 			// read list of spots along this path
 			unsigned char spotCount;
-			file->Read( &spotCount, sizeof(unsigned char) );
+			file->Read( &spotCount );
 		
-			for( int s=0; s<spotCount; ++s )
-			{
-				Vector pos;
-				file->Read( &pos, 3*sizeof(float) );
-				file->Read( &pos, sizeof(float) );
-			}
+			// each spot is a position and a parametric distance
+			file->Skip( spotCount * 4 * sizeof(float) );
 		}
 		return;
 	}
@@ -519,28 +510,28 @@ void CNavArea::Load( SteamFile *file, unsigned int version )
 	{
 		SpotEncounter encounter;
 
-		file->Read( &encounter.from.id, sizeof(unsigned int) );
+		file->Read( &encounter.from.id );
 
 		unsigned char dir;
-		file->Read( &dir, sizeof(unsigned char) );
+		file->Read( &dir );
 		encounter.fromDir = static_cast<NavDirType>( dir );
 
-		file->Read( &encounter.to.id, sizeof(unsigned int) );
+		file->Read( &encounter.to.id );
 
-		file->Read( &dir, sizeof(unsigned char) );
+		file->Read( &dir );
 		encounter.toDir = static_cast<NavDirType>( dir );
 
 		// read list of spots along this path
 		unsigned char spotCount;
-		file->Read( &spotCount, sizeof(unsigned char) );
+		file->Read( &spotCount );
 	
 		SpotOrder order;
 		for( int s=0; s<spotCount; ++s )
 		{
-			file->Read( &order.id, sizeof(unsigned int) );
+			file->Read( &order.id );
 
 			unsigned char t;
-			file->Read( &t, sizeof(unsigned char) );
+			file->Read( &t );
 
 			order.t = (float)t/255.0f;
 
@@ -557,7 +548,7 @@ void CNavArea::Load( SteamFile *file, unsigned int version )
 	// Load Place data
 	//
 	PlaceDirectory::EntryType entry;
-	file->Read( &entry, sizeof(entry) );
+	file->Read( &entry );
 
 	// convert entry to actual Place
 	SetPlace( placeDirectory.EntryToPlace( entry ) );
@@ -677,6 +668,680 @@ NavErrorType CNavArea::PostLoad( void )
 	return error;
 }
 
+//--------------------------------------------------------------------------------------------------------------
+//
+// Version 6 nav files store the mesh as flat arrays of fixed-size records, located by a section table,
+// with every reference stored as an index into those arrays instead of an ID. Loading is a single pass
+// over the file as it sits in memory - there is nothing to parse and no IDs to look up, and the overlap
+// lists that PostLoad() computes by testing every pair of areas are stored too.
+//
+// After the magic number, version, and bsp size shared by all versions comes the section table:
+//   unsigned int count, then 'count' NavFileSection entries
+// Each section is an array of the record type listed below, 4-byte aligned. Unknown sections are ignored.
+//
+enum NavFileSectionType
+{
+	NAV_SECTION_PLACES,											///< place directory - count, then length-prefixed names
+	NAV_SECTION_AREAS,											///< NavFileArea
+	NAV_SECTION_CONNECTIONS,									///< unsigned int area index
+	NAV_SECTION_HIDING_SPOTS,									///< NavFileHidingSpot
+	NAV_SECTION_APPROACHES,										///< NavFileApproach
+	NAV_SECTION_ENCOUNTERS,										///< NavFileEncounter
+	NAV_SECTION_ENCOUNTER_SPOTS,								///< NavFileSpotOrder
+	NAV_SECTION_OVERLAPS,										///< unsigned int area index
+	NAV_SECTION_VISIBILITY,										///< unsigned char - compressed potentially visible areas (see CNavAreaVisibility), or empty
+
+	NUM_NAV_SECTIONS
+};
+
+struct NavFileSection
+{
+	unsigned int type;
+	unsigned int offset;										///< from the start of the file
+	unsigned int size;											///< in bytes
+};
+
+#define NAV_FILE_NO_INDEX 0xFFFFFFFF
+
+/**
+ * Each area's connections, hiding spots, approaches, encounters, and overlaps are a run of
+ * consecutive records in their sections, with runs stored in area order.
+ */
+struct NavFileArea
+{
+	unsigned int id;
+	unsigned int attributeFlags;
+	Extent extent;
+	float neZ;
+	float swZ;
+	unsigned int place;											///< place directory entry
+
+	unsigned int connectCount[ NUM_DIRECTIONS ];				///< in the order NORTH, EAST, SOUTH, WEST
+	unsigned int hidingSpotCount;
+	unsigned int approachCount;
+	unsigned int encounterCount;
+	unsigned int overlapCount;
+};
+
+struct NavFileHidingSpot
+{
+	unsigned int id;
+	Vector pos;
+	unsigned int flags;
+};
+
+struct NavFileApproach
+{
+	unsigned int here;											///< area indices, or NAV_FILE_NO_INDEX
+	unsigned int prev;
+	unsigned int next;
+	unsigned char prevToHereHow;
+	unsigned char hereToNextHow;
+	unsigned char pad[2];
+};
+
+struct NavFileEncounter
+{
+	unsigned int from;											///< area indices
+	unsigned int to;
+	unsigned char fromDir;
+	unsigned char toDir;
+	unsigned char pad[2];
+	unsigned int spotCount;
+};
+
+struct NavFileSpotOrder
+{
+	unsigned int spot;											///< hiding spot index, or NAV_FILE_NO_INDEX
+	float t;
+};
+
+/**
+ * The sections of a version 6 nav file, pointing directly into the loaded file
+ */
+struct NavFileMesh
+{
+	const NavFileArea *area;
+	unsigned int areaCount;
+	const unsigned int *connect;
+	unsigned int connectCount;
+	const NavFileHidingSpot *spot;
+	unsigned int spotCount;
+	const NavFileApproach *approach;
+	unsigned int approachCount;
+	const NavFileEncounter *encounter;
+	unsigned int encounterCount;
+	const NavFileSpotOrder *spotOrder;
+	unsigned int spotOrderCount;
+	const unsigned int *overlap;
+	unsigned int overlapCount;
+
+	// where each area's runs start, computed while validating
+	std::vector<unsigned int> firstConnect;
+	std::vector<unsigned int> firstSpot;
+	std::vector<unsigned int> firstApproach;
+	std::vector<unsigned int> firstEncounter;
+	std::vector<unsigned int> firstSpotOrder;					///< indexed by encounter
+	std::vector<unsigned int> firstOverlap;
+};
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load a hiding spot from a version 6 nav file
+ */
+void HidingSpot::Load( const NavFileHidingSpot *data )
+{
+	m_id = data->id;
+	m_pos = data->pos;
+	m_flags = (unsigned char)data->flags;
+	++m_changeCount;
+
+	// update next ID to avoid ID collisions by later spots
+	if (m_id >= m_nextID)
+		m_nextID = m_id+1;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load a navigation area from a version 6 nav file.
+ * 'areas' and 'spots' hold every area and hiding spot in file order, so references are resolved directly.
+ */
+void CNavArea::Load( const NavFileMesh *mesh, unsigned int index, CNavArea **areas, HidingSpot **spots )
+{
+	const NavFileArea *data = &mesh->area[ index ];
+
+	m_id = data->id;
+
+	// update nextID to avoid collisions
+	if (m_id >= m_nextID)
+		m_nextID = m_id+1;
+
+	m_attributeFlags = (unsigned char)data->attributeFlags;
+	m_extent = data->extent;
+
+	m_center.x = (m_extent.lo.x + m_extent.hi.x)/2.0f;
+	m_center.y = (m_extent.lo.y + m_extent.hi.y)/2.0f;
+	m_center.z = (m_extent.lo.z + m_extent.hi.z)/2.0f;
+
+	m_neZ = data->neZ;
+	m_swZ = data->swZ;
+
+	SetPlace( placeDirectory.EntryToPlace( data->place ) );
+
+	// connections to adjacent areas
+	const unsigned int *connectIndex = &mesh->connect[ mesh->firstConnect[ index ] ];
+	for( int d=0; d<NUM_DIRECTIONS; d++ )
+	{
+		for( unsigned int i=0; i<data->connectCount[d]; ++i )
+		{
+			NavConnect connect;
+			connect.area = areas[ *connectIndex++ ];
+
+			m_connect[d].push_back( connect );
+		}
+	}
+
+	// hiding spots
+	for( unsigned int h=0; h<data->hidingSpotCount; ++h )
+		m_hidingSpotList.push_back( spots[ mesh->firstSpot[ index ] + h ] );
+
+	// approach areas
+	const NavFileApproach *approach = &mesh->approach[ mesh->firstApproach[ index ] ];
+
+	m_approachCount = (data->approachCount < MAX_APPROACH_AREAS) ? data->approachCount : MAX_APPROACH_AREAS;
+	for( int a=0; a<m_approachCount; ++a, ++approach )
+	{
+		m_approach[a].here.area = (approach->here == NAV_FILE_NO_INDEX) ? nullptr : areas[ approach->here ];
+		m_approach[a].prev.area = (approach->prev == NAV_FILE_NO_INDEX) ? nullptr : areas[ approach->prev ];
+		m_approach[a].prevToHereHow = (NavTraverseType)approach->prevToHereHow;
+		m_approach[a].next.area = (approach->next == NAV_FILE_NO_INDEX) ? nullptr : areas[ approach->next ];
+		m_approach[a].hereToNextHow = (NavTraverseType)approach->hereToNextHow;
+	}
+
+	// encounter paths
+	for( unsigned int e=0; e<data->encounterCount; ++e )
+	{
+		unsigned int encounterIndex = mesh->firstEncounter[ index ] + e;
+		const NavFileEncounter *fileEncounter = &mesh->encounter[ encounterIndex ];
+
+		m_spotEncounterList.push_back( SpotEncounter() );
+		SpotEncounter *encounter = &m_spotEncounterList.back();
+
+		encounter->from.area = areas[ fileEncounter->from ];
+		encounter->fromDir = static_cast<NavDirType>( fileEncounter->fromDir );
+		encounter->to.area = areas[ fileEncounter->to ];
+		encounter->toDir = static_cast<NavDirType>( fileEncounter->toDir );
+
+		// compute path
+		float halfWidth;
+		ComputePortal( encounter->to.area, encounter->toDir, &encounter->path.to, &halfWidth );
+		ComputePortal( encounter->from.area, encounter->fromDir, &encounter->path.from, &halfWidth );
+
+		const float eyeHeight = HalfHumanHeight;
+		encounter->path.from.z = encounter->from.area->GetZ( &encounter->path.from ) + eyeHeight;
+		encounter->path.to.z = encounter->to.area->GetZ( &encounter->path.to ) + eyeHeight;
+
+		const NavFileSpotOrder *fileOrder = &mesh->spotOrder[ mesh->firstSpotOrder[ encounterIndex ] ];
+		for( unsigned int s=0; s<fileEncounter->spotCount; ++s, ++fileOrder )
+		{
+			SpotOrder order;
+			order.spot = (fileOrder->spot == NAV_FILE_NO_INDEX) ? nullptr : spots[ fileOrder->spot ];
+			order.t = fileOrder->t;
+
+			encounter->spotList.push_back( order );
+		}
+	}
+
+	// overlapping areas
+	const unsigned int *overlapIndex = &mesh->overlap[ mesh->firstOverlap[ index ] ];
+	for( unsigned int o=0; o<data->overlapCount; ++o )
+		m_overlapList.push_back( areas[ *overlapIndex++ ] );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Locate a section of a version 6 nav file, and make sure it holds a whole number of records
+ */
+template < typename T >
+static bool GetNavFileSection( const SteamFile *file, const NavFileSection *table, int type, const T **records, unsigned int *count )
+{
+	const NavFileSection *section = &table[ type ];
+
+	if (section->size % sizeof(T))
+		return false;
+
+	*records = reinterpret_cast<const T *>( file->GetData() + section->offset );
+	*count = section->size / sizeof(T);
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Check that every run and every index in the mesh is in range, and compute where each run starts.
+ * Nothing is created until the whole file is known to be good.
+ */
+static bool ValidateNavFileMesh( NavFileMesh *mesh )
+{
+	unsigned int connect = 0, spot = 0, approach = 0, encounter = 0, spotOrder = 0, overlap = 0;
+
+	mesh->firstConnect.resize( mesh->areaCount );
+	mesh->firstSpot.resize( mesh->areaCount );
+	mesh->firstApproach.resize( mesh->areaCount );
+	mesh->firstEncounter.resize( mesh->areaCount );
+	mesh->firstOverlap.resize( mesh->areaCount );
+	mesh->firstSpotOrder.resize( mesh->encounterCount );
+
+	for( unsigned int i=0; i<mesh->areaCount; ++i )
+	{
+		const NavFileArea *area = &mesh->area[i];
+
+		// check each count against what is left of its section before adding it, so a corrupt count can't wrap around
+		mesh->firstConnect[i] = connect;
+		for( int d=0; d<NUM_DIRECTIONS; d++ )
+		{
+			if (area->connectCount[d] > mesh->connectCount - connect)
+				return false;
+			connect += area->connectCount[d];
+		}
+
+		mesh->firstSpot[i] = spot;
+		if (area->hidingSpotCount > mesh->spotCount - spot)
+			return false;
+		spot += area->hidingSpotCount;
+
+		mesh->firstApproach[i] = approach;
+		if (area->approachCount > mesh->approachCount - approach)
+			return false;
+		approach += area->approachCount;
+
+		mesh->firstEncounter[i] = encounter;
+		if (area->encounterCount > mesh->encounterCount - encounter)
+			return false;
+		encounter += area->encounterCount;
+
+		mesh->firstOverlap[i] = overlap;
+		if (area->overlapCount > mesh->overlapCount - overlap)
+			return false;
+		overlap += area->overlapCount;
+	}
+
+	for( unsigned int e=0; e<mesh->encounterCount; ++e )
+	{
+		const NavFileEncounter *fileEncounter = &mesh->encounter[e];
+
+		if (fileEncounter->from >= mesh->areaCount || fileEncounter->to >= mesh->areaCount ||
+			fileEncounter->fromDir >= NUM_DIRECTIONS || fileEncounter->toDir >= NUM_DIRECTIONS)
+			return false;
+
+		mesh->firstSpotOrder[e] = spotOrder;
+		if (fileEncounter->spotCount > mesh->spotOrderCount - spotOrder)
+			return false;
+		spotOrder += fileEncounter->spotCount;
+	}
+
+	for( unsigned int c=0; c<mesh->connectCount; ++c )
+		if (mesh->connect[c] >= mesh->areaCount)
+			return false;
+
+	for( unsigned int o=0; o<mesh->overlapCount; ++o )
+		if (mesh->overlap[o] >= mesh->areaCount)
+			return false;
+
+	for( unsigned int a=0; a<mesh->approachCount; ++a )
+	{
+		const NavFileApproach *fileApproach = &mesh->approach[a];
+
+		if ((fileApproach->here != NAV_FILE_NO_INDEX && fileApproach->here >= mesh->areaCount) ||
+			(fileApproach->prev != NAV_FILE_NO_INDEX && fileApproach->prev >= mesh->areaCount) ||
+			(fileApproach->next != NAV_FILE_NO_INDEX && fileApproach->next >= mesh->areaCount))
+			return false;
+	}
+
+	for( unsigned int s=0; s<mesh->spotOrderCount; ++s )
+		if (mesh->spotOrder[s].spot != NAV_FILE_NO_INDEX && mesh->spotOrder[s].spot >= mesh->spotCount)
+			return false;
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load the place directory from a version 6 nav file
+ */
+static bool LoadNavFilePlaces( const SteamFile *file, const NavFileSection *section )
+{
+	const byte *data = file->GetData() + section->offset;
+	const byte *end = data + section->size;
+
+	if (section->size == 0)
+		return true;
+
+	PlaceDirectory::EntryType count;
+	if (data + sizeof(count) > end)
+		return false;
+
+	memcpy( &count, data, sizeof(count) );
+	data += sizeof(count);
+
+	char placeName[256];
+	for( int i=0; i<count; ++i )
+	{
+		unsigned short len;
+		if (data + sizeof(len) > end)
+			return false;
+
+		memcpy( &len, data, sizeof(len) );
+		data += sizeof(len);
+
+		if (len == 0 || len > sizeof(placeName) || data + len > end)
+			return false;
+
+		memcpy( placeName, data, len );
+		placeName[ len-1 ] = '\000';
+		data += len;
+
+#ifdef CSTRIKE
+		placeDirectory.AddPlace( TheBotPhrases->NameToID( placeName ) );
+#endif
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load the areas of a version 6 nav file, positioned just after the bsp size.
+ * On success, the areas are on TheNavAreaList and in TheNavAreaGrid, fully connected.
+ */
+static NavErrorType LoadFlatNavigationAreas( SteamFile *file, const char *filename )
+{
+	unsigned int sectionCount;
+	if (!file->Read( &sectionCount ) || sectionCount > 1024)
+		return NAV_INVALID_FILE;
+
+	NavFileSection table[ NUM_NAV_SECTIONS ];
+	memset( table, 0, sizeof(table) );
+
+	const unsigned int fileLength = file->GetLength();
+
+	for( unsigned int i=0; i<sectionCount; ++i )
+	{
+		NavFileSection section;
+		if (!file->Read( &section ))
+			return NAV_INVALID_FILE;
+
+		if (section.offset % 4 || section.offset > fileLength || section.size > fileLength - section.offset)
+		{
+			CONSOLE_ECHO( "ERROR: Corrupt section table in navigation file '%s'.\n", filename );
+			return NAV_CORRUPT_DATA;
+		}
+
+		// ignore sections from future versions
+		if (section.type < NUM_NAV_SECTIONS)
+			table[ section.type ] = section;
+	}
+
+	NavFileMesh mesh;
+	if (!GetNavFileSection( file, table, NAV_SECTION_AREAS, &mesh.area, &mesh.areaCount ) ||
+		!GetNavFileSection( file, table, NAV_SECTION_CONNECTIONS, &mesh.connect, &mesh.connectCount ) ||
+		!GetNavFileSection( file, table, NAV_SECTION_HIDING_SPOTS, &mesh.spot, &mesh.spotCount ) ||
+		!GetNavFileSection( file, table, NAV_SECTION_APPROACHES, &mesh.approach, &mesh.approachCount ) ||
+		!GetNavFileSection( file, table, NAV_SECTION_ENCOUNTERS, &mesh.encounter, &mesh.encounterCount ) ||
+		!GetNavFileSection( file, table, NAV_SECTION_ENCOUNTER_SPOTS, &mesh.spotOrder, &mesh.spotOrderCount ) ||
+		!GetNavFileSection( file, table, NAV_SECTION_OVERLAPS, &mesh.overlap, &mesh.overlapCount ) ||
+		!ValidateNavFileMesh( &mesh ) ||
+		!LoadNavFilePlaces( file, &table[ NAV_SECTION_PLACES ] ))
+	{
+		CONSOLE_ECHO( "ERROR: Corrupt navigation data in '%s'.\n", filename );
+		return NAV_CORRUPT_DATA;
+	}
+
+	// create everything first, so references can be resolved as each area loads
+	std::vector<HidingSpot *> spots( mesh.spotCount );
+	for( unsigned int s=0; s<mesh.spotCount; ++s )
+	{
+		spots[s] = new HidingSpot;
+		spots[s]->Load( &mesh.spot[s] );
+	}
+
+	std::vector<CNavArea *> areas( mesh.areaCount );
+	for( unsigned int i=0; i<mesh.areaCount; ++i )
+	{
+		areas[i] = new CNavArea;
+		TheNavAreaList.push_back( areas[i] );
+	}
+
+	Extent extent;
+	extent.lo.x = 9999999999.9f;
+	extent.lo.y = 9999999999.9f;
+	extent.hi.x = -9999999999.9f;
+	extent.hi.y = -9999999999.9f;
+
+	for( unsigned int i=0; i<mesh.areaCount; ++i )
+	{
+		CNavArea *area = areas[i];
+		area->Load( &mesh, i, areas.data(), spots.data() );
+
+		const Extent *areaExtent = area->GetExtent();
+
+		// check validity of nav area
+		if (areaExtent->lo.x >= areaExtent->hi.x || areaExtent->lo.y >= areaExtent->hi.y)
+			CONSOLE_ECHO( "WARNING: Degenerate Navigation Area #%d at ( %g, %g, %g )\n", 
+											area->GetID(), area->GetCenter()->x, area->GetCenter()->y, area->GetCenter()->z );
+
+		if (areaExtent->lo.x < extent.lo.x)
+			extent.lo.x = areaExtent->lo.x;
+		if (areaExtent->lo.y < extent.lo.y)
+			extent.lo.y = areaExtent->lo.y;
+		if (areaExtent->hi.x > extent.hi.x)
+			extent.hi.x = areaExtent->hi.x;
+		if (areaExtent->hi.y > extent.hi.y)
+			extent.hi.y = areaExtent->hi.y;
+	}
+
+	// add the areas to the grid
+	TheNavAreaGrid.Initialize( extent.lo.x, extent.hi.x, extent.lo.y, extent.hi.y );
+
+	for( unsigned int i=0; i<mesh.areaCount; ++i )
+		TheNavAreaGrid.AddNavArea( areas[i] );
+
+	// the potentially visible areas are optional - without them, every area is potentially visible
+	const NavFileSection *visibility = &table[ NAV_SECTION_VISIBILITY ];
+	if (visibility->size)
+	{
+		if (!TheNavAreaVisibility.Decompress( file->GetData() + visibility->offset, visibility->size, areas ))
+			CONSOLE_ECHO( "WARNING: Ignoring corrupt area visibility in navigation file '%s'.\n", filename );
+	}
+
+	return NAV_OK;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Append a section's records to the file, 4-byte aligned, and record it in the section table
+ */
+template < typename T >
+static void AddNavFileSection( BufferedFileWriter *file, std::vector<NavFileSection> *table, int type, const std::vector<T> &records )
+{
+	file->Align( 4 );
+
+	NavFileSection section;
+	section.type = type;
+	section.offset = file->GetSize();
+	section.size = records.size() * sizeof(T);
+	table->push_back( section );
+
+	file->Write( records.data(), section.size );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Store the areas as a version 6 nav file, following the magic number, version, and bsp size.
+ * The place directory must already be built.
+ */
+void SaveFlatNavigationMap( BufferedFileWriter *file )
+{
+	// index every area and hiding spot
+	std::map<const CNavArea *, unsigned int> areaIndex;
+	std::map<const HidingSpot *, unsigned int> spotIndex;
+
+	NavAreaList::iterator it;
+	for( it = TheNavAreaList.begin(); it != TheNavAreaList.end(); ++it )
+	{
+		unsigned int index = areaIndex.size();
+		areaIndex[ *it ] = index;
+
+		const HidingSpotList *spotList = (*it)->GetHidingSpotList();
+		for( HidingSpotList::const_iterator spotIter = spotList->begin(); spotIter != spotList->end(); ++spotIter )
+		{
+			unsigned int index = spotIndex.size();
+			spotIndex[ *spotIter ] = index;
+		}
+	}
+
+	#define NAV_AREA_INDEX( area )	((area) ? areaIndex[ (area) ] : NAV_FILE_NO_INDEX)
+
+	std::vector<NavFileArea> areas;
+	std::vector<unsigned int> connections;
+	std::vector<NavFileHidingSpot> spots;
+	std::vector<NavFileApproach> approaches;
+	std::vector<NavFileEncounter> encounters;
+	std::vector<NavFileSpotOrder> spotOrders;
+	std::vector<unsigned int> overlaps;
+	std::vector<unsigned char> visibility;
+
+	areas.reserve( TheNavAreaList.size() );
+
+	for( it = TheNavAreaList.begin(); it != TheNavAreaList.end(); ++it )
+	{
+		const CNavArea *area = *it;
+
+		NavFileArea fileArea = {};
+
+		fileArea.id = area->m_id;
+		fileArea.attributeFlags = area->m_attributeFlags;
+		fileArea.extent = area->m_extent;
+		fileArea.neZ = area->m_neZ;
+		fileArea.swZ = area->m_swZ;
+		fileArea.place = placeDirectory.GetEntry( area->GetPlace() );
+
+		for( int d=0; d<NUM_DIRECTIONS; d++ )
+		{
+			fileArea.connectCount[d] = area->m_connect[d].size();
+
+			for( NavConnectList::const_iterator iter = area->m_connect[d].begin(); iter != area->m_connect[d].end(); ++iter )
+				connections.push_back( areaIndex[ iter->area ] );
+		}
+
+		fileArea.hidingSpotCount = area->m_hidingSpotList.size();
+		for( HidingSpotList::const_iterator iter = area->m_hidingSpotList.begin(); iter != area->m_hidingSpotList.end(); ++iter )
+		{
+			NavFileHidingSpot spot;
+			spot.id = (*iter)->GetID();
+			spot.pos = *(*iter)->GetPosition();
+			spot.flags = (*iter)->GetFlags();
+			spots.push_back( spot );
+		}
+
+		fileArea.approachCount = area->m_approachCount;
+		for( int a=0; a<area->m_approachCount; ++a )
+		{
+			NavFileApproach approach;
+			memset( &approach, 0, sizeof(approach) );
+
+			approach.here = NAV_AREA_INDEX( area->m_approach[a].here.area );
+			approach.prev = NAV_AREA_INDEX( area->m_approach[a].prev.area );
+			approach.next = NAV_AREA_INDEX( area->m_approach[a].next.area );
+			approach.prevToHereHow = (unsigned char)area->m_approach[a].prevToHereHow;
+			approach.hereToNextHow = (unsigned char)area->m_approach[a].hereToNextHow;
+			approaches.push_back( approach );
+		}
+
+		// encounters must reference real areas - skip any left dangling by editing
+		for( SpotEncounterList::const_iterator iter = area->m_spotEncounterList.begin(); iter != area->m_spotEncounterList.end(); ++iter )
+		{
+			const SpotEncounter *e = &(*iter);
+
+			if (e->from.area == nullptr || e->to.area == nullptr)
+				continue;
+
+			NavFileEncounter encounter;
+			memset( &encounter, 0, sizeof(encounter) );
+
+			encounter.from = areaIndex[ e->from.area ];
+			encounter.to = areaIndex[ e->to.area ];
+			encounter.fromDir = (unsigned char)e->fromDir;
+			encounter.toDir = (unsigned char)e->toDir;
+			encounter.spotCount = e->spotList.size();
+			encounters.push_back( encounter );
+			++fileArea.encounterCount;
+
+			for( SpotOrderList::const_iterator oiter = e->spotList.begin(); oiter != e->spotList.end(); ++oiter )
+			{
+				// the spot may be missing if the mesh has been edited but not re-analyzed
+				std::map<const HidingSpot *, unsigned int>::iterator spot = spotIndex.find( oiter->spot );
+
+				NavFileSpotOrder order;
+				order.spot = (spot != spotIndex.end()) ? spot->second : NAV_FILE_NO_INDEX;
+				order.t = oiter->t;
+				spotOrders.push_back( order );
+			}
+		}
+
+		fileArea.overlapCount = area->m_overlapList.size();
+		for( NavAreaList::const_iterator iter = area->m_overlapList.begin(); iter != area->m_overlapList.end(); ++iter )
+			overlaps.push_back( areaIndex[ *iter ] );
+
+		areas.push_back( fileArea );
+	}
+
+	#undef NAV_AREA_INDEX
+
+	// the table is indexed by area, so it can only be stored if its indices are the file's
+	std::vector<CNavArea *> areaArray( TheNavAreaList.begin(), TheNavAreaList.end() );
+	if (TheNavAreaVisibility.IsComputed())
+	{
+		if (TheNavAreaVisibility.IsInOrder( areaArray ))
+			TheNavAreaVisibility.Compress( &visibility );
+		else
+			CONSOLE_ECHO( "WARNING: Area visibility does not match the navigation mesh, and was not saved.\n" );
+	}
+
+	//
+	// Write the section table, then each section - the table is filled in once the offsets are known
+	//
+	const unsigned int sectionCount = NUM_NAV_SECTIONS;
+	file->Write( sectionCount );
+
+	const unsigned int tableOffset = file->GetSize();
+
+	std::vector<NavFileSection> table( sectionCount );
+	file->Write( table.data(), sectionCount * sizeof(NavFileSection) );
+	table.clear();
+
+	// place directory, in the same layout as older versions
+	file->Align( 4 );
+
+	NavFileSection places;
+	places.type = NAV_SECTION_PLACES;
+	places.offset = file->GetSize();
+	placeDirectory.Save( file );
+	places.size = file->GetSize() - places.offset;
+	table.push_back( places );
+
+	AddNavFileSection( file, &table, NAV_SECTION_AREAS, areas );
+	AddNavFileSection( file, &table, NAV_SECTION_CONNECTIONS, connections );
+	AddNavFileSection( file, &table, NAV_SECTION_HIDING_SPOTS, spots );
+	AddNavFileSection( file, &table, NAV_SECTION_APPROACHES, approaches );
+	AddNavFileSection( file, &table, NAV_SECTION_ENCOUNTERS, encounters );
+	AddNavFileSection( file, &table, NAV_SECTION_ENCOUNTER_SPOTS, spotOrders );
+	AddNavFileSection( file, &table, NAV_SECTION_OVERLAPS, overlaps );
+	AddNavFileSection( file, &table, NAV_SECTION_VISIBILITY, visibility );
+
+	file->Overwrite( tableOffset, table.data(), sectionCount * sizeof(NavFileSection) );
+}
+
 
 //--------------------------------------------------------------------------------------------------------------
 /*
@@ -706,9 +1371,10 @@ inline void COM_FixSlashes( char *pname )
 }
 
 /**
- * Store AI navigation data to a file
+ * Store AI navigation data to a file.
+ * Versions before 6 are always written as version 5, for use by older builds.
  */
-bool SaveNavigationMap( const char *filename )
+bool SaveNavigationMap( const char *filename, unsigned int version )
 {
 	if (filename == nullptr)
 		return false;
@@ -718,19 +1384,12 @@ bool SaveNavigationMap( const char *filename )
 	//
 	COM_FixSlashes( const_cast<char *>(filename) );
 
-#ifdef WIN32
-	int fd = _open( filename, _O_BINARY | _O_CREAT | _O_WRONLY, _S_IREAD | _S_IWRITE );
-#else
-#define _write write
-	int fd = creat( filename, S_IRUSR | S_IWUSR | S_IRGRP );
-#endif
-
-	if (fd < 0)
-		return false;
+	// the whole file is collected in memory and written at once
+	BufferedFileWriter file;
 
 	// store "magic number" to help identify this kind of file
 	unsigned int magic = NAV_MAGIC_NUMBER;
-	_write( fd, &magic, sizeof(unsigned int) );
+	file.Write( &magic, sizeof(unsigned int) );
 
 	// store version number of file
 	// 1 = hiding spots as plain vector array
@@ -739,8 +1398,13 @@ bool SaveNavigationMap( const char *filename )
 	// 4 = Includes size of source bsp file to verify nav data correlation
 	// ---- Beta Release at V4 -----
 	// 5 = Added Place info
-	unsigned int version = 5;
-	_write( fd, &version, sizeof(unsigned int) );
+	// 6 = Flat arrays located by a section table, with references stored as indices
+	if (version < 6)
+		version = 5;
+	else
+		version = NAV_CURRENT_VERSION;
+
+	file.Write( &version, sizeof(unsigned int) );
 
 
 	// get size of source bsp file and store it in the nav file
@@ -752,7 +1416,7 @@ bool SaveNavigationMap( const char *filename )
 	unsigned int bspSize = (unsigned int)engine::GetFileSize( bspFilename );
 	CONSOLE_ECHO( "Size of bsp file '%s' is %u bytes.\n", bspFilename, bspSize );
 
-	_write( fd, &bspSize, sizeof(unsigned int) );
+	file.Write( &bspSize, sizeof(unsigned int) );
 
 
 	//
@@ -773,26 +1437,34 @@ bool SaveNavigationMap( const char *filename )
 		}
 	}
 
-	placeDirectory.Save( fd );
+	if (version >= 6)
+	{
+		SaveFlatNavigationMap( &file );
+	}
+	else
+	{
+		placeDirectory.Save( &file );
 
 
-	//
-	// Store navigation areas
-	//
+		//
+		// Store navigation areas
+		//
 
-	// store number of areas
-	unsigned int count = TheNavAreaList.size();
-	_write( fd, &count, sizeof(unsigned int) );
+		// store number of areas
+		unsigned int count = TheNavAreaList.size();
+		file.Write( &count, sizeof(unsigned int) );
 
-	// store each area
-	for( it = TheNavAreaList.begin(); it != TheNavAreaList.end(); ++it )
-	{
-		CNavArea *area = *it;
+		// store each area
+		for( it = TheNavAreaList.begin(); it != TheNavAreaList.end(); ++it )
+		{
+			CNavArea *area = *it;
 
-		area->Save( fd, version );
+			area->Save( &file, version );
+		}
 	}
 
-	_close( fd );
+	if (!file.Save( filename ))
+		return false;
 
 
 #ifdef _WIN32
@@ -910,7 +1582,7 @@ void SanityCheckNavigationMap( const char *mapName )
 	// check magic number
 	bool result;
 	unsigned int magic;
-	result = navFile.Read( &magic, sizeof(unsigned int) );
+	result = navFile.Read( &magic );
 	if (!result || magic != NAV_MAGIC_NUMBER)
 	{
 		CONSOLE_ECHO( "ERROR: Invalid navigation file '%s'.\n", navFilename );
@@ -919,8 +1591,8 @@ void SanityCheckNavigationMap( const char *mapName )
 
 	// read file version number
 	unsigned int version;
-	result = navFile.Read( &version, sizeof(unsigned int) );
-	if (!result || version > 5)
+	result = navFile.Read( &version );
+	if (!result || version > NAV_CURRENT_VERSION)
 	{
 		CONSOLE_ECHO( "ERROR: Unknown version in navigation file %s.\n", navFilename );
 		return;
@@ -930,7 +1602,7 @@ void SanityCheckNavigationMap( const char *mapName )
 	{
 		// get size of source bsp file and verify that the bsp hasn't changed
 		unsigned int saveBspSize;
-		navFile.Read( &saveBspSize, sizeof(unsigned int) );
+		navFile.Read( &saveBspSize );
 
 		// verify size
 		if (bspFilename == nullptr)
@@ -952,6 +1624,8 @@ void SanityCheckNavigationMap( const char *mapName )
 }
 
 //--------------------------------------------------------------------------------------------------------------
+static void LoadNavigationAreas( SteamFile *navFile, unsigned int version );
+
 /**
  * Load AI navigation data from a file
  */
@@ -981,7 +1655,7 @@ NavErrorType LoadNavigationMap( void )
 	// check magic number
 	bool result;
 	unsigned int magic;
-	result = navFile.Read( &magic, sizeof(unsigned int) );
+	result = navFile.Read( &magic );
 	if (!result || magic != NAV_MAGIC_NUMBER)
 	{
 		CONSOLE_ECHO( "ERROR: Invalid navigation file '%s'.\n", filename );
@@ -990,8 +1664,8 @@ NavErrorType LoadNavigationMap( void )
 
 	// read file version number
 	unsigned int version;
-	result = navFile.Read( &version, sizeof(unsigned int) );
-	if (!result || version > 5)
+	result = navFile.Read( &version );
+	if (!result || version > NAV_CURRENT_VERSION)
 	{
 		CONSOLE_ECHO( "ERROR: Unknown navigation file version.\n" );
 		return NAV_BAD_FILE_VERSION;
@@ -1001,7 +1675,7 @@ NavErrorType LoadNavigationMap( void )
 	{
 		// get size of source bsp file and verify that the bsp hasn't changed
 		unsigned int saveBspSize;
-		navFile.Read( &saveBspSize, sizeof(unsigned int) );
+		navFile.Read( &saveBspSize );
 
 		// verify size
 		char *bspFilename = GetBspFilename( filename );
@@ -1021,15 +1695,61 @@ NavErrorType LoadNavigationMap( void )
 		}
 	}
 
+	if (version >= 6)
+	{
+		// flat arrays, with all references already resolved
+		NavErrorType error = LoadFlatNavigationAreas( &navFile, filename );
+		if (error != NAV_OK)
+		{
+			DestroyNavigationMap();
+			return error;
+		}
+	}
+	else
+	{
+		LoadNavigationAreas( &navFile, version );
+
+		// load legacy location file (Places)
+		if (version < 5)
+		{
+#ifdef CSTRIKE
+			LoadLocationFile( filename );
+#endif
+		}
+	}
+
+	//
+	// Set up all the ladders
+	//
+	BuildLadders();
+
+	// freeze the connectivity for pathfinding
+	TheNavAreaGraph.Build();
+
+	// use the precomputed route table, if there is one for this version of the mesh
+	char routeFilename[256];
+	sprintf( routeFilename, "maps\\%s.nrt", STRING( gpGlobals->mapname ) );
+	TheNavRouteTable.Load( routeFilename );
+
+	return NAV_OK;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load the areas of a version 1-5 nav file, positioned just after the bsp size.
+ * On return, the areas are on TheNavAreaList and in TheNavAreaGrid, with their IDs resolved.
+ */
+static void LoadNavigationAreas( SteamFile *navFile, unsigned int version )
+{
 	// load Place directory
 	if (version >= 5)
 	{
-		placeDirectory.Load( &navFile );
+		placeDirectory.Load( navFile );
 	}
 
 	// get number of areas
-	unsigned int count;
-	result = navFile.Read( &count, sizeof(unsigned int) );
+	unsigned int count = 0;
+	navFile->Read( &count );
 
 	Extent extent;
 	extent.lo.x = 9999999999.9f;
@@ -1041,7 +1761,7 @@ NavErrorType LoadNavigationMap( void )
 	for( unsigned int i=0; i<count; ++i )
 	{
 		CNavArea *area = new CNavArea;
-		area->Load( &navFile, version );
+		area->Load( navFile, version );
 		TheNavAreaList.push_back( area );
 
 		const Extent *areaExtent = area->GetExtent();
@@ -1049,7 +1769,7 @@ NavErrorType LoadNavigationMap( void )
 		// check validity of nav area
 		if (areaExtent->lo.x >= areaExtent->hi.x || areaExtent->lo.y >= areaExtent->hi.y)
 			CONSOLE_ECHO( "WARNING: Degenerate Navigation Area #%d at ( %g, %g, %g )\n", 
-											area->GetID(), area->m_center.x, area->m_center.y, area->m_center.z );
+											area->GetID(), area->GetCenter()->x, area->GetCenter()->y, area->GetCenter()->z );
 
 		if (areaExtent->lo.x < extent.lo.x)
 			extent.lo.x = areaExtent->lo.x;
@@ -1075,19 +1795,54 @@ NavErrorType LoadNavigationMap( void )
 		CNavArea *area = *iter;
 		area->PostLoad();
 	}
+}
 
-	// load legacy location file (Places)
-	if (version < 5)
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * bot_nav_convert [version]
+ * Rewrite the current map's nav file in the given version (default is the current version).
+ * The original file is kept with a ".bak" extension.
+ */
+void ConvertNavigationMap( void )
+{
+	unsigned int version = NAV_CURRENT_VERSION;
+	if (engine::Cmd_Argc() > 1)
+		version = atoi( engine::Cmd_Argv( 1 ) );
+
+	if (version < 5 || version > NAV_CURRENT_VERSION)
 	{
-#ifdef CSTRIKE
-		LoadLocationFile( filename );
-#endif
+		CONSOLE_ECHO( "bot_nav_convert: can only write versions 5 to %d.\n", NAV_CURRENT_VERSION );
+		return;
 	}
 
-	//
-	// Set up all the ladders
-	//
-	BuildLadders();
+	if (TheNavAreaList.empty())
+	{
+		NavErrorType error = LoadNavigationMap();
+		if (error != NAV_OK)
+		{
+			CONSOLE_ECHO( "Unable to load navigation mesh for this map (error %d).\n", error );
+			return;
+		}
+	}
 
-	return NAV_OK;
+	char gameDir[256];
+	engine::GetGameDir( gameDir );
+
+	char filename[512];
+	snprintf( filename, sizeof(filename), "%s/maps/%s.nav", gameDir, STRING( gpGlobals->mapname ) );
+
+	char backupFilename[512];
+	snprintf( backupFilename, sizeof(backupFilename), "%s.bak", filename );
+
+	remove( backupFilename );
+	rename( filename, backupFilename );
+
+	if (!SaveNavigationMap( filename, version ))
+	{
+		CONSOLE_ECHO( "ERROR: Unable to save navigation file '%s'.\n", filename );
+		return;
+	}
+
+	CONSOLE_ECHO( "bot_nav_convert: saved '%s' as version %d (%d areas, %d hiding spots)\n",
+					filename, version, (int)TheNavAreaList.size(), (int)TheHidingSpotList.size() );
 }
@@ -0,0 +1,355 @@
+// nav_influence.cpp
+// Per-team influence maps over the navigation mesh
+
+#pragma warning( disable : 4530 )					// STL uses exceptions, but we are not compiling with them - ignore warning
+
+#include <math.h>
+#include <vector>
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "player.h"
+#include "gamerules.h"
+#include "player_snapshot.h"
+
+#include "bot_util.h"
+#include "nav.h"
+#include "nav_area.h"
+#include "nav_influence.h"
+
+
+CNavInfluenceMap TheNavInfluenceMap;
+
+/// how long it takes each kind of influence to fall to half its value
+static const float influenceHalfLife[ CNavInfluenceMap::NUM_INFLUENCE_TYPES ] =
+{
+	20.0f,		// INFLUENCE_THREAT
+	30.0f,		// INFLUENCE_CONTROL
+	15.0f,		// INFLUENCE_DEATHS
+};
+
+/// influence this small is forgotten
+static const float minInfluence = 0.01f;
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavInfluenceMap::CNavInfluenceMap( void )
+{
+	m_buildCount = 0;
+	m_decayTimestamp = 0.0f;
+	m_spreadCount = 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavInfluenceMap::Reset( void )
+{
+	for( int type=0; type<NUM_INFLUENCE_TYPES; ++type )
+		for( int team=0; team<MAX_INFLUENCE_TEAMS; ++team )
+			m_value[ type ][ team ].clear();
+
+	m_buildCount = 0;
+	m_decayTimestamp = 0.0f;
+
+	DiscardSnapshots();
+
+	m_spreadMarker.clear();
+	m_spreadCount = 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Make the arrays match the search graph, clearing them if it has been rebuilt since they were filled in.
+ * Return false if there is no mesh.
+ */
+bool CNavInfluenceMap::Prepare( void )
+{
+	TheNavAreaGraph.Update();
+
+	if (TheNavAreaGraph.GetAreaCount() == 0)
+		return false;
+
+	if (IsCurrent())
+		return true;
+
+	const unsigned int areaCount = TheNavAreaGraph.GetAreaCount();
+
+	for( int type=0; type<NUM_INFLUENCE_TYPES; ++type )
+		for( int team=0; team<MAX_INFLUENCE_TEAMS; ++team )
+			m_value[ type ][ team ].assign( areaCount, 0.0f );
+
+	m_spreadMarker.assign( areaCount, 0 );
+	m_spreadCount = 0;
+
+	m_buildCount = TheNavAreaGraph.GetBuildCount();
+
+	DiscardSnapshots();
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Decay every value, once a second
+ */
+void CNavInfluenceMap::Update( void )
+{
+	const float elapsed = gpGlobals->time - m_decayTimestamp;
+
+	// the clock starts over with each map
+	if (elapsed < 0.0f)
+	{
+		m_decayTimestamp = gpGlobals->time;
+		return;
+	}
+
+	if (elapsed < 1.0f)
+		return;
+
+	m_decayTimestamp = gpGlobals->time;
+
+	if (!IsCurrent())
+		return;
+
+	DiscardSnapshots();
+
+	for( int type=0; type<NUM_INFLUENCE_TYPES; ++type )
+	{
+		const float scale = powf( 0.5f, elapsed / influenceHalfLife[ type ] );
+
+		for( int team=0; team<MAX_INFLUENCE_TEAMS; ++team )
+		{
+			float *value = m_value[ type ][ team ].data();
+			const unsigned int count = m_value[ type ][ team ].size();
+
+			// kept branch-free, so the compiler can vectorize it
+			for( unsigned int i=0; i<count; ++i )
+			{
+				float decayed = value[i] * scale;
+				value[i] = (decayed < minInfluence) ? 0.0f : decayed;
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return a copy of the team's threat, or nullptr if there is none.
+ * The copy is shared until the threat next changes. Searches running on other threads hold on to
+ * the copies they were given, so they never see a change, and the last to finish frees it.
+ */
+CNavInfluenceMap::Snapshot CNavInfluenceMap::GetThreatSnapshot( int team )
+{
+	if (team < TEAM_BLUE || team > TEAM_GREEN || !IsCurrent())
+		return nullptr;
+
+	Snapshot &snapshot = m_threatSnapshot[ team - TEAM_BLUE ];
+
+	if (snapshot == nullptr)
+		snapshot = std::make_shared< const std::vector< float > >( m_value[ INFLUENCE_THREAT ][ team - TEAM_BLUE ] );
+
+	return snapshot;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavInfluenceMap::DiscardSnapshots( void )
+{
+	for( int team=0; team<MAX_INFLUENCE_TEAMS; ++team )
+		m_threatSnapshot[ team ].reset();
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Add 'amount' of influence at 'pos' in 'startArea', falling off linearly to nothing at 'radius'.
+ * The influence spreads breadth-first across connections, to at most MAX_SPREAD_AREAS areas.
+ */
+void CNavInfluenceMap::AddInfluence( InfluenceType type, int team, CNavArea *startArea, const Vector *pos, float amount, float radius )
+{
+	if (startArea == nullptr || team < TEAM_BLUE || team > TEAM_GREEN || radius <= 0.0f)
+		return;
+
+	if (!Prepare() || !TheNavAreaGraph.Contains( startArea ))
+		return;
+
+	float *value = m_value[ type ][ team - TEAM_BLUE ].data();
+
+	if (type == INFLUENCE_THREAT)
+		m_threatSnapshot[ team - TEAM_BLUE ].reset();
+
+	// a new marker for this spread, so we don't have to clear the old ones
+	if (++m_spreadCount == 0)
+	{
+		m_spreadMarker.assign( m_spreadMarker.size(), 0 );
+		m_spreadCount = 1;
+	}
+
+	m_spreadQueue.clear();
+
+	const unsigned int startIndex = startArea->GetGraphIndex();
+	m_spreadMarker[ startIndex ] = m_spreadCount;
+	m_spreadQueue.push_back( startIndex );
+	value[ startIndex ] += amount;
+
+	for( unsigned int head=0; head<m_spreadQueue.size() && m_spreadQueue.size() < MAX_SPREAD_AREAS; ++head )
+	{
+		const unsigned int index = m_spreadQueue[ head ];
+
+		const NavAreaEdge *end = TheNavAreaGraph.GetEdgesEnd( index );
+		for( const NavAreaEdge *edge = TheNavAreaGraph.GetEdgesBegin( index ); edge != end; ++edge )
+		{
+			if (m_spreadMarker[ edge->to ] == m_spreadCount)
+				continue;
+
+			m_spreadMarker[ edge->to ] = m_spreadCount;
+
+			float range = (TheNavAreaGraph.GetCenter( edge->to ) - *pos).Length();
+			if (range >= radius)
+				continue;
+
+			value[ edge->to ] += amount * (1.0f - range / radius);
+
+			m_spreadQueue.push_back( edge->to );
+			if (m_spreadQueue.size() >= MAX_SPREAD_AREAS)
+				break;
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Add influence for every team that is hostile to the given entity's team
+ */
+void CNavInfluenceMap::AddHostileInfluence( InfluenceType type, CBaseEntity *entity, CNavArea *startArea, const Vector *pos, float amount, float radius )
+{
+	unsigned int hostileTeams = 0;
+
+	// only teams with players in the game matter, and asking about a player lets the rules decide
+	for( int i=0; i<g_PlayerSnapshot.GetCount(); ++i )
+	{
+		int team = g_PlayerSnapshot.GetTeam( i );
+
+		if (team < TEAM_BLUE || team > TEAM_GREEN || team == entity->TeamNumber())
+			continue;
+
+		if (g_pGameRules->PlayerRelationship( entity, g_PlayerSnapshot.GetPlayer( i ) ) < GR_ALLY)
+			hostileTeams |= 1 << (team - TEAM_BLUE);
+	}
+
+	for( int team=TEAM_BLUE; team<=TEAM_GREEN; ++team )
+		if (hostileTeams & (1 << (team - TEAM_BLUE)))
+			AddInfluence( type, team, startArea, pos, amount, radius );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the area the given entity is in, or the nearest one
+ */
+static CNavArea *GetInfluenceArea( CBaseEntity *entity )
+{
+	CNavArea *area = TheNavAreaGrid.GetNavArea( &entity->v.origin );
+	if (area == nullptr)
+		area = TheNavAreaGrid.GetNearestNavArea( &entity->v.origin );
+
+	return area;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Add influence for a game event
+ */
+void CNavInfluenceMap::OnEvent( GameEventType event, CBaseEntity *entity, CBaseEntity *other )
+{
+	const float killRadius = 500.0f;
+	const float deathRadius = 300.0f;
+	const float sentryRadius = 1000.0f;		// the sentry gun's range
+	const float flagRadius = 500.0f;
+
+	switch( event )
+	{
+		case EVENT_PLAYER_DIED:
+		{
+			// entity is the victim, other is the killer
+			if (entity == nullptr)
+				break;
+
+			CNavArea *area = GetInfluenceArea( entity );
+			const int team = entity->TeamNumber();
+
+			AddInfluence( INFLUENCE_DEATHS, team, area, &entity->v.origin, 1.0f, deathRadius );
+			AddInfluence( INFLUENCE_THREAT, team, area, &entity->v.origin, 1.0f, killRadius );
+
+			if (other && other != entity && other->IsPlayer() && other->TeamNumber() != team)
+			{
+				CNavArea *killerArea = GetInfluenceArea( other );
+
+				AddInfluence( INFLUENCE_THREAT, team, killerArea, &other->v.origin, 1.0f, killRadius );
+				AddInfluence( INFLUENCE_CONTROL, other->TeamNumber(), killerArea, &other->v.origin, 1.0f, killRadius );
+			}
+			break;
+		}
+
+		case EVENT_SENTRY_BUILT:
+		{
+			if (entity == nullptr)
+				break;
+
+			CNavArea *area = GetInfluenceArea( entity );
+
+			AddInfluence( INFLUENCE_CONTROL, entity->TeamNumber(), area, &entity->v.origin, 2.0f, sentryRadius );
+			AddHostileInfluence( INFLUENCE_THREAT, entity, area, &entity->v.origin, 3.0f, sentryRadius );
+			break;
+		}
+
+		case EVENT_FLAG_PICKED_UP:
+		{
+			// entity is the player who picked it up
+			if (entity == nullptr)
+				break;
+
+			CNavArea *area = GetInfluenceArea( entity );
+
+			AddInfluence( INFLUENCE_CONTROL, entity->TeamNumber(), area, &entity->v.origin, 1.0f, flagRadius );
+			AddHostileInfluence( INFLUENCE_THREAT, entity, area, &entity->v.origin, 1.0f, flagRadius );
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Show each team's threat for debugging, as a beam in the team's color above each area
+ */
+void CNavInfluenceMap::Draw( void ) const
+{
+	static const unsigned char teamColor[ MAX_INFLUENCE_TEAMS ][3] =
+	{
+		{ 0, 0, 255 },
+		{ 255, 0, 0 },
+		{ 255, 255, 0 },
+		{ 0, 255, 0 },
+	};
+
+	if (!IsCurrent())
+		return;
+
+	for( unsigned int i=0; i<TheNavAreaGraph.GetAreaCount(); ++i )
+	{
+		Vector center = TheNavAreaGraph.GetCenter( i );
+		center.z = TheNavAreaGraph.GetArea( i )->GetZ( &center );
+
+		for( int team=0; team<MAX_INFLUENCE_TEAMS; ++team )
+		{
+			float threat = m_value[ INFLUENCE_THREAT ][ team ][i];
+			if (threat > 0.1f)
+			{
+				// offset each team's beam a little so they don't overlap
+				Vector bottom = center + Vector( 4.0f * team, 0.0f, 0.0f );
+				Vector top = bottom + Vector( 0.0f, 0.0f, 10.0f * threat );
+				UTIL_DrawBeamPoints( bottom, top, 3, teamColor[ team ][0], teamColor[ team ][1], teamColor[ team ][2] );
+			}
+		}
+	}
+}
@@ -0,0 +1,135 @@
+// nav_influence.h
+// Per-team influence maps over the navigation mesh
+
+#ifndef _NAV_INFLUENCE_H_
+#define _NAV_INFLUENCE_H_
+
+#include <memory>
+#include <vector>
+
+#include "GameEvent.h"
+#include "nav_area.h"
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The CNavInfluenceMap records what each team has been doing where, so bots can tell dangerous areas from safe
+ * ones with a single lookup. It replaces the per-area "danger" values, which were decayed every time they were read.
+ * Each kind of influence for each team is a flat array of floats indexed by TheNavAreaGraph index.
+ * Game events add influence to the area they happen in, fading with distance across at most MAX_SPREAD_AREAS
+ * nearby areas, and once a second every value is decayed in a single pass over the arrays.
+ * If the search graph is rebuilt, the map starts over.
+ * Searches on TheNavSearchPool's threads must not read the map itself, which the main thread changes as they run.
+ * They read a snapshot of a team's threat instead, copied on the main thread, and only again once the threat changes.
+ */
+class CNavInfluenceMap
+{
+public:
+	CNavInfluenceMap( void );
+
+	enum InfluenceType
+	{
+		INFLUENCE_THREAT,									///< enemies of the team have killed, built sentries, or carried flags here
+		INFLUENCE_CONTROL,									///< the team has killed, built sentries, or carried flags here
+		INFLUENCE_DEATHS,									///< members of the team have recently died here
+
+		NUM_INFLUENCE_TYPES
+	};
+
+	enum
+	{
+		MAX_INFLUENCE_TEAMS = 4,							///< TEAM_BLUE thru TEAM_GREEN
+		MAX_SPREAD_AREAS = 64								///< most areas a single event can touch
+	};
+
+	void Reset( void );
+	void Update( void );									///< decay the map, once a second
+	void OnEvent( GameEventType event, CBaseEntity *entity, CBaseEntity *other );	///< add influence for a game event
+
+	/// add 'amount' of influence at 'pos' in 'startArea', falling off to nothing at 'radius'
+	void AddInfluence( InfluenceType type, int team, CNavArea *startArea, const Vector *pos, float amount, float radius );
+
+	float GetInfluence( InfluenceType type, int team, const CNavArea *area ) const;
+	float GetThreat( int team, const CNavArea *area ) const		{ return GetInfluence( INFLUENCE_THREAT, team, area ); }
+	float GetControl( int team, const CNavArea *area ) const	{ return GetInfluence( INFLUENCE_CONTROL, team, area ); }
+	float GetDeaths( int team, const CNavArea *area ) const		{ return GetInfluence( INFLUENCE_DEATHS, team, area ); }
+
+	typedef std::shared_ptr< const std::vector< float > > Snapshot;	///< graph index -> influence, never changed once made
+	Snapshot GetThreatSnapshot( int team );					///< the team's threat as it is now, for searches on other threads - main thread only
+
+	void Draw( void ) const;								///< show each team's threat for debugging
+
+private:
+	bool IsCurrent( void ) const;							///< true if the arrays match the search graph
+	bool Prepare( void );									///< make the arrays match the search graph - return false if there is no mesh
+	void AddHostileInfluence( InfluenceType type, CBaseEntity *entity, CNavArea *startArea, const Vector *pos, float amount, float radius );
+	void DiscardSnapshots( void );							///< the threat has changed, so snapshots must be made again
+
+	std::vector< float > m_value[ NUM_INFLUENCE_TYPES ][ MAX_INFLUENCE_TEAMS ];	///< graph index -> influence
+	Snapshot m_threatSnapshot[ MAX_INFLUENCE_TEAMS ];		///< copies of INFLUENCE_THREAT, made when first asked for
+	unsigned int m_buildCount;								///< TheNavAreaGraph build the arrays are valid for
+	float m_decayTimestamp;									///< when the map was last decayed
+
+	std::vector< unsigned int > m_spreadMarker;				///< graph index -> last spread that reached the area
+	unsigned int m_spreadCount;
+	std::vector< unsigned int > m_spreadQueue;
+};
+
+extern CNavInfluenceMap TheNavInfluenceMap;
+
+inline bool CNavInfluenceMap::IsCurrent( void ) const
+{
+	if (TheNavAreaGraph.IsDirty() || m_buildCount != TheNavAreaGraph.GetBuildCount())
+		return false;
+
+	return (m_value[0][0].size() == TheNavAreaGraph.GetAreaCount()) ? true : false;
+}
+
+inline float CNavInfluenceMap::GetInfluence( InfluenceType type, int team, const CNavArea *area ) const
+{
+	if (area == nullptr || team < TEAM_BLUE || team > TEAM_GREEN || !IsCurrent() || !TheNavAreaGraph.Contains( area ))
+		return 0.0f;
+
+	return m_value[ type ][ team - TEAM_BLUE ][ area->GetGraphIndex() ];
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Functor used with NavAreaBuildPath() that avoids areas threatening to the given team.
+ * Each unit of threat makes an area 'threatPenalty' times longer to cross.
+ * The threat is snapshot when the functor is made, which must be on the main thread, so it stays pure
+ * when a query using it is searched on another thread with bot_nav_threads. Make a new one for each path.
+ */
+class ThreatAvoidingPathCost
+{
+public:
+	ThreatAvoidingPathCost( int team, float threatPenalty = 1.0f )
+	{
+		m_threat = TheNavInfluenceMap.GetThreatSnapshot( team );
+		m_buildCount = TheNavAreaGraph.GetBuildCount();
+		m_threatPenalty = threatPenalty;
+	}
+
+	float operator() ( CNavArea *area, CNavArea *fromArea, const CNavLadder *ladder )
+	{
+		float cost = m_shortest( area, fromArea, ladder );
+
+		if (fromArea == nullptr)
+			return cost;
+
+		// the mesh can't change while a search runs, but the search may have been started over on a new one
+		if (m_threat == nullptr || m_buildCount != TheNavAreaGraph.GetBuildCount() || area->GetGraphIndex() >= m_threat->size())
+			return cost;
+
+		float dist = cost - fromArea->GetCostSoFar();
+
+		return cost + m_threatPenalty * (*m_threat)[ area->GetGraphIndex() ] * dist;
+	}
+
+private:
+	ShortestPathCost m_shortest;
+	CNavInfluenceMap::Snapshot m_threat;
+	unsigned int m_buildCount;
+	float m_threatPenalty;
+};
+
+#endif // _NAV_INFLUENCE_H_
@@ -2,6 +2,8 @@
 // Encapsulation of a path through space
 // Author: Michael S. Booth (mike@turtlerockstudios.com), November 2003
 
+#include <algorithm>
+
 #include "extdll.h"
 #include "util.h"
 #include "cbase.h"
@@ -13,9 +15,12 @@
 #include "cmd.h"
 #endif
 
+#include "perf_counter.h"
+
 #include "nav.h"
 #include "nav_path.h"
 #include "bot_util.h"
+#include "bot_profiler.h"
 #include "improv.h"
 
 //--------------------------------------------------------------------------------------------------------------
@@ -334,6 +339,73 @@ bool CNavPath::BuildTrivialPath( const Vector *start, const Vector *goal )
 	return true;
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Build path by following parent links back from 'effectiveGoalArea' once a search has finished
+ */
+bool CNavPath::BuildFromParents( const Vector *start, const Vector *goal, CNavArea *effectiveGoalArea, const Vector *pathEndPosition )
+{
+	m_segmentCount = 0;
+
+	// get count
+	int count = 0;
+	CNavArea *area;
+	for( area = effectiveGoalArea; area; area = area->GetParent() )
+		++count;
+
+	// save room for endpoint
+	if (count > MAX_PATH_SEGMENTS-1)
+		count = MAX_PATH_SEGMENTS-1;
+
+	if (count == 0)
+		return false;
+
+	if (count == 1)
+	{
+		BuildTrivialPath( start, goal );
+		return true;
+	}
+
+	// build path
+	m_segmentCount = count;
+	for( area = effectiveGoalArea; count && area; area = area->GetParent() )
+	{
+		--count;
+		m_path[ count ].area = area;
+		m_path[ count ].how = area->GetParentHow();
+	}
+
+	// compute path positions
+	if (ComputePathPositions() == false)
+	{
+		//PrintIfWatched( "Error building path\n" );
+		Invalidate();
+		return false;
+	}
+
+	// append path end position
+	m_path[ m_segmentCount ].area = effectiveGoalArea;
+	m_path[ m_segmentCount ].pos = *pathEndPosition;
+	m_path[ m_segmentCount ].ladder = nullptr;
+	m_path[ m_segmentCount ].how = NUM_TRAVERSE_TYPES;
+	++m_segmentCount;
+
+	if (cv_bot_nav_smooth_paths.value > 0.0f)
+	{
+		// start from where we actually are, instead of the center of our area
+		if (m_path[0].area->IsOverlapping( start ))
+		{
+			m_path[0].pos.x = start->x;
+			m_path[0].pos.y = start->y;
+			m_path[0].pos.z = m_path[0].area->GetZ( start );
+		}
+
+		Optimize();
+	}
+
+	return true;
+}
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Draw the path for debugging.
@@ -352,78 +424,276 @@ void CNavPath::Draw( void )
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Check line of sight from 'anchor' node on path to subsequent nodes until
- * we find a node that can't been seen from 'anchor'.
+ * Return twice the signed area of the triangle a-b-c.
+ * Positive if 'c' is to the left of the ray from 'a' thru 'b'.
+ */
+inline float TriangleArea2D( const Vector2D &a, const Vector2D &b, const Vector2D &c )
+{
+	return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+/**
+ * The part of the opening between two areas a path may cross, with its ends named as seen when walking thru it
+ */
+struct PathPortal
+{
+	Vector2D left;
+	Vector2D right;
+	bool isAlongX;											///< true if the portal runs along the X axis (we are walking NORTH or SOUTH)
+};
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Compute the part of the portal from 'from' into 'to' that a path may cross.
+ * Like ComputeClosestPointInPortal(), keep a margin from the ends of the portal that are against a wall.
  */
-int CNavPath::FindNextOccludedNode( int anchor )
+static void ComputePathPortal( const CNavArea *from, const CNavArea *to, NavDirType dir, PathPortal *portal )
 {
-	int lastVisible = anchor;
-	for( int i=anchor+1; i<m_segmentCount; ++i )
+	const float margin = GenerationStepSize/2.0f;
+
+	Vector center;
+	float halfWidth;
+	from->ComputePortal( to, dir, &center, &halfWidth );
+
+	portal->isAlongX = (dir == NORTH || dir == SOUTH);
+
+	float mid = (portal->isAlongX) ? center.x : center.y;
+	float lo = mid - halfWidth;
+	float hi = mid + halfWidth;
+
+	if (to->IsEdge( (portal->isAlongX) ? WEST : NORTH ))
+		lo += margin;
+
+	if (to->IsEdge( (portal->isAlongX) ? EAST : SOUTH ))
+		hi -= margin;
+
+	// too narrow to keep the margins - use the middle
+	if (lo > hi)
+		lo = hi = mid;
+
+	Vector2D loEnd, hiEnd;
+	if (portal->isAlongX)
+	{
+		loEnd = Vector2D( lo, center.y );
+		hiEnd = Vector2D( hi, center.y );
+	}
+	else
 	{
-		// don't remove ladder nodes
-		if (m_path[i].ladder)
-			return i;
+		loEnd = Vector2D( center.x, lo );
+		hiEnd = Vector2D( center.x, hi );
+	}
+
+	// which end is on our left depends on which way we are walking
+	Vector2D forward;
+	DirectionToVector2D( dir, &forward );
+
+	if (TriangleArea2D( Vector2D( 0.0f, 0.0f ), forward, hiEnd - loEnd ) > 0.0f)
+	{
+		portal->left = hiEnd;
+		portal->right = loEnd;
+	}
+	else
+	{
+		portal->left = loEnd;
+		portal->right = hiEnd;
+	}
+}
 
-		if (!IsWalkableTraceLineClear( m_path[ anchor ].pos, m_path[ i ].pos ))
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true if path node 'i' is where we walk thru the portal into a new area, and so can be moved along the portal
+ */
+bool CNavPath::IsPortalNode( int i ) const
+{
+	const PathSegment *from = &m_path[ i-1 ];
+	const PathSegment *to = &m_path[ i ];
+
+	if (to->how > GO_WEST || to->ladder)
+		return false;
+
+	// the bottom of a "jump down", or the end of the path
+	if (to->area == from->area)
+		return false;
+
+	// the top of a "jump down" must stay out past the ledge
+	return to->area->IsConnected( from->area, NUM_DIRECTIONS );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Pull the path taut between the fixed nodes 'first' and 'last', moving each node between them
+ * to where the shortest path thru the portals crosses its portal.
+ * The corners of the shortest path are found with a "funnel" that is narrowed by each portal in turn:
+ * when a side of the funnel would cross over the other, the point on the other side is a corner.
+ */
+void CNavPath::PullTaut( int first, int last )
+{
+	PathPortal portal[ MAX_PATH_SEGMENTS ];
+	int count = 0;
+
+	for( int i=first+1; i<last; ++i )
+		ComputePathPortal( m_path[i-1].area, m_path[i].area, (NavDirType)m_path[i].how, &portal[ count++ ] );
+
+	// the end of the run is a portal with no width
+	portal[ count ].left = portal[ count ].right = m_path[ last ].pos.Make2D();
+	portal[ count ].isAlongX = true;
+	++count;
+
+	// a run that starts on a ladder starts where we get off of it
+	Vector start = m_path[ first ].pos;
+	if (m_path[ first ].ladder)
+		start = (m_path[ first ].how == GO_LADDER_UP) ? m_path[ first ].ladder->m_top : m_path[ first ].ladder->m_bottom;
+
+	//
+	// Find the corners
+	//
+	Vector2D corner[ MAX_PATH_SEGMENTS+1 ];
+	int cornerPortal[ MAX_PATH_SEGMENTS+1 ];				///< the portal each corner is an end of, or -1 for the start
+	int cornerCount = 0;
+
+	Vector2D apex = start.Make2D();
+	Vector2D left = apex;
+	Vector2D right = apex;
+	int apexIndex = -1, leftIndex = -1, rightIndex = -1;
+
+	corner[ cornerCount ] = apex;
+	cornerPortal[ cornerCount++ ] = -1;
+
+	for( int k=0; k<count; ++k )
+	{
+		// narrow the funnel from the right
+		if (TriangleArea2D( apex, right, portal[k].right ) >= 0.0f)
 		{
-			// cant see this node from anchor node
-			return i;
+			if (rightIndex == apexIndex || TriangleArea2D( apex, left, portal[k].right ) < 0.0f)
+			{
+				right = portal[k].right;
+				rightIndex = k;
+			}
+			else
+			{
+				// the right side crossed over the left - the left side is a corner, start a new funnel from it
+				apex = right = left;
+				apexIndex = rightIndex = leftIndex;
+
+				corner[ cornerCount ] = apex;
+				cornerPortal[ cornerCount++ ] = apexIndex;
+
+				k = apexIndex;
+				continue;
+			}
 		}
 
-		Vector anchorPlusHalf =  m_path[ anchor ].pos + Vector( 0, 0, HalfHumanHeight );
-		Vector iPlusHalf =  m_path[ i ].pos +Vector( 0, 0, HalfHumanHeight );
-		if (!IsWalkableTraceLineClear( anchorPlusHalf, iPlusHalf) )
+		// narrow the funnel from the left
+		if (TriangleArea2D( apex, left, portal[k].left ) <= 0.0f)
 		{
-			// cant see this node from anchor node
-			return i;
+			if (leftIndex == apexIndex || TriangleArea2D( apex, right, portal[k].left ) > 0.0f)
+			{
+				left = portal[k].left;
+				leftIndex = k;
+			}
+			else
+			{
+				// the left side crossed over the right - the right side is a corner
+				apex = left = right;
+				apexIndex = leftIndex = rightIndex;
+
+				corner[ cornerCount ] = apex;
+				cornerPortal[ cornerCount++ ] = apexIndex;
+
+				k = apexIndex;
+				continue;
+			}
 		}
+	}
 
-		Vector anchorPlusFull =  m_path[ anchor ].pos + Vector( 0, 0, HumanHeight );
-		Vector iPlusFull = m_path[ i ].pos + Vector( 0, 0, HumanHeight );
-		if (!IsWalkableTraceLineClear( anchorPlusFull, iPlusFull ))
+	if (cornerPortal[ cornerCount-1 ] != count-1)
+	{
+		corner[ cornerCount ] = portal[ count-1 ].left;
+		cornerPortal[ cornerCount++ ] = count-1;
+	}
+
+	//
+	// Move each node to where the straight line between the corners on either side of it crosses its portal
+	//
+	const float stepInDist = 5.0f;		// how far to "step into" an area - must be less than min area size
+
+	int c = 0;
+	for( int k=0; k<count-1; ++k )
+	{
+		while( cornerPortal[ c+1 ] < k )
+			++c;
+
+		Vector2D cross;
+
+		if (cornerPortal[ c+1 ] == k)
 		{
-			// cant see this node from anchor node
-			return i;
+			cross = corner[ c+1 ];
+		}
+		else
+		{
+			const Vector2D &from = corner[c];
+			const Vector2D &to = corner[ c+1 ];
+
+			float lo, hi;
+			if (portal[k].isAlongX)
+			{
+				float t = (to.y != from.y) ? (portal[k].left.y - from.y) / (to.y - from.y) : 0.0f;
+				cross = Vector2D( from.x + t * (to.x - from.x), portal[k].left.y );
+
+				lo = std::min( portal[k].left.x, portal[k].right.x );
+				hi = std::max( portal[k].left.x, portal[k].right.x );
+				if (cross.x < lo)
+					cross.x = lo;
+				else if (cross.x > hi)
+					cross.x = hi;
+			}
+			else
+			{
+				float t = (to.x != from.x) ? (portal[k].left.x - from.x) / (to.x - from.x) : 0.0f;
+				cross = Vector2D( portal[k].left.x, from.y + t * (to.y - from.y) );
+
+				lo = std::min( portal[k].left.y, portal[k].right.y );
+				hi = std::max( portal[k].left.y, portal[k].right.y );
+				if (cross.y < lo)
+					cross.y = lo;
+				else if (cross.y > hi)
+					cross.y = hi;
+			}
 		}
-	}
 
-	return m_segmentCount;
+		PathSegment *node = &m_path[ first+1+k ];
+
+		node->pos.x = cross.x;
+		node->pos.y = cross.y;
+		AddDirectionVector( &node->pos, (NavDirType)node->how, stepInDist );
+
+		// we need to walk out of the previous area, so keep Z where we can reach it
+		node->pos.z = m_path[ first+k ].area->GetZ( &node->pos );
+	}
 }
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Smooth out path, removing redundant nodes
+ * Smooth out the path by pulling it taut thru the portals between its areas.
+ * Ladders, "jump downs", and the ends of the path stay where they are, and the path is pulled taut between them.
+ * No traces are needed, since a straight line between two points on the edges of an area never leaves it.
  */
 void CNavPath::Optimize( void )
 {
-// DONT USE THIS: Optimizing the path results in cutting thru obstacles
-return;
-
 	if (m_segmentCount < 3)
 		return;
 
-	int anchor = 0;
+	int first = 0;
 
-	while( anchor < m_segmentCount )
+	for( int i=1; i<m_segmentCount; ++i )
 	{
-		int occluded = FindNextOccludedNode( anchor );
-		int nextAnchor = occluded-1;
+		if (i < m_segmentCount-1 && IsPortalNode( i ))
+			continue;
 
-		if (nextAnchor > anchor)
-		{
-			// remove redundant nodes between anchor and nextAnchor
-			int removeCount = nextAnchor - anchor - 1;
-			if (removeCount > 0)
-			{
-				for( int i=nextAnchor; i<m_segmentCount; ++i )
-				{
-					m_path[i-removeCount] = m_path[i];
-				}
-				m_segmentCount -= removeCount;
-			}
-		}
+		if (i - first > 1)
+			PullTaut( first, i );
 
-		++anchor;
+		first = i;
 	}
 }
 
@@ -459,6 +729,8 @@ void CNavPathFollower::Reset( void )
  */
 void CNavPathFollower::Update( float deltaT, bool avoidObstacles )
 {
+	CBotProfileScope profileScope( BOT_PROFILE_PATH_FOLLOW );
+
 	if (m_path == nullptr || m_path->IsValid() == false)
 		return;
 
@@ -1191,3 +1463,537 @@ void CStuckMonitor::Update( CImprov *improv )
 	m_lastCentroid = improv->GetCentroid();
 }
 
+
+//--------------------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------------
+
+static CPerformanceCounter navQueryTimer;					///< real time clock for path query budgets and latency
+
+CNavPathQuery::CNavPathQuery( void )
+{
+	m_pathCount = 0;
+	m_isPathToGoal = false;
+	m_isPending = false;
+	m_isSearching = false;
+	m_isQueued = false;
+	m_requestTime = 0.0;
+	m_goalArea = nullptr;
+	m_closestArea = CNavSearchContext::NO_PARENT;
+	m_closestAreaDist = 0.0f;
+
+	m_job.m_query = this;
+	m_job.m_result = SEARCH_RUNNING;
+}
+
+CNavPathQuery::~CNavPathQuery()
+{
+	TheNavSearchPool.Cancel( &m_job );
+
+	if (m_isQueued)
+		TheNavPathQueue.Remove( this );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Queue computation of a new path from 'start' to 'goal', replacing any computation in progress.
+ * The current path is kept until the new one is finished.
+ */
+bool CNavPathQuery::Request( const Vector *start, const Vector *goal )
+{
+	if (start == nullptr || goal == nullptr)
+		return false;
+
+	// a worker may be reading our endpoints
+	TheNavSearchPool.Cancel( &m_job );
+
+	m_start = *start;
+	m_goal = *goal;
+
+	m_isPending = true;
+	m_isSearching = false;
+	m_requestTime = navQueryTimer.GetCurTime();
+
+	TheNavPathQueue.Add( this );
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Abandon the computation in progress, keeping the last completed path
+ */
+void CNavPathQuery::Cancel( void )
+{
+	TheNavSearchPool.Cancel( &m_job );
+
+	m_isPending = false;
+	m_isSearching = false;
+
+	if (m_isQueued)
+		TheNavPathQueue.Remove( this );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Resolve the endpoints and set up the search.
+ * Returns false if the query finished immediately (trivial or impossible path).
+ */
+bool CNavPathQuery::Begin( void )
+{
+	TheNavAreaGraph.Update();
+
+	m_isSearching = false;
+	m_closestArea = CNavSearchContext::NO_PARENT;
+
+	CNavArea *startArea = TheNavAreaGrid.GetNearestNavArea( &m_start );
+	if (startArea == nullptr || !TheNavAreaGraph.Contains( startArea ))
+	{
+		Finish( false );
+		return false;
+	}
+
+	m_goalArea = TheNavAreaGrid.GetNavArea( &m_goal );
+
+	// if we are already in the goal area, build trivial path
+	if (startArea == m_goalArea)
+	{
+		m_path.BuildTrivialPath( &m_start, &m_goal );
+
+		m_isPathToGoal = true;
+		++m_pathCount;
+		m_isPending = false;
+		return false;
+	}
+
+	// make sure path end position is on the ground
+	m_pathEndPosition = m_goal;
+	if (m_goalArea)
+		m_pathEndPosition.z = m_goalArea->GetZ( &m_pathEndPosition );
+	else
+		GetGroundHeight( &m_pathEndPosition, &m_pathEndPosition.z );
+
+	m_context.Begin();
+
+	unsigned int startIndex = startArea->GetGraphIndex();
+	m_context.SetParent( startIndex, CNavSearchContext::NO_PARENT, NUM_TRAVERSE_TYPES );
+
+	// compute estimate of path length
+	m_context.SetTotalCost( startIndex, (*startArea->GetCenter() - m_goal).Length() );
+
+	float initCost = ComputeCost( startArea, nullptr, nullptr );
+	if (initCost < 0.0f)
+	{
+		Finish( false );
+		return false;
+	}
+	m_context.SetCostSoFar( startIndex, initCost );
+
+	m_context.AddToOpenList( startIndex );
+
+	// keep track of the area we visit that is closest to the goal
+	m_closestArea = startIndex;
+	m_closestAreaDist = m_context.GetTotalCost( startIndex );
+
+	m_isSearching = true;
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Continue the A* search for at most 'maxExpansions' areas.
+ * Returns true when the query is finished and the new path is available.
+ */
+bool CNavPathQuery::Step( int maxExpansions )
+{
+	if (!m_isPending)
+		return true;
+
+	// the search is running on a worker thread
+	if (m_job.IsBusy())
+		return false;
+
+	// route CNavArea search accessors used by the cost functor and path building to our context
+	CNavSearchContext *previousContext = CNavSearchContext::GetActive();
+	CNavSearchContext::SetActive( &m_context );
+
+	bool isDone = false;
+
+	// (re)start the search if this is a new request, or the mesh changed since we began
+	if ((!m_isSearching || !m_context.IsCurrent()) && !Begin())
+		isDone = true;
+
+	if (!isDone)
+	{
+		SearchResult result = Expand( maxExpansions );
+
+		if (result != SEARCH_RUNNING)
+		{
+			Finish( result == SEARCH_FOUND_GOAL );
+			isDone = true;
+		}
+	}
+
+	CNavSearchContext::SetActive( previousContext );
+
+	return isDone;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Expand at most 'maxExpansions' areas (or until done, if NO_EXPANSION_LIMIT).
+ * This is the same search as NavAreaBuildPath(), but its state lives in our own context.
+ * Must be called with our context active. Makes no engine calls, so it may run on a worker thread.
+ */
+CNavPathQuery::SearchResult CNavPathQuery::Expand( int maxExpansions )
+{
+	while( maxExpansions == NO_EXPANSION_LIMIT || maxExpansions-- > 0 )
+	{
+		if (m_context.IsOpenListEmpty())
+		{
+			// no path to the goal - go as close as we can
+			return SEARCH_NO_PATH;
+		}
+
+		// get next area to check
+		unsigned int index = m_context.PopOpenList();
+		CNavArea *area = TheNavAreaGraph.GetArea( index );
+
+		// check if we have found the goal area
+		if (area == m_goalArea)
+			return SEARCH_FOUND_GOAL;
+
+		// search adjacent areas
+		const NavAreaEdge *edge = TheNavAreaGraph.GetEdgesBegin( index );
+		const NavAreaEdge *edgeEnd = TheNavAreaGraph.GetEdgesEnd( index );
+
+		for( ; edge != edgeEnd; ++edge )
+		{
+			// don't backtrack
+			if (edge->to == index)
+				continue;
+
+			CNavArea *newArea = TheNavAreaGraph.GetArea( edge->to );
+
+			float newCostSoFar = ComputeCost( newArea, area, edge->ladder );
+
+			// check if cost functor says this area is a dead-end
+			if (newCostSoFar < 0.0f)
+				continue;
+
+			if (m_context.IsVisited( edge->to ) && m_context.GetCostSoFar( edge->to ) <= newCostSoFar)
+			{
+				// this is a worse path - skip it
+				continue;
+			}
+
+			// compute estimate of distance left to go
+			float newCostRemaining = (TheNavAreaGraph.GetCenter( edge->to ) - m_goal).Length();
+
+			// track closest area to goal in case path fails
+			if (newCostRemaining < m_closestAreaDist)
+			{
+				m_closestArea = edge->to;
+				m_closestAreaDist = newCostRemaining;
+			}
+
+			m_context.SetParent( edge->to, index, edge->how );
+			m_context.SetCostSoFar( edge->to, newCostSoFar );
+			m_context.SetTotalCost( edge->to, newCostSoFar + newCostRemaining );
+
+			if (m_context.IsOpen( edge->to ))
+			{
+				// area already on open list, update the list order to keep costs sorted
+				m_context.UpdateOnOpenList( edge->to );
+			}
+			else
+			{
+				// new or previously closed area
+				m_context.AddToOpenList( edge->to );
+			}
+		}
+	}
+
+	return SEARCH_RUNNING;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Build the new path from the search results. Must be called with our context active.
+ */
+void CNavPathQuery::Finish( bool pathToGoalExists )
+{
+	CNavArea *effectiveGoalArea = nullptr;
+
+	if (pathToGoalExists)
+		effectiveGoalArea = m_goalArea;
+	else if (m_closestArea != CNavSearchContext::NO_PARENT)
+		effectiveGoalArea = TheNavAreaGraph.GetArea( m_closestArea );
+
+	if (effectiveGoalArea == nullptr || !m_path.BuildFromParents( &m_start, &m_goal, effectiveGoalArea, &m_pathEndPosition ))
+		m_path.Invalidate();
+
+	m_isPathToGoal = pathToGoalExists;
+	++m_pathCount;
+
+	m_isPending = false;
+	m_isSearching = false;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Run the entire search on a worker thread
+ */
+void CNavPathQuery::SearchJob::Run( void )
+{
+	CNavSearchContext::SetActive( &m_query->m_context );
+
+	m_result = m_query->Expand( NO_EXPANSION_LIMIT );
+
+	CNavSearchContext::SetActive( nullptr );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Deliver the worker's search results to the query, on the main thread
+ */
+void CNavPathQuery::SearchJob::OnComplete( void )
+{
+	CNavPathQuery *query = m_query;
+
+	if (!query->m_isPending || !query->m_isSearching)
+		return;
+
+	// if the mesh changed since the search began, leave it queued to be searched again
+	if (!query->m_context.IsCurrent())
+	{
+		++TheNavPathQueue.m_restartCount;
+		query->m_isSearching = false;
+		return;
+	}
+
+	CNavSearchContext *previousContext = CNavSearchContext::GetActive();
+	CNavSearchContext::SetActive( &query->m_context );
+
+	query->Finish( m_result == SEARCH_FOUND_GOAL );
+
+	CNavSearchContext::SetActive( previousContext );
+
+	TheNavPathQueue.Remove( query );
+	TheNavPathQueue.OnQueryFinished( query, navQueryTimer.GetCurTime() );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------------
+
+CNavPathQueue TheNavPathQueue;
+
+
+CNavPathQueue::CNavPathQueue( void )
+{
+	ResetStats();
+}
+
+void CNavPathQueue::ResetStats( void )
+{
+	m_submittedCount = 0;
+	m_completedCount = 0;
+	m_failedCount = 0;
+	m_restartCount = 0;
+	m_dispatchCount = 0;
+	m_totalLatency = 0.0;
+	m_maxLatency = 0.0;
+	m_totalSearchTime = 0.0;
+	m_maxFrameTime = 0.0;
+	m_frameCount = 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathQueue::Add( CNavPathQuery *query )
+{
+	++m_submittedCount;
+
+	if (query->m_isQueued)
+		return;
+
+	query->m_isQueued = true;
+	m_queue.push_back( query );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathQueue::Remove( CNavPathQuery *query )
+{
+	if (!query->m_isQueued)
+		return;
+
+	query->m_isQueued = false;
+	m_queue.remove( query );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Advance pending queries, oldest first, until they are all done or 'budget' microseconds have passed.
+ * At least one step is always taken, so queries make progress even with a tiny budget.
+ */
+void CNavPathQueue::Update( float budget )
+{
+	// start or stop worker threads to match bot_nav_threads
+	int threadCount = (int)cv_bot_nav_threads.value;
+	if (threadCount < 0)
+		threadCount = 0;
+	else if (threadCount > MAX_THREADS)
+		threadCount = MAX_THREADS;
+
+	if (threadCount != TheNavSearchPool.GetThreadCount())
+	{
+		TheNavSearchPool.SetThreadCount( threadCount );
+
+		// searches still held by the old workers are finished now - don't wait a frame for them
+		TheNavSearchPool.DeliverResults();
+	}
+
+	if (m_queue.empty())
+		return;
+
+	CBotProfileScope profileScope( BOT_PROFILE_PATH_BUILD );
+
+	if (threadCount > 0)
+	{
+		Dispatch();
+		return;
+	}
+
+	const double limit = budget / 1000000.0;
+	double startTime = navQueryTimer.GetCurTime();
+	double now = startTime;
+
+	while( !m_queue.empty() )
+	{
+		CNavPathQuery *query = m_queue.front();
+
+		if (query->m_isSearching && !query->m_context.IsCurrent())
+			++m_restartCount;
+
+		bool isDone = query->Step( EXPANSIONS_PER_STEP );
+
+		now = navQueryTimer.GetCurTime();
+
+		if (isDone)
+		{
+			m_queue.pop_front();
+			query->m_isQueued = false;
+
+			OnQueryFinished( query, now );
+		}
+
+		if (budget > 0.0f && now - startTime >= limit)
+			break;
+	}
+
+	double elapsed = now - startTime;
+
+	m_totalSearchTime += elapsed;
+	if (elapsed > m_maxFrameTime)
+		m_maxFrameTime = elapsed;
+	++m_frameCount;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Set up each pending query that is not already on a worker thread, and hand its search to the pool.
+ * Setting up needs the engine (traces, ground height), so it stays on the main thread.
+ */
+void CNavPathQueue::Dispatch( void )
+{
+	double startTime = navQueryTimer.GetCurTime();
+
+	std::list<CNavPathQuery *>::iterator iter = m_queue.begin();
+	while( iter != m_queue.end() )
+	{
+		CNavPathQuery *query = *iter;
+
+		if (query->m_job.IsBusy())
+		{
+			++iter;
+			continue;
+		}
+
+		CNavSearchContext *previousContext = CNavSearchContext::GetActive();
+		CNavSearchContext::SetActive( &query->m_context );
+
+		bool isSearching = query->Begin();
+
+		CNavSearchContext::SetActive( previousContext );
+
+		if (!isSearching)
+		{
+			// finished without searching
+			iter = m_queue.erase( iter );
+			query->m_isQueued = false;
+
+			OnQueryFinished( query, navQueryTimer.GetCurTime() );
+			continue;
+		}
+
+		TheNavSearchPool.Submit( &query->m_job );
+		++m_dispatchCount;
+		++iter;
+	}
+
+	double elapsed = navQueryTimer.GetCurTime() - startTime;
+
+	m_totalSearchTime += elapsed;
+	if (elapsed > m_maxFrameTime)
+		m_maxFrameTime = elapsed;
+	++m_frameCount;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathQueue::OnQueryFinished( CNavPathQuery *query, double now )
+{
+	if (query->GetPath()->IsValid())
+		++m_completedCount;
+	else
+		++m_failedCount;
+
+	double latency = now - query->GetRequestTime();
+
+	m_totalLatency += latency;
+	if (latency > m_maxLatency)
+		m_maxLatency = latency;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathQueue::PrintStats( void ) const
+{
+	unsigned int finishedCount = m_completedCount + m_failedCount;
+
+	CONSOLE_ECHO( "Path queries: %d queued, %d submitted, %d completed, %d failed, %d restarted\n",
+					(int)m_queue.size(), m_submittedCount, m_completedCount, m_failedCount, m_restartCount );
+
+	if (TheNavSearchPool.GetThreadCount())
+		CONSOLE_ECHO( "  Worker threads: %d, %d searches dispatched\n", TheNavSearchPool.GetThreadCount(), m_dispatchCount );
+
+	if (finishedCount)
+		CONSOLE_ECHO( "  Latency: %.2f ms average, %.2f ms max\n",
+						1000.0 * m_totalLatency / finishedCount, 1000.0 * m_maxLatency );
+
+	if (m_frameCount)
+		CONSOLE_ECHO( "  Search time: %.1f us/frame average, %.1f us/frame max over %d frames (budget %g us)\n",
+						1000000.0 * m_totalSearchTime / m_frameCount, 1000000.0 * m_maxFrameTime, m_frameCount, cv_bot_nav_budget_us.value );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * bot_nav_stats [reset]
+ */
+void NavPrintPathQueueStats( void )
+{
+	if (engine::Cmd_Argc() > 1 && !stricmp( engine::Cmd_Argv( 1 ), "reset" ))
+	{
+		TheNavPathQueue.ResetStats();
+		CONSOLE_ECHO( "Path query statistics reset.\n" );
+		return;
+	}
+
+	TheNavPathQueue.PrintStats();
+}
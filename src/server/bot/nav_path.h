@@ -7,6 +7,8 @@
 
 #pragma warning( disable : 4530 )					// STL uses exceptions, but we are not compiling with them - ignore warning
 
+#include <list>
+
 #include "nav_area.h"
 #include "bot_util.h"
 
@@ -51,7 +53,7 @@ public:
 	/// compute closest point on path to given point
 	bool FindClosestPointOnPath( const Vector *worldPos, int startIndex, int endIndex, Vector *close ) const;
 
-	void Optimize( void );
+	void Optimize( void );										///< pull the path taut thru the portals between its areas
 	
 	/**
 	 * Compute shortest path from 'start' to 'goal' via A* algorithm
@@ -92,67 +94,176 @@ public:
 
 		CNavArea *effectiveGoalArea = (pathToGoalExists) ? goalArea : closestArea;
 
-		//
-		// Build path by following parent links
-		//
+		return BuildFromParents( start, goal, effectiveGoalArea, &pathEndPosition );
+	}
 
-		// get count
-		int count = 0;
-		CNavArea *area;
-		for( area = effectiveGoalArea; area; area = area->GetParent() )
-			++count;
+private:
+	enum { MAX_PATH_SEGMENTS = 256 };
+	PathSegment m_path[ MAX_PATH_SEGMENTS ];
+	int m_segmentCount;
 
-		// save room for endpoint
-		if (count > MAX_PATH_SEGMENTS-1)
-			count = MAX_PATH_SEGMENTS-1;
+	friend class CNavPathQuery;
 
-		if (count == 0)
-			return false;
+	bool ComputePathPositions( void );				///< determine actual path positions 
+	bool BuildTrivialPath( const Vector *start, const Vector *goal );		///< utility function for when start and goal are in the same area
+	bool BuildFromParents( const Vector *start, const Vector *goal, CNavArea *effectiveGoalArea, const Vector *pathEndPosition );	///< build path by following parent links back from the goal
 
-		if (count == 1)
-		{
-			BuildTrivialPath( start, goal );
-			return true;
-		}
+	bool IsPortalNode( int i ) const;				///< return true if node 'i' is where we walk into a new area - used by Optimize()
+	void PullTaut( int first, int last );			///< used by Optimize()
+};
 
-		// build path
-		m_segmentCount = count;
-		for( area = effectiveGoalArea; count && area; area = area->GetParent() )
-		{
-			--count;
-			m_path[ count ].area = area;
-			m_path[ count ].how = area->GetParentHow();
-		}
+//--------------------------------------------------------------------------------------------------------
+/**
+ * A CNavPathQuery computes a CNavPath a little at a time, so that expensive searches can be spread
+ * across several frames by TheNavPathQueue instead of running to completion inside a bot's think.
+ * The query keeps its own search state, and the most recently completed path remains available
+ * (and can be followed) while a new one is being computed.
+ * If the nav mesh changes while a search is in progress, the search is restarted.
+ * When bot_nav_threads is nonzero the search itself runs on TheNavSearchPool, so the query's
+ * cost functor must then be pure - see CNavSearchJob.
+ */
+class CNavPathQuery
+{
+public:
+	CNavPathQuery( void );
+	virtual ~CNavPathQuery();
 
-		// compute path positions
-		if (ComputePathPositions() == false)
-		{
-			//PrintIfWatched( "Error building path\n" );
-			Invalidate();
-			return false;
-		}
+	bool Request( const Vector *start, const Vector *goal );	///< queue computation of a new path, replacing any in progress - return false if it cannot be started
+	void Cancel( void );										///< abandon the computation in progress, keeping the last completed path
+
+	bool IsPending( void ) const				{ return m_isPending; }		///< true while a requested path is being computed
+	bool Step( int maxExpansions );								///< continue the search for at most 'maxExpansions' areas - return true when finished
+
+	const CNavPath *GetPath( void ) const		{ return &m_path; }			///< the most recently completed path
+	CNavPath *GetPath( void )					{ return &m_path; }
+	unsigned int GetPathCount( void ) const		{ return m_pathCount; }		///< number of paths completed, so owners can notice a new one
+	bool IsPathToGoal( void ) const				{ return m_isPathToGoal; }	///< false if the last path only reaches the area closest to the goal
+
+	double GetRequestTime( void ) const			{ return m_requestTime; }	///< real time the pending request was made
+	unsigned int GetExpansionCount( void ) const	{ return m_context.GetExpansionCount(); }
+
+protected:
+	virtual float ComputeCost( CNavArea *area, CNavArea *fromArea, const CNavLadder *ladder ) = 0;	///< cost functor for this query
+
+private:
+	friend class CNavPathQueue;
+
+	enum SearchResult
+	{
+		SEARCH_RUNNING,
+		SEARCH_FOUND_GOAL,
+		SEARCH_NO_PATH
+	};
+
+	enum { NO_EXPANSION_LIMIT = -1 };
 
-		// append path end position
-		m_path[ m_segmentCount ].area = effectiveGoalArea;
-		m_path[ m_segmentCount ].pos = pathEndPosition;
-		m_path[ m_segmentCount ].ladder = nullptr;
-		m_path[ m_segmentCount ].how = NUM_TRAVERSE_TYPES;
-		++m_segmentCount;
+	bool Begin( void );											///< resolve the endpoints and set up the search - return false if it finished immediately
+	SearchResult Expand( int maxExpansions );					///< continue the search - makes no engine calls, so may run on a worker thread
+	void Finish( bool pathToGoalExists );						///< build the path from the search results
 
-		return true;
+	/**
+	 * Runs the whole search on a worker thread, and finishes the query on the main thread
+	 */
+	class SearchJob : public CNavSearchJob
+	{
+	public:
+		virtual void Run( void ) override;
+		virtual void OnComplete( void ) override;
+
+		CNavPathQuery *m_query;
+		SearchResult m_result;
+	};
+
+	SearchJob m_job;
+
+	CNavSearchContext m_context;
+	CNavPath m_path;
+	unsigned int m_pathCount;
+	bool m_isPathToGoal;
+
+	bool m_isPending;
+	bool m_isSearching;											///< true once Begin() has set up the search for the pending request
+	bool m_isQueued;											///< true if in TheNavPathQueue
+	double m_requestTime;
+
+	Vector m_start;
+	Vector m_goal;
+	Vector m_pathEndPosition;
+	CNavArea *m_goalArea;
+	unsigned int m_closestArea;									///< graph index of the visited area closest to the goal
+	float m_closestAreaDist;
+};
+
+/**
+ * A CNavPathQuery using the given cost functor, which is copied.
+ */
+template< typename CostFunctor >
+class NavPathQuery : public CNavPathQuery
+{
+public:
+	NavPathQuery( void ) { }
+	NavPathQuery( const CostFunctor &costFunc ) : m_costFunc( costFunc ) { }
+
+	CostFunctor *GetCostFunctor( void )		{ return &m_costFunc; }
+
+protected:
+	virtual float ComputeCost( CNavArea *area, CNavArea *fromArea, const CNavLadder *ladder ) override
+	{
+		return m_costFunc( area, fromArea, ladder );
 	}
 
 private:
-	enum { MAX_PATH_SEGMENTS = 256 };
-	PathSegment m_path[ MAX_PATH_SEGMENTS ];
-	int m_segmentCount;
+	CostFunctor m_costFunc;
+};
 
-	bool ComputePathPositions( void );				///< determine actual path positions 
-	bool BuildTrivialPath( const Vector *start, const Vector *goal );		///< utility function for when start and goal are in the same area
+//--------------------------------------------------------------------------------------------------------
+/**
+ * The CNavPathQueue advances pending path queries each frame, within a time budget.
+ * If bot_nav_threads is nonzero, the searches are handed to TheNavSearchPool instead, and
+ * their results are delivered to the bots at the start of the next frame.
+ */
+class CNavPathQueue
+{
+public:
+	CNavPathQueue( void );
+
+	void Add( CNavPathQuery *query );							///< queue the query, if not already queued
+	void Remove( CNavPathQuery *query );						///< remove the query from the queue
+	void Update( float budget );								///< advance pending queries for up to 'budget' microseconds (no limit if zero or less)
+	void Dispatch( void );										///< hand pending queries to worker threads
+
+	void PrintStats( void ) const;
+	void ResetStats( void );
+
+	unsigned int GetQueuedCount( void ) const	{ return m_queue.size(); }
 
-	int FindNextOccludedNode( int anchor );		///< used by Optimize()
+	enum { EXPANSIONS_PER_STEP = 16 };							///< areas expanded between budget checks
+	enum { MAX_THREADS = 8 };									///< upper limit for bot_nav_threads
+
+private:
+	friend class CNavPathQuery::SearchJob;
+
+	void OnQueryFinished( CNavPathQuery *query, double now );
+
+	std::list<CNavPathQuery *> m_queue;
+
+	// statistics
+	unsigned int m_submittedCount;
+	unsigned int m_completedCount;
+	unsigned int m_failedCount;								///< queries that could not produce any path
+	unsigned int m_restartCount;							///< searches restarted because the mesh changed
+	unsigned int m_dispatchCount;							///< searches handed to worker threads
+	double m_totalLatency;									///< sum of request-to-completion times (seconds)
+	double m_maxLatency;
+	double m_totalSearchTime;								///< sum of time spent stepping searches (seconds)
+	double m_maxFrameTime;									///< most time spent in one Update() (seconds)
+	unsigned int m_frameCount;								///< number of Update()s that did any work
 };
 
+extern CNavPathQueue TheNavPathQueue;
+
+extern void NavPrintPathQueueStats( void );						///< "bot_nav_stats" console command
+
 //--------------------------------------------------------------------------------------------------------
 /**
  * Monitor improv movement and determine if it becomes stuck
@@ -0,0 +1,561 @@
+// nav_route.cpp
+// Precomputed routing table for the navigation mesh
+
+#pragma warning( disable : 4530 )					// STL uses exceptions, but we are not compiling with them - ignore warning
+
+#include <vector>
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "player.h"
+#include "perf_counter.h"
+
+#include "bot_util.h"
+#include "nav.h"
+#include "nav_area.h"
+
+
+static const unsigned int NAV_ROUTE_MAGIC_NUMBER = 0x5254564E;		///< "NVTR"
+static const unsigned int NAV_ROUTE_VERSION = 1;
+
+CNavRouteTable TheNavRouteTable;
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavRouteTable::CNavRouteTable( void )
+{
+	m_buildCount = 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavRouteTable::Reset( void )
+{
+	m_buildCount = 0;
+	m_areaCluster.clear();
+	m_clusterArea.clear();
+	m_distance.clear();
+	m_nextHop.clear();
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The table is only valid for the search graph it was built or loaded for
+ */
+bool CNavRouteTable::IsCurrent( void ) const
+{
+	if (m_clusterArea.empty() || TheNavAreaGraph.IsDirty())
+		return false;
+
+	return (m_buildCount == TheNavAreaGraph.GetBuildCount() && m_areaCluster.size() == TheNavAreaGraph.GetAreaCount()) ? true : false;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline unsigned int CNavRouteTable::GetCluster( const CNavArea *area ) const
+{
+	if (area == nullptr || !IsCurrent() || !TheNavAreaGraph.Contains( area ))
+		return NO_CLUSTER;
+
+	return m_areaCluster[ area->GetGraphIndex() ];
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Look up the travel distance between two areas in different clusters.
+ * Returns false if the table can't answer, in which case the caller should search.
+ */
+bool CNavRouteTable::GetTravelDistance( CNavArea *startArea, CNavArea *endArea, float *distance ) const
+{
+	unsigned int from = GetCluster( startArea );
+	unsigned int to = GetCluster( endArea );
+
+	// areas in the same cluster are close together - a search is cheap and exact
+	if (from == NO_CLUSTER || to == NO_CLUSTER || from == to)
+		return false;
+
+	unsigned int stored = m_distance[ from * m_clusterArea.size() + to ];
+
+	if (stored == UNREACHABLE)
+	{
+		*distance = -1.0f;
+		return true;
+	}
+
+	// the table holds the distance between cluster centers - add the legs to and from them
+	const Vector &fromCenter = TheNavAreaGraph.GetCenter( m_clusterArea[ from ] );
+	const Vector &toCenter = TheNavAreaGraph.GetCenter( m_clusterArea[ to ] );
+
+	*distance = (float)(stored * DISTANCE_UNITS) + (*startArea->GetCenter() - fromCenter).Length() + (toCenter - *endArea->GetCenter()).Length();
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true only if the table is current and knows there is no path between the areas.
+ * Clusters are built only from two-way connections, so every area in a cluster can reach
+ * every other, and reachability between cluster centers is reachability between their areas.
+ */
+bool CNavRouteTable::IsUnreachable( CNavArea *startArea, CNavArea *endArea ) const
+{
+	unsigned int from = GetCluster( startArea );
+	unsigned int to = GetCluster( endArea );
+
+	if (from == NO_CLUSTER || to == NO_CLUSTER || from == to)
+		return false;
+
+	return (m_distance[ from * m_clusterArea.size() + to ] == UNREACHABLE) ? true : false;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the center area of the next cluster on the shortest route between the areas,
+ * or nullptr if the areas share a cluster, there is no route, or the table isn't current.
+ */
+CNavArea *CNavRouteTable::GetNextHop( CNavArea *startArea, CNavArea *endArea ) const
+{
+	unsigned int from = GetCluster( startArea );
+	unsigned int to = GetCluster( endArea );
+
+	if (from == NO_CLUSTER || to == NO_CLUSTER || from == to)
+		return nullptr;
+
+	unsigned int hop = m_nextHop[ from * m_clusterArea.size() + to ];
+	if (hop == NO_CLUSTER)
+		return nullptr;
+
+	return TheNavAreaGraph.GetArea( m_clusterArea[ hop ] );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Summarize the search graph, so a table saved for a different mesh is not used
+ */
+unsigned int CNavRouteTable::ComputeChecksum( void ) const
+{
+	// FNV-1a
+	unsigned int hash = 2166136261u;
+
+	#define NAV_ROUTE_HASH( value )		{ hash ^= (unsigned int)(value); hash *= 16777619u; }
+
+	unsigned int areaCount = TheNavAreaGraph.GetAreaCount();
+	NAV_ROUTE_HASH( areaCount );
+
+	for( unsigned int i=0; i<areaCount; ++i )
+	{
+		NAV_ROUTE_HASH( TheNavAreaGraph.GetArea( i )->GetID() );
+
+		const NavAreaEdge *edge = TheNavAreaGraph.GetEdgesBegin( i );
+		const NavAreaEdge *edgeEnd = TheNavAreaGraph.GetEdgesEnd( i );
+
+		for( ; edge != edgeEnd; ++edge )
+		{
+			NAV_ROUTE_HASH( TheNavAreaGraph.GetArea( edge->to )->GetID() );
+			NAV_ROUTE_HASH( edge->how );
+		}
+	}
+
+	#undef NAV_ROUTE_HASH
+
+	return hash;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true if there is a floor connection from area 'from' to area 'to'
+ */
+static bool HasFloorEdge( unsigned int from, unsigned int to )
+{
+	const NavAreaEdge *edge = TheNavAreaGraph.GetEdgesBegin( from );
+	const NavAreaEdge *edgeEnd = TheNavAreaGraph.GetEdgesBegin( from, CNavAreaGraph::EDGE_LADDER_UP );
+
+	for( ; edge != edgeEnd; ++edge )
+		if (edge->to == to)
+			return true;
+
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Find the shortest paths from 'source' to every area (Dijkstra's algorithm), recording the
+ * distance travelled along each path and the first cluster it enters after leaving the source's cluster.
+ */
+static void NavRouteSearch( unsigned int source, const std::vector<unsigned short> &areaCluster,
+							std::vector<float> *length, std::vector<unsigned short> *firstHop )
+{
+	CNavSearchContext *context = CNavSearchContext::GetCurrent();
+	ShortestPathCost costFunc;
+
+	const unsigned short sourceCluster = areaCluster[ source ];
+
+	context->Begin();
+
+	context->SetParent( source, CNavSearchContext::NO_PARENT, NUM_TRAVERSE_TYPES );
+	context->SetCostSoFar( source, 0.0f );
+	context->SetTotalCost( source, 0.0f );
+	context->AddToOpenList( source );
+
+	(*length)[ source ] = 0.0f;
+	(*firstHop)[ source ] = CNavRouteTable::NO_CLUSTER;
+
+	while( !context->IsOpenListEmpty() )
+	{
+		unsigned int index = context->PopOpenList();
+		CNavArea *area = TheNavAreaGraph.GetArea( index );
+
+		const NavAreaEdge *edge = TheNavAreaGraph.GetEdgesBegin( index );
+		const NavAreaEdge *edgeEnd = TheNavAreaGraph.GetEdgesEnd( index );
+
+		for( ; edge != edgeEnd; ++edge )
+		{
+			if (edge->to == index)
+				continue;
+
+			float newCostSoFar = costFunc( TheNavAreaGraph.GetArea( edge->to ), area, edge->ladder );
+
+			if (context->IsVisited( edge->to ) && context->GetCostSoFar( edge->to ) <= newCostSoFar)
+				continue;
+
+			context->SetParent( edge->to, index, edge->how );
+			context->SetCostSoFar( edge->to, newCostSoFar );
+			context->SetTotalCost( edge->to, newCostSoFar );
+
+			// measure distance the same way NavAreaTravelDistance() does
+			(*length)[ edge->to ] = (*length)[ index ] + (TheNavAreaGraph.GetCenter( edge->to ) - TheNavAreaGraph.GetCenter( index )).Length();
+
+			if ((*firstHop)[ index ] != CNavRouteTable::NO_CLUSTER)
+				(*firstHop)[ edge->to ] = (*firstHop)[ index ];
+			else if (areaCluster[ edge->to ] != sourceCluster)
+				(*firstHop)[ edge->to ] = areaCluster[ edge->to ];
+			else
+				(*firstHop)[ edge->to ] = CNavRouteTable::NO_CLUSTER;
+
+			if (context->IsOpen( edge->to ))
+				context->UpdateOnOpenList( edge->to );
+			else
+				context->AddToOpenList( edge->to );
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Compute the table for the current mesh.
+ * Returns false if the mesh needs more than MAX_CLUSTERS clusters.
+ */
+bool CNavRouteTable::Build( void )
+{
+	Reset();
+
+	TheNavAreaGraph.Update();
+
+	const unsigned int areaCount = TheNavAreaGraph.GetAreaCount();
+	if (areaCount == 0)
+		return false;
+
+	//
+	// Grow clusters outward from unassigned areas, using only two-way floor connections,
+	// so that every area in a cluster can reach every other area in it
+	//
+	const float clusterRadius = 500.0f;
+
+	m_areaCluster.assign( areaCount, NO_CLUSTER );
+
+	std::vector<unsigned int> members;
+	members.reserve( AREAS_PER_CLUSTER );
+
+	for( unsigned int seed=0; seed<areaCount; ++seed )
+	{
+		if (m_areaCluster[ seed ] != NO_CLUSTER)
+			continue;
+
+		if (m_clusterArea.size() >= MAX_CLUSTERS)
+		{
+			Reset();
+			return false;
+		}
+
+		unsigned short cluster = m_clusterArea.size();
+		m_clusterArea.push_back( seed );
+		m_areaCluster[ seed ] = cluster;
+
+		members.clear();
+		members.push_back( seed );
+
+		for( unsigned int i=0; i<members.size() && members.size() < AREAS_PER_CLUSTER; ++i )
+		{
+			const NavAreaEdge *edge = TheNavAreaGraph.GetEdgesBegin( members[i] );
+			const NavAreaEdge *edgeEnd = TheNavAreaGraph.GetEdgesBegin( members[i], CNavAreaGraph::EDGE_LADDER_UP );
+
+			for( ; edge != edgeEnd && members.size() < AREAS_PER_CLUSTER; ++edge )
+			{
+				if (m_areaCluster[ edge->to ] != NO_CLUSTER)
+					continue;
+
+				if (!HasFloorEdge( edge->to, members[i] ))
+					continue;
+
+				if ((TheNavAreaGraph.GetCenter( edge->to ) - TheNavAreaGraph.GetCenter( seed )).LengthSquared() > clusterRadius * clusterRadius)
+					continue;
+
+				m_areaCluster[ edge->to ] = cluster;
+				members.push_back( edge->to );
+			}
+		}
+	}
+
+	//
+	// Search from the center of each cluster to fill in its row of the table
+	//
+	const unsigned int clusterCount = m_clusterArea.size();
+
+	m_distance.assign( clusterCount * clusterCount, UNREACHABLE );
+	m_nextHop.assign( clusterCount * clusterCount, NO_CLUSTER );
+
+	std::vector<float> length( areaCount );
+	std::vector<unsigned short> firstHop( areaCount );
+
+	CNavSearchContext *context = CNavSearchContext::GetCurrent();
+
+	for( unsigned int from=0; from<clusterCount; ++from )
+	{
+		NavRouteSearch( m_clusterArea[ from ], m_areaCluster, &length, &firstHop );
+
+		unsigned short *distanceRow = &m_distance[ from * clusterCount ];
+		unsigned short *nextHopRow = &m_nextHop[ from * clusterCount ];
+
+		for( unsigned int to=0; to<clusterCount; ++to )
+		{
+			unsigned int center = m_clusterArea[ to ];
+
+			if (!context->IsVisited( center ))
+				continue;
+
+			unsigned int stored = (unsigned int)(length[ center ] / DISTANCE_UNITS + 0.5f);
+			distanceRow[ to ] = (stored < UNREACHABLE) ? stored : UNREACHABLE-1;
+			nextHopRow[ to ] = firstHop[ center ];
+		}
+	}
+
+	m_buildCount = TheNavAreaGraph.GetBuildCount();
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the size of the current map's bsp file, used to detect out-of-date tables
+ */
+static unsigned int GetNavRouteBspSize( void )
+{
+	char bspFilename[256];
+	sprintf( bspFilename, "maps\\%s.bsp", STRING( gpGlobals->mapname ) );
+
+	return (unsigned int)engine::GetFileSize( bspFilename );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Store the table. Next hops are run-length encoded per row, since most destinations
+ * from a cluster are reached through only a few neighbors.
+ */
+bool CNavRouteTable::Save( const char *filename ) const
+{
+	if (m_clusterArea.empty())
+		return false;
+
+	BufferedFileWriter file;
+
+	unsigned int header[6];
+	header[0] = NAV_ROUTE_MAGIC_NUMBER;
+	header[1] = NAV_ROUTE_VERSION;
+	header[2] = GetNavRouteBspSize();
+	header[3] = m_areaCluster.size();
+	header[4] = ComputeChecksum();
+	header[5] = m_clusterArea.size();
+	file.Write( header, sizeof(header) );
+
+	file.Write( m_areaCluster.data(), m_areaCluster.size() * sizeof(unsigned short) );
+	file.Write( m_clusterArea.data(), m_clusterArea.size() * sizeof(unsigned int) );
+	file.Write( m_distance.data(), m_distance.size() * sizeof(unsigned short) );
+
+	const unsigned int clusterCount = m_clusterArea.size();
+	std::vector<unsigned short> runs;
+
+	for( unsigned int from=0; from<clusterCount; ++from )
+	{
+		const unsigned short *row = &m_nextHop[ from * clusterCount ];
+
+		// (count, value) pairs
+		runs.clear();
+		for( unsigned int to=0; to<clusterCount; )
+		{
+			unsigned int count = 1;
+			while( to + count < clusterCount && row[ to + count ] == row[ to ] && count < 0xFFFF )
+				++count;
+
+			runs.push_back( count );
+			runs.push_back( row[ to ] );
+
+			to += count;
+		}
+
+		unsigned short runCount = runs.size() / 2;
+		file.Write( runCount );
+		file.Write( runs.data(), runs.size() * sizeof(unsigned short) );
+	}
+
+	return file.Save( filename );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load the table for the current mesh.
+ * Returns false, leaving the table empty, if there is no table or it was made for a different bsp or mesh.
+ */
+bool CNavRouteTable::Load( const char *filename )
+{
+	Reset();
+
+	SteamFile file( filename );
+	if (!file.IsValid())
+		return false;
+
+	unsigned int header[6];
+	if (!file.Read( &header ) || header[0] != NAV_ROUTE_MAGIC_NUMBER || header[1] != NAV_ROUTE_VERSION)
+	{
+		CONSOLE_ECHO( "ERROR: Invalid route table '%s'.\n", filename );
+		return false;
+	}
+
+	TheNavAreaGraph.Update();
+
+	const unsigned int areaCount = TheNavAreaGraph.GetAreaCount();
+	const unsigned int clusterCount = header[5];
+
+	if (header[2] != GetNavRouteBspSize() || header[3] != areaCount || header[4] != ComputeChecksum())
+	{
+		CONSOLE_ECHO( "Route table '%s' is out of date - using A* only. Run bot_nav_build_routes to rebuild it.\n", filename );
+		return false;
+	}
+
+	if (clusterCount == 0 || clusterCount > MAX_CLUSTERS)
+	{
+		CONSOLE_ECHO( "ERROR: Invalid route table '%s'.\n", filename );
+		return false;
+	}
+
+	m_areaCluster.resize( areaCount );
+	m_clusterArea.resize( clusterCount );
+	m_distance.resize( clusterCount * clusterCount );
+	m_nextHop.resize( clusterCount * clusterCount );
+
+	bool isValid = file.Read( m_areaCluster.data(), areaCount * sizeof(unsigned short) ) &&
+					file.Read( m_clusterArea.data(), clusterCount * sizeof(unsigned int) ) &&
+					file.Read( m_distance.data(), clusterCount * clusterCount * sizeof(unsigned short) );
+
+	for( unsigned int i=0; isValid && i<areaCount; ++i )
+		if (m_areaCluster[i] >= clusterCount)
+			isValid = false;
+
+	for( unsigned int i=0; isValid && i<clusterCount; ++i )
+		if (m_clusterArea[i] >= areaCount)
+			isValid = false;
+
+	for( unsigned int from=0; isValid && from<clusterCount; ++from )
+	{
+		unsigned short runCount;
+		if (!file.Read( &runCount ))
+		{
+			isValid = false;
+			break;
+		}
+
+		// the runs are decoded in place
+		const unsigned short *runs = file.View<unsigned short>( 2 * runCount );
+		if (runs == nullptr)
+		{
+			isValid = false;
+			break;
+		}
+
+		unsigned short *row = &m_nextHop[ from * clusterCount ];
+		unsigned int to = 0;
+
+		for( unsigned int r=0; r<runCount; ++r )
+		{
+			unsigned int count = runs[ 2*r ];
+			unsigned short value = runs[ 2*r+1 ];
+
+			if (to + count > clusterCount || (value != NO_CLUSTER && value >= clusterCount))
+			{
+				isValid = false;
+				break;
+			}
+
+			for( unsigned int i=0; i<count; ++i )
+				row[ to++ ] = value;
+		}
+
+		if (to != clusterCount)
+			isValid = false;
+	}
+
+	if (!isValid)
+	{
+		CONSOLE_ECHO( "ERROR: Invalid route table '%s'.\n", filename );
+		Reset();
+		return false;
+	}
+
+	m_buildCount = TheNavAreaGraph.GetBuildCount();
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * bot_nav_build_routes
+ * Compute the route table for the current map's nav mesh and save it next to the .nav file.
+ */
+void NavBuildRouteTable( void )
+{
+	if (TheNavAreaList.empty())
+	{
+		NavErrorType error = LoadNavigationMap();
+		if (error != NAV_OK)
+		{
+			CONSOLE_ECHO( "Unable to load navigation mesh for this map (error %d).\n", error );
+			return;
+		}
+	}
+
+	CPerformanceCounter counter;
+	double startTime = counter.GetCurTime();
+
+	if (!TheNavRouteTable.Build())
+	{
+		CONSOLE_ECHO( "bot_nav_build_routes: navigation mesh is too large for a route table (%d areas).\n", TheNavAreaGraph.GetAreaCount() );
+		return;
+	}
+
+	double elapsed = counter.GetCurTime() - startTime;
+
+	unsigned int clusterCount = TheNavRouteTable.GetClusterCount();
+
+	CONSOLE_ECHO( "bot_nav_build_routes: %d areas in %d clusters, %d KB in memory, built in %.1f ms\n",
+					TheNavAreaGraph.GetAreaCount(), clusterCount, (4 * clusterCount * clusterCount) / 1024, 1000.0 * elapsed );
+
+	// save it where the engine will find it next to the .nav file
+	char gameDir[256];
+	engine::GetGameDir( gameDir );
+
+	char filename[512];
+	snprintf( filename, sizeof(filename), "%s/maps/%s.nrt", gameDir, STRING( gpGlobals->mapname ) );
+
+	if (TheNavRouteTable.Save( filename ))
+		CONSOLE_ECHO( "bot_nav_build_routes: saved '%s'\n", filename );
+	else
+		CONSOLE_ECHO( "ERROR: Unable to save route table '%s'.\n", filename );
+}
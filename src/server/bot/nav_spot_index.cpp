@@ -0,0 +1,375 @@
+// nav_spot_index.cpp
+// Flat, spatially indexed copy of the hiding spots, with per-frame occupancy
+
+#pragma warning( disable : 4530 )					// STL uses exceptions, but we are not compiling with them - ignore warning
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "player.h"
+#include "player_snapshot.h"
+
+#include "bot_util.h"
+#include "nav.h"
+#include "nav_area.h"
+#include "nav_spot_index.h"
+
+
+CHidingSpotIndex TheHidingSpotIndex;
+
+/// the grid's cells start this size, and grow if the map would need too many of them
+static const float minSpotCellSize = 256.0f;
+static const int maxSpotGridCells = 65536;
+
+
+//--------------------------------------------------------------------------------------------------------------
+CHidingSpotIndex::CHidingSpotIndex( void )
+{
+	m_cellSize = minSpotCellSize;
+	m_minX = m_minY = 0.0f;
+	m_gridSizeX = m_gridSizeY = 0;
+	m_occupancyTimestamp = -1.0f;
+	m_buildCount = 0;
+	m_spotChangeCount = 0;
+	m_isBuilt = false;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CHidingSpotIndex::Reset( void )
+{
+	m_spot.clear();
+	m_pos.clear();
+	m_flags.clear();
+	m_area.clear();
+	m_areaFirstSpot.clear();
+
+	m_gridSizeX = m_gridSizeY = 0;
+	m_cellFirst.clear();
+	m_cellSpot.clear();
+	m_cellPos.clear();
+	m_cellFlags.clear();
+
+	m_isOccupied.clear();
+	m_occupancyTimestamp = -1.0f;
+
+	m_isBuilt = false;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true if the index matches the search graph and the hiding spots
+ */
+bool CHidingSpotIndex::IsCurrent( void ) const
+{
+	if (!m_isBuilt || TheNavAreaGraph.IsDirty() || m_buildCount != TheNavAreaGraph.GetBuildCount())
+		return false;
+
+	return (m_spotChangeCount == HidingSpot::GetChangeCount()) ? true : false;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Rebuild if out of date, and find the spots players are standing in, once per frame.
+ * Every query into the index must be preceded by a call to Update().
+ */
+void CHidingSpotIndex::Update( void )
+{
+	// pick up any edits made since the search graph was last built
+	TheNavAreaGraph.Update();
+
+	if (!IsCurrent())
+		Build();
+
+	if (m_occupancyTimestamp != gpGlobals->time)
+		UpdateOccupancy();
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Copy every area's hiding spots into the flat arrays, in graph order, and grid them
+ */
+void CHidingSpotIndex::Build( void )
+{
+	Reset();
+
+	const unsigned int areaCount = TheNavAreaGraph.GetAreaCount();
+	m_areaFirstSpot.resize( areaCount+1 );
+
+	for( unsigned int a=0; a<areaCount; ++a )
+	{
+		m_areaFirstSpot[a] = m_spot.size();
+
+		const HidingSpotList *list = TheNavAreaGraph.GetArea( a )->GetHidingSpotList();
+
+		for( HidingSpotList::const_iterator iter = list->begin(); iter != list->end(); ++iter )
+		{
+			const HidingSpot *spot = *iter;
+
+			unsigned char flags = spot->GetFlags();
+
+			// the spot may lie on a neighboring area, so look it up
+			CNavArea *spotArea = TheNavAreaGrid.GetNavArea( spot->GetPosition() );
+			if (spotArea && (spotArea->GetAttributes() & NAV_CROUCH))
+				flags |= IN_CROUCH_AREA;
+
+			m_spot.push_back( spot );
+			m_pos.push_back( *spot->GetPosition() );
+			m_flags.push_back( flags );
+			m_area.push_back( a );
+		}
+	}
+
+	m_areaFirstSpot[ areaCount ] = m_spot.size();
+
+	const unsigned int spotCount = m_spot.size();
+
+	//
+	// Size the grid to the spots, doubling the cells until there are few enough of them
+	//
+	if (spotCount)
+	{
+		float maxX, maxY;
+		m_minX = maxX = m_pos[0].x;
+		m_minY = maxY = m_pos[0].y;
+
+		for( unsigned int i=1; i<spotCount; ++i )
+		{
+			if (m_pos[i].x < m_minX)
+				m_minX = m_pos[i].x;
+			else if (m_pos[i].x > maxX)
+				maxX = m_pos[i].x;
+
+			if (m_pos[i].y < m_minY)
+				m_minY = m_pos[i].y;
+			else if (m_pos[i].y > maxY)
+				maxY = m_pos[i].y;
+		}
+
+		m_cellSize = minSpotCellSize;
+		while( true )
+		{
+			m_gridSizeX = (int)((maxX - m_minX) / m_cellSize) + 1;
+			m_gridSizeY = (int)((maxY - m_minY) / m_cellSize) + 1;
+
+			if (m_gridSizeX * m_gridSizeY <= maxSpotGridCells)
+				break;
+
+			m_cellSize *= 2.0f;
+		}
+
+		// counting sort of the spots into their cells
+		std::vector< unsigned int > cell( spotCount );
+
+		m_cellFirst.assign( m_gridSizeX * m_gridSizeY + 1, 0 );
+
+		for( unsigned int i=0; i<spotCount; ++i )
+		{
+			int x = (int)((m_pos[i].x - m_minX) / m_cellSize);
+			int y = (int)((m_pos[i].y - m_minY) / m_cellSize);
+
+			cell[i] = x + y * m_gridSizeX;
+			++m_cellFirst[ cell[i] + 1 ];
+		}
+
+		for( unsigned int c=1; c<m_cellFirst.size(); ++c )
+			m_cellFirst[c] += m_cellFirst[c-1];
+
+		std::vector< unsigned int > next( m_cellFirst.begin(), m_cellFirst.end() - 1 );
+
+		m_cellSpot.resize( spotCount );
+		for( unsigned int i=0; i<spotCount; ++i )
+			m_cellSpot[ next[ cell[i] ]++ ] = i;
+
+		m_cellPos.resize( spotCount );
+		m_cellFlags.resize( spotCount );
+		for( unsigned int s=0; s<spotCount; ++s )
+		{
+			m_cellPos[s] = m_pos[ m_cellSpot[s] ];
+			m_cellFlags[s] = m_flags[ m_cellSpot[s] ];
+		}
+	}
+
+	m_isOccupied.assign( (spotCount + 31) / 32, 0 );
+	m_occupancyTimestamp = -1.0f;
+
+	m_buildCount = TheNavAreaGraph.GetBuildCount();
+	m_spotChangeCount = HidingSpot::GetChangeCount();
+	m_isBuilt = true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Invoke 'func' on each spot with any of 'flags' within 'range' of 'pos', until it returns false.
+ * 'func' is given the spot and its squared distance from 'pos'.
+ * If 'flags' is 0, spots are not checked for flags, and if 'range' is 0 or less, spots anywhere are visited.
+ */
+template < typename Functor >
+void CHidingSpotIndex::ForSpotsInRange( const Vector &pos, float range, unsigned char flags, Functor &func ) const
+{
+	if (m_spot.empty())
+		return;
+
+	if (range <= 0.0f)
+	{
+		for( unsigned int i=0; i<m_spot.size(); ++i )
+		{
+			if (flags && !(m_flags[i] & flags))
+				continue;
+
+			if (!func( i, (m_pos[i] - pos).LengthSquared() ))
+				return;
+		}
+
+		return;
+	}
+
+	int loX = (int)floor( (pos.x - range - m_minX) / m_cellSize );
+	int hiX = (int)floor( (pos.x + range - m_minX) / m_cellSize );
+	int loY = (int)floor( (pos.y - range - m_minY) / m_cellSize );
+	int hiY = (int)floor( (pos.y + range - m_minY) / m_cellSize );
+
+	if (loX < 0)
+		loX = 0;
+	if (hiX >= m_gridSizeX)
+		hiX = m_gridSizeX-1;
+	if (loY < 0)
+		loY = 0;
+	if (hiY >= m_gridSizeY)
+		hiY = m_gridSizeY-1;
+
+	const float rangeSq = range * range;
+
+	for( int y=loY; y<=hiY; ++y )
+	{
+		for( int x=loX; x<=hiX; ++x )
+		{
+			const int c = x + y * m_gridSizeX;
+
+			for( unsigned int s=m_cellFirst[c]; s<m_cellFirst[c+1]; ++s )
+			{
+				if (flags && !(m_cellFlags[s] & flags))
+					continue;
+
+				const float spotRangeSq = (m_cellPos[s] - pos).LengthSquared();
+				if (spotRangeSq > rangeSq)
+					continue;
+
+				if (!func( m_cellSpot[s], spotRangeSq ))
+					return;
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Sets the occupied bit of each spot it is given
+ */
+class MarkOccupiedSpotFunctor
+{
+public:
+	MarkOccupiedSpotFunctor( std::vector< unsigned int > *isOccupied ) : m_isOccupied( isOccupied ) { }
+
+	bool operator() ( unsigned int i, float )
+	{
+		(*m_isOccupied)[ i >> 5 ] |= 1u << (i & 31);
+		return true;
+	}
+
+	std::vector< unsigned int > *m_isOccupied;
+};
+
+/**
+ * Find the spots each living player is standing in, from the frame's player snapshot
+ */
+void CHidingSpotIndex::UpdateOccupancy( void )
+{
+	if (!m_isOccupied.empty())
+		memset( m_isOccupied.data(), 0, m_isOccupied.size() * sizeof(unsigned int) );
+
+	MarkOccupiedSpotFunctor markOccupied( &m_isOccupied );
+
+	for( int p=0; p<g_PlayerSnapshot.GetCount(); ++p )
+	{
+		if (!g_PlayerSnapshot.IsAlive( p ))
+			continue;
+
+		ForSpotsInRange( g_PlayerSnapshot.GetOrigin( p ), SPOT_OCCUPIED_RANGE, 0, markOccupied );
+	}
+
+	m_occupancyTimestamp = gpGlobals->time;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true if a living player other than 'ignore' is in the spot
+ */
+bool CHidingSpotIndex::IsPlayerInSpot( unsigned int i, CBaseEntity *ignore ) const
+{
+	const float rangeSq = SPOT_OCCUPIED_RANGE * SPOT_OCCUPIED_RANGE;
+
+	for( int p=0; p<g_PlayerSnapshot.GetCount(); ++p )
+	{
+		if (!g_PlayerSnapshot.IsAlive( p ) || g_PlayerSnapshot.GetPlayer( p ) == ignore)
+			continue;
+
+		if ((g_PlayerSnapshot.GetOrigin( p ) - m_pos[i]).LengthSquared() < rangeSq)
+			return true;
+	}
+
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Keeps the nearest unoccupied spot it is given
+ */
+class NearestIndexedSpotFunctor
+{
+public:
+	NearestIndexedSpotFunctor( const CHidingSpotIndex *index, CBaseEntity *ignore )
+	{
+		m_index = index;
+		m_ignore = ignore;
+		m_nearest = -1;
+		m_nearestRangeSq = 0.0f;
+	}
+
+	bool operator() ( unsigned int i, float rangeSq )
+	{
+		if (m_nearest >= 0 && rangeSq >= m_nearestRangeSq)
+			return true;
+
+		if (m_index->IsOccupied( i, m_ignore ))
+			return true;
+
+		m_nearest = i;
+		m_nearestRangeSq = rangeSq;
+
+		return true;
+	}
+
+	const CHidingSpotIndex *m_index;
+	CBaseEntity *m_ignore;
+	int m_nearest;
+	float m_nearestRangeSq;
+};
+
+/**
+ * Return the nearest unoccupied spot with any of 'flags' within 'range' of 'pos', or -1 if there is none.
+ * If 'range' is 0 or less, spots anywhere are considered.
+ */
+int CHidingSpotIndex::FindNearestSpot( const Vector &pos, float range, unsigned char flags, CBaseEntity *ignore ) const
+{
+	if (flags == 0)
+		return -1;
+
+	NearestIndexedSpotFunctor nearest( this, ignore );
+	ForSpotsInRange( pos, range, flags, nearest );
+
+	return nearest.m_nearest;
+}
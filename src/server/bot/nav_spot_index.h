@@ -0,0 +1,93 @@
+// nav_spot_index.h
+// Flat, spatially indexed copy of the hiding spots, with per-frame occupancy
+
+#ifndef _NAV_SPOT_INDEX_H_
+#define _NAV_SPOT_INDEX_H_
+
+#include <vector>
+
+#include "nav_area.h"
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The CHidingSpotIndex keeps every hiding spot in flat arrays ordered by TheNavAreaGraph index, so each area's
+ * spots are one contiguous run, along with a uniform grid over their positions.
+ * Once per frame, the spots players are standing in are found by looking up each player in the grid, and kept
+ * as a bitset, so asking if a spot is occupied no longer loops over all players.
+ * The index is rebuilt whenever the search graph is rebuilt or hiding spots are created or changed.
+ * It is only used from the main thread.
+ */
+class CHidingSpotIndex
+{
+public:
+	CHidingSpotIndex( void );
+
+	enum
+	{
+		IN_CROUCH_AREA		= 0x80,							///< not a HidingSpot flag - the spot is on an area that must be crouched thru
+	};
+
+	void Reset( void );
+	void Update( void );									///< rebuild if out of date, and find the occupied spots once per frame
+
+	unsigned int GetSpotCount( void ) const					{ return m_spot.size(); }
+	const HidingSpot *GetSpot( unsigned int i ) const		{ return m_spot[i]; }
+	const Vector &GetPosition( unsigned int i ) const		{ return m_pos[i]; }
+	unsigned char GetFlags( unsigned int i ) const			{ return m_flags[i]; }	///< HidingSpot flags, plus IN_CROUCH_AREA
+	CNavArea *GetArea( unsigned int i ) const				{ return TheNavAreaGraph.GetArea( m_area[i] ); }
+	unsigned int GetAreaIndex( unsigned int i ) const		{ return m_area[i]; }	///< graph index of the spot's area
+
+	unsigned int GetAreaSpotsBegin( unsigned int areaIndex ) const	{ return m_areaFirstSpot[ areaIndex ]; }	///< the spots of the area with the given graph index
+	unsigned int GetAreaSpotsEnd( unsigned int areaIndex ) const	{ return m_areaFirstSpot[ areaIndex+1 ]; }
+
+	bool IsOccupied( unsigned int i, CBaseEntity *ignore = nullptr ) const;	///< return true if a player other than 'ignore' is in the spot
+
+	/// return the nearest unoccupied spot with any of 'flags' within 'range' of 'pos', or -1 if there is none
+	int FindNearestSpot( const Vector &pos, float range, unsigned char flags, CBaseEntity *ignore ) const;
+
+	enum { SPOT_OCCUPIED_RANGE = 75 };						///< a player this close to a spot is using it
+
+private:
+	bool IsCurrent( void ) const;
+	void Build( void );
+	void UpdateOccupancy( void );
+	bool IsPlayerInSpot( unsigned int i, CBaseEntity *ignore ) const;
+
+	/// invoke 'func' on each spot with any of 'flags' within 'range' of 'pos', until it returns false
+	template < typename Functor >
+	void ForSpotsInRange( const Vector &pos, float range, unsigned char flags, Functor &func ) const;
+
+	std::vector< const HidingSpot * > m_spot;
+	std::vector< Vector > m_pos;
+	std::vector< unsigned char > m_flags;
+	std::vector< unsigned int > m_area;						///< graph index of the area the spot belongs to
+	std::vector< unsigned int > m_areaFirstSpot;			///< graph index -> first spot, with one more entry at the end
+
+	float m_cellSize;
+	float m_minX, m_minY;
+	int m_gridSizeX, m_gridSizeY;
+	std::vector< unsigned int > m_cellFirst;				///< cell -> first entry of m_cellSpot, with one more entry at the end
+	std::vector< unsigned int > m_cellSpot;					///< spot indices, grouped by cell
+	std::vector< Vector > m_cellPos;						///< the same spots' positions and flags, so a cell is scanned in order
+	std::vector< unsigned char > m_cellFlags;
+
+	std::vector< unsigned int > m_isOccupied;				///< one bit per spot
+	float m_occupancyTimestamp;								///< the frame occupancy was found for
+
+	unsigned int m_buildCount;								///< TheNavAreaGraph build the index is valid for
+	unsigned int m_spotChangeCount;							///< HidingSpot change count the index is valid for
+	bool m_isBuilt;
+};
+
+extern CHidingSpotIndex TheHidingSpotIndex;
+
+inline bool CHidingSpotIndex::IsOccupied( unsigned int i, CBaseEntity *ignore ) const
+{
+	// nearly every spot is empty - only look at the players for the few that are not
+	if ((m_isOccupied[ i >> 5 ] & (1u << (i & 31))) == 0)
+		return false;
+
+	return IsPlayerInSpot( i, ignore );
+}
+
+#endif // _NAV_SPOT_INDEX_H_
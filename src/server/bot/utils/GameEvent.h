@@ -140,6 +140,9 @@ enum GameEventType
 
 	EVENT_HOSTAGE_CALLED_FOR_HELP,					///< hostage yelled to a CT
 
+	EVENT_SENTRY_BUILT,								///< an engineer built a sentry gun (entity = the gun, other = the engineer)
+	EVENT_FLAG_PICKED_UP,							///< a player picked up a goal item, such as a flag (entity = the player, other = the item)
+
 	NUM_GAME_EVENTS
 };
 
@@ -270,6 +273,9 @@ const char *GameEventName[ NUM_GAME_EVENTS+1 ] =
 
 	"EVENT_HOSTAGE_CALLED_FOR_HELP",
 
+	"EVENT_SENTRY_BUILT",
+	"EVENT_FLAG_PICKED_UP",
+
 	nullptr		// must be nullptr-terminated
 };
 #else
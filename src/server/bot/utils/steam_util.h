@@ -5,6 +5,10 @@
 #ifndef _STEAM_UTIL_H_
 #define _STEAM_UTIL_H_
 
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Used to load a file via Steam
@@ -18,6 +22,18 @@ public:
 	bool IsValid( void ) const				{ return (m_fileData) ? true : false; }	///< returns true if this file object is attached to a file
 	bool Read( void *data, int length );		///< read 'length' bytes from the file
 
+	template < typename T >
+	bool Read( T *value )					{ return Read( value, sizeof(T) ); }	///< read one value of plain type T
+
+	template < typename T >
+	const T *View( int count = 1 );			///< point at 'count' values in the loaded file, without copying
+
+	bool Skip( int length );				///< move past 'length' bytes
+	int GetBytesLeft( void ) const			{ return m_bytesLeft; }
+
+	const byte *GetData( void ) const		{ return m_fileData; }			///< the whole file, as loaded into memory
+	int GetLength( void ) const				{ return m_fileDataLength; }
+
 private:
 	byte *m_fileData;												///< the file read into memory
 	int m_fileDataLength;										///< the length of the file
@@ -41,18 +57,87 @@ inline SteamFile::~SteamFile()
 
 inline bool SteamFile::Read( void *data, int length )
 {
-	if (length > m_bytesLeft || m_cursor == nullptr || m_bytesLeft <= 0)
+	if (length < 0 || length > m_bytesLeft || m_cursor == nullptr)
+		return false;
+
+	memcpy( data, m_cursor, length );
+
+	m_cursor += length;
+	m_bytesLeft -= length;
+
+	return true;
+}
+
+/**
+ * Return 'count' values of type T in place in the file, and move past them.
+ * Returns nullptr, and doesn't move, if the file is too short.
+ * NOTE: The values may not be aligned for T
+ */
+template < typename T >
+inline const T *SteamFile::View( int count )
+{
+	if (count < 0 || m_cursor == nullptr || (unsigned int)count > m_bytesLeft / sizeof(T))
+		return nullptr;
+
+	const T *values = reinterpret_cast<const T *>( m_cursor );
+
+	m_cursor += count * sizeof(T);
+	m_bytesLeft -= count * sizeof(T);
+
+	return values;
+}
+
+inline bool SteamFile::Skip( int length )
+{
+	if (length < 0 || length > m_bytesLeft || m_cursor == nullptr)
 		return false;
 
-	byte *readCursor = static_cast<byte *>( data );
+	m_cursor += length;
+	m_bytesLeft -= length;
 
-	for( int i=0; i<length; ++i )
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Collects a file's contents in memory, so the whole file is written with a single call
+ */
+class BufferedFileWriter
+{
+public:
+	void Write( const void *data, int length )
 	{
-		*readCursor++ = *m_cursor++;
-		--m_bytesLeft;
+		const byte *bytes = static_cast<const byte *>( data );
+		m_buffer.insert( m_buffer.end(), bytes, bytes + length );
 	}
 
-	return true;
+	template < typename T >
+	void Write( const T &value )					{ Write( &value, sizeof(T) ); }		///< write one value of plain type T
+
+	void Align( int alignment )						{ while( m_buffer.size() % alignment ) m_buffer.push_back( 0 ); }	///< pad with zeros to a multiple of 'alignment'
+	void Overwrite( unsigned int offset, const void *data, int length )	{ memcpy( &m_buffer[ offset ], data, length ); }	///< replace bytes already written
+
+	unsigned int GetSize( void ) const				{ return m_buffer.size(); }
+
+	bool Save( const char *filename ) const;		///< write everything, replacing the file
+
+private:
+	std::vector<byte> m_buffer;
+};
+
+inline bool BufferedFileWriter::Save( const char *filename ) const
+{
+	FILE *fp = fopen( filename, "wb" );
+	if (fp == nullptr)
+		return false;
+
+	bool isWritten = (fwrite( m_buffer.data(), 1, m_buffer.size(), fp ) == m_buffer.size()) ? true : false;
+
+	if (fclose( fp ) != 0)
+		isWritten = false;
+
+	return isWritten;
 }
 
 #endif // _STEAM_UTIL_H_
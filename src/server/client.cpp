@@ -44,6 +44,12 @@
 #include "pm_shared.h"
 #include "pm_defs.h"
 #include "UserMessages.h"
+#include "player_snapshot.h"
+#include "visibility_cache.h"
+#include "entity_hash.h"
+#include "entity_names.h"
+#include "lag_compensation.h"
+#include "explosion_resolver.h"
 #ifdef HALFLIFE_BOTS
 #include "bot/hl_bot_manager.h"
 #endif
@@ -117,6 +123,11 @@ void ClientDisconnect(Entity* pEntity)
 
 		player->SetOrigin(g_vecZero);
 
+		g_PlayerSnapshot.RemovePlayer(player);
+		g_VisibilityCache.RemovePlayer(player);
+		g_LagCompensation.RemovePlayer(player);
+		g_EntityHash.SetClientActive(pEntity, false);
+
 		engine::FreeEntPrivateData(pEntity);
 	}
 }
@@ -173,6 +184,8 @@ void ClientPutInServer(Entity* pEntity)
 
 	pPlayer->InstallGameMovement(new CHalfLifeMovement{pmove, pPlayer});
 
+	g_EntityHash.SetClientActive(pEntity, true);
+
 	g_pGameRules->PlayerSpawn(pPlayer);
 
 	if (util::IsMultiplayer())
@@ -665,6 +678,13 @@ void ServerDeactivate()
 
 	g_serveractive = 0;
 
+	g_PlayerSnapshot.Clear();
+	g_VisibilityCache.Clear();
+	g_EntityHash.Clear();
+	g_EntityNames.Clear();
+	g_LagCompensation.Clear();
+	g_ExplosionResolver.Clear();
+
 #ifdef HALFLIFE_BOTS
 	if (g_pBotMan)
 	{
@@ -681,6 +701,9 @@ void ServerActivate(Entity* pEdictList, int edictCount, int clientMax)
 	// Every call to ServerActivate should be matched by a call to ServerDeactivate
 	g_serveractive = 1;
 
+	// File the level's entities under their names before they look each other up
+	g_EntityNames.Update();
+
 	// Clients have not been initialized yet
 	for (i = 0; i < edictCount; i++)
 	{
@@ -886,6 +909,11 @@ void StartFrame()
 {
 	Steam_Frame();
 
+	g_EntityNames.Update();
+	g_PlayerSnapshot.Update();
+	g_VisibilityCache.Update();
+	g_LagCompensation.Update();
+
 	if (g_pGameRules)
 	{
 		g_pGameRules->Think();
@@ -1807,6 +1835,12 @@ AllowLagCompensation
 */
 int AllowLagCompensation()
 {
+	// Hitscan shots move players back themselves, with their animation, so the engine mustn't as well.
+	if (CLagCompensation::IsEnabled())
+	{
+		return 0;
+	}
+
 	return sv_unlag->value;
 }
 
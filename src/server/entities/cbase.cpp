@@ -20,6 +20,8 @@
 #include "gamerules.h"
 #include "game.h"
 #include "pm_shared.h"
+#include "entity_hash.h"
+#include "entity_names.h"
 
 void OnFreeEntPrivateData(Entity* pEdict);
 int ShouldCollide(Entity* pentTouched, Entity* pentOther);
@@ -149,6 +151,7 @@ int DispatchSpawn(Entity* pent)
 	// Initialize these or entities who don't link to the world won't have anything in here
 	entity->v.absmin = entity->v.origin - Vector(1, 1, 1);
 	entity->v.absmax = entity->v.origin + Vector(1, 1, 1);
+	g_EntityHash.Link(pent);
 
 	if (!entity->Spawn())
 	{
@@ -365,6 +368,16 @@ void DispatchKeyValue(Entity* pentKeyvalue, KeyValueData* pkvd)
 		return;
 	}
 
+	// File the entity under its new name, however the key is handled
+	const CallOnDestroy updateNames{[pentKeyvalue, pkvd]()
+		{
+			CEntityNameIndex::Field field;
+			if (CEntityNameIndex::GetField(pkvd->szKeyName, field))
+			{
+				g_EntityNames.Update(pentKeyvalue);
+			}
+		}};
+
 	auto entity = pentKeyvalue->Get<CBaseEntity>();
 
 	if (pkvd->szClassName == nullptr || entity == nullptr)
@@ -502,6 +515,8 @@ void OnFreeEntPrivateData(Entity* pEdict)
 		return;
 	}
 
+	g_EntityHash.Unlink(pEdict);
+
 	pEdict->Free<CBaseEntity>();
 }
 
@@ -682,6 +697,8 @@ void DispatchObjectCollsionBox(Entity* pent)
 	{
 		SetObjectCollisionBox(pent);
 	}
+
+	g_EntityHash.Link(pent);
 }
 
 
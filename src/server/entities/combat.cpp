@@ -28,9 +28,14 @@
 #include "animation.h"
 #include "weapons.h"
 #include "func_break.h"
+#include "lag_compensation.h"
+#include "explosion_resolver.h"
 #include "player.h"
 #include "UserMessages.h"
 #include "gamerules.h"
+#ifdef HALFLIFE_BOTS
+#include "bot/hl_bot_manager.h"
+#endif
 
 
 bool CBaseEntity::ApplyMultiDamage(CBaseEntity* inflictor, CBaseEntity* attacker)
@@ -66,36 +71,7 @@ void RadiusDamage(
 	const float radius,
 	const int damageType)
 {
-	const float damageFalloff = damageMin - damageMax;
-	CBaseEntity* entity = nullptr;
-	TraceResult tr;
-	float adjusted;
-
-	while ((entity = util::FindEntityInSphere(entity, origin, radius)) != nullptr)
-	{
-		if (entity->v.takedamage == DAMAGE_NO)
-		{
-			continue;
-		}
-
-		const auto isBrush = entity->IsBSPModel();
-
-		const auto eyes = isBrush ? entity->Center() : entity->EyePosition();
-
-		util::TraceLine(origin, eyes, &tr, inflictor, util::kTraceBox);
-
-		if (tr.flFraction != 1.0F && tr.pHit != &entity->v)
-		{
-			continue;
-		}
-
-		const auto center = isBrush ? tr.vecEndPos : entity->BodyTarget();
-
-		adjusted = (origin - center).Length() / radius;
-		adjusted = std::max(damageMax + damageFalloff * adjusted, 0.0F);
-
-		entity->TakeDamage(inflictor, attacker, adjusted, damageType);
-	}
+	g_ExplosionResolver.RadiusDamage(origin, inflictor, attacker, damageMax, damageMin, radius, damageType);
 }
 
 //=========================================================
@@ -244,6 +220,15 @@ void CBasePlayer::FireBullets(
 	auto traceCount = 0;
 	auto traceEntities = static_cast<CBaseEntity**>(alloca(count * sizeof(CBaseEntity*)));
 
+#ifdef HALFLIFE_BOTS
+	if (g_pBotMan != nullptr)
+	{
+		g_pBotMan->OnEvent(EVENT_WEAPON_FIRED, this);
+	}
+#endif
+
+	g_LagCompensation.Begin(this);
+
 	for (auto i = 0; i < count; i++)
 	{
 		const Vector2D spreadScale
@@ -264,6 +249,8 @@ void CBasePlayer::FireBullets(
 		Vector dir;
 		AngleVectors(angles, &dir, nullptr, nullptr);
 
+		g_LagCompensation.Rewind(gun, gun + dir * distance);
+
 		TraceResult tr;
 		util::TraceLine(gun, gun + dir * distance, &tr, this, util::kTraceBox | util::kTraceBoxModel);
 		
@@ -324,6 +311,9 @@ void CBasePlayer::FireBullets(
 		traceHits++;
 	}
 
+	/* Put everyone back before the damage is dealt, since dying moves players. */
+	g_LagCompensation.End();
+
 	for (auto i = 0; i < traceCount; i++)
 	{
 		traceEntities[i]->ApplyMultiDamage(this, this);
@@ -25,6 +25,9 @@
 #include "weapons.h"
 #include "UserMessages.h"
 #include "gamerules.h"
+#ifdef HALFLIFE_BOTS
+#include "bot/hl_bot_manager.h"
+#endif
 
 
 unsigned short g_usGetNailedIdiot;
@@ -67,6 +70,13 @@ void CGrenade::Explode(TraceResult* pTrace, int bitsDamageType)
 
 	v.owner = nullptr; // can't traceline attack owner if this is set
 
+#ifdef HALFLIFE_BOTS
+	if (g_pBotMan != nullptr)
+	{
+		g_pBotMan->OnEvent(EVENT_HE_GRENADE_EXPLODED, this, owner);
+	}
+#endif
+
 	RadiusDamage(v.origin, this, owner, v.dmg, v.dmg_save, v.dmg_take, DMG_RESIST_SELF | bitsDamageType);
 
 	Remove();
@@ -349,6 +359,13 @@ void CPrimeGrenade::Explode(TraceResult* pTrace, int bitsDamageType)
 
 	v.owner = nullptr; // can't traceline attack owner if this is set
 
+#ifdef HALFLIFE_BOTS
+	if (g_pBotMan != nullptr)
+	{
+		g_pBotMan->OnEvent(EVENT_HE_GRENADE_EXPLODED, this, owner);
+	}
+#endif
+
 	RadiusDamage(v.origin, this, owner, v.dmg, v.dmg_save, v.dmg_take, bitsDamageType);
 
 	Remove();
@@ -614,6 +631,13 @@ void CConcussionGrenade::Explode(TraceResult* pTrace, int bitsDamageType)
 
 	tent::Explosion(v.origin, -pTrace->vecPlaneNormal, tent::ExplosionType::Concussion, v.dmg, true, true, predictionOwner);
 
+#ifdef HALFLIFE_BOTS
+	if (g_pBotMan != nullptr)
+	{
+		g_pBotMan->OnEvent(EVENT_HE_GRENADE_EXPLODED, this, owner);
+	}
+#endif
+
 	CBaseEntity* entity = nullptr;
 	TraceResult tr;
 	Vector difference;
@@ -995,25 +1019,7 @@ void CNapalmGrenade::NapalmThink()
 
 	tent::FireField(v.origin);
 
-	CBaseEntity* entity = nullptr;
-	TraceResult tr;
-
-	while ((entity = util::FindEntityInSphere(entity, v.origin, v.dmg_take)) != nullptr)
-	{
-		if (entity->v.takedamage == DAMAGE_NO)
-		{
-			continue;
-		}
-
-		util::TraceLine(v.origin, entity->EyePosition(), &tr, this, util::kTraceBox);
-
-		if (tr.flFraction != 1.0F && tr.pHit != &entity->v)
-		{
-			continue;
-		}
-
-		entity->TakeDamage(this, v.owner->Get<CBasePlayer>(), v.dmg, DMG_BURN | DMG_IGNITE | DMG_NO_KNOCKBACK);
-	}
+	RadiusDamage(v.origin, this, v.owner->Get<CBasePlayer>(), v.dmg, v.dmg, v.dmg_take, DMG_BURN | DMG_IGNITE | DMG_NO_KNOCKBACK);
 
 	v.health--;
 
@@ -1068,6 +1074,13 @@ void CEMP::Explode(TraceResult* pTrace, int bitsDamageType)
 
 	tent::Explosion(v.origin, -pTrace->vecPlaneNormal, tent::ExplosionType::EMP, v.dmg);
 
+#ifdef HALFLIFE_BOTS
+	if (g_pBotMan != nullptr)
+	{
+		g_pBotMan->OnEvent(EVENT_HE_GRENADE_EXPLODED, this, owner);
+	}
+#endif
+
 	CBaseEntity* entity = nullptr;
 
 	/* Detonate items. */
@@ -1139,6 +1152,13 @@ void CFlashGrenade::Explode(TraceResult* pTrace, int bitsDamageType)
 
 	tent::Explosion(v.origin, -pTrace->vecPlaneNormal, tent::ExplosionType::Flash);
 
+#ifdef HALFLIFE_BOTS
+	if (g_pBotMan != nullptr)
+	{
+		g_pBotMan->OnEvent(EVENT_FLASHBANG_GRENADE_EXPLODED, this, owner);
+	}
+#endif
+
 	for (int i = 1; i <= gpGlobals->maxClients; i++)
 	{
 		auto player = static_cast<CBasePlayer*>(util::PlayerByIndex(i));
@@ -2641,9 +2641,12 @@ void CBasePlayer::SendExtraInfo(CBaseEntity* toWhom)
 
 void CBasePlayer::RemoveGoalItems(bool force)
 {
-	CTFGoalItem* goal = nullptr;
-	while ((goal = (CTFGoalItem*)util::FindEntityByClassname(goal, "item_tfgoal")))
+	const auto& items = g_TFGoalRegistry.GetAll(CTFGoalRegistry::kItems);
+
+	for (std::size_t i = 0; i < items.size(); i++)
 	{
+		CTFGoalItem* goal = (CTFGoalItem*)items[i];
+
 		if (goal->v.owner == &v && (force || goal->IsGoalActivatedBy(TFGI_CANBEDROPPED)))
 		{
 			goal->RemoveFromPlayer(this, GI_DROP_PLAYERDROP);
@@ -364,6 +364,7 @@ public:
 
 #ifdef GAME_DLL
 	int m_netPing;
+	int m_netLerp; // the client's interpolation time, in milliseconds
 #endif
 
 public:
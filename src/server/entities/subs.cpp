@@ -26,6 +26,7 @@
 #include "saverestore.h"
 #include "doors.h"
 #include "gamerules.h"
+#include "game.h"
 #ifdef HALFLIFE_NODEGRAPH
 #include "nodes.h"
 #endif
@@ -187,7 +188,10 @@ void util::FireTargets(const char* targetName, CBaseEntity* pActivator, CBaseEnt
 	if (!targetName)
 		return;
 
-	engine::AlertMessage(at_aiconsole, "Firing: (%s)\n", targetName);
+	if (g_bDeveloperMode)
+	{
+		engine::AlertMessage(at_aiconsole, "Firing: (%s)\n", targetName);
+	}
 
 	for (;;)
 	{
@@ -197,7 +201,10 @@ void util::FireTargets(const char* targetName, CBaseEntity* pActivator, CBaseEnt
 
 		if ((pTarget->v.flags & FL_KILLME) == 0) // Don't use dying ents
 		{
-			engine::AlertMessage(at_aiconsole, "Found: %s, firing (%s)\n", STRING(pTarget->v.classname), targetName);
+			if (g_bDeveloperMode)
+			{
+				engine::AlertMessage(at_aiconsole, "Found: %s, firing (%s)\n", STRING(pTarget->v.classname), targetName);
+			}
 			pTarget->Use(pActivator, pCaller, useType, value);
 		}
 	}
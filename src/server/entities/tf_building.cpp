@@ -13,6 +13,11 @@
 #include "gamerules.h"
 #include "items.h"
 #include "shake.h"
+#include "player_snapshot.h"
+#include "visibility_cache.h"
+#ifdef HALFLIFE_BOTS
+#include "bot/hl_bot_manager.h"
+#endif
 #include <algorithm>
 
 #define attachment euser1
@@ -564,6 +569,7 @@ protected:
 	static constexpr float kSentryYawSpeed = 30.0F; /* 10.0F */
 	static constexpr float kSentryRange = 1000.0F;
 	static constexpr float kSentryDamage = 16.0F;
+	static constexpr float kSentryVisibilityMaxAge = 0.05F;
 
 	enum
 	{
@@ -653,6 +659,13 @@ bool CSentryBase::Spawn()
 		return false;
 	}
 
+#ifdef HALFLIFE_BOTS
+	if (g_pBotMan != nullptr)
+	{
+		g_pBotMan->OnEvent(EVENT_SENTRY_BUILT, head, m_pPlayer);
+	}
+#endif
+
 	return true;
 }
 
@@ -842,15 +855,24 @@ void CSentryGun::FindTarget()
 	auto bestDistance = kSentryRange;
 	CBaseEntity* bestEnemy = nullptr;
 
-	for (int i = 1; i <= gpGlobals->maxClients; i++)
+	/* Skip players who can't be targeted before doing anything expensive. A player's center is near their origin. */
+	const auto maxDistanceSq = (kSentryRange + 64.0F) * (kSentryRange + 64.0F);
+	const auto eyePosition = EyePosition();
+
+	for (int i = 0; i < g_PlayerSnapshot.GetCount(); i++)
 	{
-		const auto player = static_cast<CBasePlayer*>(util::PlayerByIndex(i));
+		if (!g_PlayerSnapshot.IsActive(i) || !g_PlayerSnapshot.IsAlive(i))
+		{
+			continue;
+		}
 
-		if (player == nullptr)
+		if ((g_PlayerSnapshot.GetOrigin(i) - eyePosition).LengthSquared() > maxDistanceSq)
 		{
 			continue;
 		}
 
+		const auto player = g_PlayerSnapshot.GetPlayer(i);
+
 		const auto distance = HuntTarget(player);
 
 		if (distance < 0.0F || distance >= bestDistance)
@@ -964,12 +986,8 @@ float CSentryGun::HuntTarget(CBaseEntity* other)
 		base = v.attachment->Get<CSentryBase>();
 	}
 
-	TraceResult trace;
-
-	util::TraceLine(EyePosition(), other->EyePosition(),
-		util::ignore_monsters, base, &trace);
-
-	if (trace.flFraction != 1.0F && trace.pHit != &other->v)
+	if (!g_VisibilityCache.IsVisible(this, static_cast<CBasePlayer*>(other),
+		kSentryVisibilityMaxAge, CVisibilityCache::Point::Eyes, base))
 	{
 		return -1.0F;
 	}
@@ -23,17 +23,13 @@ CTFGoal* util::FindGoal(int goal_no)
         return nullptr;
     }
 
-    CTFGoal* goal = nullptr;
-    while ((goal = (CTFGoal*)util::FindEntityByClassname(goal, "info_tfgoal")))
+    CTFGoal* goal = g_TFGoalRegistry.Find(CTFGoalRegistry::kGoals, goal_no);
+
+    if (goal == nullptr)
     {
-        if (goal->GetNumber() == goal_no)
-        {
-            return goal;
-        }
+        engine::AlertMessage(at_aiconsole, "Could not find a goal with a goal_no of %i\n", goal_no);
     }
-
-    engine::AlertMessage(at_aiconsole, "Could not find a goal with a goal_no of %i\n", goal_no);
-    return nullptr;
+    return goal;
 }
 
 CTFGoalItem* util::FindItem(int item_no)
@@ -43,17 +39,13 @@ CTFGoalItem* util::FindItem(int item_no)
         return nullptr;
     }
 
-    CTFGoalItem* goal = nullptr;
-    while ((goal = (CTFGoalItem*)util::FindEntityByClassname(goal, "item_tfgoal")))
+    CTFGoalItem* goal = (CTFGoalItem*)g_TFGoalRegistry.Find(CTFGoalRegistry::kItems, item_no);
+
+    if (goal == nullptr)
     {
-        if (goal->GetNumber() == item_no)
-        {
-            return goal;
-        }
+        engine::AlertMessage(at_aiconsole, "Could not find an item with a goal_no of %i\n", item_no);
     }
-
-    engine::AlertMessage(at_aiconsole, "Could not find an item with a goal_no of %i\n", item_no);
-    return nullptr;
+    return goal;
 }
 
 CTFSpawn* util::FindTeamSpawn(int spawn_no)
@@ -63,17 +55,13 @@ CTFSpawn* util::FindTeamSpawn(int spawn_no)
         return nullptr;
     }
 
-    CTFSpawn* spawn = nullptr;
-    while ((spawn = (CTFSpawn*)util::FindEntityByClassname(spawn, "info_player_teamspawn")))
+    CTFSpawn* spawn = (CTFSpawn*)g_TFGoalRegistry.Find(CTFGoalRegistry::kSpawns, spawn_no);
+
+    if (spawn == nullptr)
     {
-        if (spawn->tfv.goal_no == spawn_no)
-        {
-            return spawn;
-        }
+        engine::AlertMessage(at_aiconsole, "Could not find a spawn with a goal_no of %i\n", spawn_no);
     }
-
-    engine::AlertMessage(at_aiconsole, "Could not find a spawn with a goal_no of %i\n", spawn_no);
-    return nullptr;
+    return spawn;
 }
 
 bool util::GoalInState(int goal_no, TFGoalState state)
@@ -97,27 +85,15 @@ bool util::GroupInState(int group_no, TFGoalState state, bool check_items = fals
 
     bool found = false;
 
-    const char* classname = check_items ? "item_tfgoal" : "info_tfgoal";
-
-    CTFGoal* goal = nullptr;
-    while ((goal = (CTFGoal*)util::FindEntityByClassname(goal, classname)))
-    {
-        if (goal->GetGroup() == group_no)
-        {
-            if (!goal->InGoalState(state))
-            {
-                return false;
-            }
-            found = true;
-        }
-    }
+    const auto list = check_items ? CTFGoalRegistry::kItems : CTFGoalRegistry::kGoals;
+    const auto in_state = g_TFGoalRegistry.GroupInState(list, group_no, state, found);
 
     if (!found)
     {
         engine::AlertMessage(at_aiconsole, "Could not find any goals with a group_no of %i\n", group_no);
     }
 
-    return true;
+    return in_state;
 }
 
 void util::SetGoalState(int goal_no, TFGoalState state, CBaseEntity* player = nullptr, CTFVars* activating_goal = nullptr)
@@ -155,33 +131,31 @@ void util::SetGroupState(int group_no, TFGoalState state, CBaseEntity* player =
         return;
     }
 
-    bool found = false;
+    const auto& group = g_TFGoalRegistry.GetGroup(CTFGoalRegistry::kGoals, group_no);
 
-    CTFGoal* goal = nullptr;
-    while ((goal = (CTFGoal*)util::FindEntityByClassname(goal, "info_tfgoal")))
+    /* Goals don't join or leave groups when their state changes, but index anyway to be safe. */
+    for (std::size_t i = 0; i < group.size(); i++)
     {
-        if (goal->GetGroup() == group_no)
+        CTFGoal* goal = group[i];
+
+        switch (state)
         {
-            switch (state)
-            {
-                case TFGS_ACTIVE:
-                    goal->AttemptToActivate(player, nullptr);
-                    break;
-                case TFGS_INACTIVE:
-                    goal->InactivateGoal();
-                    break;
-                case TFGS_RESTORED:
-                    goal->RestoreGoal();
-                    break;
-                case TFGS_REMOVED:
-                    goal->RemoveGoal();
-                    break;
-            }
-            found = true;
+            case TFGS_ACTIVE:
+                goal->AttemptToActivate(player, nullptr);
+                break;
+            case TFGS_INACTIVE:
+                goal->InactivateGoal();
+                break;
+            case TFGS_RESTORED:
+                goal->RestoreGoal();
+                break;
+            case TFGS_REMOVED:
+                goal->RemoveGoal();
+                break;
         }
     }
 
-    if (!found)
+    if (group.empty())
     {
         engine::AlertMessage(at_aiconsole, "Could not find any goals with a group_no of %i\n", group_no);
     }
@@ -194,22 +168,19 @@ void util::SetSpawnGroupActive(int group_no, bool active)
         return;
     }
 
-    bool found = false;
+    const auto& group = g_TFGoalRegistry.GetGroup(CTFGoalRegistry::kSpawns, group_no);
 
-    CTFSpawn* spawn = nullptr;
-    while ((spawn = (CTFSpawn*)util::FindEntityByClassname(spawn, "info_player_teamspawn")))
+    for (auto goal : group)
     {
-        if (spawn->tfv.group_no == group_no)
-        {
-            /* Why, no, this is not intuitive at all! */
-            /* Toodles FIXME: Use TFGS_REMOVED? */
-            spawn->tfv.goal_state = active ? TFGS_INACTIVE : TFGS_ACTIVE;
-            spawn->DebugState();
-            found = true;
-        }
+        CTFSpawn* spawn = (CTFSpawn*)goal;
+
+        /* Why, no, this is not intuitive at all! */
+        /* Toodles FIXME: Use TFGS_REMOVED? */
+        spawn->tfv.goal_state = active ? TFGS_INACTIVE : TFGS_ACTIVE;
+        spawn->DebugState();
     }
 
-    if (!found)
+    if (group.empty())
     {
         engine::AlertMessage(at_aiconsole, "Could not find any spawns with a group_no of %i\n", group_no);
     }
@@ -217,9 +188,12 @@ void util::SetSpawnGroupActive(int group_no, bool active)
 
 void util::GoalDetpackUse(const Vector& origin, CBaseEntity* activator, CBaseEntity* caller)
 {
-    CTFGoal* goal = nullptr;
-    while ((goal = (CTFGoal*)util::FindEntityByClassname(goal, "info_tfgoal")))
+    const auto& goals = g_TFGoalRegistry.GetAll(CTFGoalRegistry::kGoals);
+
+    for (std::size_t i = 0; i < goals.size(); i++)
     {
+        CTFGoal* goal = goals[i];
+
         if (goal->Classify() != CLASS_TFGOAL)
         {
             continue;
@@ -247,6 +221,154 @@ void util::GoalDetpackUse(const Vector& origin, CBaseEntity* activator, CBaseEnt
     }
 }
 
+//==================================================
+// CTFGoalRegistry
+//==================================================
+
+CTFGoalRegistry::List CTFGoalRegistry::GetList(CTFGoal* goal)
+{
+    switch (goal->Classify())
+    {
+        case CLASS_TFGOAL_ITEM:
+            return kItems;
+        case CLASS_TFSPAWN:
+            return kSpawns;
+        default:
+            return kGoals;
+    }
+}
+
+int CTFGoalRegistry::GetStateSlot(const int state)
+{
+    return (state >= TFGS_ACTIVE && state <= TFGS_RESTORED) ? state : 0;
+}
+
+/* Keep the goals in entity index order. */
+void CTFGoalRegistry::Insert(std::vector<CTFGoal*>& goals, CTFGoal* goal)
+{
+    auto it = std::lower_bound(goals.begin(), goals.end(), goal,
+        [](CTFGoal* a, CTFGoal* b) { return &a->v < &b->v; });
+
+    goals.insert(it, goal);
+}
+
+void CTFGoalRegistry::Erase(std::vector<CTFGoal*>& goals, CTFGoal* goal)
+{
+    auto it = std::find(goals.begin(), goals.end(), goal);
+
+    if (it != goals.end())
+    {
+        goals.erase(it);
+    }
+}
+
+void CTFGoalRegistry::Register(CTFGoal* goal)
+{
+    Unregister(goal);
+
+    const auto list = GetList(goal);
+
+    goal->m_iRegisteredList = list;
+    goal->m_iRegisteredNumber = goal->tfv.goal_no;
+    goal->m_iRegisteredGroup = goal->tfv.group_no;
+    goal->m_iCountedState = goal->tfv.goal_state;
+
+    Insert(m_All[list], goal);
+
+    if (goal->m_iRegisteredNumber > 0)
+    {
+        Insert(m_Numbers[list][goal->m_iRegisteredNumber], goal);
+    }
+
+    if (goal->m_iRegisteredGroup > 0)
+    {
+        auto& group = m_Groups[list][goal->m_iRegisteredGroup];
+
+        Insert(group.members, goal);
+        group.inState[GetStateSlot(goal->m_iCountedState)]++;
+    }
+}
+
+void CTFGoalRegistry::Unregister(CTFGoal* goal)
+{
+    if (goal->m_iRegisteredList < 0)
+    {
+        return;
+    }
+
+    const auto list = goal->m_iRegisteredList;
+
+    Erase(m_All[list], goal);
+
+    if (goal->m_iRegisteredNumber > 0)
+    {
+        Erase(m_Numbers[list][goal->m_iRegisteredNumber], goal);
+    }
+
+    if (goal->m_iRegisteredGroup > 0)
+    {
+        auto& group = m_Groups[list][goal->m_iRegisteredGroup];
+
+        Erase(group.members, goal);
+        group.inState[GetStateSlot(goal->m_iCountedState)]--;
+    }
+
+    goal->m_iRegisteredList = -1;
+}
+
+/* Move the goal to its new state in its group's counts. */
+void CTFGoalRegistry::StateChanged(CTFGoal* goal)
+{
+    if (goal->m_iRegisteredList < 0 || goal->m_iRegisteredGroup <= 0)
+    {
+        return;
+    }
+
+    auto& group = m_Groups[goal->m_iRegisteredList][goal->m_iRegisteredGroup];
+
+    group.inState[GetStateSlot(goal->m_iCountedState)]--;
+    group.inState[GetStateSlot(goal->tfv.goal_state)]++;
+
+    goal->m_iCountedState = goal->tfv.goal_state;
+}
+
+/* The first goal with the number, in entity index order. */
+CTFGoal* CTFGoalRegistry::Find(const List list, const int goal_no) const
+{
+    const auto goals = m_Numbers[list].find(goal_no);
+
+    if (goals == m_Numbers[list].end() || goals->second.empty())
+    {
+        return nullptr;
+    }
+
+    return goals->second.front();
+}
+
+const std::vector<CTFGoal*>& CTFGoalRegistry::GetGroup(const List list, const int group_no) const
+{
+    static const std::vector<CTFGoal*> empty;
+
+    const auto group = m_Groups[list].find(group_no);
+
+    return (group != m_Groups[list].end()) ? group->second.members : empty;
+}
+
+/* True if every member of the group is in the state, or the group is empty. */
+bool CTFGoalRegistry::GroupInState(const List list, const int group_no, const TFGoalState state, bool& found) const
+{
+    const auto group = m_Groups[list].find(group_no);
+
+    found = group != m_Groups[list].end() && !group->second.members.empty();
+
+    if (!found)
+    {
+        return true;
+    }
+
+    return group->second.inState[GetStateSlot(state)] == static_cast<int>(group->second.members.size());
+}
+
 //==================================================
 // CTFGoal
 //==================================================
@@ -272,6 +394,22 @@ CTFGoal::CTFGoal(Entity* containingEntity) : CBaseToggle(containingEntity)
 
     m_pPlayer = nullptr;
     m_bAddBonuses = false;
+
+    m_iRegisteredList = -1;
+    m_iRegisteredNumber = 0;
+    m_iRegisteredGroup = 0;
+    m_iCountedState = 0;
+}
+
+CTFGoal::~CTFGoal()
+{
+    g_TFGoalRegistry.Unregister(this);
+}
+
+void CTFGoal::SetGoalState(TFGoalState state)
+{
+    tfv.goal_state = state;
+    g_TFGoalRegistry.StateChanged(this);
 }
 
 bool CTFGoal::KeyValue(KeyValueData* pkvd)
@@ -404,6 +542,8 @@ bool CTFGoal::Spawn()
         v.animtime = gpGlobals->time;
     }
 
+    g_TFGoalRegistry.Register(this);
+
     return true;
 }
 
@@ -1064,12 +1204,13 @@ dead_bonuses:
 
     if (tfv.remove_item_group)
     {
-        goal = nullptr;
+        const auto& group = g_TFGoalRegistry.GetGroup(CTFGoalRegistry::kItems, tfv.remove_item_group);
 
-        while ((goal = (CTFGoalItem*)util::FindEntityByClassname(goal, "item_tfgoal")))
+        for (std::size_t i = 0; i < group.size(); i++)
         {
-            if (goal->GetGroup() == tfv.remove_item_group
-             && goal->v.owner == &activating_player->v)
+            goal = (CTFGoalItem*)group[i];
+
+            if (goal->v.owner == &activating_player->v)
             {
                 goal->RemoveFromPlayer(player, GI_DROP_REMOVEGOAL);
             }
@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include <unordered_map>
+#include <vector>
+
 #include "extdll.h"
 #include "util.h"
 #include "cbase.h"
@@ -16,8 +19,10 @@ class CTFGoal : public CBaseToggle
 {
 public:
     friend class CBasePlayer;
+    friend class CTFGoalRegistry;
 
     CTFGoal(Entity* containingEntity);
+    virtual ~CTFGoal();
 
     virtual bool KeyValue(KeyValueData* pkvd) override;
     virtual void Precache() override;
@@ -57,7 +62,7 @@ protected:
 
 public:
     inline bool InGoalState(TFGoalState state) { return tfv.goal_state == state; }
-    inline void SetGoalState(TFGoalState state) { tfv.goal_state = state; }
+    void SetGoalState(TFGoalState state);
     inline int GetNumber() { return tfv.goal_no; }
     inline int GetGroup() { return tfv.group_no; }
     inline bool HasGoalEffects(int effects) { return (tfv.goal_effects & effects); }
@@ -81,6 +86,13 @@ protected:
 
     CBaseEntity* m_pPlayer;
     bool m_bAddBonuses;
+
+private:
+    /* Where the registry has this goal filed, and the state it was counted in. */
+    int m_iRegisteredList;
+    int m_iRegisteredNumber;
+    int m_iRegisteredGroup;
+    int m_iCountedState;
 };
 
 class CTFGoalTimer : public CTFGoal
@@ -163,3 +175,48 @@ public:
     bool Spawn() override;
     void EXPORT TeamSetUse(CBaseEntity* activator, CBaseEntity* caller, USE_TYPE use_type, float value);
 };
+
+/*
+Goals, items and spawns, filed by goal number and group number when they spawn,
+so triggers don't have to look through every goal on the map to find the ones they affect.
+Each group of goals and items also counts how many of its members are in each state.
+Everything is kept in entity index order, the order the classname searches found them in.
+*/
+class CTFGoalRegistry
+{
+public:
+    enum List
+    {
+        kGoals,     // info_tfgoal, including timers
+        kItems,     // item_tfgoal
+        kSpawns,    // info_player_teamspawn
+        kListCount,
+    };
+
+    void Register(CTFGoal* goal);
+    void Unregister(CTFGoal* goal);
+    void StateChanged(CTFGoal* goal);
+
+    CTFGoal* Find(const List list, const int goal_no) const;
+    const std::vector<CTFGoal*>& GetAll(const List list) const { return m_All[list]; }
+    const std::vector<CTFGoal*>& GetGroup(const List list, const int group_no) const;
+    bool GroupInState(const List list, const int group_no, const TFGoalState state, bool& found) const;
+
+private:
+    struct Group
+    {
+        std::vector<CTFGoal*> members;
+        int inState[TFGS_RESTORED + 1] = {};    // members in each state, with any other state in 0
+    };
+
+    static List GetList(CTFGoal* goal);
+    static int GetStateSlot(const int state);
+    static void Insert(std::vector<CTFGoal*>& goals, CTFGoal* goal);
+    static void Erase(std::vector<CTFGoal*>& goals, CTFGoal* goal);
+
+    std::vector<CTFGoal*> m_All[kListCount];
+    std::unordered_map<int, std::vector<CTFGoal*>> m_Numbers[kListCount];
+    std::unordered_map<int, Group> m_Groups[kListCount];
+};
+
+inline CTFGoalRegistry g_TFGoalRegistry;
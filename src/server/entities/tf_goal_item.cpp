@@ -9,6 +9,9 @@
 #include "player.h"
 #include "game.h"
 #include "gamerules.h"
+#ifdef HALFLIFE_BOTS
+#include "bot/hl_bot_manager.h"
+#endif
 
 //==================================================
 // CTFGoalItem
@@ -204,6 +207,13 @@ void CTFGoalItem::GiveToPlayer(CBaseEntity* player, CTFGoal* activating_goal)
         dynamic_cast<CBasePlayer*>(player)->m_flSpeedReduction = 0.5f;
     }
 
+#ifdef HALFLIFE_BOTS
+    if (g_pBotMan != nullptr)
+    {
+        g_pBotMan->OnEvent(EVENT_FLAG_PICKED_UP, player, this);
+    }
+#endif
+
     if (activating_goal != this && HasGoalResults(TFGR_NO_ITEM_RESULTS))
     {
         SetGoalState(TFGS_ACTIVE);
@@ -237,15 +247,16 @@ void CTFGoalItem::RemoveFromPlayer(CBaseEntity* activating_player, int method)
     v.frame = 0;
     v.animtime = gpGlobals->time;
 
-    CTFGoalItem* goal = nullptr;
     bool remove_glow = IsGoalActivatedBy(TFGI_GLOW);
     bool update_speed = IsGoalActivatedBy(TFGI_SLOW) || (speed_reduction != 0.0F);
     float best_reduction = 0.0F;
     bool let_disguise = HasGoalResults(TFGR_REMOVE_DISGUISE);
     int remove_items = tfv.items;
 
-    while ((goal = (CTFGoalItem*)util::FindEntityByClassname(goal, "item_tfgoal")))
+    for (auto item : g_TFGoalRegistry.GetAll(CTFGoalRegistry::kItems))
     {
+        CTFGoalItem* goal = (CTFGoalItem*)item;
+
         if (goal == this)
         {
             continue;
@@ -499,11 +510,15 @@ void CTFGoalItem::DoItemGroupWork(CBaseEntity* player)
         }
         else
         {
-            CTFGoal* goal = nullptr;
             bool all_carried = true;
             Entity* carrier = nullptr;
-            while ((goal = (CTFGoal*)util::FindEntityByClassname(goal, "item_tfgoal")) && all_carried)
+            for (auto goal : g_TFGoalRegistry.GetGroup(CTFGoalRegistry::kItems, v.speed))
             {
+                if (!all_carried)
+                {
+                    break;
+                }
+
                 if (goal->GetGroup() != v.speed)
                 {
                     continue;
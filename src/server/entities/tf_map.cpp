@@ -357,15 +357,10 @@ bool CTFVars::PlayerMeetsCriteria(CBaseEntity* player)
     {
         if (has_item_from_group)
         {
-            bool got_one = false;
+            const auto& group = g_TFGoalRegistry.GetGroup(CTFGoalRegistry::kItems, has_item_from_group);
 
-            while ((goal = (CTFGoal*)util::FindEntityByClassname(goal, "item_tfgoal")) && !got_one)
-            {
-                if (goal->GetGroup() == has_item_from_group && goal->v.owner == &player->v)
-                {
-                    got_one = true;
-                }
-            }
+            const auto got_one = std::any_of(group.begin(), group.end(),
+                [player](CTFGoal* item) { return item->v.owner == &player->v; });
 
             if (!got_one)
             {
@@ -374,9 +369,11 @@ bool CTFVars::PlayerMeetsCriteria(CBaseEntity* player)
         }
         if (hasnt_item_from_group)
         {
-            while ((goal = (CTFGoal*)util::FindEntityByClassname(goal, "item_tfgoal")))
+            const auto& group = g_TFGoalRegistry.GetGroup(CTFGoalRegistry::kItems, hasnt_item_from_group);
+
+            for (auto item : group)
             {
-                if (goal->GetGroup() == hasnt_item_from_group && goal->v.owner == &player->v)
+                if (item->v.owner == &player->v)
                 {
                     return false;
                 }
@@ -639,6 +636,7 @@ bool CTFSpawn::Spawn()
     SetUse(&CTFGoal::GoalUse);
 
     g_pGameRules->AddPlayerSpawnSpot(this);
+    g_TFGoalRegistry.Register(this);
     return true;
 }
 
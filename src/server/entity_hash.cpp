@@ -0,0 +1,725 @@
+//========= Copyright © 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Spatial hash of the server's entities, for range queries
+//
+// $NoKeywords: $
+//=============================================================================
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "entity_hash.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <random>
+
+static cvar_t sv_entity_hash = {"sv_entity_hash", "1", FCVAR_SERVER};
+
+
+void CEntityHash::RegisterCvars()
+{
+    engine::CVarRegister(&sv_entity_hash);
+
+    engine::AddServerCommand("sv_entity_hash_bench", &CEntityHash::Benchmark);
+}
+
+
+bool CEntityHash::IsEnabled() const
+{
+    return sv_entity_hash.value != 0.0F;
+}
+
+
+/*
+Forget every entity. The hash binds itself to the server's entity list the next time it is used,
+unless another list is given.
+*/
+void CEntityHash::Clear(Entity* list, int maxEntities, int maxClients)
+{
+    m_List = list;
+    m_MaxEntities = maxEntities;
+    m_MaxClients = maxClients;
+
+    m_Records.assign(maxEntities, Record{});
+    m_Seen.assign(maxEntities, 0);
+    m_Stamp = 0;
+
+    for (auto& cell : m_Cells)
+    {
+        cell.clear();
+    }
+    m_Large.clear();
+
+    m_Generation++;
+    m_SphereRadius = -1.0F;
+}
+
+
+bool CEntityHash::Bind()
+{
+    if (m_List == nullptr)
+    {
+        auto list = util::GetEntityList();
+
+        if (list == nullptr)
+        {
+            return false;
+        }
+
+        Clear(list, gpGlobals->maxEntities, gpGlobals->maxClients);
+    }
+
+    return true;
+}
+
+
+int CEntityHash::IndexOf(Entity* entity) const
+{
+    const auto index = static_cast<int>(entity - m_List);
+
+    return (index > 0 && index < m_MaxEntities) ? index : -1;
+}
+
+
+int CEntityHash::CellOf(const float coord)
+{
+    const auto cell = static_cast<int>(std::floor((coord + kGridSize * kCellSize / 2) / kCellSize));
+
+    return std::clamp(cell, 0, kGridSize - 1);
+}
+
+
+/*
+Put the entity in the cells its absolute bounds cover.
+Called whenever the engine links the entity, after its bounds are computed.
+*/
+void CEntityHash::Link(Entity* entity)
+{
+    if (!Bind())
+    {
+        return;
+    }
+
+    const auto index = IndexOf(entity);
+
+    if (index < 0)
+    {
+        return;
+    }
+
+    auto& record = m_Records[index];
+
+    const auto x0 = CellOf(entity->absmin.x);
+    const auto y0 = CellOf(entity->absmin.y);
+    const auto x1 = CellOf(entity->absmax.x);
+    const auto y1 = CellOf(entity->absmax.y);
+
+    /* Nearly every move stays in the same cells. */
+    if (x0 == record.x0 && y0 == record.y0 && x1 == record.x1 && y1 == record.y1)
+    {
+        return;
+    }
+
+    RemoveFromCells(index, record);
+
+    record.x0 = x0;
+    record.y0 = y0;
+    record.x1 = x1;
+    record.y1 = y1;
+
+    if ((x1 - x0 + 1) * (y1 - y0 + 1) > kMaxCellsPerEntity)
+    {
+        record.large = true;
+        m_Large.push_back(index);
+    }
+    else
+    {
+        for (auto y = y0; y <= y1; y++)
+        {
+            for (auto x = x0; x <= x1; x++)
+            {
+                m_Cells[x + y * kGridSize].push_back(index);
+            }
+        }
+    }
+
+    m_Generation++;
+}
+
+
+void CEntityHash::Unlink(Entity* entity)
+{
+    if (m_List == nullptr)
+    {
+        return;
+    }
+
+    const auto index = IndexOf(entity);
+
+    if (index < 0)
+    {
+        return;
+    }
+
+    RemoveFromCells(index, m_Records[index]);
+
+    m_Generation++;
+}
+
+
+/*
+The engine's sphere search skips the edicts of clients that aren't in the game,
+which the game DLL can only follow from ClientPutInServer and ClientDisconnect.
+*/
+void CEntityHash::SetClientActive(Entity* entity, const bool active)
+{
+    if (!Bind())
+    {
+        return;
+    }
+
+    const auto index = IndexOf(entity);
+
+    if (index < 0)
+    {
+        return;
+    }
+
+    m_Records[index].clientActive = active;
+
+    m_Generation++;
+}
+
+
+void CEntityHash::RemoveFromCells(const int index, Record& record)
+{
+    auto remove = [index](std::vector<int>& cell)
+    {
+        auto it = std::find(cell.begin(), cell.end(), index);
+        if (it != cell.end())
+        {
+            *it = cell.back();
+            cell.pop_back();
+        }
+    };
+
+    if (record.large)
+    {
+        remove(m_Large);
+    }
+    else
+    {
+        for (auto y = record.y0; y <= record.y1; y++)
+        {
+            for (auto x = record.x0; x <= record.x1; x++)
+            {
+                remove(m_Cells[x + y * kGridSize]);
+            }
+        }
+    }
+
+    record.x0 = record.y0 = 0;
+    record.x1 = record.y1 = -1;
+    record.large = false;
+}
+
+
+/*
+Find every entity whose cells overlap the box, in entity index order.
+*/
+void CEntityHash::Gather(const Vector& mins, const Vector& maxs, std::vector<int>& candidates)
+{
+    candidates.clear();
+
+    if (++m_Stamp == 0)
+    {
+        std::fill(m_Seen.begin(), m_Seen.end(), 0);
+        m_Stamp = 1;
+    }
+
+    candidates.insert(candidates.end(), m_Large.begin(), m_Large.end());
+
+    const auto x0 = CellOf(mins.x);
+    const auto y0 = CellOf(mins.y);
+    const auto x1 = CellOf(maxs.x);
+    const auto y1 = CellOf(maxs.y);
+
+    for (auto y = y0; y <= y1; y++)
+    {
+        for (auto x = x0; x <= x1; x++)
+        {
+            for (const auto index : m_Cells[x + y * kGridSize])
+            {
+                if (m_Seen[index] != m_Stamp)
+                {
+                    m_Seen[index] = m_Stamp;
+                    candidates.push_back(index);
+                }
+            }
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+}
+
+
+bool CEntityHash::InBox(const Entity* entity, const Vector& mins, const Vector& maxs, int flagMask, bool checkSolid)
+{
+    if (entity->IsFree()) // Not in use
+        return false;
+
+    if (0 != flagMask && (entity->flags & flagMask) == 0) // Does it meet the criteria?
+        return false;
+
+    if (checkSolid && (entity->solid == SOLID_NOT || entity->mins.x == entity->maxs.x))
+        return false;
+
+    if (mins.x > entity->absmax.x ||
+        mins.y > entity->absmax.y ||
+        mins.z > entity->absmax.z ||
+        maxs.x < entity->absmin.x ||
+        maxs.y < entity->absmin.y ||
+        maxs.z < entity->absmin.z)
+        return false;
+
+    return entity->pvPrivateData != nullptr;
+}
+
+
+bool CEntityHash::InMonsterSphere(const Entity* entity, const Vector& center, float radiusSquared)
+{
+    if (entity->IsFree()) // Not in use
+        return false;
+
+    if ((entity->flags & (FL_CLIENT | FL_MONSTER)) == 0) // Not a client/monster ?
+        return false;
+
+    // Use origin for X & Y since they are centered for all monsters
+    float delta = center.x - entity->origin.x;
+    float distance = delta * delta;
+
+    if (distance > radiusSquared)
+        return false;
+
+    delta = center.y - entity->origin.y;
+    distance += delta * delta;
+
+    if (distance > radiusSquared)
+        return false;
+
+    delta = center.z - (entity->absmin.z + entity->absmax.z) * 0.5;
+    distance += delta * delta;
+
+    if (distance > radiusSquared)
+        return false;
+
+    return entity->pvPrivateData != nullptr;
+}
+
+
+/*
+The engine's test, the distance from the center to the nearest point of the absolute bounds.
+*/
+bool CEntityHash::InSphere(const int index, const Vector& center, float radiusSquared) const
+{
+    const auto entity = m_List + index;
+
+    if (entity->IsFree() || entity->classname == 0)
+        return false;
+
+    if (index <= m_MaxClients && !m_Records[index].clientActive)
+        return false;
+
+    float distance = 0.0F;
+
+    for (int i = 0; i < 3; i++)
+    {
+        float delta = 0.0F;
+
+        if (center[i] < entity->absmin[i])
+            delta = center[i] - entity->absmin[i];
+        else if (center[i] > entity->absmax[i])
+            delta = center[i] - entity->absmax[i];
+
+        distance += delta * delta;
+    }
+
+    return distance <= radiusSquared;
+}
+
+
+int CEntityHash::EntitiesInBox(CBaseEntity** list, int listMax, const Vector& mins, const Vector& maxs, int flagMask, bool checkSolid)
+{
+    if (!Bind())
+    {
+        return 0;
+    }
+
+    if (!IsEnabled())
+    {
+        return EntitiesInBoxLinear(list, listMax, mins, maxs, flagMask, checkSolid);
+    }
+
+    return EntitiesInBoxHashed(list, listMax, mins, maxs, flagMask, checkSolid);
+}
+
+
+int CEntityHash::MonstersInSphere(CBaseEntity** list, int listMax, const Vector& center, float radius)
+{
+    if (!Bind())
+    {
+        return 0;
+    }
+
+    if (!IsEnabled())
+    {
+        return MonstersInSphereLinear(list, listMax, center, radius);
+    }
+
+    return MonstersInSphereHashed(list, listMax, center, radius);
+}
+
+
+int CEntityHash::EntitiesInBoxHashed(CBaseEntity** list, int listMax, const Vector& mins, const Vector& maxs, int flagMask, bool checkSolid)
+{
+    Gather(mins, maxs, m_Candidates);
+
+    int count = 0;
+
+    for (const auto index : m_Candidates)
+    {
+        const auto entity = m_List + index;
+
+        if (!InBox(entity, mins, maxs, flagMask, checkSolid))
+            continue;
+
+        list[count] = entity->Get<CBaseEntity>();
+        count++;
+
+        if (count >= listMax)
+            break;
+    }
+
+    return count;
+}
+
+
+int CEntityHash::MonstersInSphereHashed(CBaseEntity** list, int listMax, const Vector& center, float radius)
+{
+    const Vector extents{radius, radius, radius};
+
+    Gather(center - extents, center + extents, m_Candidates);
+
+    const auto radiusSquared = radius * radius;
+    int count = 0;
+
+    for (const auto index : m_Candidates)
+    {
+        const auto entity = m_List + index;
+
+        if (!InMonsterSphere(entity, center, radiusSquared))
+            continue;
+
+        list[count] = entity->Get<CBaseEntity>();
+        count++;
+
+        if (count >= listMax)
+            break;
+    }
+
+    return count;
+}
+
+
+/*
+Return the first entity after 'start' that is within 'radius' of 'center', or null if there are no more.
+*/
+Entity* CEntityHash::FindEntityInSphere(Entity* start, const Vector& center, float radius)
+{
+    if (!Bind())
+    {
+        return nullptr;
+    }
+
+    if (m_SphereGeneration != m_Generation || m_SphereCenter != center || m_SphereRadius != radius)
+    {
+        const Vector extents{radius, radius, radius};
+
+        Gather(center - extents, center + extents, m_SphereCandidates);
+
+        m_SphereCenter = center;
+        m_SphereRadius = radius;
+        m_SphereGeneration = m_Generation;
+    }
+
+    const auto startIndex = (start != nullptr) ? static_cast<int>(start - m_List) : 0;
+    const auto radiusSquared = radius * radius;
+
+    auto it = std::upper_bound(m_SphereCandidates.begin(), m_SphereCandidates.end(), startIndex);
+
+    for (; it != m_SphereCandidates.end(); ++it)
+    {
+        if (InSphere(*it, center, radiusSquared))
+        {
+            return m_List + *it;
+        }
+    }
+
+    return nullptr;
+}
+
+
+int CEntityHash::EntitiesInBoxLinear(CBaseEntity** list, int listMax, const Vector& mins, const Vector& maxs, int flagMask, bool checkSolid)
+{
+    int count = 0;
+
+    // Ignore world.
+    for (int i = 1; i < m_MaxEntities; i++)
+    {
+        const auto entity = m_List + i;
+
+        if (!InBox(entity, mins, maxs, flagMask, checkSolid))
+            continue;
+
+        list[count] = entity->Get<CBaseEntity>();
+        count++;
+
+        if (count >= listMax)
+            break;
+    }
+
+    return count;
+}
+
+
+int CEntityHash::MonstersInSphereLinear(CBaseEntity** list, int listMax, const Vector& center, float radius)
+{
+    const auto radiusSquared = radius * radius;
+    int count = 0;
+
+    // Ignore world.
+    for (int i = 1; i < m_MaxEntities; i++)
+    {
+        const auto entity = m_List + i;
+
+        if (!InMonsterSphere(entity, center, radiusSquared))
+            continue;
+
+        list[count] = entity->Get<CBaseEntity>();
+        count++;
+
+        if (count >= listMax)
+            break;
+    }
+
+    return count;
+}
+
+
+/*
+What the engine's search does, so the benchmark can compare against it.
+*/
+Entity* CEntityHash::FindEntityInSphereLinear(Entity* start, const Vector& center, float radius)
+{
+    const auto radiusSquared = radius * radius;
+
+    for (int i = (start != nullptr) ? static_cast<int>(start - m_List) + 1 : 1; i < m_MaxEntities; i++)
+    {
+        if (InSphere(i, center, radiusSquared))
+        {
+            return m_List + i;
+        }
+    }
+
+    return nullptr;
+}
+
+
+/*
+Time every query against a linear scan of a made-up world of 1500 entities,
+and check that both give the same answers.
+*/
+void CEntityHash::Benchmark()
+{
+    constexpr int kEntityCount = 1500;
+    constexpr int kQueryCount = 2000;
+    constexpr int kListMax = 256;
+
+    std::vector<Entity> world(kEntityCount);
+    auto hash = std::make_unique<CEntityHash>();
+
+    std::mt19937 random{kEntityCount};
+    auto randomFloat = [&random](const float low, const float high)
+    {
+        return std::uniform_real_distribution<float>{low, high}(random);
+    };
+
+    /* Players and monsters, items and projectiles, triggers, point entities, and a few large brushes. */
+    for (int i = 1; i < kEntityCount; i++)
+    {
+        auto& entity = world[i];
+
+        entity.classname = 1;
+        entity.pvPrivateData = &entity;
+        entity.origin = Vector{randomFloat(-3000, 3000), randomFloat(-3000, 3000), randomFloat(-500, 500)};
+
+        const auto kind = i % 10;
+
+        if (kind == 5)
+        {
+            entity.free = 1;
+        }
+        else if (kind < 2)
+        {
+            entity.flags = (kind == 0) ? FL_CLIENT : FL_MONSTER;
+            entity.solid = SOLID_SLIDEBOX;
+            entity.mins = Vector{-16, -16, -36};
+            entity.maxs = Vector{16, 16, 36};
+        }
+        else if (kind < 8)
+        {
+            entity.flags = (kind == 2) ? FL_ONGROUND : 0;
+            entity.solid = (kind < 5) ? SOLID_TRIGGER : SOLID_BBOX;
+            entity.mins = Vector{-8, -8, 0};
+            entity.maxs = Vector{8, 8, 16};
+        }
+        else if (i % 100 == 9)
+        {
+            entity.solid = SOLID_BSP;
+            entity.mins = Vector{-randomFloat(200, 1500), -randomFloat(200, 1500), -64};
+            entity.maxs = -entity.mins;
+        }
+        else
+        {
+            entity.solid = SOLID_NOT;
+        }
+
+        entity.absmin = entity.origin + entity.mins - Vector{1, 1, 1};
+        entity.absmax = entity.origin + entity.maxs + Vector{1, 1, 1};
+    }
+
+    hash->Clear(world.data(), kEntityCount, 0);
+
+    for (int i = 1; i < kEntityCount; i++)
+    {
+        hash->Link(&world[i]);
+    }
+
+    std::vector<Vector> centers(kQueryCount);
+    std::vector<float> sizes(kQueryCount);
+
+    for (int i = 0; i < kQueryCount; i++)
+    {
+        centers[i] = Vector{randomFloat(-3200, 3200), randomFloat(-3200, 3200), randomFloat(-600, 600)};
+        sizes[i] = randomFloat(48, 600);
+    }
+
+    CBaseEntity* list[kListMax];
+    CBaseEntity* expected[kListMax];
+
+    auto box = [&](const int i, CBaseEntity** results, const bool hashed)
+    {
+        const Vector extents{sizes[i], sizes[i], sizes[i]};
+        return hashed
+            ? hash->EntitiesInBoxHashed(results, kListMax, centers[i] - extents, centers[i] + extents, 0, true)
+            : hash->EntitiesInBoxLinear(results, kListMax, centers[i] - extents, centers[i] + extents, 0, true);
+    };
+
+    auto monsters = [&](const int i, CBaseEntity** results, const bool hashed)
+    {
+        return hashed
+            ? hash->MonstersInSphereHashed(results, kListMax, centers[i], sizes[i])
+            : hash->MonstersInSphereLinear(results, kListMax, centers[i], sizes[i]);
+    };
+
+    auto sphere = [&](const int i, CBaseEntity** results, const bool hashed)
+    {
+        int count = 0;
+        Entity* entity = nullptr;
+
+        while ((entity = hashed
+            ? hash->FindEntityInSphere(entity, centers[i], sizes[i])
+            : hash->FindEntityInSphereLinear(entity, centers[i], sizes[i])) != nullptr)
+        {
+            if (count < kListMax)
+            {
+                results[count++] = entity->Get<CBaseEntity>();
+            }
+        }
+
+        return count;
+    };
+
+    auto run = [&](const char* name, auto&& query)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        double elapsed[2];
+        int found = 0;
+
+        for (int pass = 0; pass < 2; pass++)
+        {
+            const auto start = Clock::now();
+
+            for (int i = 0; i < kQueryCount; i++)
+            {
+                found += query(i, list, pass != 0);
+            }
+
+            elapsed[pass] = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+        }
+
+        int mismatches = 0;
+
+        for (int i = 0; i < kQueryCount; i++)
+        {
+            const auto count = query(i, expected, false);
+
+            if (query(i, list, true) != count || !std::equal(list, list + count, expected))
+            {
+                mismatches++;
+            }
+        }
+
+        engine::ServerPrint(util::VarArgs("%-18s %8.2f us linear  %8.2f us hashed  %6.1f found  %d mismatches\n",
+            name, elapsed[0] / kQueryCount, elapsed[1] / kQueryCount, found / (2.0F * kQueryCount), mismatches));
+    };
+
+    engine::ServerPrint(util::VarArgs("%d entities, %d queries each, %d large entities\n",
+        kEntityCount, kQueryCount, static_cast<int>(hash->m_Large.size())));
+
+    run("EntitiesInBox", box);
+    run("MonstersInSphere", monsters);
+    run("FindEntityInSphere", sphere);
+
+    /* A frame of movement: every player and monster moves, and is linked again. */
+    int moveCount = 0;
+    const auto moveStart = std::chrono::steady_clock::now();
+
+    for (int i = 1; i < kEntityCount; i++)
+    {
+        auto& entity = world[i];
+
+        if (entity.free != 0 || (entity.flags & (FL_CLIENT | FL_MONSTER)) == 0)
+            continue;
+
+        const Vector move{randomFloat(-64, 64), randomFloat(-64, 64), 0};
+
+        entity.origin = entity.origin + move;
+        entity.absmin = entity.absmin + move;
+        entity.absmax = entity.absmax + move;
+
+        hash->Link(&entity);
+        moveCount++;
+    }
+
+    const auto moveTime = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - moveStart).count();
+
+    engine::ServerPrint(util::VarArgs("Moved %d entities, %.3f us per link\n", moveCount, moveTime / moveCount));
+
+    run("EntitiesInBox", box);
+    run("MonstersInSphere", monsters);
+    run("FindEntityInSphere", sphere);
+}
@@ -0,0 +1,95 @@
+//========= Copyright © 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Spatial hash of the server's entities, for range queries
+//
+// $NoKeywords: $
+//=============================================================================
+
+#pragma once
+
+#include <vector>
+
+class CBaseEntity;
+
+
+/**
+ * A uniform grid over the XY plane that every linked entity is bucketed into by its absolute bounds.
+ * The engine tells the game DLL whenever it links an entity, to compute its absolute bounds,
+ * so the grid is kept current as entities move, without ever looking at the whole entity list.
+ * Entities that cover too many cells, like large brush entities, are kept in one list checked by every query.
+ * Queries gather the entities in the cells they overlap, test them exactly as the linear scans
+ * did, and return them in entity index order, so callers get the same results as before.
+ */
+class CEntityHash
+{
+public:
+    static void RegisterCvars();
+
+    bool IsEnabled() const;
+
+    void Clear(Entity* list = nullptr, int maxEntities = 0, int maxClients = 0);
+    void Link(Entity* entity);
+    void Unlink(Entity* entity);
+    void SetClientActive(Entity* entity, const bool active);
+
+    int EntitiesInBox(CBaseEntity** list, int listMax, const Vector& mins, const Vector& maxs, int flagMask, bool checkSolid);
+    int MonstersInSphere(CBaseEntity** list, int listMax, const Vector& center, float radius);
+    Entity* FindEntityInSphere(Entity* start, const Vector& center, float radius);
+
+    static void Benchmark();
+
+private:
+    static constexpr int kCellSize = 128;
+    static constexpr int kGridSize = 64;                // cells on a side, covering the +/-4096 unit world
+    static constexpr int kMaxCellsPerEntity = 16;       // entities covering more cells than this go in m_Large
+
+    struct Record
+    {
+        short x0 = 0, y0 = 0, x1 = -1, y1 = -1;         // the cells the entity is in, empty if it is not
+        bool large = false;
+        bool clientActive = false;
+    };
+
+    bool Bind();
+    int IndexOf(Entity* entity) const;
+    static int CellOf(const float coord);
+
+    void RemoveFromCells(const int index, Record& record);
+    void Gather(const Vector& mins, const Vector& maxs, std::vector<int>& candidates);
+
+    int EntitiesInBoxHashed(CBaseEntity** list, int listMax, const Vector& mins, const Vector& maxs, int flagMask, bool checkSolid);
+    int MonstersInSphereHashed(CBaseEntity** list, int listMax, const Vector& center, float radius);
+
+    int EntitiesInBoxLinear(CBaseEntity** list, int listMax, const Vector& mins, const Vector& maxs, int flagMask, bool checkSolid);
+    int MonstersInSphereLinear(CBaseEntity** list, int listMax, const Vector& center, float radius);
+    Entity* FindEntityInSphereLinear(Entity* start, const Vector& center, float radius);
+
+    static bool InBox(const Entity* entity, const Vector& mins, const Vector& maxs, int flagMask, bool checkSolid);
+    static bool InMonsterSphere(const Entity* entity, const Vector& center, float radiusSquared);
+    bool InSphere(const int index, const Vector& center, float radiusSquared) const;
+
+    Entity* m_List = nullptr;
+    int m_MaxEntities = 0;
+    int m_MaxClients = 0;
+
+    std::vector<Record> m_Records;                      // by entity index
+    std::vector<int> m_Cells[kGridSize * kGridSize];    // entity indices
+    std::vector<int> m_Large;
+
+    /* Marks the entities a query has already gathered, since one can be in many cells. */
+    std::vector<unsigned int> m_Seen;
+    unsigned int m_Stamp = 0;
+    std::vector<int> m_Candidates;
+
+    /*
+    FindEntityInSphere is called once per result, so the candidates of the last sphere are kept
+    for as long as no entity changes cells.
+    */
+    unsigned int m_Generation = 0;
+    std::vector<int> m_SphereCandidates;
+    Vector m_SphereCenter;
+    float m_SphereRadius = -1.0F;
+    unsigned int m_SphereGeneration = 0;
+};
+
+inline CEntityHash g_EntityHash;
@@ -0,0 +1,253 @@
+//========= Copyright © 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Index of the server's entities by classname and targetname
+//
+// $NoKeywords: $
+//=============================================================================
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "entity_names.h"
+#include <algorithm>
+
+static cvar_t sv_entity_names = {"sv_entity_names", "1", FCVAR_SERVER};
+
+
+void CEntityNameIndex::RegisterCvars()
+{
+    engine::CVarRegister(&sv_entity_names);
+}
+
+
+bool CEntityNameIndex::IsEnabled() const
+{
+    return sv_entity_names.value != 0.0F;
+}
+
+
+/*
+Return true if 'key' is one of the fields the index is kept for.
+*/
+bool CEntityNameIndex::GetField(const char* key, Field& field)
+{
+    if (streq(key, "classname"))
+    {
+        field = kClassname;
+        return true;
+    }
+
+    if (streq(key, "targetname"))
+    {
+        field = kTargetname;
+        return true;
+    }
+
+    return false;
+}
+
+
+/*
+Forget every entity, when the level ends.
+*/
+void CEntityNameIndex::Clear()
+{
+    m_List = nullptr;
+    m_MaxEntities = 0;
+
+    m_Records.clear();
+    m_Fresh.clear();
+
+    for (auto& names : m_Names)
+    {
+        names.clear();
+    }
+}
+
+
+bool CEntityNameIndex::Bind()
+{
+    if (m_List == nullptr)
+    {
+        m_List = util::GetEntityList();
+
+        if (m_List == nullptr)
+        {
+            return false;
+        }
+
+        m_MaxEntities = gpGlobals->maxEntities;
+        m_Records.assign(m_MaxEntities, Record{});
+    }
+
+    return true;
+}
+
+
+int CEntityNameIndex::IndexOf(Entity* entity) const
+{
+    const auto index = static_cast<int>(entity - m_List);
+
+    return (index > 0 && index < m_MaxEntities) ? index : -1;
+}
+
+
+/*
+Called when the game DLL's object for the entity is created.
+*/
+void CEntityNameIndex::Created(Entity* entity)
+{
+    if (!Bind())
+    {
+        return;
+    }
+
+    const auto index = IndexOf(entity);
+
+    if (index < 0 || m_Records[index].fresh)
+    {
+        return;
+    }
+
+    m_Records[index].fresh = true;
+    m_Fresh.push_back(index);
+}
+
+
+/*
+File the entity under its current names.
+*/
+void CEntityNameIndex::Update(Entity* entity)
+{
+    if (!Bind())
+    {
+        return;
+    }
+
+    const auto index = IndexOf(entity);
+
+    if (index >= 0)
+    {
+        File(index);
+    }
+}
+
+
+/*
+File the entities created since the last frame under their names.
+*/
+void CEntityNameIndex::Update()
+{
+    if (m_List == nullptr)
+    {
+        return;
+    }
+
+    for (const auto index : m_Fresh)
+    {
+        File(index);
+        m_Records[index].fresh = false;
+    }
+
+    m_Fresh.clear();
+}
+
+
+void CEntityNameIndex::File(const int index)
+{
+    const auto entity = m_List + index;
+    auto& record = m_Records[index];
+
+    for (int field = 0; field < kFieldCount; field++)
+    {
+        const auto name = entity->IsFree() ? 0 : GetName(entity, static_cast<Field>(field));
+
+        if (name == record.name[field])
+        {
+            continue;
+        }
+
+        auto& names = m_Names[field];
+
+        if (record.name[field] != 0)
+        {
+            const auto old = names.find(STRING(record.name[field]));
+
+            if (old != names.end())
+            {
+                auto& list = old->second;
+                auto it = std::lower_bound(list.begin(), list.end(), index);
+
+                if (it != list.end() && *it == index)
+                {
+                    list.erase(it);
+                }
+            }
+        }
+
+        if (name != 0)
+        {
+            auto& list = names[STRING(name)];
+            list.insert(std::lower_bound(list.begin(), list.end(), index), index);
+        }
+
+        record.name[field] = name;
+    }
+}
+
+
+bool CEntityNameIndex::Matches(const int index, const Field field, const char* value) const
+{
+    const auto entity = m_List + index;
+
+    if (entity->IsFree())
+    {
+        return false;
+    }
+
+    const auto name = GetName(entity, field);
+
+    return name != 0 && streq(STRING(name), value);
+}
+
+
+/*
+Return the first entity after 'start' whose 'field' is 'value'.
+Like the engine's search, the world is returned if there are no more.
+*/
+Entity* CEntityNameIndex::Find(Entity* start, const Field field, const char* value)
+{
+    if (value == nullptr || !Bind())
+    {
+        return nullptr;
+    }
+
+    const auto startIndex = (start != nullptr) ? static_cast<int>(start - m_List) : 0;
+    auto found = m_MaxEntities;
+
+    const auto names = m_Names[field].find(value);
+
+    if (names != m_Names[field].end())
+    {
+        const auto& list = names->second;
+
+        for (auto it = std::upper_bound(list.begin(), list.end(), startIndex); it != list.end(); ++it)
+        {
+            if (Matches(*it, field, value))
+            {
+                found = *it;
+                break;
+            }
+        }
+    }
+
+    for (const auto index : m_Fresh)
+    {
+        if (index > startIndex && index < found && Matches(index, field, value))
+        {
+            found = index;
+        }
+    }
+
+    return (found < m_MaxEntities) ? m_List + found : m_List;
+}
@@ -0,0 +1,75 @@
+//========= Copyright © 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Index of the server's entities by classname and targetname
+//
+// $NoKeywords: $
+//=============================================================================
+
+#pragma once
+
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+ * Lists the entities with each classname and targetname, in entity index order, so finding
+ * the targets of a trigger no longer compares the name of every entity on the server.
+ * Entities created since the start of the frame are kept in a short list and checked by every
+ * search, since their names are usually set after they are created, often outside of spawning.
+ * At the start of each frame, and whenever a name is set by a keyvalue, they are filed under their names.
+ * Every entity found is checked against its current name, so the searches return exactly
+ * what the engine's search would.
+ * Code that renames an entity that already exists, without a keyvalue, must call Update() on it.
+ */
+class CEntityNameIndex
+{
+public:
+    enum Field
+    {
+        kClassname,
+        kTargetname,
+        kFieldCount,
+    };
+
+    static void RegisterCvars();
+    static bool GetField(const char* key, Field& field);
+
+    bool IsEnabled() const;
+
+    void Clear();
+    void Created(Entity* entity);
+    void Update(Entity* entity);
+    void Update();
+
+    Entity* Find(Entity* start, const Field field, const char* value);
+
+private:
+    struct Record
+    {
+        string_t name[kFieldCount] = {};    // the names the entity is filed under
+        bool fresh = false;
+    };
+
+    bool Bind();
+    int IndexOf(Entity* entity) const;
+    bool Matches(const int index, const Field field, const char* value) const;
+
+    static string_t GetName(const Entity* entity, const Field field)
+    {
+        return (field == kClassname) ? entity->classname : entity->targetname;
+    }
+
+    void File(const int index);
+
+    Entity* m_List = nullptr;
+    int m_MaxEntities = 0;
+
+    std::vector<Record> m_Records;          // by entity index
+    std::vector<int> m_Fresh;               // entities created this frame
+
+    /* The keys point into the string table, which lasts until the level ends. */
+    std::unordered_map<std::string_view, std::vector<int>> m_Names[kFieldCount];
+};
+
+inline CEntityNameIndex g_EntityNames;
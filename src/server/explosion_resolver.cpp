@@ -0,0 +1,265 @@
+//========= Copyright © 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Radius damage, with line of effect traces shared between explosions
+//
+// $NoKeywords: $
+//=============================================================================
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "explosion_resolver.h"
+#include <algorithm>
+#include <cmath>
+
+static cvar_t sv_explosion_cache = {"sv_explosion_cache", "1", FCVAR_SERVER};
+
+
+void CExplosionResolver::RegisterCvars()
+{
+    engine::CVarRegister(&sv_explosion_cache);
+
+    engine::AddServerCommand("sv_explosion_stats", []()
+        { g_ExplosionResolver.PrintStats(); });
+}
+
+
+void CExplosionResolver::Clear()
+{
+    m_Time = -1.0F;
+    m_Traces.clear();
+    m_Origins.clear();
+}
+
+
+std::uint64_t CExplosionResolver::GetKey(const Vector& origin, const int index)
+{
+    const auto x = static_cast<std::uint16_t>(static_cast<int>(std::floor(origin.x / kCellSize)));
+    const auto y = static_cast<std::uint16_t>(static_cast<int>(std::floor(origin.y / kCellSize)));
+    const auto z = static_cast<std::uint16_t>(static_cast<int>(std::floor(origin.z / kCellSize)));
+
+    return static_cast<std::uint64_t>(x)
+        | (static_cast<std::uint64_t>(y) << 16)
+        | (static_cast<std::uint64_t>(z) << 32)
+        | (static_cast<std::uint64_t>(index) << 48);
+}
+
+
+/*
+Find the origin the explosion at 'origin' can share traces from, the first explosion in its cell.
+Return false if nothing can be shared, because it is too far from it or something solid is in between.
+*/
+bool CExplosionResolver::GetSharedOrigin(const Vector& origin, CBaseEntity* inflictor, Vector& shared)
+{
+    if (sv_explosion_cache.value == 0.0F)
+    {
+        return false;
+    }
+
+    const auto first = m_Origins.emplace(GetKey(origin, 0), origin);
+
+    shared = first.first->second;
+
+    if (first.second || shared == origin)
+    {
+        return true;
+    }
+
+    if ((origin - shared).LengthSquared() > kShareDistance * kShareDistance)
+    {
+        m_BlockedCount++;
+        return false;
+    }
+
+    /* Only the world and brush entities matter here, not the other grenades. */
+    TraceResult tr;
+    util::TraceLine(origin, shared, util::ignore_monsters, inflictor, &tr);
+
+    m_SightCount++;
+
+    if (tr.fAllSolid || tr.fStartSolid || tr.flFraction != 1.0F)
+    {
+        m_BlockedCount++;
+        return false;
+    }
+
+    return true;
+}
+
+
+/*
+Return true if the remembered trace would have gone the same way for an explosion by 'inflictor'.
+The trace passed through its own inflictor, so that must have gone since, unless it is this one,
+and this explosion's inflictor, which its own trace passes through, mustn't have stopped it.
+*/
+bool CExplosionResolver::CanShare(const Trace& trace, CBaseEntity* inflictor)
+{
+    const auto self = (inflictor != nullptr) ? &inflictor->v : nullptr;
+
+    if (trace.hit != nullptr && trace.hit == self)
+    {
+        return false;
+    }
+
+    if (trace.inflictor == nullptr || trace.inflictor == self)
+    {
+        return true;
+    }
+
+    return trace.inflictor->IsFree()
+        || trace.inflictor->GetSerialNumber() != trace.inflictorSerialNumber
+        || trace.inflictor->solid == SOLID_NOT;
+}
+
+
+/*
+Return true if nothing stands between an explosion at 'origin' and 'target' on 'entity'.
+'end' is set to where the trace stopped.
+If 'share' is set, a trace made from 'shared' may be used instead,
+and the trace is kept for other explosions if it was made from there.
+*/
+bool CExplosionResolver::LineOfEffect(const Vector& origin, const bool share, const Vector& shared,
+    CBaseEntity* inflictor, CBaseEntity* entity, const Vector& target, Vector& end)
+{
+    const auto ignoreOwner = (inflictor != nullptr) ? inflictor->v.owner : nullptr;
+    Trace* cached = nullptr;
+
+    if (share)
+    {
+        cached = &m_Traces[GetKey(shared, entity->v.GetIndex())];
+
+        if (cached->serialNumber == entity->v.GetSerialNumber()
+         && cached->origin == shared
+         && cached->target == target
+         && cached->ignoreOwner == ignoreOwner
+         && CanShare(*cached, inflictor))
+        {
+            m_SharedCount++;
+            end = cached->end;
+            return cached->reached;
+        }
+    }
+
+    TraceResult tr;
+    util::TraceLine(origin, target, &tr, inflictor, util::kTraceBox);
+
+    m_TraceCount++;
+
+    const auto reached = tr.flFraction == 1.0F || tr.pHit == &entity->v;
+
+    end = tr.vecEndPos;
+
+    /* Only traces from the shared origin itself are any use to the others. */
+    if (cached != nullptr && origin == shared)
+    {
+        cached->serialNumber = entity->v.GetSerialNumber();
+        cached->origin = shared;
+        cached->target = target;
+        cached->ignoreOwner = ignoreOwner;
+        cached->inflictor = (inflictor != nullptr) ? &inflictor->v : nullptr;
+        cached->inflictorSerialNumber = (inflictor != nullptr) ? inflictor->v.GetSerialNumber() : 0;
+        cached->hit = tr.pHit;
+        cached->reached = reached;
+        cached->end = end;
+    }
+
+    return reached;
+}
+
+
+/*
+Damage everything within 'radius' of 'origin' that the explosion can reach.
+The damage falls off from 'damageMax' at the origin to 'damageMin' at the edge.
+*/
+void CExplosionResolver::RadiusDamage(const Vector& origin, CBaseEntity* inflictor, CBaseEntity* attacker,
+    const float damageMax, const float damageMin, const float radius, const int damageType)
+{
+    /* Traces only hold for the frame they were made in. */
+    if (m_Time != gpGlobals->time)
+    {
+        m_Traces.clear();
+        m_Origins.clear();
+        m_Time = gpGlobals->time;
+    }
+
+    m_ExplosionCount++;
+
+    Vector shared;
+    const auto canShare = GetSharedOrigin(origin, inflictor, shared);
+
+    const float damageFalloff = damageMin - damageMax;
+    const auto first = m_Targets.size();
+    CBaseEntity* entity = nullptr;
+
+    while ((entity = util::FindEntityInSphere(entity, origin, radius)) != nullptr)
+    {
+        if (entity->v.takedamage == DAMAGE_NO)
+        {
+            continue;
+        }
+
+        m_CandidateCount++;
+
+        const auto isBrush = entity->IsBSPModel();
+
+        const auto eyes = isBrush ? entity->Center() : entity->EyePosition();
+
+        Vector end;
+
+        if (!LineOfEffect(origin, canShare && !isBrush, shared, inflictor, entity, eyes, end))
+        {
+            continue;
+        }
+
+        const auto center = isBrush ? end : entity->BodyTarget();
+
+        auto adjusted = (origin - center).Length() / radius;
+        adjusted = std::max(damageMax + damageFalloff * adjusted, 0.0F);
+
+        Target target;
+        target.entity = entity;
+        target.damage = adjusted;
+        m_Targets.push_back(target);
+    }
+
+    const auto last = m_Targets.size();
+
+    /* Dealing damage may set off more explosions, which add their own targets after ours. */
+    for (auto i = first; i < last; i++)
+    {
+        auto target = m_Targets[i];
+        CBaseEntity* victim = target.entity;
+
+        if (victim != nullptr)
+        {
+            victim->TakeDamage(inflictor, attacker, target.damage, damageType);
+            m_DamageCount++;
+        }
+    }
+
+    m_Targets.resize(first);
+}
+
+
+void CExplosionResolver::PrintStats()
+{
+    const auto lookups = m_TraceCount + m_SharedCount;
+    const auto shareRate = (lookups != 0) ? 100.0F * m_SharedCount / lookups : 0.0F;
+
+    engine::ServerPrint(util::VarArgs("Explosions: %u explosions, %u entities in range, %u damaged\n",
+        m_ExplosionCount, m_CandidateCount, m_DamageCount));
+
+    engine::ServerPrint(util::VarArgs("Explosions: %u traces, %u shared with an earlier explosion (%.1f%%)\n",
+        m_TraceCount, m_SharedCount, shareRate));
+
+    engine::ServerPrint(util::VarArgs("Explosions: %u traces between explosions, %u could not share\n",
+        m_SightCount, m_BlockedCount));
+
+    m_ExplosionCount = 0;
+    m_CandidateCount = 0;
+    m_TraceCount = 0;
+    m_SharedCount = 0;
+    m_SightCount = 0;
+    m_BlockedCount = 0;
+    m_DamageCount = 0;
+}
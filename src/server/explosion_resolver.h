@@ -0,0 +1,87 @@
+//========= Copyright © 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Radius damage, with line of effect traces shared between explosions
+//
+// $NoKeywords: $
+//=============================================================================
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class CBaseEntity;
+
+
+/**
+ * Deals radius damage in two passes: every entity in range is found and traced to first,
+ * then all of the damage is dealt, so nothing the damage does can change who else is hit.
+ * The traces are remembered for the rest of the frame by the small cell the explosion was in
+ * and the entity traced to. Only the traces of the first explosion in the cell are remembered.
+ * A later explosion shares them only if it is within a few units of the first and nothing solid
+ * stands between the two, which costs it one trace, so a volley of pipebombs traces each entity
+ * about once between them, but two on either side of a thin wall don't. Other explosions trace from their own origin.
+ * A remembered trace is only used while its entity has not moved, for inflictors with the same owner,
+ * once the inflictor it passed through has gone, and if it wasn't stopped by the later explosion's inflictor.
+ * Traces to brush entities are never shared, since their distance is measured to where the trace hit them.
+ */
+class CExplosionResolver
+{
+public:
+    static void RegisterCvars();
+
+    void RadiusDamage(const Vector& origin, CBaseEntity* inflictor, CBaseEntity* attacker,
+        const float damageMax, const float damageMin, const float radius, const int damageType);
+
+    void Clear();
+
+    void PrintStats();
+
+private:
+    static constexpr float kCellSize = 8.0F;
+    static constexpr float kShareDistance = 4.0F;    // explosions further than this from the first in their cell trace for themselves
+
+    struct Trace
+    {
+        int serialNumber = -1;  // of the entity traced to
+        Vector origin;          // the point traced from
+        Vector target;          // the point traced to
+        Entity* ignoreOwner;    // the owner of the inflictor, which traces pass through
+        Entity* inflictor;      // the inflictor, which traces pass through too
+        int inflictorSerialNumber;
+        Entity* hit;            // what stopped the trace, if anything
+        bool reached;           // nothing was in the way
+        Vector end;
+    };
+
+    struct Target
+    {
+        EHANDLE entity;
+        float damage;
+    };
+
+    bool GetSharedOrigin(const Vector& origin, CBaseEntity* inflictor, Vector& shared);
+    static bool CanShare(const Trace& trace, CBaseEntity* inflictor);
+    bool LineOfEffect(const Vector& origin, const bool share, const Vector& shared,
+        CBaseEntity* inflictor, CBaseEntity* entity, const Vector& target, Vector& end);
+
+    static std::uint64_t GetKey(const Vector& origin, const int index);
+
+    float m_Time = -1.0F;
+    std::unordered_map<std::uint64_t, Trace> m_Traces;
+    std::unordered_map<std::uint64_t, Vector> m_Origins;    // of the first explosion in each cell, by GetKey(origin, 0)
+
+    /* The entities to damage, of this explosion and any it sets off. */
+    std::vector<Target> m_Targets;
+
+    unsigned int m_ExplosionCount = 0;
+    unsigned int m_CandidateCount = 0;      // entities in range that can take damage
+    unsigned int m_TraceCount = 0;
+    unsigned int m_SharedCount = 0;         // traces made by an earlier explosion
+    unsigned int m_SightCount = 0;          // traces between explosions, to see if they can share
+    unsigned int m_BlockedCount = 0;        // explosions too far from or out of sight of the first one in their cell
+    unsigned int m_DamageCount = 0;         // entities damaged
+};
+
+inline CExplosionResolver g_ExplosionResolver;
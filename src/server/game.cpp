@@ -23,6 +23,11 @@
 #endif
 #include "steam_utils.h"
 #include "vote_manager.h"
+#include "visibility_cache.h"
+#include "entity_hash.h"
+#include "entity_names.h"
+#include "lag_compensation.h"
+#include "explosion_resolver.h"
 
 // multiplayer server rules
 cvar_t teamplay = {"mp_teamplay", "0", FCVAR_SERVER};
@@ -97,6 +102,11 @@ void GameDLLInit()
 	engine::CVarRegister(&mp_chattime);
 
 	CVoteManager::RegisterCvars();
+	CVisibilityCache::RegisterCvars();
+	CEntityHash::RegisterCvars();
+	CEntityNameIndex::RegisterCvars();
+	CLagCompensation::RegisterCvars();
+	CExplosionResolver::RegisterCvars();
 
 #ifdef HALFLIFE_BOTS
 	Bot_RegisterCvars();
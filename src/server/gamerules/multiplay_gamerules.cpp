@@ -29,6 +29,9 @@
 #include "vote_manager.h"
 #include "hltv.h"
 #include "UserMessages.h"
+#ifdef HALFLIFE_BOTS
+#include "bot/hl_bot_manager.h"
+#endif
 
 
 #define ITEM_RESPAWN_TIME 30
@@ -631,6 +634,13 @@ void CHalfLifeMultiplay::PlayerKilled(CBasePlayer* pVictim, CBaseEntity* killer,
 	}
 
 	pVictim->SendExtraInfo();
+
+#ifdef HALFLIFE_BOTS
+	if (g_pBotMan != nullptr)
+	{
+		g_pBotMan->OnEvent(EVENT_PLAYER_DIED, pVictim, killer);
+	}
+#endif
 }
 
 
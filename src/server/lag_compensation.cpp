@@ -0,0 +1,412 @@
+//========= Copyright © 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Player position history, for lag compensated hitscan
+//
+// $NoKeywords: $
+//=============================================================================
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "player.h"
+#include "game.h"
+#include "lag_compensation.h"
+#include <algorithm>
+#include <chrono>
+
+static cvar_t sv_unlag_players = {"sv_unlag_players", "1", FCVAR_SERVER};
+
+
+void CLagCompensation::RegisterCvars()
+{
+    engine::CVarRegister(&sv_unlag_players);
+
+    engine::AddServerCommand("sv_unlag_stats", []()
+        { g_LagCompensation.PrintStats(); });
+}
+
+
+/* True if players are moved back for hitscan shots by us, rather than by the engine. */
+bool CLagCompensation::IsEnabled()
+{
+    return sv_unlag->value != 0.0F && sv_unlag_players.value != 0.0F;
+}
+
+
+void CLagCompensation::Clear()
+{
+    for (auto& history : m_History)
+    {
+        history.count = 0;
+    }
+
+    m_Active = false;
+    m_Shooter = nullptr;
+    m_RewoundCount = 0;
+    m_IsRewound = 0;
+}
+
+
+void CLagCompensation::RemovePlayer(CBasePlayer* player)
+{
+    const auto index = player->v.GetIndex();
+
+    if (index >= 1 && index <= MAX_PLAYERS)
+    {
+        m_History[index].count = 0;
+    }
+}
+
+
+/* Only living players that can be shot are kept track of. */
+bool CLagCompensation::CanRewind(CBasePlayer* player)
+{
+    return player->IsAlive() && player->v.solid != SOLID_NOT;
+}
+
+
+void CLagCompensation::Save(CBasePlayer* player, Record& record)
+{
+    record.time = gpGlobals->time;
+    record.origin = player->v.origin;
+    record.mins = player->v.mins;
+    record.maxs = player->v.maxs;
+    record.angles = player->v.angles;
+    record.sequence = player->v.sequence;
+    record.frame = player->v.frame;
+}
+
+
+void CLagCompensation::Restore(CBasePlayer* player, const Record& record)
+{
+    player->v.angles = record.angles;
+    player->v.sequence = record.sequence;
+    player->v.frame = record.frame;
+
+    /* Set the size ourselves, so the player is only linked once, by SetOrigin. */
+    if (player->v.mins != record.mins || player->v.maxs != record.maxs)
+    {
+        player->v.mins = record.mins;
+        player->v.maxs = record.maxs;
+        player->v.size = record.maxs - record.mins;
+    }
+
+    player->SetOrigin(record.origin);
+}
+
+
+/*
+Record where every player is. Called at the start of each frame.
+*/
+void CLagCompensation::Update()
+{
+    const auto now = gpGlobals->time;
+
+    /* Shots are made with their player's time, which may be a little behind the frame's. */
+    const auto sweepStart = now - sv_maxunlag->value - 0.1F;
+
+    for (int i = 1; i <= gpGlobals->maxClients; i++)
+    {
+        auto& history = m_History[i];
+        auto player = static_cast<CBasePlayer*>(util::PlayerByIndex(i));
+
+        if (player == nullptr || !CanRewind(player))
+        {
+            history.count = 0;
+            continue;
+        }
+
+        auto record = true;
+
+        if (history.count != 0)
+        {
+            const auto& newest = history.record[history.newest];
+
+            if ((player->v.origin - newest.origin).LengthSquared() > kTeleportDistance * kTeleportDistance)
+            {
+                history.count = 0;
+            }
+            else if (now - newest.time < kRecordInterval)
+            {
+                record = false;
+            }
+        }
+
+        if (record)
+        {
+            history.newest = (history.count != 0) ? (history.newest + 1) % kHistorySize : 0;
+            history.count = std::min(history.count + 1, kHistorySize);
+
+            Save(player, history.record[history.newest]);
+        }
+
+        history.sweptMins = history.record[history.newest].origin + history.record[history.newest].mins;
+        history.sweptMaxs = history.record[history.newest].origin + history.record[history.newest].maxs;
+
+        for (int j = 1; j < history.count; j++)
+        {
+            const auto& older = history.record[(history.newest - j + kHistorySize) % kHistorySize];
+
+            for (int k = 0; k < 3; k++)
+            {
+                history.sweptMins[k] = std::min(history.sweptMins[k], older.origin[k] + older.mins[k]);
+                history.sweptMaxs[k] = std::max(history.sweptMaxs[k], older.origin[k] + older.maxs[k]);
+            }
+
+            /* This record is the oldest a shot can be moved back between. */
+            if (older.time < sweepStart)
+            {
+                break;
+            }
+        }
+    }
+}
+
+
+/*
+Work out where the player was at 'time', between the two records around it.
+The player's current state counts as the newest record.
+Return false if the player should not be moved.
+*/
+bool CLagCompensation::Sample(const History& history, CBasePlayer* player, const float time, Record& sample) const
+{
+    Record current;
+    Save(player, current);
+
+    if (history.count == 0 || time >= current.time)
+    {
+        return false;
+    }
+
+    const Record* newer = &current;
+
+    for (int j = 0; j < history.count; j++)
+    {
+        const auto& older = history.record[(history.newest - j + kHistorySize) % kHistorySize];
+
+        /* Don't drag the player back across a teleport. */
+        if ((newer->origin - older.origin).LengthSquared() > kTeleportDistance * kTeleportDistance)
+        {
+            return false;
+        }
+
+        if (older.time > time)
+        {
+            newer = &older;
+            continue;
+        }
+
+        const auto fraction = (time - older.time) / (newer->time - older.time);
+        const auto& nearest = (fraction < 0.5F) ? older : *newer;
+
+        sample.time = time;
+        sample.origin = older.origin + (newer->origin - older.origin) * fraction;
+        sample.mins = nearest.mins;
+        sample.maxs = nearest.maxs;
+
+        for (int k = 0; k < 3; k++)
+        {
+            sample.angles[k] = older.angles[k] + util::AngleDiff(newer->angles[k], older.angles[k]) * fraction;
+        }
+
+        sample.sequence = nearest.sequence;
+
+        /* Animations that looped or changed between the records can't be blended. */
+        if (older.sequence == newer->sequence && older.frame <= newer->frame)
+        {
+            sample.frame = older.frame + (newer->frame - older.frame) * fraction;
+        }
+        else
+        {
+            sample.frame = nearest.frame;
+        }
+
+        return true;
+    }
+
+    /* The player spawned or teleported since then. */
+    if (history.count < kHistorySize)
+    {
+        return false;
+    }
+
+    sample = *newer;
+    return true;
+}
+
+
+/*
+Start a shot by 'shooter'. Players are moved back by the shooter's latency, by Rewind().
+*/
+void CLagCompensation::Begin(CBasePlayer* shooter)
+{
+    if (m_Active)
+    {
+        End();
+    }
+
+    if (!IsEnabled() || shooter->m_netPing <= 5)
+    {
+        return;
+    }
+
+    /* Convert milliseconds into seconds & clamp, as for projectiles. */
+    const auto latency = std::clamp((shooter->m_netPing + shooter->m_netLerp) / 1000.0F, 0.0F, sv_maxunlag->value);
+
+    m_Active = true;
+    m_Shooter = shooter;
+    m_TargetTime = gpGlobals->time - latency;
+
+    m_ShotCount++;
+}
+
+
+/* Return true if the line from 'start' to 'end' passes through the box. */
+static bool LineCrossesBox(const Vector& start, const Vector& end, const Vector& mins, const Vector& maxs)
+{
+    auto enter = 0.0F;
+    auto exit = 1.0F;
+
+    for (int k = 0; k < 3; k++)
+    {
+        const auto delta = end[k] - start[k];
+
+        if (std::fabs(delta) < 0.0001F)
+        {
+            if (start[k] < mins[k] || start[k] > maxs[k])
+            {
+                return false;
+            }
+            continue;
+        }
+
+        auto t0 = (mins[k] - start[k]) / delta;
+        auto t1 = (maxs[k] - start[k]) / delta;
+
+        if (t0 > t1)
+        {
+            std::swap(t0, t1);
+        }
+
+        enter = std::max(enter, t0);
+        exit = std::min(exit, t1);
+
+        if (enter > exit)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/*
+Move back the players that the shot's ray from 'start' to 'end' could hit.
+Players already moved back by an earlier ray of the shot stay where they are.
+*/
+void CLagCompensation::Rewind(const Vector& start, const Vector& end)
+{
+    if (!m_Active)
+    {
+        return;
+    }
+
+    const auto timeStart = std::chrono::steady_clock::now();
+
+    m_RayCount++;
+
+    for (int i = 1; i <= gpGlobals->maxClients; i++)
+    {
+        const auto& history = m_History[i];
+
+        if (history.count == 0 || (m_IsRewound & (1U << (i - 1))) != 0)
+        {
+            continue;
+        }
+
+        auto player = static_cast<CBasePlayer*>(util::PlayerByIndex(i));
+
+        if (player == nullptr || player == m_Shooter || !CanRewind(player))
+        {
+            continue;
+        }
+
+        /* The player may have moved since the frame started. The engine pads absolute bounds by a unit. */
+        Vector mins, maxs;
+
+        for (int k = 0; k < 3; k++)
+        {
+            mins[k] = std::min(history.sweptMins[k], player->v.absmin[k]) - 1.0F;
+            maxs[k] = std::max(history.sweptMaxs[k], player->v.absmax[k]) + 1.0F;
+        }
+
+        if (!LineCrossesBox(start, end, mins, maxs))
+        {
+            continue;
+        }
+
+        m_CandidateCount++;
+
+        Record sample;
+
+        if (!Sample(history, player, m_TargetTime, sample))
+        {
+            continue;
+        }
+
+        auto& rewound = m_Rewound[m_RewoundCount++];
+        rewound.player = player;
+        Save(player, rewound.saved);
+
+        m_IsRewound |= 1U << (i - 1);
+
+        Restore(player, sample);
+
+        m_RewindCount++;
+    }
+
+    m_RewindTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - timeStart).count();
+}
+
+
+/* Put every player moved back for the shot where they were. */
+void CLagCompensation::End()
+{
+    if (!m_Active)
+    {
+        return;
+    }
+
+    const auto timeStart = std::chrono::steady_clock::now();
+
+    for (int i = m_RewoundCount - 1; i >= 0; i--)
+    {
+        Restore(m_Rewound[i].player, m_Rewound[i].saved);
+    }
+
+    m_Active = false;
+    m_Shooter = nullptr;
+    m_RewoundCount = 0;
+    m_IsRewound = 0;
+
+    m_RewindTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - timeStart).count();
+}
+
+
+void CLagCompensation::PrintStats()
+{
+    const auto perShot = (m_ShotCount != 0) ? 1000000.0 * m_RewindTime / m_ShotCount : 0.0;
+
+    engine::ServerPrint(util::VarArgs("Lag compensation: %u shots, %u rays, %u players in the way, %u moved back\n",
+        m_ShotCount, m_RayCount, m_CandidateCount, m_RewindCount));
+
+    engine::ServerPrint(util::VarArgs("Lag compensation: %.0f microseconds moving players, %.2f per shot\n",
+        1000000.0 * m_RewindTime, perShot));
+
+    m_ShotCount = 0;
+    m_RayCount = 0;
+    m_CandidateCount = 0;
+    m_RewindCount = 0;
+    m_RewindTime = 0.0;
+}
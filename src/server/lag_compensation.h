@@ -0,0 +1,93 @@
+//========= Copyright © 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Player position history, for lag compensated hitscan
+//
+// $NoKeywords: $
+//=============================================================================
+
+#pragma once
+
+#include "cdll_dll.h"
+
+class CBasePlayer;
+
+
+/**
+ * Keeps a short history of where every player was and how they were posed, so hitscan shots
+ * can be traced against players where the shooter saw them, rather than where the server has them now.
+ * A shot calls Begin(), then Rewind() with each of its rays before tracing it, then End().
+ * Only the players whose bounds over the last sv_maxunlag seconds cross a ray are moved back,
+ * and End() puts every one of them back where they were.
+ * Players are not moved back past the last time they spawned, died or teleported.
+ * While this is enabled, the engine is told not to move players back itself, or they would be moved back twice.
+ */
+class CLagCompensation
+{
+public:
+    static void RegisterCvars();
+    static bool IsEnabled();
+
+    void Update();
+    void RemovePlayer(CBasePlayer* player);
+    void Clear();
+
+    void Begin(CBasePlayer* shooter);
+    void Rewind(const Vector& start, const Vector& end);
+    void End();
+
+    void PrintStats();
+
+private:
+    static constexpr int kHistorySize = 64;
+    static constexpr float kRecordInterval = 0.01F;     // 64 records cover 0.64 seconds, past the default sv_maxunlag
+    static constexpr float kTeleportDistance = 128.0F;  // players that move further than this between records teleported
+
+    struct Record
+    {
+        float time;
+        Vector origin;
+        Vector mins;
+        Vector maxs;
+        Vector angles;
+        int sequence;
+        float frame;
+    };
+
+    struct History
+    {
+        Record record[kHistorySize];
+        int newest;
+        int count;              // 0 if the player is dead or not in the game
+        Vector sweptMins;       // the player's bounds over the last sv_maxunlag seconds
+        Vector sweptMaxs;
+    };
+
+    struct Rewound
+    {
+        CBasePlayer* player;
+        Record saved;
+    };
+
+    static void Save(CBasePlayer* player, Record& record);
+    static void Restore(CBasePlayer* player, const Record& record);
+    static bool CanRewind(CBasePlayer* player);
+
+    bool Sample(const History& history, CBasePlayer* player, const float time, Record& sample) const;
+
+    History m_History[MAX_PLAYERS + 1];     // by player index
+
+    bool m_Active = false;
+    CBasePlayer* m_Shooter = nullptr;
+    float m_TargetTime = 0.0F;
+    Rewound m_Rewound[MAX_PLAYERS];
+    int m_RewoundCount = 0;
+    unsigned int m_IsRewound = 0;           // bit for each player index, less one
+
+    unsigned int m_ShotCount = 0;
+    unsigned int m_RayCount = 0;
+    unsigned int m_CandidateCount = 0;      // players whose swept bounds crossed a ray
+    unsigned int m_RewindCount = 0;         // players moved back
+    double m_RewindTime = 0.0;              // seconds spent moving players back and forth
+};
+
+inline CLagCompensation g_LagCompensation;
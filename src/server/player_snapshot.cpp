@@ -0,0 +1,156 @@
+//========= Copyright © 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Per-frame snapshot of every player, for AI queries
+//
+// $NoKeywords: $
+//=============================================================================
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "player.h"
+#include "player_snapshot.h"
+
+#ifdef HALFLIFE_BOTS
+#include "bot/bot.h"
+#include "bot/nav.h"
+#include "bot/nav_area.h"
+#endif
+
+
+void CPlayerSnapshot::Clear()
+{
+    m_Count = 0;
+
+#ifdef HALFLIFE_BOTS
+    for (int i = 0; i <= MAX_PLAYERS; i++)
+    {
+        m_LastNavArea[i] = nullptr;
+    }
+    m_NavGeneration = 0;
+#endif
+}
+
+
+/* Take the snapshot. Called at the start of each frame. */
+void CPlayerSnapshot::Update()
+{
+    m_Count = 0;
+
+#ifdef HALFLIFE_BOTS
+    /* The areas we found last frame may have been destroyed. */
+    if (m_NavGeneration != TheNavAreaGrid.GetGeneration())
+    {
+        for (int i = 0; i <= MAX_PLAYERS; i++)
+        {
+            m_LastNavArea[i] = nullptr;
+        }
+        m_NavGeneration = TheNavAreaGrid.GetGeneration();
+    }
+#endif
+
+    for (int i = 1; i <= gpGlobals->maxClients; i++)
+    {
+        auto player = static_cast<CBasePlayer*>(util::PlayerByIndex(i));
+
+        if (player == nullptr || STRING(player->v.netname)[0] == '\0')
+        {
+            continue;
+        }
+
+#ifdef HALFLIFE_SAVERESTORE
+        if ((player->v.flags & FL_DORMANT) != 0)
+        {
+            continue;
+        }
+#endif
+
+        const auto n = m_Count++;
+
+        m_Player[n] = player;
+        m_Origin[n] = player->v.origin;
+        m_EyePosition[n] = player->EyePosition();
+        m_Team[n] = player->TeamNumber();
+        m_DisguiseTeam[n] = player->m_iDisguiseTeam;
+
+        AngleVectors(player->v.v_angle + player->v.punchangle, &m_Forward[n], nullptr, nullptr);
+
+        m_Flags[n] = 0;
+
+        if (player->IsAlive())
+        {
+            m_Flags[n] |= kAlive;
+        }
+
+        if (player->IsPlayer())
+        {
+            m_Flags[n] |= kActive;
+        }
+
+        if (player->IsBot())
+        {
+            m_Flags[n] |= kBot;
+        }
+
+        if (player->InState(CBasePlayer::State::Disguised))
+        {
+            m_Flags[n] |= kDisguised;
+        }
+
+        if (player->InState(CBasePlayer::State::FeigningDeath))
+        {
+            m_Flags[n] |= kFeigningDeath;
+        }
+
+#ifdef HALFLIFE_BOTS
+        /* Bots keep track of their own area. */
+        if (player->IsBot())
+        {
+            m_NavArea[n] = static_cast<CBot*>(player)->GetLastKnownArea();
+        }
+        else
+        {
+            auto area = TheNavAreaGrid.GetNavArea(&player->v.origin, 120.0F, m_LastNavArea[i]);
+
+            if (area != nullptr)
+            {
+                m_LastNavArea[i] = area;
+            }
+
+            m_NavArea[n] = m_LastNavArea[i];
+        }
+#else
+        m_NavArea[n] = nullptr;
+#endif
+    }
+}
+
+
+/* Forget a player whose entity is going away, so queries later this frame don't touch it. */
+void CPlayerSnapshot::RemovePlayer(CBasePlayer* player)
+{
+    for (int n = 0; n < m_Count; n++)
+    {
+        if (m_Player[n] != player)
+        {
+            continue;
+        }
+
+        m_Count--;
+
+        /* Move the last player into the hole. */
+        m_Player[n] = m_Player[m_Count];
+        m_Origin[n] = m_Origin[m_Count];
+        m_EyePosition[n] = m_EyePosition[m_Count];
+        m_Forward[n] = m_Forward[m_Count];
+        m_Team[n] = m_Team[m_Count];
+        m_DisguiseTeam[n] = m_DisguiseTeam[m_Count];
+        m_Flags[n] = m_Flags[m_Count];
+        m_NavArea[n] = m_NavArea[m_Count];
+        break;
+    }
+
+#ifdef HALFLIFE_BOTS
+    m_LastNavArea[player->v.GetIndex()] = nullptr;
+#endif
+}
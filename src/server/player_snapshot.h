@@ -0,0 +1,76 @@
+//========= Copyright © 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Per-frame snapshot of every player, for AI queries
+//
+// $NoKeywords: $
+//=============================================================================
+
+#pragma once
+
+#include "cdll_dll.h"
+
+class CBasePlayer;
+class CNavArea;
+
+
+/**
+ * A copy of the state of every player that AI queries look at, taken once at the start of each frame.
+ * Queries that used to visit every player entity, re-reading its entvars and recomputing its aim,
+ * loop over these arrays instead. Each field is stored in its own array, so a query that only
+ * needs origins and teams only touches origins and teams.
+ * The snapshot is not updated as players move during the frame.
+ */
+class CPlayerSnapshot
+{
+public:
+    enum Flags
+    {
+        kAlive = 1,
+        kActive = 2,            // in the game, rather than spectating or observing
+        kBot = 4,
+        kDisguised = 8,         // a spy wearing a disguise
+        kFeigningDeath = 16,
+    };
+
+    CPlayerSnapshot() : m_Count(0) {}
+
+    void Update();
+    void RemovePlayer(CBasePlayer* player);
+    void Clear();
+
+    int GetCount() const { return m_Count; }
+
+    CBasePlayer* GetPlayer(const int i) const { return m_Player[i]; }
+    const Vector& GetOrigin(const int i) const { return m_Origin[i]; }
+    const Vector& GetEyePosition(const int i) const { return m_EyePosition[i]; }
+    const Vector& GetForward(const int i) const { return m_Forward[i]; }
+    int GetTeam(const int i) const { return m_Team[i]; }
+    int GetDisguiseTeam(const int i) const { return m_DisguiseTeam[i]; }
+    CNavArea* GetNavArea(const int i) const { return m_NavArea[i]; }
+
+    bool IsAlive(const int i) const { return (m_Flags[i] & kAlive) != 0; }
+    bool IsActive(const int i) const { return (m_Flags[i] & kActive) != 0; }
+    bool IsBot(const int i) const { return (m_Flags[i] & kBot) != 0; }
+    bool IsDisguised(const int i) const { return (m_Flags[i] & kDisguised) != 0; }
+    bool IsFeigningDeath(const int i) const { return (m_Flags[i] & kFeigningDeath) != 0; }
+
+private:
+    int m_Count;
+
+    CBasePlayer* m_Player[MAX_PLAYERS];
+    Vector m_Origin[MAX_PLAYERS];
+    Vector m_EyePosition[MAX_PLAYERS];
+    Vector m_Forward[MAX_PLAYERS];          // unit aiming vector, including punch angle
+    int m_Team[MAX_PLAYERS];
+    int m_DisguiseTeam[MAX_PLAYERS];
+    unsigned int m_Flags[MAX_PLAYERS];
+    CNavArea* m_NavArea[MAX_PLAYERS];       // the nav area the player is standing on, if the nav mesh is loaded
+
+#ifdef HALFLIFE_BOTS
+    /* The areas humans were last found on, by player index, to start the next lookup from. */
+    CNavArea* m_LastNavArea[MAX_PLAYERS + 1] = {};
+    unsigned int m_NavGeneration = 0;
+#endif
+};
+
+inline CPlayerSnapshot g_PlayerSnapshot;
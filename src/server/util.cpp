@@ -30,6 +30,8 @@
 #include "gamerules.h"
 #include "UserMessages.h"
 #include "game.h"
+#include "entity_hash.h"
+#include "entity_names.h"
 
 #include <algorithm>
 
@@ -253,114 +255,27 @@ Vector util::VecToAngles(const Vector& vec)
 
 int util::EntitiesInBox(CBaseEntity** pList, int listMax, const Vector& mins, const Vector& maxs, int flagMask, bool checkSolid)
 {
-	Entity* pEdict = util::GetEntityList();
-	CBaseEntity* pEntity;
-	int count;
-
-	count = 0;
-
-	if (!pEdict)
-		return count;
-
-	// Ignore world.
-	++pEdict;
-
-	for (int i = 1; i < gpGlobals->maxEntities; i++, pEdict++)
-	{
-		if (pEdict->IsFree()) // Not in use
-			continue;
-
-		if (0 != flagMask && (pEdict->flags & flagMask) == 0) // Does it meet the criteria?
-			continue;
-
-		if (0 != checkSolid && (pEdict->solid == SOLID_NOT || pEdict->mins.x == pEdict->maxs.x))
-			continue;
-
-		if (mins.x > pEdict->absmax.x ||
-			mins.y > pEdict->absmax.y ||
-			mins.z > pEdict->absmax.z ||
-			maxs.x < pEdict->absmin.x ||
-			maxs.y < pEdict->absmin.y ||
-			maxs.z < pEdict->absmin.z)
-			continue;
-
-		pEntity = pEdict->Get<CBaseEntity>();
-		if (!pEntity)
-			continue;
-
-		pList[count] = pEntity;
-		count++;
-
-		if (count >= listMax)
-			return count;
-	}
-
-	return count;
+	return g_EntityHash.EntitiesInBox(pList, listMax, mins, maxs, flagMask, checkSolid);
 }
 
 
 int util::MonstersInSphere(CBaseEntity** pList, int listMax, const Vector& center, float radius)
 {
-	Entity* pEdict = util::GetEntityList();
-	CBaseEntity* pEntity;
-	int count;
-	float distance, delta;
-
-	count = 0;
-	float radiusSquared = radius * radius;
+	return g_EntityHash.MonstersInSphere(pList, listMax, center, radius);
+}
 
-	if (!pEdict)
-		return count;
 
-	// Ignore world.
-	++pEdict;
+// Classnames and targetnames are looked up in the name index, anything else is left to the engine
+static Entity* FindEntityByString(Entity* start, const char* key, const char* value)
+{
+	CEntityNameIndex::Field field;
 
-	for (int i = 1; i < gpGlobals->maxEntities; i++, pEdict++)
+	if (g_EntityNames.IsEnabled() && CEntityNameIndex::GetField(key, field))
 	{
-		if (pEdict->IsFree()) // Not in use
-			continue;
-
-		if ((pEdict->flags & (FL_CLIENT | FL_MONSTER)) == 0) // Not a client/monster ?
-			continue;
-
-		// Use origin for X & Y since they are centered for all monsters
-		// Now X
-		delta = center.x - pEdict->origin.x;
-		delta *= delta;
-
-		if (delta > radiusSquared)
-			continue;
-		distance = delta;
-
-		// Now Y
-		delta = center.y - pEdict->origin.y;
-		delta *= delta;
-
-		distance += delta;
-		if (distance > radiusSquared)
-			continue;
-
-		// Now Z
-		delta = center.z - (pEdict->absmin.z + pEdict->absmax.z) * 0.5;
-		delta *= delta;
-
-		distance += delta;
-		if (distance > radiusSquared)
-			continue;
-
-		pEntity = pEdict->Get<CBaseEntity>();
-		if (!pEntity)
-			continue;
-
-		pList[count] = pEntity;
-		count++;
-
-		if (count >= listMax)
-			return count;
+		return g_EntityNames.Find(start, field, value);
 	}
 
-
-	return count;
+	return engine::FindEntityByString(start, key, value);
 }
 
 
@@ -369,12 +284,12 @@ util::EntityIterator::EntityIterator(const char* key, const char* value, CBaseEn
 	_key = key;
 	_value = value;
 	_start = (start != nullptr) ? &start->v : &CWorld::World->v;
-	_current = engine::FindEntityByString(_start, _key, _value);
+	_current = FindEntityByString(_start, _key, _value);
 }
 
 void util::EntityIterator::operator++()
 {
-	_current = engine::FindEntityByString(_current, _key, _value);
+	_current = FindEntityByString(_current, _key, _value);
 }
 
 util::EntityIterator::operator bool()
@@ -392,7 +307,14 @@ CBaseEntity* util::FindEntityInSphere(CBaseEntity* pStartEntity, const Vector& v
 	else
 		pentEntity = nullptr;
 
-	pentEntity = engine::FindEntityInSphere(pentEntity, vecCenter, flRadius);
+	if (g_EntityHash.IsEnabled())
+	{
+		pentEntity = g_EntityHash.FindEntityInSphere(pentEntity, vecCenter, flRadius);
+	}
+	else
+	{
+		pentEntity = engine::FindEntityInSphere(pentEntity, vecCenter, flRadius);
+	}
 
 	if (pentEntity != nullptr && OFFSET(pentEntity) != 0)
 		return pentEntity->Get<CBaseEntity>();
@@ -409,7 +331,7 @@ CBaseEntity* util::FindEntityByString(CBaseEntity* pStartEntity, const char* szK
 		entity = &pStartEntity->v;
 	}
 
-	entity = engine::FindEntityByString(entity, szKeyword, szValue);
+	entity = ::FindEntityByString(entity, szKeyword, szValue);
 
 	if (entity != nullptr && engine::EntOffsetOfPEntity(entity) != 0)
 	{
@@ -1258,7 +1180,7 @@ bool util::IsDeathmatch()
 
 void util::LagCompensation(CBaseEntity* entity, const int ping)
 {
-	if (AllowLagCompensation() == 0 || ping <= 5)
+	if (sv_unlag->value == 0.0F || ping <= 5)
 	{
 		return;
 	}
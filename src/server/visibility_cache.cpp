@@ -0,0 +1,256 @@
+//========= Copyright © 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Shared cache of player visibility traces
+//
+// $NoKeywords: $
+//=============================================================================
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "player.h"
+#include "visibility_cache.h"
+#include <algorithm>
+
+static cvar_t sv_visibility_cache = {"sv_visibility_cache", "1", FCVAR_SERVER};
+static cvar_t sv_visibility_refresh = {"sv_visibility_refresh", "16", FCVAR_SERVER};
+
+
+void CVisibilityCache::RegisterCvars()
+{
+    engine::CVarRegister(&sv_visibility_cache);
+    engine::CVarRegister(&sv_visibility_refresh);
+
+    engine::AddServerCommand("sv_visibility_stats", []()
+        { g_VisibilityCache.PrintStats(); });
+}
+
+
+/*
+Return true if 'target' can be seen from the eyes of 'viewer'.
+If the pair was traced no more than 'maxAge' seconds ago, the cached answer is used.
+Otherwise, a trace is made now. The trace ignores 'ignore', or 'viewer' if none is given.
+A viewer must always ask with the same 'point' and 'ignore'.
+*/
+bool CVisibilityCache::IsVisible(CBaseEntity* viewer, CBasePlayer* target, const float maxAge,
+    const Point point, CBaseEntity* ignore)
+{
+    const auto viewerIndex = viewer->v.GetIndex();
+    const auto targetIndex = target->v.GetIndex();
+
+    if (targetIndex < 1 || targetIndex > MAX_PLAYERS)
+    {
+        return false;
+    }
+
+    if (viewerIndex >= static_cast<int>(m_RowOfEntity.size()))
+    {
+        m_RowOfEntity.resize(viewerIndex + 1, -1);
+    }
+
+    if (m_RowOfEntity[viewerIndex] < 0)
+    {
+        m_RowOfEntity[viewerIndex] = m_Rows.size();
+        m_Rows.emplace_back();
+        ResetRow(m_Rows.back(), viewer);
+    }
+
+    auto& row = m_Rows[m_RowOfEntity[viewerIndex]];
+
+    /* The entity index now belongs to someone else. */
+    if (static_cast<CBaseEntity*>(row.viewer) != viewer)
+    {
+        ResetRow(row, viewer);
+    }
+
+    row.ignore = (ignore != nullptr) ? ignore : viewer;
+    row.point = point;
+    row.queryTime = gpGlobals->time;
+
+    auto& pair = row.pair[targetIndex];
+    pair.queryTime = gpGlobals->time;
+
+    m_QueryCount++;
+
+    if (sv_visibility_cache.value != 0.0F
+     && pair.traceTime >= 0.0F
+     && gpGlobals->time - pair.traceTime <= maxAge)
+    {
+        m_HitCount++;
+        return pair.visible;
+    }
+
+    m_QueryTraceCount++;
+    return Trace(row, targetIndex);
+}
+
+
+void CVisibilityCache::ResetRow(Row& row, CBaseEntity* viewer)
+{
+    row.viewer = viewer;
+    row.ignore = viewer;
+    row.point = Point::Body;
+    row.queryTime = -1.0F;
+
+    for (auto& pair : row.pair)
+    {
+        pair.traceTime = -1.0F;
+        pair.queryTime = -1.0F;
+        pair.visible = false;
+    }
+}
+
+
+/* Trace the line of sight from the row's viewer to the given player, and remember the result. */
+bool CVisibilityCache::Trace(Row& row, const int target)
+{
+    auto& pair = row.pair[target];
+
+    CBaseEntity* viewer = row.viewer;
+    auto player = util::PlayerByIndex(target);
+
+    pair.traceTime = gpGlobals->time;
+    pair.visible = false;
+
+    if (viewer == nullptr || player == nullptr)
+    {
+        return false;
+    }
+
+    const auto start = viewer->EyePosition();
+    const auto end = (row.point == Point::Eyes) ? player->EyePosition() : player->BodyTarget();
+
+    TraceResult tr;
+    util::TraceLine(start, end, util::ignore_monsters, row.ignore, &tr);
+
+    pair.visible = tr.flFraction == 1.0F || tr.pHit == &player->v;
+
+    return pair.visible;
+}
+
+
+/*
+Refresh the pairs that are still being asked about, within this frame's budget.
+Called at the start of each frame, so the answers are fresh when the bots and buildings think.
+*/
+void CVisibilityCache::Update()
+{
+    const auto budget = static_cast<int>(sv_visibility_refresh.value);
+
+    if (sv_visibility_cache.value == 0.0F || budget <= 0)
+    {
+        return;
+    }
+
+    m_Candidates.clear();
+
+    for (int r = 0; r < static_cast<int>(m_Rows.size()); r++)
+    {
+        auto& row = m_Rows[r];
+
+        if (gpGlobals->time - row.queryTime > kInterestTime)
+        {
+            continue;
+        }
+
+        CBaseEntity* viewer = row.viewer;
+
+        if (viewer == nullptr)
+        {
+            continue;
+        }
+
+        for (int t = 1; t <= gpGlobals->maxClients && t <= MAX_PLAYERS; t++)
+        {
+            const auto& pair = row.pair[t];
+
+            if (gpGlobals->time - pair.queryTime > kInterestTime)
+            {
+                continue;
+            }
+
+            const auto age = gpGlobals->time - pair.traceTime;
+
+            if (age <= 0.0F)
+            {
+                continue;
+            }
+
+            auto player = util::PlayerByIndex(t);
+
+            if (player == nullptr)
+            {
+                continue;
+            }
+
+            /* Nearby pairs go stale faster, since a small movement changes what they can see. */
+            const auto distance = std::max((player->v.origin - viewer->v.origin).Length(), kNearDistance);
+
+            m_Candidates.push_back({age * kNearDistance / distance, r, t});
+        }
+    }
+
+    if (static_cast<int>(m_Candidates.size()) > budget)
+    {
+        std::nth_element(m_Candidates.begin(), m_Candidates.begin() + budget, m_Candidates.end(), IsHigherPriority);
+        m_Candidates.resize(budget);
+    }
+
+    for (const auto& candidate : m_Candidates)
+    {
+        Trace(m_Rows[candidate.row], candidate.target);
+        m_RefreshTraceCount++;
+    }
+}
+
+
+/* Forget what a player who is leaving could see, and whether they could be seen. */
+void CVisibilityCache::RemovePlayer(CBasePlayer* player)
+{
+    const auto index = player->v.GetIndex();
+
+    if (index < static_cast<int>(m_RowOfEntity.size()) && m_RowOfEntity[index] >= 0)
+    {
+        ResetRow(m_Rows[m_RowOfEntity[index]], nullptr);
+    }
+
+    if (index < 1 || index > MAX_PLAYERS)
+    {
+        return;
+    }
+
+    for (auto& row : m_Rows)
+    {
+        row.pair[index].traceTime = -1.0F;
+        row.pair[index].queryTime = -1.0F;
+        row.pair[index].visible = false;
+    }
+}
+
+
+void CVisibilityCache::Clear()
+{
+    m_Rows.clear();
+    m_RowOfEntity.clear();
+    m_Candidates.clear();
+}
+
+
+/* Print and reset the cache statistics. */
+void CVisibilityCache::PrintStats()
+{
+    const auto traceCount = m_QueryTraceCount + m_RefreshTraceCount;
+    const auto hitRate = (m_QueryCount != 0) ? 100.0F * m_HitCount / m_QueryCount : 0.0F;
+
+    engine::ServerPrint(util::VarArgs("Visibility cache: %u queries, %.1f%% answered from the cache\n",
+        m_QueryCount, hitRate));
+
+    engine::ServerPrint(util::VarArgs("Visibility cache: %u traces (%u for queries, %u refreshes), %d traces saved\n",
+        traceCount, m_QueryTraceCount, m_RefreshTraceCount,
+        static_cast<int>(m_QueryCount) - static_cast<int>(traceCount)));
+
+    m_QueryCount = 0;
+    m_HitCount = 0;
+    m_QueryTraceCount = 0;
+    m_RefreshTraceCount = 0;
+}
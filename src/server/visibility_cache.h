@@ -0,0 +1,90 @@
+//========= Copyright © 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Shared cache of player visibility traces
+//
+// $NoKeywords: $
+//=============================================================================
+
+#pragma once
+
+#include <vector>
+
+#include "cdll_dll.h"
+
+class CBaseEntity;
+class CBasePlayer;
+
+
+/**
+ * Remembers whether each player was visible from each viewer (players and buildings) the last time
+ * anyone asked, so bots and sentries that ask the same question in the same frame share one trace.
+ * Each frame, a fixed number of the pairs that are still being asked about are traced again,
+ * the stalest and closest first, so most questions can be answered without tracing at all.
+ */
+class CVisibilityCache
+{
+public:
+    /* Where on the target the line of sight ends. */
+    enum class Point
+    {
+        Body,
+        Eyes,
+    };
+
+    static void RegisterCvars();
+
+    bool IsVisible(CBaseEntity* viewer, CBasePlayer* target, const float maxAge,
+        const Point point = Point::Body, CBaseEntity* ignore = nullptr);
+
+    void Update();
+    void RemovePlayer(CBasePlayer* player);
+    void Clear();
+
+    void PrintStats();
+
+private:
+    /* How long a pair is refreshed after it was last asked about. */
+    static constexpr float kInterestTime = 1.0F;
+
+    /* Pairs closer than this are refreshed as if they were this far apart. */
+    static constexpr float kNearDistance = 512.0F;
+
+    struct Pair
+    {
+        float traceTime;        // when the pair was last traced, or negative if it never was
+        float queryTime;        // when someone last asked about the pair
+        bool visible;
+    };
+
+    struct Row
+    {
+        EHANDLE viewer;
+        EHANDLE ignore;
+        Point point;
+        float queryTime;
+        Pair pair[MAX_PLAYERS + 1];
+    };
+
+    struct Candidate
+    {
+        float priority;
+        int row;
+        int target;
+    };
+
+    static bool IsHigherPriority(const Candidate& a, const Candidate& b) { return a.priority > b.priority; }
+
+    void ResetRow(Row& row, CBaseEntity* viewer);
+    bool Trace(Row& row, const int target);
+
+    std::vector<Row> m_Rows;
+    std::vector<int> m_RowOfEntity;         // row of each viewer entity index, or -1
+    std::vector<Candidate> m_Candidates;
+
+    unsigned int m_QueryCount = 0;
+    unsigned int m_HitCount = 0;            // queries answered without tracing
+    unsigned int m_QueryTraceCount = 0;     // traces made because a query's answer was too old
+    unsigned int m_RefreshTraceCount = 0;   // traces made by Update()
+};
+
+inline CVisibilityCache g_VisibilityCache;
@@ -13,6 +13,7 @@
 #ifdef GAME_DLL
 #include "gamerules.h"
 #include "UserMessages.h"
+#include "entity_names.h"
 #endif
 #include "animation.h"
 #include "trace.h"
@@ -26,6 +27,10 @@ static bool g_bRunConcussionPrediction = false;
 CBaseEntity::CBaseEntity(Entity* containingEntity) : v {*containingEntity}
 {
 	containingEntity->effects |= EF_NOINTERP;
+
+#ifdef GAME_DLL
+	g_EntityNames.Created(containingEntity);
+#endif
 }
 
 
@@ -621,6 +626,10 @@ void CBasePlayer::CmdStart(const usercmd_t& cmd, unsigned int randomSeed)
 	}
 
 	m_randomSeed = randomSeed;
+
+#ifdef GAME_DLL
+	m_netLerp = cmd.lerp_msec;
+#endif
 }
 
 
@@ -14,6 +14,10 @@
 #include "UserMessages.h"
 #include "gamerules.h"
 #include "customentity.h"
+#include "lag_compensation.h"
+#ifdef HALFLIFE_BOTS
+#include "bot/hl_bot_manager.h"
+#endif
 #endif
 
 #include <algorithm>
@@ -131,9 +135,21 @@ void CSniperRifle::PrimaryAttack()
 	Vector dir;
 	AngleVectors(aim, &dir, nullptr, nullptr);
 
+#ifdef HALFLIFE_BOTS
+	if (g_pBotMan != nullptr)
+	{
+		g_pBotMan->OnEvent(EVENT_WEAPON_FIRED, m_pPlayer);
+	}
+#endif
+
+	g_LagCompensation.Begin(m_pPlayer);
+	g_LagCompensation.Rewind(gun, gun + dir * info.iProjectileRange);
+
 	TraceResult tr;
 	util::TraceLine(gun, gun + dir * info.iProjectileRange, &tr, m_pPlayer, util::kTraceBox | util::kTraceBoxModel);
 
+	g_LagCompensation.End();
+
 	if (tr.flFraction == 1.0F)
 	{
 		return;